@@ -0,0 +1,703 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <chrono>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <functional>
+
+#include "../Core/Fluid/FluidGrid.h"
+#include "../Core/Fluid/FluidSolver.h"
+#include "../Core/Fluid/Scenarios.h"
+#include "../Core/Utils/ThreadPool.h"
+
+// Times every solver stage on its own, per resolution, kernel set and thread count
+// eulerian-bench --max-res 2048 --threads 8 --json bench.json
+// eulerian-bench --max-res 2048 --threads 8 --compare bench.json
+
+namespace
+{
+	using namespace Simulation;
+
+	enum class Stage : int {
+		Gravity = 0,
+		Divergence,
+		Projection,
+		Advection,
+		Sampling,
+		Upload,
+		Count
+	};
+
+	struct StageInfo
+	{
+		const char* Name;
+
+		// Compulsory memory traffic of one call per cell, every array the stage touches read (and written) once
+		// A stage that needs several passes or misses in cache shows up as GB/s below what it really moves
+		double BytesPerCell;
+
+		// Runs on a thread pool, the upload stays on the render thread
+		bool Parallel;
+	};
+
+	const StageInfo Stages[] = {
+		// V read and written, the face flags read
+		{ "gravity", 9.0, true },
+
+		// U, V and the face flags read, the divergence written
+		{ "divergence", 13.0, true },
+
+		// One red-black sweep : U, V and the pressure read and written, the face flags, solid flags and weights read
+		{ "projection", 30.0, true },
+
+		// U, V, the face flags and both scalars read, their back buffers written
+		{ "advection", 33.0, true },
+
+		// One velocity sample per cell around its centre : U and V read, the sample written
+		{ "sampling", 16.0, true },
+
+		// The display field copied row by row into the upload buffer
+		{ "upload", 8.0, false }
+	};
+
+	static_assert(sizeof(Stages) / sizeof(Stages[0]) == size_t(Stage::Count), "One StageInfo per stage");
+
+	struct Options
+	{
+		int MinResolution = 64;
+		int MaxResolution = 8192;
+		int MaxThreads = ThreadPool::GetHardwareThreads();
+		int Repeat = 5;
+
+		// Cells one timed run covers at least, small grids repeat the stage that many times over
+		double RunCells = double(1 << 22);
+
+		std::vector<Stage> Stages;
+		std::vector<KernelISA> ISAs;
+
+		std::string JsonPath;
+		std::string ComparePath;
+		double Threshold = 0.1;
+	};
+
+	struct Backend
+	{
+		KernelISA ISA = KernelISA::Scalar;
+		int Threads = 1;
+	};
+
+	struct StreamResult
+	{
+		int Threads = 1;
+		double CopyGBs = 0.0;
+		double TriadGBs = 0.0;
+	};
+
+	struct Result
+	{
+		std::string Stage;
+		int Resolution = 0;
+		std::string Kernels;
+		int Threads = 1;
+
+		double NsPerCell = 0.0;
+		double GBs = 0.0;
+
+		// Of the STREAM triad bandwidth with as many threads
+		double StreamFraction = 0.0;
+
+		// Time on one thread / (threads * time), negative for single threaded rows
+		double Scaling = -1.0;
+	};
+
+	void PrintUsage()
+	{
+		std::cout << "usage : eulerian-bench [options]\n"
+			<< "  --min-res N    smallest grid resolution, doubled up to --max-res (default 64)\n"
+			<< "  --max-res N    largest grid resolution (default 8192)\n"
+			<< "  --threads N    highest thread count, the best kernel set is also run on 2, 4, ... N threads (default all cores)\n"
+			<< "  --repeat N     timed runs per measurement, the best one is kept (default 5)\n"
+			<< "  --run-cells N  cells a timed run covers at least, small grids repeat the stage (default 4194304)\n"
+			<< "  --stages LIST  comma separated : gravity, divergence, projection, advection, sampling, upload (default all)\n"
+			<< "  --kernels LIST comma separated kernel sets : scalar, sse42, avx2, avx512 (default every supported one)\n"
+			<< "  --json PATH    write the results to PATH\n"
+			<< "  --compare PATH compare against results written by --json, exits with 2 when a stage got slower\n"
+			<< "  --threshold F  slowdown in ns/cell counted as a regression (default 0.1, 10 %)\n"
+			<< "  --help         show this message\n";
+	}
+
+	std::vector<std::string> SplitList(const std::string& list)
+	{
+		std::vector<std::string> Items;
+		size_t Begin = 0;
+
+		while (Begin <= list.size()) {
+			const size_t End = std::min(list.find(',', Begin), list.size());
+
+			if (End > Begin) {
+				Items.push_back(list.substr(Begin, End - Begin));
+			}
+
+			Begin = End + 1;
+		}
+
+		return Items;
+	}
+
+	bool ParseOptions(int argc, char** argv, Options& options)
+	{
+		std::string StageList;
+		std::string KernelList;
+
+		for (int i = 1; i < argc; i++) {
+			std::string Arg = argv[i];
+
+			if (Arg == "--help" || Arg == "-h") {
+				PrintUsage();
+				exit(0);
+			}
+
+			if (i + 1 >= argc) {
+				std::cerr << "Missing value for " << Arg << "\n";
+				return false;
+			}
+
+			const char* Value = argv[++i];
+
+			if (Arg == "--min-res") {
+				options.MinResolution = atoi(Value);
+			}
+
+			else if (Arg == "--max-res") {
+				options.MaxResolution = atoi(Value);
+			}
+
+			else if (Arg == "--threads") {
+				options.MaxThreads = atoi(Value);
+			}
+
+			else if (Arg == "--repeat") {
+				options.Repeat = atoi(Value);
+			}
+
+			else if (Arg == "--run-cells") {
+				options.RunCells = atof(Value);
+			}
+
+			else if (Arg == "--stages") {
+				StageList = Value;
+			}
+
+			else if (Arg == "--kernels") {
+				KernelList = Value;
+			}
+
+			else if (Arg == "--json") {
+				options.JsonPath = Value;
+			}
+
+			else if (Arg == "--compare") {
+				options.ComparePath = Value;
+			}
+
+			else if (Arg == "--threshold") {
+				options.Threshold = atof(Value);
+			}
+
+			else {
+				std::cerr << "Unknown option : " << Arg << "\n";
+				return false;
+			}
+		}
+
+		if (options.MinResolution < 4 || options.MaxResolution < options.MinResolution || options.MaxThreads < 1 || options.Repeat < 1 || options.RunCells < 1.0) {
+			std::cerr << "Invalid min-res/max-res/threads/repeat/run-cells\n";
+			return false;
+		}
+
+		if (options.Threshold <= 0.0) {
+			std::cerr << "Invalid threshold\n";
+			return false;
+		}
+
+		for (const std::string& Name : SplitList(StageList)) {
+			int Index = 0;
+
+			while (Index < int(Stage::Count) && Name != Stages[Index].Name) {
+				Index++;
+			}
+
+			if (Index == int(Stage::Count)) {
+				std::cerr << "Unknown stage : " << Name << "\n";
+				return false;
+			}
+
+			options.Stages.push_back(Stage(Index));
+		}
+
+		if (options.Stages.empty()) {
+			for (int i = 0; i < int(Stage::Count); i++) {
+				options.Stages.push_back(Stage(i));
+			}
+		}
+
+		for (const std::string& Name : SplitList(KernelList)) {
+			KernelISA ISA;
+
+			if (!Kernels::ParseISA(Name.c_str(), ISA)) {
+				std::cerr << "Unknown kernel set : " << Name << "\n";
+				return false;
+			}
+
+			if (!Kernels::IsSupported(ISA)) {
+				std::cerr << "Kernel set not supported by this CPU : " << Name << "\n";
+				return false;
+			}
+
+			options.ISAs.push_back(ISA);
+		}
+
+		if (options.ISAs.empty()) {
+			for (int i = 0; i < int(KernelISA::Count); i++) {
+				if (Kernels::IsSupported(KernelISA(i))) {
+					options.ISAs.push_back(KernelISA(i));
+				}
+			}
+		}
+
+		std::sort(options.ISAs.begin(), options.ISAs.end());
+		options.ISAs.erase(std::unique(options.ISAs.begin(), options.ISAs.end()), options.ISAs.end());
+
+		return true;
+	}
+
+	// 1, 2, 4, ... up to and including maxThreads
+	std::vector<int> GetThreadCounts(int maxThreads)
+	{
+		std::vector<int> Counts;
+
+		for (int Threads = 1; Threads < maxThreads; Threads *= 2) {
+			Counts.push_back(Threads);
+		}
+
+		Counts.push_back(maxThreads);
+		return Counts;
+	}
+
+	// Best of repeat runs, each one calls fn iterations times after reset, returns seconds per call
+	double TimeBest(int repeat, int iterations, const std::function<void()>& reset, const std::function<void()>& fn)
+	{
+		double Best = 0.0;
+
+		for (int Run = 0; Run < repeat; Run++) {
+			reset();
+
+			// Untimed first call, faults the pages in and wakes the workers
+			fn();
+
+			auto Start = std::chrono::steady_clock::now();
+
+			for (int i = 0; i < iterations; i++) {
+				fn();
+			}
+
+			const double Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count() / iterations;
+			Best = Run == 0 ? Seconds : std::min(Best, Seconds);
+		}
+
+		return Best;
+	}
+
+	// STREAM copy and triad over arrays well past the last level cache, counted the way STREAM counts them
+	StreamResult MeasureStream(ThreadPool& pool, int threads, int repeat)
+	{
+		const int Count = 1 << 24;
+
+		std::vector<float> A(Count), B(Count), C(Count);
+		pool.SetThreadCount(threads);
+
+		// First touch on the threads that run the loops
+		pool.ParallelFor(0, Count, [&](int Begin, int End) {
+			for (int i = Begin; i < End; i++) {
+				A[i] = 1.0f;
+				B[i] = 2.0f;
+				C[i] = 0.0f;
+			}
+		});
+
+		const float Scale = 3.0f;
+		auto Nothing = []() {};
+
+		const double CopySeconds = TimeBest(repeat, 1, Nothing, [&]() {
+			pool.ParallelFor(0, Count, [&](int Begin, int End) {
+				for (int i = Begin; i < End; i++) {
+					C[i] = A[i];
+				}
+			});
+		});
+
+		const double TriadSeconds = TimeBest(repeat, 1, Nothing, [&]() {
+			pool.ParallelFor(0, Count, [&](int Begin, int End) {
+				for (int i = Begin; i < End; i++) {
+					A[i] = B[i] + Scale * C[i];
+				}
+			});
+		});
+
+		StreamResult Stream;
+		Stream.Threads = threads;
+		Stream.CopyGBs = 2.0 * sizeof(float) * Count / CopySeconds / 1e9;
+		Stream.TriadGBs = 3.0 * sizeof(float) * Count / TriadSeconds / 1e9;
+		return Stream;
+	}
+
+	// Runs every selected stage at one resolution for each backend, appends to results
+	void BenchResolution(const Options& options, int resolution, const std::vector<Backend>& backends, const std::vector<StreamResult>& stream, std::vector<Result>& results)
+	{
+		const float DeltaTime = 1.0f / 60.0f;
+		const double Cells = double(resolution) * double(resolution);
+		const int Iterations = std::max(1, int(options.RunCells / Cells));
+
+		FluidGrid Grid(resolution);
+		FluidSolver Solver(Grid);
+		ThreadPool Pool;
+
+		const int Stride = Grid.GetStride();
+		const size_t FieldSize = Grid.GetFieldSize();
+
+		// The divergence, the samples and the upload share one buffer, two floats per cell is enough for all of them
+		std::vector<float> Output(std::max(FieldSize, size_t(resolution) * size_t(resolution) * 2));
+
+		// Fixed offsets within two cells of the sampled cell centre, like the back traces of a fast flow
+		glm::vec2 Offsets[256];
+		uint32_t Seed = 0x9e3779b9u;
+
+		for (glm::vec2& Offset : Offsets) {
+			Seed = Seed * 1664525u + 1013904223u;
+			Offset.x = float(Seed >> 8) / float(1 << 24) * 4.0f - 2.0f;
+			Seed = Seed * 1664525u + 1013904223u;
+			Offset.y = float(Seed >> 8) / float(1 << 24) * 4.0f - 2.0f;
+		}
+
+		// Every run starts from the same burst, the stages move the fields as they go
+		auto Reset = [&]() {
+			Grid.Reset();
+			Scenarios::CircularBurst(Grid);
+			Scenarios::ScalarDisk(Grid, SCALAR_DYE, glm::vec2(0.0f), 0.7f, 1.0f);
+			Scenarios::ScalarDisk(Grid, SCALAR_TEMPERATURE, glm::vec2(0.0f), 0.35f, 1.0f);
+		};
+
+		auto RunStage = [&](Stage stage) {
+			switch (stage) {
+			case Stage::Gravity:
+				Solver.ApplyForces(DeltaTime);
+				break;
+
+			case Stage::Divergence:
+				Solver.ComputeDivergence(Output.data());
+				break;
+
+			case Stage::Projection:
+				Solver.Project(DeltaTime);
+				break;
+
+			case Stage::Advection:
+				Solver.Advect(DeltaTime);
+				break;
+
+			case Stage::Sampling:
+				Pool.ParallelFor(0, resolution, [&](int RowBegin, int RowEnd) {
+					glm::vec2* Samples = reinterpret_cast<glm::vec2*>(Output.data());
+
+					for (int y = RowBegin; y < RowEnd; y++) {
+						for (int x = 0; x < resolution; x++) {
+							const glm::vec2 Position = glm::vec2(float(x) + 0.5f, float(y) + 0.5f) + Offsets[(x * 7 + y * 13) & 255];
+							Samples[size_t(y) * resolution + x] = Solver.SampleVelocity(Position);
+						}
+					}
+				});
+				break;
+
+			// What the render thread does with the display field when every row changed, the mapped buffer is plain memory here
+			case Stage::Upload: {
+				const float* Source = Grid.GetPressure();
+
+				for (int Row = 0; Row < Grid.GetRows(); Row++) {
+					memcpy(Output.data() + size_t(Row) * Stride, Source + size_t(Row) * Stride, sizeof(float) * Stride);
+				}
+				break;
+			}
+
+			default:
+				break;
+			}
+		};
+
+		printf("\nResolution %d x %d, %d call%s per run\n", resolution, resolution, Iterations, Iterations > 1 ? "s" : "");
+		printf("%-11s %-8s %7s %12s %10s %9s %8s %8s\n", "stage", "kernels", "threads", "ms", "ns/cell", "GB/s", "stream", "scaling");
+
+		const size_t FirstResult = results.size();
+
+		for (const Backend& B : backends) {
+			// Every stage over the whole domain, one red-black sweep per projection
+			Solver.Parameters = FluidParameters();
+			Solver.Parameters.Threads = B.Threads;
+			Solver.Parameters.TrackActivity = false;
+			Solver.Parameters.PressureSolver = PressureSolverType::RedBlackGaussSeidel;
+			Solver.Parameters.TemporalBlocking = 1;
+			Solver.Parameters.Relaxation.MaxIterations = 1;
+			Solver.Parameters.Relaxation.Tolerance = 0.0f;
+			Solver.SetKernelISA(B.ISA);
+			Pool.SetThreadCount(B.Threads);
+
+			// Sizes the pool, the scratch rows and the activity map the stages expect
+			Reset();
+			Solver.Step(DeltaTime);
+
+			const StreamResult* Stream = &stream[0];
+
+			for (const StreamResult& S : stream) {
+				Stream = S.Threads == B.Threads ? &S : Stream;
+			}
+
+			for (Stage S : options.Stages) {
+				const StageInfo& Info = Stages[int(S)];
+
+				if (!Info.Parallel && B.Threads > 1) {
+					continue;
+				}
+
+				const double Seconds = TimeBest(options.Repeat, Iterations, Reset, [&]() { RunStage(S); });
+
+				Result R;
+				R.Stage = Info.Name;
+				R.Resolution = resolution;
+				R.Kernels = Kernels::GetName(B.ISA);
+				R.Threads = B.Threads;
+				R.NsPerCell = Seconds * 1e9 / Cells;
+				R.GBs = Info.BytesPerCell * Cells / Seconds / 1e9;
+				R.StreamFraction = R.GBs / Stream->TriadGBs;
+
+				// Against the same kernel set on one thread, which always runs first
+				for (size_t i = FirstResult; i < results.size() && B.Threads > 1; i++) {
+					if (results[i].Stage == R.Stage && results[i].Kernels == R.Kernels && results[i].Threads == 1) {
+						R.Scaling = results[i].NsPerCell / (R.NsPerCell * B.Threads);
+					}
+				}
+
+				printf("%-11s %-8s %7d %12.4f %10.3f %9.2f %7.0f%% ", R.Stage.c_str(), R.Kernels.c_str(), R.Threads,
+					Seconds * 1000.0, R.NsPerCell, R.GBs, R.StreamFraction * 100.0);
+
+				if (R.Scaling >= 0.0) {
+					printf("%7.0f%%\n", R.Scaling * 100.0);
+				}
+
+				else {
+					printf("%8s\n", "-");
+				}
+
+				results.push_back(R);
+			}
+		}
+	}
+
+	bool WriteJson(const std::string& path, const std::vector<StreamResult>& stream, const std::vector<Result>& results)
+	{
+		std::ofstream File(path);
+
+		if (!File) {
+			return false;
+		}
+
+		// One object per line, ReadJson() relies on it
+		File << "{\n\t\"format\": \"eulerian-bench\",\n\t\"version\": 1,\n\t\"stream\": [\n";
+
+		for (size_t i = 0; i < stream.size(); i++) {
+			char Line[256];
+			snprintf(Line, sizeof(Line), "\t\t{ \"threads\": %d, \"copy_gbs\": %.3f, \"triad_gbs\": %.3f }%s\n",
+				stream[i].Threads, stream[i].CopyGBs, stream[i].TriadGBs, i + 1 < stream.size() ? "," : "");
+			File << Line;
+		}
+
+		File << "\t],\n\t\"results\": [\n";
+
+		for (size_t i = 0; i < results.size(); i++) {
+			const Result& R = results[i];
+			char Scaling[32];
+			char Line[512];
+
+			snprintf(Scaling, sizeof(Scaling), R.Scaling >= 0.0 ? "%.4f" : "null", R.Scaling);
+			snprintf(Line, sizeof(Line), "\t\t{ \"stage\": \"%s\", \"resolution\": %d, \"kernels\": \"%s\", \"threads\": %d, "
+				"\"ns_per_cell\": %.5f, \"gbs\": %.3f, \"stream_fraction\": %.4f, \"scaling_efficiency\": %s }%s\n",
+				R.Stage.c_str(), R.Resolution, R.Kernels.c_str(), R.Threads, R.NsPerCell, R.GBs, R.StreamFraction, Scaling,
+				i + 1 < results.size() ? "," : "");
+			File << Line;
+		}
+
+		File << "\t]\n}\n";
+		return bool(File);
+	}
+
+	// Value of "key" in one line of a file WriteJson() wrote, the quotes of strings are stripped
+	bool FindValue(const std::string& line, const char* key, std::string& value)
+	{
+		const std::string Pattern = std::string("\"") + key + "\": ";
+		size_t Begin = line.find(Pattern);
+
+		if (Begin == std::string::npos) {
+			return false;
+		}
+
+		Begin += Pattern.size();
+		const bool Quoted = Begin < line.size() && line[Begin] == '"';
+		Begin += Quoted ? 1 : 0;
+
+		const size_t End = Quoted ? line.find('"', Begin) : line.find_first_of(",}", Begin);
+
+		if (End == std::string::npos) {
+			return false;
+		}
+
+		value = line.substr(Begin, End - Begin);
+		return true;
+	}
+
+	// Only reads results written by WriteJson(), not JSON in general
+	bool ReadJson(const std::string& path, std::vector<Result>& results)
+	{
+		std::ifstream File(path);
+		std::string Line;
+
+		if (!File) {
+			return false;
+		}
+
+		while (std::getline(File, Line)) {
+			std::string Stage, Resolution, Kernels, Threads, NsPerCell;
+
+			if (!FindValue(Line, "stage", Stage) || !FindValue(Line, "resolution", Resolution) || !FindValue(Line, "kernels", Kernels)
+				|| !FindValue(Line, "threads", Threads) || !FindValue(Line, "ns_per_cell", NsPerCell)) {
+				continue;
+			}
+
+			Result R;
+			R.Stage = Stage;
+			R.Resolution = atoi(Resolution.c_str());
+			R.Kernels = Kernels;
+			R.Threads = atoi(Threads.c_str());
+			R.NsPerCell = atof(NsPerCell.c_str());
+			results.push_back(R);
+		}
+
+		return true;
+	}
+
+	// Lists every result that moved past the threshold, returns the number of regressions
+	int Compare(const std::vector<Result>& baseline, const std::vector<Result>& results, double threshold)
+	{
+		int Regressions = 0;
+		int Improvements = 0;
+		int Missing = 0;
+
+		printf("\n%-11s %6s %-8s %7s %12s %12s %9s\n", "stage", "res", "kernels", "threads", "base ns", "ns/cell", "change");
+
+		for (const Result& R : results) {
+			const Result* Base = nullptr;
+
+			for (const Result& B : baseline) {
+				if (B.Stage == R.Stage && B.Resolution == R.Resolution && B.Kernels == R.Kernels && B.Threads == R.Threads) {
+					Base = &B;
+				}
+			}
+
+			if (!Base || Base->NsPerCell <= 0.0) {
+				Missing++;
+				continue;
+			}
+
+			const double Change = R.NsPerCell / Base->NsPerCell - 1.0;
+
+			if (std::fabs(Change) <= threshold) {
+				continue;
+			}
+
+			Regressions += Change > 0.0;
+			Improvements += Change < 0.0;
+
+			printf("%-11s %6d %-8s %7d %12.3f %12.3f %+8.1f%% %s\n", R.Stage.c_str(), R.Resolution, R.Kernels.c_str(), R.Threads,
+				Base->NsPerCell, R.NsPerCell, Change * 100.0, Change > 0.0 ? "REGRESSION" : "");
+		}
+
+		printf("%d regression%s, %d improvement%s beyond %.0f %%, %d result%s not in the baseline\n", Regressions, Regressions == 1 ? "" : "s",
+			Improvements, Improvements == 1 ? "" : "s", threshold * 100.0, Missing, Missing == 1 ? "" : "s");
+
+		return Regressions;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Options Opts;
+
+	if (!ParseOptions(argc, argv, Opts)) {
+		PrintUsage();
+		return 1;
+	}
+
+	// Read first so a bad path doesn't waste a whole run
+	std::vector<Result> Baseline;
+
+	if (!Opts.ComparePath.empty() && !ReadJson(Opts.ComparePath, Baseline)) {
+		std::cerr << "Can't read the baseline " << Opts.ComparePath << "\n";
+		return 1;
+	}
+
+	const std::vector<int> ThreadCounts = GetThreadCounts(Opts.MaxThreads);
+
+	// Every selected kernel set on one thread, then the best of them on each thread count
+	std::vector<Backend> Backends;
+
+	for (KernelISA ISA : Opts.ISAs) {
+		Backends.push_back({ ISA, 1 });
+	}
+
+	for (int Threads : ThreadCounts) {
+		if (Threads > 1) {
+			Backends.push_back({ Opts.ISAs.back(), Threads });
+		}
+	}
+
+	ThreadPool StreamPool;
+	std::vector<StreamResult> Stream;
+
+	printf("%-8s %12s %12s\n", "threads", "copy GB/s", "triad GB/s");
+
+	for (int Threads : ThreadCounts) {
+		Stream.push_back(MeasureStream(StreamPool, Threads, Opts.Repeat));
+		printf("%-8d %12.2f %12.2f\n", Threads, Stream.back().CopyGBs, Stream.back().TriadGBs);
+	}
+
+	StreamPool.SetThreadCount(1);
+
+	std::vector<Result> Results;
+
+	for (int Resolution = Opts.MinResolution; Resolution <= Opts.MaxResolution; Resolution *= 2) {
+		BenchResolution(Opts, Resolution, Backends, Stream, Results);
+	}
+
+	if (!Opts.JsonPath.empty() && !WriteJson(Opts.JsonPath, Stream, Results)) {
+		std::cerr << "Can't write " << Opts.JsonPath << "\n";
+		return 1;
+	}
+
+	if (!Opts.ComparePath.empty() && Compare(Baseline, Results, Opts.Threshold) > 0) {
+		return 2;
+	}
+
+	return 0;
+}
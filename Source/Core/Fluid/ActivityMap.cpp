@@ -0,0 +1,192 @@
+#include "ActivityMap.h"
+
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+namespace Simulation
+{
+	void ActivityMap::Resize(int resolution, int tileSize)
+	{
+		m_Resolution = resolution;
+		m_TileSize = std::max(1, std::min(tileSize, resolution));
+		m_TilesX = (resolution + m_TileSize - 1) / m_TileSize;
+		m_TilesY = m_TilesX;
+
+		m_Moving.assign(GetTileCount(), 1);
+		m_State.assign(GetTileCount(), TILE_ACTIVE);
+		m_PreviousState.assign(GetTileCount(), TILE_ACTIVE);
+		m_ActiveTiles = GetTileCount();
+		m_WakeAll = true;
+		m_WokenTiles.clear();
+
+		BuildSpans(m_ActiveSpans, TILE_ACTIVE);
+		BuildSpans(m_HaloSpans, TILE_HALO);
+	}
+
+	void ActivityMap::WakeAll()
+	{
+		m_WakeAll = true;
+	}
+
+	void ActivityMap::WakeCells(int x0, int y0, int x1, int y1)
+	{
+		x0 = std::max(x0, 0);
+		y0 = std::max(y0, 0);
+		x1 = std::min(x1, m_Resolution);
+		y1 = std::min(y1, m_Resolution);
+
+		if (m_WakeAll || x0 >= x1 || y0 >= y1) {
+			return;
+		}
+
+		for (int ty = y0 / m_TileSize; ty <= (y1 - 1) / m_TileSize; ty++) {
+			for (int tx = x0 / m_TileSize; tx <= (x1 - 1) / m_TileSize; tx++) {
+				m_WokenTiles.push_back(TileIndex(tx, ty));
+			}
+		}
+	}
+
+	void ActivityMap::Update(FluidGrid& grid, ThreadPool& pool, float threshold)
+	{
+		// After a wake up nothing is known about the back buffers, treat every tile as coming from the active set
+		if (m_WakeAll) {
+			std::fill(m_State.begin(), m_State.end(), uint8_t(TILE_ACTIVE));
+		}
+
+		// Same for the woken tiles, a tile going back to rest right away still gets its back buffers synced below
+		for (int i : m_WokenTiles) {
+			m_State[i] = TILE_ACTIVE;
+		}
+
+		m_WokenTiles.clear();
+
+		pool.ParallelFor(0, m_TilesY, [&](int RowBegin, int RowEnd) {
+			for (int ty = RowBegin; ty < RowEnd; ty++) {
+				for (int tx = 0; tx < m_TilesX; tx++) {
+					const int i = TileIndex(tx, ty);
+					m_Moving[i] = m_State[i] == TILE_ACTIVE && MeasureTile(grid, tx, ty, threshold);
+				}
+			}
+		});
+
+		m_WakeAll = false;
+		m_PreviousState.swap(m_State);
+		m_ActiveTiles = 0;
+
+		// Moving tiles dilated by one tile are active, the ring around those is halo
+		for (int ty = 0; ty < m_TilesY; ty++) {
+			for (int tx = 0; tx < m_TilesX; tx++) {
+				int Distance = 3;
+
+				for (int dy = -2; dy <= 2; dy++) {
+					for (int dx = -2; dx <= 2; dx++) {
+						const int nx = tx + dx;
+						const int ny = ty + dy;
+
+						if (nx < 0 || ny < 0 || nx >= m_TilesX || ny >= m_TilesY || !m_Moving[TileIndex(nx, ny)]) {
+							continue;
+						}
+
+						Distance = std::min(Distance, std::max(std::abs(dx), std::abs(dy)));
+					}
+				}
+
+				const int i = TileIndex(tx, ty);
+				m_State[i] = Distance <= 1 ? TILE_ACTIVE : (Distance == 2 ? TILE_HALO : TILE_REST);
+				m_ActiveTiles += m_State[i] == TILE_ACTIVE;
+			}
+		}
+
+		// Last step's relaxation may have moved faces of these after advection copied them
+		for (int ty = 0; ty < m_TilesY; ty++) {
+			for (int tx = 0; tx < m_TilesX; tx++) {
+				const int i = TileIndex(tx, ty);
+
+				if (m_State[i] == TILE_REST && m_PreviousState[i] != TILE_REST) {
+					SyncTile(grid, tx, ty);
+				}
+			}
+		}
+
+		BuildSpans(m_ActiveSpans, TILE_ACTIVE);
+		BuildSpans(m_HaloSpans, TILE_HALO);
+	}
+
+	bool ActivityMap::MeasureTile(const FluidGrid& grid, int tileX, int tileY, float threshold) const
+	{
+		const int Stride = grid.GetStride();
+		const float* U = grid.GetU();
+		const float* V = grid.GetV();
+
+		const int X0 = tileX * m_TileSize;
+		const int Y0 = tileY * m_TileSize;
+		const int X1 = std::min(X0 + m_TileSize, m_Resolution);
+		const int Y1 = std::min(Y0 + m_TileSize, m_Resolution);
+
+		float Max = 0.0f;
+
+		// The right and top faces of the tile are included, they are the ones active neighbours move in a tile at rest
+		for (int y = Y0; y <= Y1; y++) {
+			const int Base = grid.Index(0, y);
+
+			for (int x = X0; x <= X1; x++) {
+				const int i = Base + x;
+				Max = std::max(Max, std::max(std::fabs(U[i]), std::fabs(V[i])));
+
+				if (x < X1 && y < Y1) {
+					Max = std::max(Max, std::fabs((U[i + 1] - U[i]) + (V[i + Stride] - V[i])));
+				}
+			}
+		}
+
+		return Max > threshold;
+	}
+
+	void ActivityMap::SyncTile(FluidGrid& grid, int tileX, int tileY) const
+	{
+		const int X0 = tileX * m_TileSize;
+		const int Y0 = tileY * m_TileSize;
+		const int X1 = std::min(X0 + m_TileSize, m_Resolution);
+		const int Y1 = std::min(Y0 + m_TileSize, m_Resolution);
+
+		for (int y = Y0; y < Y1; y++) {
+			const int i = grid.Index(X0, y);
+
+			memcpy(grid.GetBackU() + i, grid.GetU() + i, (X1 - X0) * sizeof(float));
+			memcpy(grid.GetBackV() + i, grid.GetV() + i, (X1 - X0) * sizeof(float));
+
+			for (int f = 0; f < SCALAR_COUNT; f++) {
+				memcpy(grid.GetBackScalar(f) + i, grid.GetScalar(f) + i, (X1 - X0) * sizeof(float));
+			}
+		}
+	}
+
+	void ActivityMap::BuildSpans(std::vector<std::vector<Span>>& spans, TileState state) const
+	{
+		spans.resize(m_TilesY);
+
+		// Runs of neighbouring tiles merge into one span
+		for (int ty = 0; ty < m_TilesY; ty++) {
+			std::vector<Span>& Row = spans[ty];
+			Row.clear();
+
+			for (int tx = 0; tx < m_TilesX; tx++) {
+				if (m_State[TileIndex(tx, ty)] != state) {
+					continue;
+				}
+
+				const int Begin = tx * m_TileSize;
+				const int End = std::min(Begin + m_TileSize, m_Resolution);
+
+				if (!Row.empty() && Row.back().End == Begin) {
+					Row.back().End = End;
+				}
+
+				else {
+					Row.push_back({ Begin, End });
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "FluidGrid.h"
+
+#include "../Utils/ThreadPool.h"
+
+namespace Simulation
+{
+	// Cells [Begin, End) of a row
+	struct Span
+	{
+		int Begin;
+		int End;
+	};
+
+	// Per tile activity of the velocity field, lets the grid stages skip regions at rest
+	//
+	// A tile is moving when any face speed or cell divergence in it is above the threshold
+	// Active tiles are the moving ones dilated by one tile, the stages only run on these
+	// Halo tiles are the ring around the active ones, relaxation moves the faces they share with active tiles
+	// so advection has to keep their back buffers in sync, every other tile has identical front and back buffers
+	//
+	// Only active tiles are measured, a tile at rest can only be woken up through a neighbour
+	// Anything that writes the velocities behind the solver's back has to call WakeAll()
+	class ActivityMap
+	{
+	public :
+
+		// Every tile starts active
+		void Resize(int resolution, int tileSize);
+
+		// Measures every tile on the next Update()
+		void WakeAll();
+
+		// Measures the tiles overlapping cells [x0, x1) x [y0, y1) on the next Update(), for writes confined to a region
+		void WakeCells(int x0, int y0, int x1, int y1);
+
+		// Re-measures the active tiles and rebuilds the spans
+		// Tiles going to rest get their back buffers synced
+		void Update(FluidGrid& grid, ThreadPool& pool, float threshold);
+
+		// Active/halo spans of the tile row containing cell row y
+		inline const std::vector<Span>& GetActiveSpans(int y) const { return m_ActiveSpans[y / m_TileSize]; }
+		inline const std::vector<Span>& GetHaloSpans(int y) const { return m_HaloSpans[y / m_TileSize]; }
+
+		// fn(begin, end) over the active cells of row y within [x0, x1)
+		template <typename F>
+		void ForEachActiveSpan(int y, int x0, int x1, const F& fn) const
+		{
+			for (const Span& S : GetActiveSpans(y)) {
+				const int Begin = S.Begin > x0 ? S.Begin : x0;
+				const int End = S.End < x1 ? S.End : x1;
+
+				if (Begin < End) {
+					fn(Begin, End);
+				}
+			}
+		}
+
+		inline int GetResolution() const { return m_Resolution; }
+		inline int GetTileSize() const { return m_TileSize; }
+		inline int GetTileCount() const { return m_TilesX * m_TilesY; }
+		inline int GetActiveTileCount() const { return m_ActiveTiles; }
+
+	private :
+
+		enum TileState : uint8_t {
+			TILE_REST = 0,
+			TILE_HALO,
+			TILE_ACTIVE
+		};
+
+		bool MeasureTile(const FluidGrid& grid, int tileX, int tileY, float threshold) const;
+		void SyncTile(FluidGrid& grid, int tileX, int tileY) const;
+		void BuildSpans(std::vector<std::vector<Span>>& spans, TileState state) const;
+
+		inline int TileIndex(int tileX, int tileY) const { return tileY * m_TilesX + tileX; }
+
+		int m_Resolution = 0;
+		int m_TileSize = 0;
+		int m_TilesX = 0;
+		int m_TilesY = 0;
+		int m_ActiveTiles = 0;
+		bool m_WakeAll = true;
+
+		// Tiles woken by WakeCells() since the last Update()
+		std::vector<int> m_WokenTiles;
+
+		std::vector<uint8_t> m_Moving;
+		std::vector<uint8_t> m_State;
+		std::vector<uint8_t> m_PreviousState;
+
+		std::vector<std::vector<Span>> m_ActiveSpans;
+		std::vector<std::vector<Span>> m_HaloSpans;
+	};
+}
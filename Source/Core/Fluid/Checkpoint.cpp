@@ -0,0 +1,596 @@
+#include "Checkpoint.h"
+#include "ParameterBlock.h"
+
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <filesystem>
+#include <type_traits>
+#include <algorithm>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace Simulation
+{
+	namespace
+	{
+		const char Magic[8] = { 'E', 'U', 'L', 'C', 'K', 'P', 'T', '\0' };
+
+		static_assert(sizeof(CheckpointHeader) == 32, "CheckpointHeader is written raw");
+		static_assert(sizeof(CheckpointFieldEntry) == 24, "CheckpointFieldEntry is written raw");
+		static_assert(std::is_trivially_copyable<Object>::value, "Object is written raw");
+
+		// One record per body in CHECKPOINT_BODIES, followed by its vertices
+		struct BodyRecord
+		{
+			Object State;
+			int32_t Shape;
+			int32_t Kinematic;
+			float Area;
+			uint32_t VertexCount;
+		};
+
+		struct Block
+		{
+			CheckpointFieldEntry Entry;
+			const void* Data;
+		};
+
+		inline uint64_t AlignBlock(uint64_t offset)
+		{
+			return (offset + CheckpointBlockAlignment - 1) / CheckpointBlockAlignment * CheckpointBlockAlignment;
+		}
+	}
+
+	std::vector<uint8_t> EncodeBodies(const std::vector<RigidBody>& bodies)
+	{
+		std::vector<uint8_t> Bytes;
+
+		for (const RigidBody& Body : bodies) {
+			BodyRecord Record;
+			Record.State = Body.State;
+			Record.Shape = int32_t(Body.Shape);
+			Record.Kinematic = Body.Kinematic ? 1 : 0;
+			Record.Area = Body.Area;
+			Record.VertexCount = uint32_t(Body.Vertices.size());
+
+			const size_t Offset = Bytes.size();
+			Bytes.resize(Offset + sizeof(Record) + Body.Vertices.size() * sizeof(glm::vec2));
+			memcpy(Bytes.data() + Offset, &Record, sizeof(Record));
+
+			if (!Body.Vertices.empty()) {
+				memcpy(Bytes.data() + Offset + sizeof(Record), Body.Vertices.data(), Body.Vertices.size() * sizeof(glm::vec2));
+			}
+		}
+
+		return Bytes;
+	}
+
+	std::vector<RigidBody> DecodeBodies(const uint8_t* data, uint64_t bytes)
+	{
+		std::vector<RigidBody> Bodies;
+		uint64_t Offset = 0;
+
+		// Records are packed, copied out rather than cast
+		while (Offset + sizeof(BodyRecord) <= bytes) {
+			BodyRecord Record;
+			memcpy(&Record, data + Offset, sizeof(Record));
+			Offset += sizeof(Record);
+
+			const uint64_t VertexBytes = uint64_t(Record.VertexCount) * sizeof(glm::vec2);
+
+			if (VertexBytes > bytes - Offset) {
+				break;
+			}
+
+			RigidBody Body;
+			Body.State = Record.State;
+			Body.Shape = BodyShape(Record.Shape);
+			Body.Kinematic = Record.Kinematic != 0;
+			Body.Area = Record.Area;
+			Body.Vertices.resize(Record.VertexCount);
+
+			if (Record.VertexCount) {
+				memcpy(Body.Vertices.data(), data + Offset, size_t(VertexBytes));
+			}
+
+			Offset += VertexBytes;
+			Bodies.push_back(Body);
+		}
+
+		return Bodies;
+	}
+
+	void CheckpointState::Capture(FluidSolver& solver, uint64_t stepIndex)
+	{
+		const FluidGrid& Grid = solver.GetGrid();
+		const RigidBodySystem& BodySystem = solver.GetBodies();
+		const size_t Size = Grid.GetFieldSize();
+
+		Resolution = Grid.GetResolution();
+		Stride = Grid.GetStride();
+		StepIndex = stepIndex;
+		Parameters = solver.Parameters;
+
+		U.assign(Grid.GetU(), Grid.GetU() + Size);
+		V.assign(Grid.GetV(), Grid.GetV() + Size);
+		Pressure.assign(Grid.GetPressure(), Grid.GetPressure() + Size);
+
+		for (int f = 0; f < SCALAR_COUNT; f++) {
+			Scalars[f].assign(Grid.GetScalar(f), Grid.GetScalar(f) + Size);
+		}
+
+		Solid.assign(Grid.GetSolid(), Grid.GetSolid() + Size);
+
+		// Only the static obstacles, the bodies put their cells back when they are restored
+		if (!BodySystem.IsEmpty()) {
+			for (size_t i = 0; i < Size; i++) {
+				Solid[i] &= BodySystem.IsBodyCell(i) ? 0 : 1;
+			}
+		}
+
+		Bodies = BodySystem.GetBodies();
+	}
+
+	uint64_t WriteCheckpoint(const std::string& path, const CheckpointState& state)
+	{
+		const uint64_t FloatBytes = uint64_t(state.U.size()) * sizeof(float);
+		const std::vector<uint8_t> Bodies = EncodeBodies(state.Bodies);
+
+		// Written field by field, so the block doesn't carry the padding of the struct
+		const uint32_t ParameterHeader[2] = { ParameterBlock::GetLayout(), ParameterBlock::GetFieldCount() };
+		std::vector<uint8_t> Parameters(reinterpret_cast<const uint8_t*>(ParameterHeader), reinterpret_cast<const uint8_t*>(ParameterHeader + 2));
+		const std::vector<uint8_t> ParameterWords = ParameterBlock::Write(state.Parameters);
+		Parameters.insert(Parameters.end(), ParameterWords.begin(), ParameterWords.end());
+
+		std::vector<Block> Blocks;
+
+		auto AddBlock = [&](uint32_t id, uint32_t elementBytes, uint64_t bytes, const void* data) {
+			Block New;
+			New.Entry.Id = id;
+			New.Entry.ElementBytes = elementBytes;
+			New.Entry.Offset = 0;
+			New.Entry.Bytes = bytes;
+			New.Data = data;
+			Blocks.push_back(New);
+		};
+
+		AddBlock(CHECKPOINT_U, sizeof(float), FloatBytes, state.U.data());
+		AddBlock(CHECKPOINT_V, sizeof(float), FloatBytes, state.V.data());
+		AddBlock(CHECKPOINT_PRESSURE, sizeof(float), FloatBytes, state.Pressure.data());
+
+		for (int f = 0; f < SCALAR_COUNT; f++) {
+			AddBlock(CHECKPOINT_SCALAR + f, sizeof(float), FloatBytes, state.Scalars[f].data());
+		}
+
+		AddBlock(CHECKPOINT_SOLID, sizeof(uint8_t), state.Solid.size(), state.Solid.data());
+		AddBlock(CHECKPOINT_PARAMETERS, sizeof(uint32_t), Parameters.size(), Parameters.data());
+		AddBlock(CHECKPOINT_BODIES, 1, Bodies.size(), Bodies.data());
+
+		CheckpointHeader Header;
+		memcpy(Header.Magic, Magic, sizeof(Magic));
+		Header.Version = CheckpointVersion;
+		Header.FieldCount = uint32_t(Blocks.size());
+		Header.Resolution = state.Resolution;
+		Header.Stride = state.Stride;
+		Header.StepIndex = state.StepIndex;
+
+		uint64_t Offset = AlignBlock(sizeof(Header) + Blocks.size() * sizeof(CheckpointFieldEntry));
+
+		for (Block& Each : Blocks) {
+			Each.Entry.Offset = Offset;
+			Offset = AlignBlock(Offset + Each.Entry.Bytes);
+		}
+
+		const std::string TempPath = path + ".tmp";
+		FILE* File = fopen(TempPath.c_str(), "wb");
+
+		if (!File) {
+			return 0;
+		}
+
+		// Header and table, then each block after the zero padding up to its offset
+		static const uint8_t Padding[CheckpointBlockAlignment] = {};
+		uint64_t Written = 0;
+		bool Succeeded = fwrite(&Header, sizeof(Header), 1, File) == 1;
+		Written += sizeof(Header);
+
+		for (const Block& Each : Blocks) {
+			Succeeded = Succeeded && fwrite(&Each.Entry, sizeof(Each.Entry), 1, File) == 1;
+			Written += sizeof(Each.Entry);
+		}
+
+		for (const Block& Each : Blocks) {
+			Succeeded = Succeeded && fwrite(Padding, 1, size_t(Each.Entry.Offset - Written), File) == size_t(Each.Entry.Offset - Written);
+			Succeeded = Succeeded && (Each.Entry.Bytes == 0 || fwrite(Each.Data, 1, size_t(Each.Entry.Bytes), File) == size_t(Each.Entry.Bytes));
+			Written = Each.Entry.Offset + Each.Entry.Bytes;
+		}
+
+		Succeeded = fclose(File) == 0 && Succeeded;
+
+		std::error_code Error;
+
+		if (Succeeded) {
+			std::filesystem::rename(TempPath, path, Error);
+		}
+
+		if (!Succeeded || Error) {
+			std::filesystem::remove(TempPath, Error);
+			return 0;
+		}
+
+		return Written;
+	}
+
+	CheckpointWriter::~CheckpointWriter()
+	{
+		{
+			std::lock_guard<std::mutex> Guard(m_Mutex);
+			m_Stop = true;
+		}
+
+		m_Condition.notify_all();
+
+		if (m_Thread.joinable()) {
+			m_Thread.join();
+		}
+	}
+
+	std::shared_ptr<CheckpointState> CheckpointWriter::AcquireState()
+	{
+		std::lock_guard<std::mutex> Guard(m_Mutex);
+
+		if (m_Spare) {
+			return std::move(m_Spare);
+		}
+
+		return std::make_shared<CheckpointState>();
+	}
+
+	void CheckpointWriter::Save(const std::string& path, std::shared_ptr<CheckpointState> state)
+	{
+		{
+			std::lock_guard<std::mutex> Guard(m_Mutex);
+			m_PendingPath = path;
+			m_Pending = std::move(state);
+
+			if (!m_Thread.joinable()) {
+				m_Thread = std::thread(&CheckpointWriter::ThreadLoop, this);
+			}
+		}
+
+		m_Condition.notify_all();
+	}
+
+	void CheckpointWriter::Wait()
+	{
+		std::unique_lock<std::mutex> Guard(m_Mutex);
+
+		m_Condition.wait(Guard, [this]() {
+			return !m_Pending && !m_Writing;
+		});
+	}
+
+	bool CheckpointWriter::IsBusy() const
+	{
+		std::lock_guard<std::mutex> Guard(m_Mutex);
+		return m_Pending || m_Writing;
+	}
+
+	CheckpointSaveResult CheckpointWriter::GetLastResult() const
+	{
+		std::lock_guard<std::mutex> Guard(m_Mutex);
+		return m_LastResult;
+	}
+
+	void CheckpointWriter::ThreadLoop()
+	{
+		std::unique_lock<std::mutex> Guard(m_Mutex);
+
+		while (true) {
+			m_Condition.wait(Guard, [this]() {
+				return m_Stop || m_Pending;
+			});
+
+			// Whatever was asked for before shutting down is still written
+			if (!m_Pending) {
+				return;
+			}
+
+			std::shared_ptr<CheckpointState> State = std::move(m_Pending);
+			const std::string Path = m_PendingPath;
+			const uint64_t StepIndex = State->StepIndex;
+			m_Pending.reset();
+			m_Writing = true;
+
+			Guard.unlock();
+
+			const auto Start = std::chrono::steady_clock::now();
+			const uint64_t Bytes = WriteCheckpoint(Path, *State);
+			const float WriteMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - Start).count();
+
+			Guard.lock();
+
+			m_Spare = std::move(State);
+
+			m_LastResult.Path = Path;
+			m_LastResult.Succeeded = Bytes != 0;
+			m_LastResult.Bytes = Bytes;
+			m_LastResult.StepIndex = StepIndex;
+			m_LastResult.WriteMs = WriteMs;
+			m_LastResult.Saves++;
+			m_Writing = false;
+
+			m_Condition.notify_all();
+		}
+	}
+
+	MappedCheckpoint::~MappedCheckpoint()
+	{
+		Close();
+	}
+
+	bool MappedCheckpoint::Open(const std::string& path)
+	{
+		Close();
+
+		m_Path = path;
+
+#ifdef _WIN32
+		HANDLE File = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+
+		if (File == INVALID_HANDLE_VALUE) {
+			return Fail("can't open the file");
+		}
+
+		m_File = File;
+
+		LARGE_INTEGER Size;
+
+		if (!GetFileSizeEx(File, &Size) || Size.QuadPart < LONGLONG(sizeof(CheckpointHeader))) {
+			return Fail("file too small");
+		}
+
+		m_Mapping = CreateFileMappingA(File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+		if (!m_Mapping) {
+			return Fail("can't map the file");
+		}
+
+		m_Data = static_cast<const uint8_t*>(MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0));
+		m_Size = uint64_t(Size.QuadPart);
+#else
+		const int File = open(path.c_str(), O_RDONLY);
+
+		if (File < 0) {
+			return Fail("can't open the file");
+		}
+
+		struct stat Info;
+
+		if (fstat(File, &Info) != 0 || uint64_t(Info.st_size) < sizeof(CheckpointHeader)) {
+			close(File);
+			return Fail("file too small");
+		}
+
+		void* Data = mmap(nullptr, size_t(Info.st_size), PROT_READ, MAP_PRIVATE, File, 0);
+
+		// The mapping keeps its own reference to the file
+		close(File);
+
+		if (Data == MAP_FAILED) {
+			return Fail("can't map the file");
+		}
+
+		// Restoring reads every block front to back, the read ahead can start right away
+		madvise(Data, size_t(Info.st_size), MADV_SEQUENTIAL);
+		madvise(Data, size_t(Info.st_size), MADV_WILLNEED);
+
+		m_Data = static_cast<const uint8_t*>(Data);
+		m_Size = uint64_t(Info.st_size);
+#endif
+
+		if (!m_Data) {
+			return Fail("can't map the file");
+		}
+
+		m_Header = reinterpret_cast<const CheckpointHeader*>(m_Data);
+		m_Fields = reinterpret_cast<const CheckpointFieldEntry*>(m_Data + sizeof(CheckpointHeader));
+
+		if (memcmp(m_Header->Magic, Magic, sizeof(Magic)) != 0) {
+			return Fail("not a checkpoint");
+		}
+
+		if (m_Header->Version != CheckpointVersion) {
+			return Fail("checkpoint version " + std::to_string(m_Header->Version) + ", this build reads " + std::to_string(CheckpointVersion));
+		}
+
+		if (sizeof(CheckpointHeader) + uint64_t(m_Header->FieldCount) * sizeof(CheckpointFieldEntry) > m_Size) {
+			return Fail("truncated field table");
+		}
+
+		for (uint32_t i = 0; i < m_Header->FieldCount; i++) {
+			const CheckpointFieldEntry& Entry = m_Fields[i];
+
+			if (Entry.Offset % CheckpointBlockAlignment != 0 || Entry.Offset > m_Size || Entry.Bytes > m_Size - Entry.Offset) {
+				return Fail("truncated field " + std::to_string(Entry.Id));
+			}
+		}
+
+		// The grid fields have to cover the padded layout the header describes
+		const uint64_t Cells = uint64_t(std::max(m_Header->Stride, 0)) * uint64_t(std::max(m_Header->Resolution + 2, 0));
+		const uint32_t Required[] = { CHECKPOINT_U, CHECKPOINT_V, CHECKPOINT_PRESSURE, CHECKPOINT_SOLID };
+
+		if (m_Header->Resolution <= 0 || m_Header->Stride < m_Header->Resolution + 2) {
+			return Fail("invalid resolution");
+		}
+
+		for (uint32_t Id : Required) {
+			const CheckpointFieldEntry* Entry = FindField(Id);
+
+			if (!Entry || Entry->Bytes != Cells * Entry->ElementBytes) {
+				return Fail("missing field " + std::to_string(Id));
+			}
+		}
+
+		return true;
+	}
+
+	void MappedCheckpoint::Close()
+	{
+#ifdef _WIN32
+		if (m_Data) {
+			UnmapViewOfFile(m_Data);
+		}
+
+		if (m_Mapping) {
+			CloseHandle(m_Mapping);
+		}
+
+		if (m_File) {
+			CloseHandle(m_File);
+		}
+
+		m_File = nullptr;
+		m_Mapping = nullptr;
+#else
+		if (m_Data) {
+			munmap(const_cast<uint8_t*>(m_Data), size_t(m_Size));
+		}
+#endif
+
+		m_Data = nullptr;
+		m_Size = 0;
+		m_Header = nullptr;
+		m_Fields = nullptr;
+	}
+
+	bool MappedCheckpoint::Fail(const std::string& error)
+	{
+		const std::string Path = m_Path;
+		Close();
+
+		m_Path = Path;
+		m_Error = error;
+		return false;
+	}
+
+	const CheckpointFieldEntry* MappedCheckpoint::FindField(uint32_t id) const
+	{
+		for (uint32_t i = 0; IsOpen() && i < m_Header->FieldCount; i++) {
+			if (m_Fields[i].Id == id) {
+				return &m_Fields[i];
+			}
+		}
+
+		return nullptr;
+	}
+
+	const void* MappedCheckpoint::GetField(uint32_t id) const
+	{
+		const CheckpointFieldEntry* Entry = FindField(id);
+		return Entry ? m_Data + Entry->Offset : nullptr;
+	}
+
+	bool MappedCheckpoint::GetParameters(FluidParameters& parameters) const
+	{
+		const CheckpointFieldEntry* Entry = FindField(CHECKPOINT_PARAMETERS);
+
+		if (!Entry || Entry->Bytes != 2 * sizeof(uint32_t) + ParameterBlock::GetBytes()) {
+			return false;
+		}
+
+		uint32_t ParameterHeader[2];
+		memcpy(ParameterHeader, m_Data + Entry->Offset, sizeof(ParameterHeader));
+
+		if (ParameterHeader[0] != ParameterBlock::GetLayout() || ParameterHeader[1] != ParameterBlock::GetFieldCount()) {
+			return false;
+		}
+
+		parameters = ParameterBlock::Read(m_Data + Entry->Offset + sizeof(ParameterHeader));
+		return true;
+	}
+
+	std::vector<RigidBody> MappedCheckpoint::GetBodies() const
+	{
+		const CheckpointFieldEntry* Entry = FindField(CHECKPOINT_BODIES);
+
+		if (!Entry) {
+			return std::vector<RigidBody>();
+		}
+
+		return DecodeBodies(m_Data + Entry->Offset, Entry->Bytes);
+	}
+
+	bool RestoreCheckpoint(const MappedCheckpoint& checkpoint, FluidSolver& solver, bool restoreParameters)
+	{
+		FluidGrid& Grid = solver.GetGrid();
+
+		if (!checkpoint.IsOpen() || checkpoint.GetResolution() != Grid.GetResolution() || checkpoint.GetStride() != Grid.GetStride()) {
+			return false;
+		}
+
+		const size_t Size = Grid.GetFieldSize();
+		const float* U = static_cast<const float*>(checkpoint.GetField(CHECKPOINT_U));
+		const float* V = static_cast<const float*>(checkpoint.GetField(CHECKPOINT_V));
+		const float* Pressure = static_cast<const float*>(checkpoint.GetField(CHECKPOINT_PRESSURE));
+		const uint8_t* Solid = static_cast<const uint8_t*>(checkpoint.GetField(CHECKPOINT_SOLID));
+
+		if (restoreParameters) {
+			checkpoint.GetParameters(solver.Parameters);
+		}
+
+		// Straight out of the mapping, the layouts are the same
+		memcpy(Grid.GetU(), U, Size * sizeof(float));
+		memcpy(Grid.GetV(), V, Size * sizeof(float));
+		memcpy(Grid.GetBackU(), U, Size * sizeof(float));
+		memcpy(Grid.GetBackV(), V, Size * sizeof(float));
+		memcpy(Grid.GetPressure(), Pressure, Size * sizeof(float));
+
+		// A scalar missing from the file starts empty
+		for (int f = 0; f < SCALAR_COUNT; f++) {
+			const CheckpointFieldEntry* Entry = checkpoint.FindField(CHECKPOINT_SCALAR + f);
+			const float* Scalar = static_cast<const float*>(checkpoint.GetField(CHECKPOINT_SCALAR + f));
+
+			if (Entry && Entry->Bytes == Size * sizeof(float)) {
+				memcpy(Grid.GetScalar(f), Scalar, Size * sizeof(float));
+			}
+
+			else {
+				memset(Grid.GetScalar(f), 0, Size * sizeof(float));
+			}
+
+			memcpy(Grid.GetBackScalar(f), Grid.GetScalar(f), Size * sizeof(float));
+		}
+
+		// Static obstacles first so the bodies know what they cover, only the cells that differ are rebuilt
+		solver.ClearBodies();
+
+		for (int y = 0; y < Grid.GetResolution(); y++) {
+			for (int x = 0; x < Grid.GetResolution(); x++) {
+				const bool IsSolid = Solid[Grid.Index(x, y)] != 0;
+
+				if (Grid.IsSolid(x, y) != IsSolid) {
+					Grid.SetSolid(x, y, IsSolid);
+				}
+			}
+		}
+
+		Grid.UpdateFaceWeights();
+
+		for (const RigidBody& Body : checkpoint.GetBodies()) {
+			solver.AddBody(Body);
+		}
+
+		solver.WakeAll();
+		return true;
+	}
+}
@@ -0,0 +1,197 @@
+#pragma once
+
+#include "FluidSolver.h"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+
+// Binary checkpoints of the full simulation state
+//
+// [CheckpointHeader][CheckpointFieldEntry x FieldCount] then one block per field, each starting on a CheckpointBlockAlignment boundary
+// The grid fields are stored raw in the padded FluidGrid layout, so restoring is a memcpy out of the mapped file
+// Little endian, like every platform the project builds on, nothing is byte swapped
+// Bump CheckpointVersion whenever a block changes meaning
+// CHECKPOINT_PARAMETERS is [layout hash][field count] then the words of ParameterBlock.h, other layouts aren't read
+
+namespace Simulation
+{
+	constexpr uint32_t CheckpointVersion = 2;
+
+	// Page size, keeps every field aligned for the kernels when the file is mapped
+	constexpr uint64_t CheckpointBlockAlignment = 4096;
+
+	enum CheckpointFieldId : uint32_t {
+		CHECKPOINT_U = 0,
+		CHECKPOINT_V,
+		CHECKPOINT_PRESSURE,
+
+		// Static obstacles, the cells covered by bodies are left out and rasterized again from CHECKPOINT_BODIES
+		CHECKPOINT_SOLID,
+
+		CHECKPOINT_PARAMETERS,
+		CHECKPOINT_BODIES,
+
+		// Scalar field f is CHECKPOINT_SCALAR + f
+		CHECKPOINT_SCALAR = 16
+	};
+
+	struct CheckpointHeader
+	{
+		char Magic[8];
+		uint32_t Version;
+		uint32_t FieldCount;
+		int32_t Resolution;
+		int32_t Stride;
+		uint64_t StepIndex;
+	};
+
+	struct CheckpointFieldEntry
+	{
+		uint32_t Id;
+		uint32_t ElementBytes;
+		uint64_t Offset;
+		uint64_t Bytes;
+	};
+
+	// Copy of the solver state taken between two steps, immutable once captured
+	// The writer thread works from this while the simulation keeps stepping
+	struct CheckpointState
+	{
+		int Resolution = 0;
+		int Stride = 0;
+		uint64_t StepIndex = 0;
+		FluidParameters Parameters;
+
+		std::vector<float> U;
+		std::vector<float> V;
+		std::vector<float> Pressure;
+		std::vector<float> Scalars[SCALAR_COUNT];
+		std::vector<uint8_t> Solid;
+		std::vector<RigidBody> Bodies;
+
+		// Plain copies into the vectors, the only part of a save that runs on the simulation side
+		// Reusing a state keeps its allocations, a fresh one pays for the page faults of the whole copy
+		void Capture(FluidSolver& solver, uint64_t stepIndex);
+	};
+
+	// Packed body records of CHECKPOINT_BODIES, each followed by its vertices, the recordings store bodies the same way
+	std::vector<uint8_t> EncodeBodies(const std::vector<RigidBody>& bodies);
+	std::vector<RigidBody> DecodeBodies(const uint8_t* data, uint64_t bytes);
+
+	// Writes to path + ".tmp" and renames it over path, an interrupted save never leaves a truncated checkpoint
+	// Returns the file size, 0 on failure
+	uint64_t WriteCheckpoint(const std::string& path, const CheckpointState& state);
+
+	struct CheckpointSaveResult
+	{
+		std::string Path;
+		bool Succeeded = false;
+		uint64_t Bytes = 0;
+		uint64_t StepIndex = 0;
+		float WriteMs = 0.0f;
+		int Saves = 0;
+	};
+
+	// Writes checkpoints on its own thread
+	// One save runs at a time, a newer request replaces the one still waiting so a slow disk never queues up copies of the state
+	class CheckpointWriter
+	{
+	public :
+
+		CheckpointWriter() = default;
+		~CheckpointWriter();
+
+		CheckpointWriter(const CheckpointWriter&) = delete;
+		CheckpointWriter operator=(CheckpointWriter const&) = delete;
+
+		// State to capture into, the one written last when the writer is done with it so periodic saves don't allocate
+		// That one stays allocated between saves
+		std::shared_ptr<CheckpointState> AcquireState();
+
+		void Save(const std::string& path, std::shared_ptr<CheckpointState> state);
+
+		// Blocks until nothing is waiting or being written
+		void Wait();
+
+		bool IsBusy() const;
+		CheckpointSaveResult GetLastResult() const;
+
+	private :
+
+		void ThreadLoop();
+
+		mutable std::mutex m_Mutex;
+		std::condition_variable m_Condition;
+		std::thread m_Thread;
+		bool m_Stop = false;
+		bool m_Writing = false;
+
+		std::string m_PendingPath;
+		std::shared_ptr<CheckpointState> m_Pending;
+		std::shared_ptr<CheckpointState> m_Spare;
+		CheckpointSaveResult m_LastResult;
+	};
+
+	// Read only mapping of a checkpoint file, validated on Open() but never parsed
+	// The field pointers point straight into the mapping and stay valid as long as the object lives
+	class MappedCheckpoint
+	{
+	public :
+
+		MappedCheckpoint() = default;
+		~MappedCheckpoint();
+
+		MappedCheckpoint(const MappedCheckpoint&) = delete;
+		MappedCheckpoint operator=(MappedCheckpoint const&) = delete;
+
+		// Returns false with GetError() set when the file can't be mapped or isn't a checkpoint of this version
+		bool Open(const std::string& path);
+		void Close();
+
+		inline bool IsOpen() const { return m_Data != nullptr; }
+		inline const std::string& GetError() const { return m_Error; }
+		inline const std::string& GetPath() const { return m_Path; }
+		inline uint64_t GetFileSize() const { return m_Size; }
+		inline const uint8_t* GetData() const { return m_Data; }
+
+		inline int GetResolution() const { return m_Header->Resolution; }
+		inline int GetStride() const { return m_Header->Stride; }
+		inline uint64_t GetStepIndex() const { return m_Header->StepIndex; }
+
+		// Null when the file has no such block
+		const CheckpointFieldEntry* FindField(uint32_t id) const;
+		const void* GetField(uint32_t id) const;
+
+		// False when the parameters were written by a build with another parameter layout
+		bool GetParameters(FluidParameters& parameters) const;
+
+		// The only block that is decoded, bodies are small and have a variable vertex count
+		std::vector<RigidBody> GetBodies() const;
+
+	private :
+
+		bool Fail(const std::string& error);
+
+		std::string m_Path;
+		std::string m_Error;
+		const uint8_t* m_Data = nullptr;
+		uint64_t m_Size = 0;
+		const CheckpointHeader* m_Header = nullptr;
+		const CheckpointFieldEntry* m_Fields = nullptr;
+
+#ifdef _WIN32
+		void* m_File = nullptr;
+		void* m_Mapping = nullptr;
+#endif
+	};
+
+	// Copies a mapped checkpoint into the solver's grid and bodies, the grid must have the checkpoint's resolution
+	// Both velocity and scalar buffers are written and every tile woken, like a LoadFields command
+	// The parameters are only taken over when restoreParameters is set and they match this build
+	bool RestoreCheckpoint(const MappedCheckpoint& checkpoint, FluidSolver& solver, bool restoreParameters = true);
+}
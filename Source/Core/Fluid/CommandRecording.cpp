@@ -0,0 +1,451 @@
+#include "CommandRecording.h"
+#include "ParameterBlock.h"
+
+#include <cstdio>
+#include <cstring>
+#include <type_traits>
+#include <filesystem>
+
+namespace Simulation
+{
+	namespace
+	{
+		const char Magic[8] = { 'E', 'U', 'L', 'R', 'E', 'C', '\0', '\0' };
+
+		static_assert(sizeof(CommandRecordingHeader) == 32, "CommandRecordingHeader is written raw");
+		static_assert(sizeof(RecordedCommandHeader) == 32, "RecordedCommandHeader is written raw");
+		static_assert(std::is_trivially_copyable<ClockSettings>::value, "ClockSettings is written raw");
+
+		// Payloads are built in memory, they are small apart from the fields of a LoadFields
+		class PayloadWriter
+		{
+		public :
+
+			template <typename T>
+			void Put(const T& value)
+			{
+				PutBytes(&value, sizeof(T));
+			}
+
+			void PutBytes(const void* data, size_t bytes)
+			{
+				const size_t Offset = Bytes.size();
+				Bytes.resize(Offset + bytes);
+
+				if (bytes) {
+					memcpy(Bytes.data() + Offset, data, bytes);
+				}
+			}
+
+			void PutString(const std::string& value)
+			{
+				Put(uint64_t(value.size()));
+				PutBytes(value.data(), value.size());
+			}
+
+			template <typename T>
+			void PutVector(const std::vector<T>& values)
+			{
+				Put(uint64_t(values.size()));
+				PutBytes(values.data(), values.size() * sizeof(T));
+			}
+
+			std::vector<uint8_t> Bytes;
+		};
+
+		// Reads stop at the end of the payload, Failed is set instead of reading past it
+		class PayloadReader
+		{
+		public :
+
+			PayloadReader(const uint8_t* data, uint64_t bytes) : m_Data(data), m_Bytes(bytes) {}
+
+			template <typename T>
+			T Get()
+			{
+				T Value {};
+				GetBytes(&Value, sizeof(T));
+				return Value;
+			}
+
+			void GetBytes(void* data, uint64_t bytes)
+			{
+				if (Failed || bytes > m_Bytes - m_Offset) {
+					Failed = true;
+					return;
+				}
+
+				if (bytes) {
+					memcpy(data, m_Data + m_Offset, size_t(bytes));
+				}
+
+				m_Offset += bytes;
+			}
+
+			std::string GetString()
+			{
+				const uint64_t Length = Get<uint64_t>();
+
+				if (Failed || Length > m_Bytes - m_Offset) {
+					Failed = true;
+					return std::string();
+				}
+
+				std::string Value(reinterpret_cast<const char*>(m_Data + m_Offset), size_t(Length));
+				m_Offset += Length;
+				return Value;
+			}
+
+			template <typename T>
+			std::vector<T> GetVector()
+			{
+				const uint64_t Count = Get<uint64_t>();
+
+				if (Failed || Count > (m_Bytes - m_Offset) / sizeof(T)) {
+					Failed = true;
+					return std::vector<T>();
+				}
+
+				std::vector<T> Values(static_cast<size_t>(Count));
+				GetBytes(Values.data(), Count * sizeof(T));
+				return Values;
+			}
+
+			void Skip(uint64_t bytes)
+			{
+				Failed = Failed || bytes > m_Bytes - m_Offset;
+				m_Offset += Failed ? 0 : bytes;
+			}
+
+			const uint8_t* GetRemaining(uint64_t& bytes) const
+			{
+				bytes = m_Bytes - m_Offset;
+				return m_Data + m_Offset;
+			}
+
+			bool Failed = false;
+
+		private :
+
+			const uint8_t* m_Data;
+			uint64_t m_Bytes;
+			uint64_t m_Offset = 0;
+		};
+
+		// Same as WriteCheckpoint, through a temporary file renamed over path
+		bool WriteFile(const std::string& path, const uint8_t* data, uint64_t bytes)
+		{
+			const std::string TempPath = path + ".tmp";
+			FILE* File = fopen(TempPath.c_str(), "wb");
+
+			if (!File) {
+				return false;
+			}
+
+			bool Succeeded = fwrite(data, 1, size_t(bytes), File) == size_t(bytes);
+			Succeeded = fclose(File) == 0 && Succeeded;
+
+			std::error_code Error;
+
+			if (Succeeded) {
+				std::filesystem::rename(TempPath, path, Error);
+			}
+
+			if (!Succeeded || Error) {
+				std::filesystem::remove(TempPath, Error);
+				return false;
+			}
+
+			return true;
+		}
+
+		// checkpointName is the copy of command.Checkpoint next to the recording
+		void EncodeCommand(const SimulationCommand& command, const std::string& checkpointName, PayloadWriter& payload)
+		{
+			using Type = SimulationCommand::Type;
+
+			switch (command.Kind) {
+			case Type::SetParameters: {
+				const std::vector<uint8_t> Parameters = ParameterBlock::Write(command.Parameters);
+				payload.PutBytes(Parameters.data(), Parameters.size());
+				break;
+			}
+
+			case Type::SetClockSettings:
+				payload.Put(command.Clock);
+				break;
+
+			case Type::LoadFields:
+				payload.Put(uint8_t(command.Checkpoint ? 1 : 0));
+
+				if (command.Checkpoint) {
+					payload.PutString(checkpointName);
+				}
+
+				else {
+					payload.PutVector(command.U);
+					payload.PutVector(command.V);
+					payload.PutVector(command.Pressure);
+				}
+				break;
+
+			case Type::LoadObstacles:
+				payload.Put(command.ObstacleSettings.Threshold);
+				payload.Put(uint8_t(command.ObstacleSettings.Invert ? 1 : 0));
+				payload.Put(uint8_t(command.Obstacles ? 1 : 0));
+
+				if (command.Obstacles) {
+					payload.PutString(command.Obstacles->GetPath());
+					payload.Put(int32_t(command.Obstacles->GetWidth()));
+					payload.Put(int32_t(command.Obstacles->GetHeight()));
+					payload.PutVector(command.Obstacles->GetPixels());
+				}
+				break;
+
+			case Type::AddBody: {
+				const std::vector<uint8_t> Body = EncodeBodies({ command.Body });
+				payload.PutBytes(Body.data(), Body.size());
+				break;
+			}
+
+			default:
+				break;
+			}
+		}
+
+		// directory is where the recording is, the checkpoint copies are next to it
+		bool DecodeCommand(PayloadReader& payload, const std::filesystem::path& directory, SimulationCommand& command, std::string& error)
+		{
+			using Type = SimulationCommand::Type;
+
+			switch (command.Kind) {
+			case Type::SetParameters: {
+				std::vector<uint8_t> Parameters(ParameterBlock::GetBytes());
+				payload.GetBytes(Parameters.data(), Parameters.size());
+
+				if (!payload.Failed) {
+					command.Parameters = ParameterBlock::Read(Parameters.data());
+				}
+				break;
+			}
+
+			case Type::SetClockSettings:
+				command.Clock = payload.Get<ClockSettings>();
+				break;
+
+			case Type::LoadFields:
+				if (payload.Get<uint8_t>()) {
+					const std::string Path = (directory / payload.GetString()).string();
+					std::shared_ptr<MappedCheckpoint> Checkpoint = std::make_shared<MappedCheckpoint>();
+
+					if (!payload.Failed && !Checkpoint->Open(Path)) {
+						error = "can't map " + Path + " : " + Checkpoint->GetError();
+						return false;
+					}
+
+					command.Checkpoint = Checkpoint;
+				}
+
+				else {
+					command.U = payload.GetVector<float>();
+					command.V = payload.GetVector<float>();
+					command.Pressure = payload.GetVector<float>();
+				}
+				break;
+
+			case Type::LoadObstacles:
+				command.ObstacleSettings.Threshold = payload.Get<float>();
+				command.ObstacleSettings.Invert = payload.Get<uint8_t>() != 0;
+
+				if (payload.Get<uint8_t>()) {
+					const std::string Path = payload.GetString();
+					const int Width = payload.Get<int32_t>();
+					const int Height = payload.Get<int32_t>();
+					std::vector<uint8_t> Pixels = payload.GetVector<uint8_t>();
+
+					if (!payload.Failed && Pixels.size() != size_t(Width) * size_t(Height)) {
+						payload.Failed = true;
+					}
+
+					std::shared_ptr<ObstacleMap> Obstacles = std::make_shared<ObstacleMap>();
+					Obstacles->Assign(Path, Width, Height, std::move(Pixels));
+					command.Obstacles = Obstacles;
+				}
+				break;
+
+			case Type::AddBody: {
+				uint64_t Bytes = 0;
+				const uint8_t* Data = payload.GetRemaining(Bytes);
+				const std::vector<RigidBody> Bodies = DecodeBodies(Data, Bytes);
+
+				if (Bodies.size() != 1) {
+					payload.Failed = true;
+				}
+
+				else {
+					command.Body = Bodies[0];
+				}
+				break;
+			}
+
+			default:
+				break;
+			}
+
+			if (payload.Failed) {
+				error = "truncated command";
+				return false;
+			}
+
+			return true;
+		}
+	}
+
+	bool CommandRecording::IsRecorded(SimulationCommand::Type kind)
+	{
+		using Type = SimulationCommand::Type;
+
+		return kind == Type::SetParameters || kind == Type::SetClockSettings || kind == Type::Reset || kind == Type::LoadFields
+			|| kind == Type::LoadObstacles || kind == Type::AddBody || kind == Type::ClearBodies;
+	}
+
+	void CommandRecording::Begin(const std::string& startCheckpoint)
+	{
+		m_StartCheckpoint = startCheckpoint;
+		m_Commands.clear();
+		m_StepCount = 0;
+	}
+
+	void CommandRecording::Add(uint64_t step, double time, const SimulationCommand& command)
+	{
+		RecordedCommand Recorded;
+		Recorded.Step = step;
+		Recorded.Time = time;
+		Recorded.Command = command;
+		m_Commands.push_back(std::move(Recorded));
+	}
+
+	bool CommandRecording::Save(const std::string& path) const
+	{
+		FILE* File = fopen(path.c_str(), "wb");
+
+		if (!File) {
+			return false;
+		}
+
+		CommandRecordingHeader Header;
+		memcpy(Header.Magic, Magic, sizeof(Magic));
+		Header.Version = CommandRecordingVersion;
+		Header.CommandCount = uint32_t(m_Commands.size());
+		Header.StepCount = m_StepCount;
+		Header.ParametersBytes = uint32_t(ParameterBlock::GetBytes());
+		Header.ParametersLayout = ParameterBlock::GetLayout();
+
+		PayloadWriter Name;
+		Name.PutString(m_StartCheckpoint);
+
+		bool Succeeded = fwrite(&Header, sizeof(Header), 1, File) == 1;
+		Succeeded = Succeeded && fwrite(Name.Bytes.data(), 1, Name.Bytes.size(), File) == Name.Bytes.size();
+
+		const std::filesystem::path Recording(path);
+		int Copies = 0;
+
+		for (const RecordedCommand& Recorded : m_Commands) {
+			std::string CheckpointName;
+
+			if (Recorded.Command.Kind == SimulationCommand::Type::LoadFields && Recorded.Command.Checkpoint) {
+				const MappedCheckpoint& Checkpoint = *Recorded.Command.Checkpoint;
+				CheckpointName = Recording.filename().string() + "." + std::to_string(Copies++) + ".eulckpt";
+				Succeeded = Succeeded && WriteFile((Recording.parent_path() / CheckpointName).string(), Checkpoint.GetData(), Checkpoint.GetFileSize());
+			}
+
+			PayloadWriter Payload;
+			EncodeCommand(Recorded.Command, CheckpointName, Payload);
+
+			RecordedCommandHeader CommandHeader;
+			CommandHeader.Kind = uint32_t(Recorded.Command.Kind);
+			CommandHeader.Reserved = 0;
+			CommandHeader.Step = Recorded.Step;
+			CommandHeader.Time = Recorded.Time;
+			CommandHeader.PayloadBytes = Payload.Bytes.size();
+
+			Succeeded = Succeeded && fwrite(&CommandHeader, sizeof(CommandHeader), 1, File) == 1;
+			Succeeded = Succeeded && (Payload.Bytes.empty() || fwrite(Payload.Bytes.data(), 1, Payload.Bytes.size(), File) == Payload.Bytes.size());
+		}
+
+		return fclose(File) == 0 && Succeeded;
+	}
+
+	bool CommandRecording::Load(const std::string& path)
+	{
+		Begin(std::string());
+		m_Error.clear();
+
+		FILE* File = fopen(path.c_str(), "rb");
+
+		if (!File) {
+			return Fail("can't open the file");
+		}
+
+		std::vector<uint8_t> Bytes;
+		uint8_t Buffer[1 << 16];
+
+		for (size_t Read; (Read = fread(Buffer, 1, sizeof(Buffer), File)) > 0;) {
+			Bytes.insert(Bytes.end(), Buffer, Buffer + Read);
+		}
+
+		fclose(File);
+
+		PayloadReader Reader(Bytes.data(), Bytes.size());
+		const CommandRecordingHeader Header = Reader.Get<CommandRecordingHeader>();
+
+		if (Reader.Failed || memcmp(Header.Magic, Magic, sizeof(Magic)) != 0) {
+			return Fail("not a recording");
+		}
+
+		if (Header.Version != CommandRecordingVersion) {
+			return Fail("version " + std::to_string(Header.Version) + ", this build reads " + std::to_string(CommandRecordingVersion));
+		}
+
+		if (Header.ParametersBytes != ParameterBlock::GetBytes() || Header.ParametersLayout != ParameterBlock::GetLayout()) {
+			return Fail("recorded by a build with other parameters");
+		}
+
+		m_StartCheckpoint = Reader.GetString();
+		m_StepCount = Header.StepCount;
+
+		for (uint32_t i = 0; i < Header.CommandCount; i++) {
+			const RecordedCommandHeader CommandHeader = Reader.Get<RecordedCommandHeader>();
+			uint64_t Remaining = 0;
+			const uint8_t* Payload = Reader.GetRemaining(Remaining);
+
+			if (Reader.Failed || CommandHeader.PayloadBytes > Remaining || CommandHeader.Kind > uint32_t(SimulationCommand::Type::StopRecording)) {
+				return Fail("truncated recording");
+			}
+
+			RecordedCommand Recorded;
+			Recorded.Step = CommandHeader.Step;
+			Recorded.Time = CommandHeader.Time;
+			Recorded.Command.Kind = SimulationCommand::Type(CommandHeader.Kind);
+
+			PayloadReader CommandPayload(Payload, CommandHeader.PayloadBytes);
+			std::string Error;
+
+			if (!DecodeCommand(CommandPayload, std::filesystem::path(path).parent_path(), Recorded.Command, Error)) {
+				return Fail(Error);
+			}
+
+			Reader.Skip(CommandHeader.PayloadBytes);
+			m_Commands.push_back(std::move(Recorded));
+		}
+
+		return true;
+	}
+
+	bool CommandRecording::Fail(const std::string& error)
+	{
+		m_Error = error;
+		m_Commands.clear();
+		return false;
+	}
+}
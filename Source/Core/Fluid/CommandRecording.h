@@ -0,0 +1,88 @@
+#pragma once
+
+#include "SimulationCommand.h"
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// Recordings of what changed a simulation, replayed to rerun the exact same workload
+//
+// Every edit reaches the solver as a SimulationCommand applied between two steps, so a recording is the checkpoint
+// the simulation started from plus each state changing command keyed by the steps taken before it was applied
+// Replaying them in order on the same build gives the same fields bit for bit, whatever the frame rate or pauses were
+// [CommandRecordingHeader][start checkpoint name] then per command [RecordedCommandHeader][payload]
+// Checkpoints loaded while recording are copied next to the recording as <recording>.<n>.eulckpt, the payload keeps that name
+
+namespace Simulation
+{
+	constexpr uint32_t CommandRecordingVersion = 3;
+
+	struct CommandRecordingHeader
+	{
+		char Magic[8];
+		uint32_t Version;
+		uint32_t CommandCount;
+		uint64_t StepCount;
+
+		// ParameterBlock::GetBytes() and GetLayout() of the recording build, SetParameters payloads are parameter blocks
+		uint32_t ParametersBytes;
+		uint32_t ParametersLayout;
+	};
+
+	struct RecordedCommandHeader
+	{
+		uint32_t Kind;
+		uint32_t Reserved;
+		uint64_t Step;
+		double Time;
+		uint64_t PayloadBytes;
+	};
+
+	struct RecordedCommand
+	{
+		// Steps taken since the recording started, the command goes in before step Step + 1
+		uint64_t Step = 0;
+
+		// Wall time since the recording started in seconds, only there to read the log
+		double Time = 0.0;
+
+		SimulationCommand Command;
+	};
+
+	class CommandRecording
+	{
+	public :
+
+		// Commands that change the state, pacing (pauses, single steps) and outputs (checkpoints, streams) aren't kept
+		static bool IsRecorded(SimulationCommand::Type kind);
+
+		// Forgets the commands, startCheckpoint is the file name of the start state next to the recording
+		void Begin(const std::string& startCheckpoint);
+		void Add(uint64_t step, double time, const SimulationCommand& command);
+
+		// Steps the recording ran for, replays stop there
+		inline void SetStepCount(uint64_t steps) { m_StepCount = steps; }
+		inline uint64_t GetStepCount() const { return m_StepCount; }
+
+		inline const std::vector<RecordedCommand>& GetCommands() const { return m_Commands; }
+		inline const std::string& GetStartCheckpoint() const { return m_StartCheckpoint; }
+		inline const std::string& GetError() const { return m_Error; }
+
+		// Also writes the copies of the loaded checkpoints, from their mappings so a later save over the same file doesn't matter
+		bool Save(const std::string& path) const;
+
+		// Returns false with GetError() set when the file isn't a recording of this version and build
+		// The checkpoint copies are mapped from the directory of the recording, like the start checkpoint
+		bool Load(const std::string& path);
+
+	private :
+
+		bool Fail(const std::string& error);
+
+		std::string m_StartCheckpoint;
+		std::vector<RecordedCommand> m_Commands;
+		uint64_t m_StepCount = 0;
+		std::string m_Error;
+	};
+}
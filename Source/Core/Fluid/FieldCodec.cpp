@@ -0,0 +1,228 @@
+#include "FieldCodec.h"
+
+#include <cstring>
+
+namespace Simulation
+{
+	namespace
+	{
+		constexpr size_t MinMatch = 4;
+		constexpr size_t MaxOffset = 65535;
+		constexpr int HashBits = 16;
+
+		// No match starts in the last bytes of the input, they always go out as literals
+		constexpr size_t LastLiterals = 12;
+
+		inline uint32_t Read32(const uint8_t* p)
+		{
+			uint32_t Value;
+			memcpy(&Value, p, sizeof(Value));
+			return Value;
+		}
+
+		inline uint64_t Read64(const uint8_t* p)
+		{
+			uint64_t Value;
+			memcpy(&Value, p, sizeof(Value));
+			return Value;
+		}
+
+		inline uint32_t Hash(uint32_t sequence)
+		{
+			return (sequence * 2654435761u) >> (32 - HashBits);
+		}
+
+		inline uint8_t* WriteLength(uint8_t* op, size_t length)
+		{
+			for (; length >= 255; length -= 255) {
+				*op++ = 255;
+			}
+
+			*op++ = uint8_t(length);
+			return op;
+		}
+
+		inline uint8_t* WriteSequence(uint8_t* op, const uint8_t* literals, size_t literalLength, size_t offset, size_t matchLength)
+		{
+			const size_t MatchCode = matchLength - MinMatch;
+			uint8_t* Token = op++;
+
+			*Token = uint8_t((literalLength >= 15 ? 15 : literalLength) << 4);
+
+			if (literalLength >= 15) {
+				op = WriteLength(op, literalLength - 15);
+			}
+
+			memcpy(op, literals, literalLength);
+			op += literalLength;
+
+			// The last sequence has literals only
+			if (matchLength == 0) {
+				return op;
+			}
+
+			*op++ = uint8_t(offset);
+			*op++ = uint8_t(offset >> 8);
+
+			*Token |= uint8_t(MatchCode >= 15 ? 15 : MatchCode);
+
+			if (MatchCode >= 15) {
+				op = WriteLength(op, MatchCode - 15);
+			}
+
+			return op;
+		}
+
+		// Lengths of 15 continue in 255 byte runs, false when the input ends first
+		inline bool ReadLength(const uint8_t*& ip, const uint8_t* end, size_t& length)
+		{
+			if (length != 15) {
+				return true;
+			}
+
+			while (ip < end) {
+				const uint8_t Byte = *ip++;
+				length += Byte;
+
+				if (Byte != 255) {
+					return true;
+				}
+			}
+
+			return false;
+		}
+	}
+
+	void FieldCodec::Shuffle(const uint8_t* src, uint8_t* dst, size_t count, size_t elementBytes)
+	{
+		for (size_t b = 0; b < elementBytes; b++) {
+			uint8_t* Plane = dst + b * count;
+
+			for (size_t i = 0; i < count; i++) {
+				Plane[i] = src[i * elementBytes + b];
+			}
+		}
+	}
+
+	void FieldCodec::Unshuffle(const uint8_t* src, uint8_t* dst, size_t count, size_t elementBytes)
+	{
+		for (size_t b = 0; b < elementBytes; b++) {
+			const uint8_t* Plane = src + b * count;
+
+			for (size_t i = 0; i < count; i++) {
+				dst[i * elementBytes + b] = Plane[i];
+			}
+		}
+	}
+
+	size_t FieldCodec::CompressBound(size_t size)
+	{
+		return size + size / 255 + 16;
+	}
+
+	size_t FieldCodec::Compress(const uint8_t* src, size_t size, uint8_t* dst, std::vector<uint32_t>& table)
+	{
+		table.assign(size_t(1) << HashBits, 0);
+
+		const uint8_t* Ip = src;
+		const uint8_t* Anchor = src;
+		const uint8_t* End = src + size;
+		const uint8_t* MatchLimit = size > LastLiterals ? End - LastLiterals : src;
+		uint8_t* Op = dst;
+
+		while (Ip < MatchLimit) {
+			const uint32_t Sequence = Read32(Ip);
+			const uint32_t Slot = Hash(Sequence);
+			const uint8_t* Candidate = src + table[Slot];
+			table[Slot] = uint32_t(Ip - src);
+
+			if (Candidate >= Ip || size_t(Ip - Candidate) > MaxOffset || Read32(Candidate) != Sequence) {
+				// Skips faster the longer nothing matched, noise costs little time that way
+				Ip += 1 + (size_t(Ip - Anchor) >> 6);
+				continue;
+			}
+
+			// Eight bytes at a time while they're equal, then byte by byte
+			const uint8_t* MatchEnd = Ip + MinMatch;
+			const uint8_t* Reference = Candidate + MinMatch;
+			const uint8_t* ExtendLimit = End - 5;
+
+			while (MatchEnd + 8 <= ExtendLimit && Read64(MatchEnd) == Read64(Reference)) {
+				MatchEnd += 8;
+				Reference += 8;
+			}
+
+			while (MatchEnd < ExtendLimit && *MatchEnd == *Reference) {
+				MatchEnd++;
+				Reference++;
+			}
+
+			Op = WriteSequence(Op, Anchor, size_t(Ip - Anchor), size_t(Ip - Candidate), size_t(MatchEnd - Ip));
+			Ip = MatchEnd;
+			Anchor = Ip;
+		}
+
+		Op = WriteSequence(Op, Anchor, size_t(End - Anchor), 0, 0);
+		return size_t(Op - dst);
+	}
+
+	bool FieldCodec::Decompress(const uint8_t* src, size_t size, uint8_t* dst, size_t rawSize)
+	{
+		const uint8_t* Ip = src;
+		const uint8_t* End = src + size;
+		uint8_t* Op = dst;
+		uint8_t* OutEnd = dst + rawSize;
+
+		while (Ip < End) {
+			const uint8_t Token = *Ip++;
+			size_t LiteralLength = Token >> 4;
+
+			if (!ReadLength(Ip, End, LiteralLength) || LiteralLength > size_t(End - Ip) || LiteralLength > size_t(OutEnd - Op)) {
+				return false;
+			}
+
+			memcpy(Op, Ip, LiteralLength);
+			Ip += LiteralLength;
+			Op += LiteralLength;
+
+			if (Ip == End) {
+				break;
+			}
+
+			if (End - Ip < 2) {
+				return false;
+			}
+
+			const size_t Offset = size_t(Ip[0]) | (size_t(Ip[1]) << 8);
+			Ip += 2;
+
+			size_t MatchLength = Token & 15;
+
+			if (!ReadLength(Ip, End, MatchLength)) {
+				return false;
+			}
+
+			MatchLength += MinMatch;
+
+			if (Offset == 0 || Offset > size_t(Op - dst) || MatchLength > size_t(OutEnd - Op)) {
+				return false;
+			}
+
+			// Overlapping matches repeat the bytes they are still writing, those have to go one at a time
+			const uint8_t* Match = Op - Offset;
+
+			if (Offset >= MatchLength) {
+				memcpy(Op, Match, MatchLength);
+				Op += MatchLength;
+			}
+
+			else {
+				for (size_t i = 0; i < MatchLength; i++) {
+					*Op++ = Match[i];
+				}
+			}
+		}
+
+		return Op == OutEnd;
+	}
+}
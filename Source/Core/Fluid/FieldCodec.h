@@ -0,0 +1,33 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// Lossless compression of grid fields
+//
+// Shuffle() splits the elements into byte planes : the sign/exponent bytes of neighbouring floats are nearly equal
+// and the calm parts of a field are runs of zeros, both of which a plain LZ finds once the bytes are grouped
+// Compress() is an LZ77 in the LZ4 block layout : a token (literal length << 4 | match length - 4), the literals,
+// a 16 bit little endian offset, with 255 byte runs extending lengths of 15 and more
+// Greedy with a single hash probe, it trades ratio for a few hundred MB/s on one thread
+
+namespace Simulation
+{
+	namespace FieldCodec
+	{
+		// dst[b * count + i] = src[i * elementBytes + b]
+		void Shuffle(const uint8_t* src, uint8_t* dst, size_t count, size_t elementBytes);
+		void Unshuffle(const uint8_t* src, uint8_t* dst, size_t count, size_t elementBytes);
+
+		// Worst case output size, incompressible input only grows by its literal length runs
+		size_t CompressBound(size_t size);
+
+		// dst must hold CompressBound(size) bytes, table is the hash table kept between calls
+		// Returns the compressed size
+		size_t Compress(const uint8_t* src, size_t size, uint8_t* dst, std::vector<uint32_t>& table);
+
+		// False when the data is corrupt or doesn't decode to exactly rawSize bytes, never writes past dst + rawSize
+		bool Decompress(const uint8_t* src, size_t size, uint8_t* dst, size_t rawSize);
+	}
+}
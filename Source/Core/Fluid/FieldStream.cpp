@@ -0,0 +1,521 @@
+#include "FieldStream.h"
+#include "FieldCodec.h"
+
+#include <cstring>
+#include <chrono>
+#include <filesystem>
+
+namespace Simulation
+{
+	namespace
+	{
+		const char StreamMagic[8] = { 'E', 'U', 'L', 'S', 'T', 'R', 'M', '\0' };
+		const char IndexMagic[8] = { 'E', 'U', 'L', 'S', 'I', 'D', 'X', '\0' };
+
+		// "FRAM", marks the start of every frame so an unclosed stream can be walked
+		constexpr uint32_t FrameMagic = 0x4D415246u;
+
+		static_assert(sizeof(FieldStreamHeader) == 24, "FieldStreamHeader is written raw");
+		static_assert(sizeof(FieldStreamFrameHeader) == 16, "FieldStreamFrameHeader is written raw");
+		static_assert(sizeof(FieldStreamChunk) == 24, "FieldStreamChunk is written raw");
+		static_assert(sizeof(FieldStreamIndexEntry) == 24, "FieldStreamIndexEntry is written raw");
+		static_assert(sizeof(FieldStreamFooter) == 24, "FieldStreamFooter is written raw");
+
+		inline bool Seek(FILE* file, uint64_t offset)
+		{
+#ifdef _WIN32
+			return _fseeki64(file, int64_t(offset), SEEK_SET) == 0;
+#else
+			return fseeko(file, off_t(offset), SEEK_SET) == 0;
+#endif
+		}
+
+		template <typename T>
+		inline bool ReadRaw(FILE* file, T* data, size_t count = 1)
+		{
+			return fread(data, sizeof(T), count, file) == count;
+		}
+
+		double MillisecondsSince(std::chrono::steady_clock::time_point start)
+		{
+			return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		}
+	}
+
+	FieldStreamWriter::~FieldStreamWriter()
+	{
+		Close();
+	}
+
+	bool FieldStreamWriter::Open(const std::string& path, const FluidGrid& grid, const FieldStreamSettings& settings)
+	{
+		Close();
+
+		m_File = fopen(path.c_str(), "wb");
+
+		FieldStreamHeader Header;
+		memcpy(Header.Magic, StreamMagic, sizeof(StreamMagic));
+		Header.Version = FieldStreamVersion;
+		Header.Reserved = 0;
+		Header.Resolution = grid.GetResolution();
+		Header.Stride = grid.GetStride();
+
+		const bool Succeeded = m_File && fwrite(&Header, sizeof(Header), 1, m_File) == 1;
+
+		{
+			std::lock_guard<std::mutex> Guard(m_Mutex);
+			m_Stats = FieldStreamStats();
+			m_Stats.Failed = !Succeeded;
+		}
+
+		// Nothing to append to, the writer thread isn't started
+		if (!Succeeded) {
+			if (m_File) {
+				fclose(m_File);
+			}
+
+			m_File = nullptr;
+			return false;
+		}
+
+		m_Path = path;
+		m_Settings = settings;
+		m_Settings.QueueDepth = settings.QueueDepth < 1 ? 1 : settings.QueueDepth;
+		m_FieldSize = grid.GetFieldSize();
+		m_Offset = sizeof(Header);
+		m_Index.clear();
+
+		// Frames of another grid size are no use anymore
+		m_Free.clear();
+		m_Allocated = 0;
+
+		m_Stop = false;
+		m_Thread = std::thread(&FieldStreamWriter::ThreadLoop, this);
+
+		return true;
+	}
+
+	bool FieldStreamWriter::Close()
+	{
+		if (!m_File) {
+			return false;
+		}
+
+		{
+			std::lock_guard<std::mutex> Guard(m_Mutex);
+			m_Stop = true;
+		}
+
+		m_Condition.notify_all();
+		m_Thread.join();
+
+		FieldStreamFooter Footer;
+		Footer.IndexOffset = m_Offset;
+		Footer.FrameCount = m_Index.size();
+		memcpy(Footer.Magic, IndexMagic, sizeof(IndexMagic));
+
+		bool Succeeded = !m_Stats.Failed;
+		Succeeded = Succeeded && (m_Index.empty() || fwrite(m_Index.data(), sizeof(FieldStreamIndexEntry), m_Index.size(), m_File) == m_Index.size());
+		Succeeded = Succeeded && fwrite(&Footer, sizeof(Footer), 1, m_File) == 1;
+		Succeeded = fclose(m_File) == 0 && Succeeded;
+
+		m_File = nullptr;
+
+		std::lock_guard<std::mutex> Guard(m_Mutex);
+		m_Stats.Failed = !Succeeded;
+
+		return Succeeded;
+	}
+
+	bool FieldStreamWriter::Push(const FluidGrid& grid, uint64_t stepIndex)
+	{
+		if (!m_File || grid.GetFieldSize() != m_FieldSize) {
+			return false;
+		}
+
+		std::unique_ptr<Frame> New;
+
+		{
+			std::unique_lock<std::mutex> Guard(m_Mutex);
+
+			// Every frame is queued or being written, the disk is behind
+			if (m_Free.empty() && m_Allocated >= m_Settings.QueueDepth) {
+				if (m_Settings.DropWhenFull) {
+					m_Stats.Dropped++;
+					return false;
+				}
+
+				const auto StallStart = std::chrono::steady_clock::now();
+
+				m_Condition.wait(Guard, [this]() {
+					return !m_Free.empty();
+				});
+
+				m_Stats.Stalls++;
+				m_Stats.StallMs += MillisecondsSince(StallStart);
+			}
+
+			if (!m_Free.empty()) {
+				New = std::move(m_Free.back());
+				m_Free.pop_back();
+			}
+
+			else {
+				New = std::make_unique<Frame>();
+				m_Allocated++;
+			}
+		}
+
+		const auto CopyStart = std::chrono::steady_clock::now();
+		const size_t Size = grid.GetFieldSize();
+		size_t Count = 0;
+
+		auto AddField = [&](uint32_t id, const float* data) {
+			if (New->Fields.size() <= Count) {
+				New->Fields.emplace_back();
+				New->Ids.push_back(id);
+			}
+
+			New->Ids[Count] = id;
+			New->Fields[Count].assign(data, data + Size);
+			Count++;
+		};
+
+		New->StepIndex = stepIndex;
+
+		if (m_Settings.Velocity) {
+			AddField(CHECKPOINT_U, grid.GetU());
+			AddField(CHECKPOINT_V, grid.GetV());
+		}
+
+		if (m_Settings.Pressure) {
+			AddField(CHECKPOINT_PRESSURE, grid.GetPressure());
+		}
+
+		if (m_Settings.Scalars) {
+			for (int f = 0; f < SCALAR_COUNT; f++) {
+				AddField(CHECKPOINT_SCALAR + f, grid.GetScalar(f));
+			}
+		}
+
+		New->Ids.resize(Count);
+		New->Fields.resize(Count);
+
+		{
+			std::lock_guard<std::mutex> Guard(m_Mutex);
+			m_Stats.CopyMs += MillisecondsSince(CopyStart);
+			m_Queue.push_back(std::move(New));
+		}
+
+		m_Condition.notify_all();
+		return true;
+	}
+
+	FieldStreamStats FieldStreamWriter::GetStats() const
+	{
+		std::lock_guard<std::mutex> Guard(m_Mutex);
+		return m_Stats;
+	}
+
+	void FieldStreamWriter::ThreadLoop()
+	{
+		std::unique_lock<std::mutex> Guard(m_Mutex);
+
+		while (true) {
+			m_Condition.wait(Guard, [this]() {
+				return m_Stop || !m_Queue.empty();
+			});
+
+			// The queue is drained before stopping, Close() loses no frame
+			if (m_Queue.empty()) {
+				return;
+			}
+
+			std::unique_ptr<Frame> Next = std::move(m_Queue.front());
+			m_Queue.pop_front();
+
+			const bool Failed = m_Stats.Failed;
+
+			Guard.unlock();
+
+			// Only this thread touches the file and the scratch buffers while the stream is open
+			const uint64_t Start = m_Offset;
+
+			const bool Written = !Failed && WriteFrame(*Next);
+
+			Guard.lock();
+
+			m_Stats.Failed = !Written;
+
+			if (Written) {
+				m_Stats.Frames++;
+				m_Stats.StoredBytes += m_Offset - Start;
+				m_Stats.RawBytes += uint64_t(Next->Fields.size()) * m_FieldSize * sizeof(float);
+			}
+
+			m_Free.push_back(std::move(Next));
+
+			m_Condition.notify_all();
+		}
+	}
+
+	bool FieldStreamWriter::WriteFrame(const Frame& frame)
+	{
+		const size_t FieldBytes = m_FieldSize * sizeof(float);
+		const size_t Bound = FieldCodec::CompressBound(FieldBytes);
+		const auto CompressStart = std::chrono::steady_clock::now();
+
+		std::vector<FieldStreamChunk> Chunks(frame.Fields.size());
+		std::vector<const uint8_t*> Data(frame.Fields.size());
+
+		if (m_Settings.Compress) {
+			m_Shuffled.resize(FieldBytes);
+			m_Compressed.resize(Bound * frame.Fields.size());
+		}
+
+		for (size_t f = 0; f < frame.Fields.size(); f++) {
+			const uint8_t* Raw = reinterpret_cast<const uint8_t*>(frame.Fields[f].data());
+
+			Chunks[f].Id = frame.Ids[f];
+			Chunks[f].Codec = FIELD_CODEC_RAW;
+			Chunks[f].RawBytes = FieldBytes;
+			Chunks[f].StoredBytes = FieldBytes;
+			Data[f] = Raw;
+
+			if (!m_Settings.Compress) {
+				continue;
+			}
+
+			uint8_t* Compressed = m_Compressed.data() + f * Bound;
+			FieldCodec::Shuffle(Raw, m_Shuffled.data(), m_FieldSize, sizeof(float));
+			const size_t CompressedBytes = FieldCodec::Compress(m_Shuffled.data(), FieldBytes, Compressed, m_HashTable);
+
+			if (CompressedBytes < FieldBytes) {
+				Chunks[f].Codec = FIELD_CODEC_SHUFFLE_LZ;
+				Chunks[f].StoredBytes = CompressedBytes;
+				Data[f] = Compressed;
+			}
+		}
+
+		const double CompressMs = m_Settings.Compress ? MillisecondsSince(CompressStart) : 0.0;
+		const auto WriteStart = std::chrono::steady_clock::now();
+
+		FieldStreamFrameHeader Header;
+		Header.Magic = FrameMagic;
+		Header.FieldCount = uint32_t(Chunks.size());
+		Header.StepIndex = frame.StepIndex;
+
+		bool Succeeded = fwrite(&Header, sizeof(Header), 1, m_File) == 1;
+		Succeeded = Succeeded && (Chunks.empty() || fwrite(Chunks.data(), sizeof(FieldStreamChunk), Chunks.size(), m_File) == Chunks.size());
+
+		uint64_t Bytes = sizeof(Header) + Chunks.size() * sizeof(FieldStreamChunk);
+
+		for (size_t f = 0; f < Chunks.size(); f++) {
+			Succeeded = Succeeded && fwrite(Data[f], 1, size_t(Chunks[f].StoredBytes), m_File) == size_t(Chunks[f].StoredBytes);
+			Bytes += Chunks[f].StoredBytes;
+		}
+
+		const double WriteMs = MillisecondsSince(WriteStart);
+
+		if (Succeeded) {
+			FieldStreamIndexEntry Entry;
+			Entry.StepIndex = frame.StepIndex;
+			Entry.Offset = m_Offset;
+			Entry.Bytes = Bytes;
+			m_Index.push_back(Entry);
+			m_Offset += Bytes;
+		}
+
+		std::lock_guard<std::mutex> Guard(m_Mutex);
+		m_Stats.CompressMs += CompressMs;
+		m_Stats.WriteMs += WriteMs;
+
+		return Succeeded;
+	}
+
+	FieldStreamReader::~FieldStreamReader()
+	{
+		Close();
+	}
+
+	bool FieldStreamReader::Open(const std::string& path)
+	{
+		Close();
+
+		std::error_code Error;
+		const uint64_t Size = std::filesystem::file_size(path, Error);
+
+		m_File = Error ? nullptr : fopen(path.c_str(), "rb");
+
+		if (!m_File) {
+			return false;
+		}
+
+		if (!ReadRaw(m_File, &m_Header) || memcmp(m_Header.Magic, StreamMagic, sizeof(StreamMagic)) != 0 || m_Header.Version != FieldStreamVersion
+			|| m_Header.Resolution < 1 || m_Header.Stride < int64_t(m_Header.Resolution) + 2) {
+			Close();
+			return false;
+		}
+
+		// The index of a closed stream ends exactly at the footer
+		// Both counts are bounded by the file size before they are multiplied, so the sum can't wrap around
+		FieldStreamFooter Footer;
+
+		if (Size >= sizeof(FieldStreamHeader) + sizeof(Footer) && Seek(m_File, Size - sizeof(Footer)) && ReadRaw(m_File, &Footer)
+			&& memcmp(Footer.Magic, IndexMagic, sizeof(IndexMagic)) == 0
+			&& Footer.IndexOffset <= Size - sizeof(Footer)
+			&& Footer.FrameCount <= (Size - sizeof(Footer) - Footer.IndexOffset) / sizeof(FieldStreamIndexEntry)
+			&& Footer.IndexOffset + Footer.FrameCount * sizeof(FieldStreamIndexEntry) + sizeof(Footer) == Size) {
+			m_Index.resize(size_t(Footer.FrameCount));
+
+			if (Seek(m_File, Footer.IndexOffset) && (m_Index.empty() || ReadRaw(m_File, m_Index.data(), m_Index.size()))) {
+				bool Valid = Footer.IndexOffset >= sizeof(FieldStreamHeader);
+
+				for (const FieldStreamIndexEntry& Entry : m_Index) {
+					Valid = Valid && Entry.Offset >= sizeof(FieldStreamHeader) && Entry.Offset <= Footer.IndexOffset
+						&& Entry.Bytes >= sizeof(FieldStreamFrameHeader) && Entry.Bytes <= Footer.IndexOffset - Entry.Offset;
+				}
+
+				if (Valid) {
+					return true;
+				}
+			}
+
+			m_Index.clear();
+		}
+
+		// Interrupted stream, every complete frame is still readable
+		uint64_t Offset = sizeof(FieldStreamHeader);
+		std::vector<FieldStreamChunk> Chunks;
+
+		while (Offset + sizeof(FieldStreamFrameHeader) <= Size) {
+			FieldStreamFrameHeader Header;
+
+			if (!Seek(m_File, Offset) || !ReadRaw(m_File, &Header) || Header.Magic != FrameMagic) {
+				break;
+			}
+
+			// The counts come from the file, a chunk table or chunk past its end is a torn or corrupt frame
+			const uint64_t Remaining = Size - Offset - sizeof(Header);
+
+			if (Header.FieldCount > Remaining / sizeof(FieldStreamChunk)) {
+				break;
+			}
+
+			Chunks.resize(Header.FieldCount);
+
+			if (!Chunks.empty() && !ReadRaw(m_File, Chunks.data(), Chunks.size())) {
+				break;
+			}
+
+			uint64_t Bytes = sizeof(Header) + Chunks.size() * sizeof(FieldStreamChunk);
+			bool Complete = true;
+
+			for (const FieldStreamChunk& Chunk : Chunks) {
+				Complete = Complete && Chunk.StoredBytes <= Size - Offset - Bytes;
+				Bytes += Complete ? Chunk.StoredBytes : 0;
+			}
+
+			if (!Complete) {
+				break;
+			}
+
+			FieldStreamIndexEntry Entry;
+			Entry.StepIndex = Header.StepIndex;
+			Entry.Offset = Offset;
+			Entry.Bytes = Bytes;
+			m_Index.push_back(Entry);
+
+			Offset += Bytes;
+		}
+
+		return true;
+	}
+
+	void FieldStreamReader::Close()
+	{
+		if (m_File) {
+			fclose(m_File);
+		}
+
+		m_File = nullptr;
+		m_Header = FieldStreamHeader {};
+		m_Index.clear();
+	}
+
+	bool FieldStreamReader::ReadField(int frame, uint32_t id, std::vector<float>& field)
+	{
+		if (!m_File || frame < 0 || frame >= GetFrameCount()) {
+			return false;
+		}
+
+		const FieldStreamIndexEntry& Entry = m_Index[frame];
+		FieldStreamFrameHeader Header;
+
+		if (!Seek(m_File, Entry.Offset) || !ReadRaw(m_File, &Header) || Header.Magic != FrameMagic) {
+			return false;
+		}
+
+		// Nothing read from the frame may reach past its Bytes, Open() checked those against the file size
+		if (Header.FieldCount > (Entry.Bytes - sizeof(Header)) / sizeof(FieldStreamChunk)) {
+			return false;
+		}
+
+		std::vector<FieldStreamChunk> Chunks(Header.FieldCount);
+
+		if (!Chunks.empty() && !ReadRaw(m_File, Chunks.data(), Chunks.size())) {
+			return false;
+		}
+
+		const uint64_t FieldBytes = uint64_t(m_Header.Stride) * uint64_t(m_Header.Resolution + 2) * sizeof(float);
+		uint64_t Used = sizeof(Header) + Chunks.size() * sizeof(FieldStreamChunk);
+
+		for (const FieldStreamChunk& Chunk : Chunks) {
+			if (Chunk.StoredBytes > Entry.Bytes - Used) {
+				return false;
+			}
+
+			const uint64_t Offset = Entry.Offset + Used;
+			Used += Chunk.StoredBytes;
+
+			if (Chunk.Id != id) {
+				continue;
+			}
+
+			if (Chunk.RawBytes != FieldBytes || !Seek(m_File, Offset)) {
+				return false;
+			}
+
+			m_Stored.resize(size_t(Chunk.StoredBytes));
+			field.resize(size_t(Chunk.RawBytes / sizeof(float)));
+
+			if (!m_Stored.empty() && !ReadRaw(m_File, m_Stored.data(), m_Stored.size())) {
+				return false;
+			}
+
+			if (Chunk.Codec == FIELD_CODEC_RAW) {
+				if (Chunk.StoredBytes != Chunk.RawBytes) {
+					return false;
+				}
+
+				memcpy(field.data(), m_Stored.data(), m_Stored.size());
+				return true;
+			}
+
+			if (Chunk.Codec != FIELD_CODEC_SHUFFLE_LZ) {
+				return false;
+			}
+
+			m_Shuffled.resize(size_t(Chunk.RawBytes));
+
+			if (!FieldCodec::Decompress(m_Stored.data(), m_Stored.size(), m_Shuffled.data(), m_Shuffled.size())) {
+				return false;
+			}
+
+			FieldCodec::Unshuffle(m_Shuffled.data(), reinterpret_cast<uint8_t*>(field.data()), field.size(), sizeof(float));
+			return true;
+		}
+
+		return false;
+	}
+}
@@ -0,0 +1,203 @@
+#pragma once
+
+#include "FluidGrid.h"
+#include "Checkpoint.h"
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdint>
+
+// Field output of a running simulation, one frame every few steps, for offline analysis
+//
+// [FieldStreamHeader] then the frames back to back, each [FieldStreamFrameHeader][FieldStreamChunk x FieldCount] and the chunk data
+// Closing the stream appends the frame index ([FieldStreamIndexEntry x FrameCount][FieldStreamFooter]) so a frame can be read
+// without walking the file; a stream that was never closed has no index and is read by walking the frames instead
+// The fields are the grid's padded layout with the checkpoint ids (CHECKPOINT_U, CHECKPOINT_SCALAR + f, ...)
+
+namespace Simulation
+{
+	constexpr uint32_t FieldStreamVersion = 1;
+
+	enum FieldStreamCodec : uint32_t {
+		FIELD_CODEC_RAW = 0,
+
+		// FieldCodec::Shuffle() over the floats then FieldCodec::Compress()
+		FIELD_CODEC_SHUFFLE_LZ
+	};
+
+	struct FieldStreamHeader
+	{
+		char Magic[8];
+		uint32_t Version;
+		uint32_t Reserved;
+		int32_t Resolution;
+		int32_t Stride;
+	};
+
+	struct FieldStreamFrameHeader
+	{
+		uint32_t Magic;
+		uint32_t FieldCount;
+		uint64_t StepIndex;
+	};
+
+	struct FieldStreamChunk
+	{
+		uint32_t Id;
+		uint32_t Codec;
+		uint64_t RawBytes;
+		uint64_t StoredBytes;
+	};
+
+	struct FieldStreamIndexEntry
+	{
+		uint64_t StepIndex;
+		uint64_t Offset;
+		uint64_t Bytes;
+	};
+
+	struct FieldStreamFooter
+	{
+		uint64_t IndexOffset;
+		uint64_t FrameCount;
+		char Magic[8];
+	};
+
+	struct FieldStreamSettings
+	{
+		bool Velocity = true;
+		bool Pressure = true;
+		bool Scalars = true;
+
+		// Shuffle + LZ on the writer thread, fields that don't shrink are stored raw anyway
+		bool Compress = false;
+
+		// Frames allocated for the queue, the one being copied and the one being written included
+		int QueueDepth = 4;
+
+		// A full queue drops the frame instead of blocking the step until the writer catches up
+		bool DropWhenFull = false;
+	};
+
+	struct FieldStreamStats
+	{
+		int Frames = 0;
+		int Dropped = 0;
+
+		// Pushes that found every frame of the pool queued, and the time they waited for one
+		int Stalls = 0;
+		double StallMs = 0.0;
+
+		// Copy time on the pushing side, compression and write time on the writer thread
+		double CopyMs = 0.0;
+		double CompressMs = 0.0;
+		double WriteMs = 0.0;
+
+		uint64_t RawBytes = 0;
+		uint64_t StoredBytes = 0;
+
+		bool Failed = false;
+	};
+
+	// Streams frames to disk from a thread of its own
+	// Push() copies the fields into a pooled frame and returns, the writer compresses and appends it
+	// The pool is bounded, when the disk can't keep up Push() waits for a frame to come back (a stall) or drops the new one
+	class FieldStreamWriter
+	{
+	public :
+
+		FieldStreamWriter() = default;
+		~FieldStreamWriter();
+
+		FieldStreamWriter(const FieldStreamWriter&) = delete;
+		FieldStreamWriter operator=(FieldStreamWriter const&) = delete;
+
+		// Truncates path, closes the stream that was open first
+		bool Open(const std::string& path, const FluidGrid& grid, const FieldStreamSettings& settings);
+
+		// Writes what is queued and the frame index, returns false when any write failed
+		bool Close();
+
+		// The grid must have the resolution the stream was opened with, returns false when the frame was dropped
+		bool Push(const FluidGrid& grid, uint64_t stepIndex);
+
+		inline bool IsOpen() const { return m_File != nullptr; }
+		inline const std::string& GetPath() const { return m_Path; }
+
+		// Safe to call from any thread
+		FieldStreamStats GetStats() const;
+
+	private :
+
+		struct Frame
+		{
+			uint64_t StepIndex = 0;
+			std::vector<uint32_t> Ids;
+			std::vector<std::vector<float>> Fields;
+		};
+
+		void ThreadLoop();
+		bool WriteFrame(const Frame& frame);
+
+		std::string m_Path;
+		FILE* m_File = nullptr;
+		FieldStreamSettings m_Settings;
+		size_t m_FieldSize = 0;
+		uint64_t m_Offset = 0;
+		std::vector<FieldStreamIndexEntry> m_Index;
+
+		// Writer thread scratch
+		std::vector<uint8_t> m_Shuffled;
+		std::vector<uint8_t> m_Compressed;
+		std::vector<uint32_t> m_HashTable;
+
+		mutable std::mutex m_Mutex;
+		std::condition_variable m_Condition;
+		std::thread m_Thread;
+		bool m_Stop = false;
+
+		std::vector<std::unique_ptr<Frame>> m_Free;
+		std::deque<std::unique_ptr<Frame>> m_Queue;
+		int m_Allocated = 0;
+		FieldStreamStats m_Stats;
+	};
+
+	// Random access to the frames of a stream file
+	class FieldStreamReader
+	{
+	public :
+
+		FieldStreamReader() = default;
+		~FieldStreamReader();
+
+		FieldStreamReader(const FieldStreamReader&) = delete;
+		FieldStreamReader operator=(FieldStreamReader const&) = delete;
+
+		// Reads the frame index, or rebuilds it from the frames when the stream wasn't closed
+		bool Open(const std::string& path);
+		void Close();
+
+		inline bool IsOpen() const { return m_File != nullptr; }
+		inline int GetResolution() const { return m_Header.Resolution; }
+		inline int GetStride() const { return m_Header.Stride; }
+		inline int GetFrameCount() const { return int(m_Index.size()); }
+		inline uint64_t GetStepIndex(int frame) const { return m_Index[frame].StepIndex; }
+
+		// Decodes one field of a frame into grid layout, false when the frame has no such field or is corrupt
+		bool ReadField(int frame, uint32_t id, std::vector<float>& field);
+
+	private :
+
+		FILE* m_File = nullptr;
+		FieldStreamHeader m_Header {};
+		std::vector<FieldStreamIndexEntry> m_Index;
+		std::vector<uint8_t> m_Stored;
+		std::vector<uint8_t> m_Shuffled;
+	};
+}
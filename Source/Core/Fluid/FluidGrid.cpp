@@ -0,0 +1,240 @@
+#include "FluidGrid.h"
+
+#include <cstring>
+#include <utility>
+
+#include "../Utils/AlignedAlloc.h"
+
+namespace Simulation
+{
+	FluidGrid::FluidGrid(int resolution)
+	{
+		const int FloatsPerLine = int(FieldAlignment / sizeof(float));
+
+		m_Resolution = resolution;
+		m_Stride = ((resolution + 2 + FloatsPerLine - 1) / FloatsPerLine) * FloatsPerLine;
+
+		m_U = AlignedAlloc<float>(GetFieldSize());
+		m_V = AlignedAlloc<float>(GetFieldSize());
+		m_BackU = AlignedAlloc<float>(GetFieldSize());
+		m_BackV = AlignedAlloc<float>(GetFieldSize());
+		m_Pressure = AlignedAlloc<float>(GetFieldSize());
+
+		for (int f = 0; f < SCALAR_COUNT; f++) {
+			m_Scalars[f] = AlignedAlloc<float>(GetFieldSize());
+			m_BackScalars[f] = AlignedAlloc<float>(GetFieldSize());
+		}
+
+		m_Solid = AlignedAlloc<uint8_t>(GetFieldSize());
+		m_Faces = AlignedAlloc<uint8_t>(GetFieldSize());
+		m_InvWeight = AlignedAlloc<float>(GetFieldSize());
+
+		memset(m_Faces, 0, GetFieldSize() * sizeof(uint8_t));
+
+		ClearObstacles();
+		Reset();
+		UpdateFaceWeights();
+	}
+
+	FluidGrid::~FluidGrid()
+	{
+		AlignedFree(m_U);
+		AlignedFree(m_V);
+		AlignedFree(m_BackU);
+		AlignedFree(m_BackV);
+		AlignedFree(m_Pressure);
+
+		for (int f = 0; f < SCALAR_COUNT; f++) {
+			AlignedFree(m_Scalars[f]);
+			AlignedFree(m_BackScalars[f]);
+		}
+
+		AlignedFree(m_Solid);
+		AlignedFree(m_Faces);
+		AlignedFree(m_InvWeight);
+	}
+
+	void FluidGrid::Reset()
+	{
+		memset(m_U, 0, GetFieldSize() * sizeof(float));
+		memset(m_V, 0, GetFieldSize() * sizeof(float));
+		memset(m_BackU, 0, GetFieldSize() * sizeof(float));
+		memset(m_BackV, 0, GetFieldSize() * sizeof(float));
+		memset(m_Pressure, 0, GetFieldSize() * sizeof(float));
+
+		for (int f = 0; f < SCALAR_COUNT; f++) {
+			memset(m_Scalars[f], 0, GetFieldSize() * sizeof(float));
+			memset(m_BackScalars[f], 0, GetFieldSize() * sizeof(float));
+		}
+	}
+
+	void FluidGrid::SwapVelocities()
+	{
+		std::swap(m_U, m_BackU);
+		std::swap(m_V, m_BackV);
+	}
+
+	void FluidGrid::SwapScalars(int count)
+	{
+		for (int f = 0; f < count; f++) {
+			std::swap(m_Scalars[f], m_BackScalars[f]);
+		}
+	}
+
+	void FluidGrid::ClearObstacles()
+	{
+		// Border and row padding are solid
+		memset(m_Solid, 1, GetFieldSize() * sizeof(uint8_t));
+
+		for (int y = 0; y < m_Resolution; y++) {
+			memset(m_Solid + Index(0, y), 0, m_Resolution * sizeof(uint8_t));
+		}
+
+		m_DirtyCells.clear();
+		m_FullRebuild = true;
+	}
+
+	void FluidGrid::SetSolid(int x, int y, bool solid)
+	{
+		if (x < 0 || x >= m_Resolution || y < 0 || y >= m_Resolution) {
+			return;
+		}
+
+		const int i = Index(x, y);
+
+		if ((m_Solid[i] != 0) == solid) {
+			return;
+		}
+
+		m_Solid[i] = solid ? 1 : 0;
+
+		if (m_FullRebuild) {
+			return;
+		}
+
+		// Touching the neighbours of that many cells costs about as much as one pass over the grid
+		if (m_DirtyCells.size() >= GetFieldSize() / 8) {
+			m_DirtyCells.clear();
+			m_FullRebuild = true;
+			return;
+		}
+
+		m_DirtyCells.push_back(i);
+	}
+
+	void FluidGrid::UpdateFaceWeights()
+	{
+		m_ChangedCells.clear();
+		m_LastUpdateFull = m_FullRebuild;
+
+		if (m_FullRebuild) {
+			const int Size = int(GetFieldSize());
+
+			for (int i = 0; i < Size; i++) {
+				RebuildCell(i);
+			}
+		}
+
+		else {
+			// A cell flipping opens/closes the shared face of each neighbour as well
+			// Later rebuilds of a cell see the same solid mask, so each changed cell is only listed once
+			for (int i : m_DirtyCells) {
+				for (int Cell : { i, i - 1, i + 1, i - m_Stride, i + m_Stride }) {
+					if (RebuildCell(Cell)) {
+						m_ChangedCells.push_back(Cell);
+					}
+				}
+			}
+		}
+
+		m_DirtyCells.clear();
+		m_FullRebuild = false;
+		m_ObstacleVersion++;
+	}
+
+	bool FluidGrid::RebuildCell(int i)
+	{
+		const uint8_t Previous = m_Faces[i];
+		m_ActiveCells -= Previous != 0;
+
+		// Fluid cells are never on the border so their neighbours are always inside the field
+		if (m_Solid[i]) {
+			m_Faces[i] = 0;
+			m_InvWeight[i] = 0.0f;
+			return Previous != 0;
+		}
+
+		uint8_t Faces = 0;
+		int Open = 0;
+
+		if (!m_Solid[i - 1]) { Faces |= FACE_LEFT; Open++; }
+		if (!m_Solid[i + 1]) { Faces |= FACE_RIGHT; Open++; }
+		if (!m_Solid[i - m_Stride]) { Faces |= FACE_BOTTOM; Open++; }
+		if (!m_Solid[i + m_Stride]) { Faces |= FACE_TOP; Open++; }
+
+		m_Faces[i] = Faces;
+		m_InvWeight[i] = Open > 0 ? 1.0f / float(Open) : 0.0f;
+		m_ActiveCells += Faces != 0;
+		return Faces != Previous;
+	}
+
+	bool FluidGrid::IsObstacle(int x, int y, Directions dir) const
+	{
+		static const glm::ivec2 Offsets[4] = {
+			glm::ivec2(0,1), glm::ivec2(0,-1), glm::ivec2(-1,0), glm::ivec2(1,0)
+		};
+
+		const int nx = x + Offsets[int(dir)].x;
+		const int ny = y + Offsets[int(dir)].y;
+
+		if (nx < -1 || nx > m_Resolution || ny < -1 || ny > m_Resolution) {
+			return true;
+		}
+
+		return m_Solid[Index(nx, ny)] != 0;
+	}
+
+	float FluidGrid::GetVelocity(int x, int y, Directions dir) const
+	{
+		const glm::ivec3 References[4] = {
+			  glm::ivec3(0,1,1),
+			  glm::ivec3(0,0,1),
+			  glm::ivec3(0,0,0),
+			  glm::ivec3(1,0,0)
+		};
+
+		if (int(dir) < 0 || int(dir) > 3) {
+			throw "WTFFF";
+		}
+
+		const auto& r = References[int(dir)];
+		const float* Field = r.z == 0 ? m_U : m_V;
+		return Field[Index(x + r.x, y + r.y)];
+	}
+
+	float& FluidGrid::GetVelocityRef(int x, int y, Directions dir)
+	{
+		const glm::ivec3 References[4] = {
+			  glm::ivec3(0,1,1),
+			  glm::ivec3(0,0,1),
+			  glm::ivec3(0,0,0),
+			  glm::ivec3(1,0,0)
+		};
+
+		if (int(dir) < 0 || int(dir) > 3) {
+			throw "WTFFF";
+		}
+
+		glm::ivec3 r = References[int(dir)];
+		float* Field = r.z == 0 ? m_U : m_V;
+		return Field[Index(x + r.x, y + r.y)];
+	}
+
+	float GetDirectionSign(Directions dir)
+	{
+		if (dir == Directions::DOWN || dir == Directions::LEFT) {
+			return -1.;
+		}
+		return 1.;
+	}
+}
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <glm/glm.hpp>
+
+namespace Simulation
+{
+	enum Directions : uint8_t {
+		UP = 0,
+		DOWN,
+		LEFT,
+		RIGHT
+	};
+
+	// Bits of the per cell face mask, a face is open when the cells on both sides of it are fluid
+	enum FaceBits : uint8_t {
+		FACE_LEFT = 1 << 0,
+		FACE_RIGHT = 1 << 1,
+		FACE_BOTTOM = 1 << 2,
+		FACE_TOP = 1 << 3
+	};
+
+	// Passive cell centred fields, carried along by advection without acting back on the flow
+	enum ScalarField : int {
+		SCALAR_DYE = 0,
+		SCALAR_TEMPERATURE,
+		SCALAR_COUNT
+	};
+
+	// Owns the MAC grid state of the simulation
+	// Has no dependency on the window/GL context so it can be stepped headless
+	//
+	// Every field is a separate 64 byte aligned array and they all share one padded layout :
+	// (Resolution + 2) rows of m_Stride floats, with a one cell border around the domain
+	// m_Stride is rounded up to a whole number of cache lines so every row starts aligned
+	//
+	// U[Index(x, y)] -> Velocity on the left face of cell (x, y)
+	// V[Index(x, y)] -> Velocity on the bottom face of cell (x, y)
+	// Scalar(f)[Index(x, y)] -> Value of scalar field f at the centre of cell (x, y)
+	//
+	// Obstacles live in the Solid mask, the solver never looks at it directly but at two fields derived from it :
+	// Faces[i]     -> FaceBits of the open faces of cell i, 0 for solid cells
+	// InvWeight[i] -> 1 / number of open faces, 0 for solid or fully enclosed cells
+	// Both are rebuilt by UpdateFaceWeights(), only around the cells that changed since the last call
+	class FluidGrid
+	{
+	public :
+
+		FluidGrid(int resolution);
+		~FluidGrid();
+
+		FluidGrid(const FluidGrid&) = delete;
+		FluidGrid operator=(FluidGrid const&) = delete;
+
+		// Zeroes velocities, pressure and scalars, interior obstacles are kept
+		void Reset();
+
+		// Marks/clears an interior obstacle, the border is always solid
+		void SetSolid(int x, int y, bool solid);
+		inline bool IsSolid(int x, int y) const { return m_Solid[Index(x, y)] != 0; }
+
+		// Removes every interior obstacle
+		void ClearObstacles();
+
+		// Rebuilds the face mask and weights around the cells touched by SetSolid() since the last call
+		void UpdateFaceWeights();
+		inline bool HasDirtyObstacles() const { return m_FullRebuild || !m_DirtyCells.empty(); }
+
+		// Cells with at least one open face, the ones the pressure solvers work on
+		inline int GetActiveCellCount() const { return m_ActiveCells; }
+
+		// Bumped by every UpdateFaceWeights(), lets derived data (solver hierarchies) know when to rebuild
+		inline uint64_t GetObstacleVersion() const { return m_ObstacleVersion; }
+
+		// Cells whose face mask the last UpdateFaceWeights() changed, derived data one version behind only has to update those
+		// Not tracked when that update rebuilt the whole grid, IsLastUpdateFull() tells
+		inline const std::vector<int>& GetChangedCells() const { return m_ChangedCells; }
+		inline bool IsLastUpdateFull() const { return m_LastUpdateFull; }
+
+		// Domain coordinates, -1 and Resolution address the border
+		inline int Index(int x, int y) const {
+			return ((y + 1) * m_Stride) + (x + 1);
+		}
+
+		// Is the cell next to (x, y) in that direction solid
+		bool IsObstacle(int x, int y, Directions dir) const;
+
+		// Gets velocity at a particular direction
+		// Assume velocity is at the border of a square
+		float GetVelocity(int x, int y, Directions dir) const;
+		float& GetVelocityRef(int x, int y, Directions dir);
+
+		inline int GetResolution() const { return m_Resolution; }
+		inline int GetStride() const { return m_Stride; }
+		inline int GetRows() const { return m_Resolution + 2; }
+
+		// Element count of one field including the border and row padding
+		inline size_t GetFieldSize() const { return size_t(m_Stride) * size_t(m_Resolution + 2); }
+
+		inline float* GetU() { return m_U; }
+		inline float* GetV() { return m_V; }
+
+		// Write targets of stages that can't update the velocities in place (advection), SwapVelocities() publishes them
+		inline float* GetBackU() { return m_BackU; }
+		inline float* GetBackV() { return m_BackV; }
+		void SwapVelocities();
+
+		inline float* GetScalar(int field) { return m_Scalars[field]; }
+		inline float* GetBackScalar(int field) { return m_BackScalars[field]; }
+		inline const float* GetScalar(int field) const { return m_Scalars[field]; }
+		void SwapScalars(int count = SCALAR_COUNT);
+
+		inline float* GetPressure() { return m_Pressure; }
+
+		inline const float* GetU() const { return m_U; }
+		inline const float* GetV() const { return m_V; }
+		inline const float* GetPressure() const { return m_Pressure; }
+		inline const uint8_t* GetSolid() const { return m_Solid; }
+		inline const uint8_t* GetFaces() const { return m_Faces; }
+		inline const float* GetInvWeight() const { return m_InvWeight; }
+
+	private :
+
+		int m_Resolution = 0;
+		int m_Stride = 0;
+
+		float* m_U = nullptr;
+		float* m_V = nullptr;
+		float* m_BackU = nullptr;
+		float* m_BackV = nullptr;
+		float* m_Pressure = nullptr;
+
+		float* m_Scalars[SCALAR_COUNT] = {};
+		float* m_BackScalars[SCALAR_COUNT] = {};
+
+		// 1 -> Solid, 0 -> Fluid
+		uint8_t* m_Solid = nullptr;
+
+		uint8_t* m_Faces = nullptr;
+		float* m_InvWeight = nullptr;
+
+		// Cells whose solid flag changed, past a certain count the whole grid is rebuilt instead
+		std::vector<int> m_DirtyCells;
+		bool m_FullRebuild = true;
+		uint64_t m_ObstacleVersion = 0;
+		int m_ActiveCells = 0;
+
+		std::vector<int> m_ChangedCells;
+		bool m_LastUpdateFull = true;
+
+		// Returns whether the face mask of the cell changed
+		bool RebuildCell(int i);
+	};
+
+	float GetDirectionSign(Directions dir);
+
+	// Cell width in world units the stages can divide by, rejects 0, negative and NaN
+	inline bool IsValidSpacing(float spacing) { return spacing > 0.0f; }
+}
@@ -0,0 +1,739 @@
+#include "FluidSolver.h"
+
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <thread>
+
+#include "../Utils/Timer.h"
+
+namespace Simulation
+{
+	FluidSolver::FluidSolver(FluidGrid& grid) : m_Grid(grid)
+	{
+		SetKernelISA(Kernels::DetectISA());
+		m_Activity.Resize(grid.GetResolution(), Parameters.ActivityTileSize);
+	}
+
+	void FluidSolver::SetKernelISA(KernelISA isa)
+	{
+		if (!Kernels::IsSupported(isa)) {
+			isa = KernelISA::Scalar;
+		}
+
+		m_KernelISA = isa;
+		m_Kernels = &Kernels::Get(isa);
+	}
+
+	KernelRow FluidSolver::GetKernelRow(int x, int y, int count)
+	{
+		const int Base = m_Grid.Index(x, y);
+
+		KernelRow Row;
+		Row.U = m_Grid.GetU() + Base;
+		Row.V = m_Grid.GetV() + Base;
+		Row.Pressure = m_Grid.GetPressure() + Base;
+		Row.Solid = m_Grid.GetSolid() + Base;
+		Row.Faces = m_Grid.GetFaces() + Base;
+		Row.InvWeight = m_Grid.GetInvWeight() + Base;
+		Row.Stride = m_Grid.GetStride();
+		Row.Count = count;
+		return Row;
+	}
+
+	template <typename F>
+	void FluidSolver::ForEachRowOfParity(int rowParity, const F& fn)
+	{
+		const int Resolution = m_Grid.GetResolution();
+		const int RowCount = (Resolution - rowParity + 1) / 2;
+
+		m_Pool.Run([&](int index, int threads) {
+			int Begin, End;
+			ThreadPool::GetChunk(0, RowCount, index, threads, Begin, End);
+
+			float* Scratch = m_Scratch[index].data();
+
+			for (int i = Begin; i < End; i++) {
+				fn(rowParity + 2 * i, Scratch);
+			}
+		});
+	}
+
+	void FluidSolver::Step(float dt)
+	{
+		// Advection divides by the spacing, parameters from the UI or a replayed recording can hold anything
+		if (dt <= 0.0f || !IsValidSpacing(Parameters.GridSpacing)) {
+			return;
+		}
+
+		m_Pool.SetThreadCount(Parameters.Threads);
+
+		if (m_Grid.HasDirtyObstacles()) {
+			m_Grid.UpdateFaceWeights();
+			m_Activity.WakeAll();
+		}
+
+		// Tiles at rest only get their back buffers synced on the way there, a scalar joining the sweep needs that for every tile
+		if (Parameters.ScalarFields != m_ScalarFields) {
+			m_ScalarFields = Parameters.ScalarFields;
+			m_Activity.WakeAll();
+		}
+
+		const size_t ScratchSize = size_t(m_Grid.GetResolution()) + 2;
+
+		if (m_Scratch.size() != size_t(m_Pool.GetThreadCount()) || m_Scratch[0].size() != ScratchSize) {
+			m_Scratch.assign(m_Pool.GetThreadCount(), std::vector<float>(ScratchSize, 0.0f));
+		}
+
+		m_RowMax.resize(m_Grid.GetResolution());
+		m_RowSums.resize(m_Grid.GetResolution());
+
+		Blocks::Timer StageTimer;
+
+		// Bodies move before the activity update so it measures the tiles they touched
+		// Only the cells they swept get their faces rebuilt, the rest of the grid stays asleep
+		StageTimer.Start();
+
+		if (!m_Bodies.IsEmpty()) {
+			m_Bodies.Move(m_Grid, m_Activity, dt, Parameters.Gravity, Parameters.DensityWater, Parameters.GridSpacing);
+
+			if (m_Grid.HasDirtyObstacles()) {
+				m_Grid.UpdateFaceWeights();
+			}
+		}
+
+		m_Stats.BodiesMs = StageTimer.End();
+
+		StageTimer.Start();
+
+		const bool ActivityChanged = m_Activity.GetResolution() != m_Grid.GetResolution() ||
+			m_Activity.GetTileSize() != std::max(1, std::min(Parameters.ActivityTileSize, m_Grid.GetResolution()));
+
+		// The global solvers need forces and advection on the whole domain, gravity left out of the tiles at rest would act as a source
+		const bool TrackActivity = Parameters.TrackActivity && UsesRelaxation();
+
+		// Resizing leaves every tile active, which is also what turning the tracking off needs
+		if (ActivityChanged || (!TrackActivity && m_Activity.GetActiveTileCount() != m_Activity.GetTileCount())) {
+			m_Activity.Resize(m_Grid.GetResolution(), Parameters.ActivityTileSize);
+		}
+
+		if (TrackActivity) {
+			m_Activity.Update(m_Grid, m_Pool, Parameters.ActivityThreshold);
+		}
+
+		m_Stats.ActivityMs = StageTimer.End();
+		m_Stats.ActiveTiles = m_Activity.GetActiveTileCount();
+		m_Stats.TotalTiles = m_Activity.GetTileCount();
+
+		StageTimer.Start();
+		ApplyForces(dt);
+		m_Stats.ForcesMs = StageTimer.End();
+
+		StageTimer.Start();
+
+		if (Parameters.Advection) {
+			Advect(dt);
+		}
+
+		m_Stats.AdvectionMs = StageTimer.End();
+
+		StageTimer.Start();
+		Project(dt);
+		m_Stats.ProjectionMs = StageTimer.End();
+
+		if (!m_Bodies.IsEmpty()) {
+			StageTimer.Start();
+			m_Bodies.GatherForces(m_Grid, Parameters.GridSpacing);
+			m_Stats.BodiesMs += StageTimer.End();
+		}
+
+		m_Stats.TotalMs = m_Stats.BodiesMs + m_Stats.ActivityMs + m_Stats.ForcesMs + m_Stats.AdvectionMs + m_Stats.ProjectionMs;
+	}
+
+	void FluidSolver::ApplyForces(float dt)
+	{
+		const int Resolution = m_Grid.GetResolution();
+		const float Acceleration = Parameters.Gravity * dt * -1.;
+		float* V = m_Grid.GetV();
+		const uint8_t* Faces = m_Grid.GetFaces();
+
+		const bool Confinement = Parameters.VorticityConfinement > 0.0f;
+		const float ConfinementScale = Parameters.VorticityConfinement * dt;
+
+		// The confinement force of a face depends on the curl of the cells around it, so the curl has to be complete first
+		if (Confinement) {
+			ComputeCurl();
+		}
+
+		// Every vertical face is the bottom face of exactly one cell, faces touching a solid (the floor included) don't move
+		// Confinement moves the left and bottom faces of each cell in the same span, while they are still in cache
+		Tiling::ParallelForEachTile(m_Pool, Resolution, Resolution, Parameters.TileSize, [&](const Tile& T, int) {
+			for (int y = T.Y0; y < T.Y1; y++) {
+				m_Activity.ForEachActiveSpan(y, T.X0, T.X1, [&](int Begin, int End) {
+					const int Base = m_Grid.Index(Begin, y);
+					m_Kernels->AddOpenFaces(V + Base, Faces + Base, FACE_BOTTOM, End - Begin, Acceleration);
+
+					if (Confinement) {
+						m_Kernels->ConfinementRow(GetKernelRow(Begin, y, End - Begin), m_Curl.data() + Base, ConfinementScale);
+					}
+				});
+			}
+		});
+	}
+
+	void FluidSolver::ComputeCurl()
+	{
+		const int Resolution = m_Grid.GetResolution();
+
+		if (m_Curl.size() != m_Grid.GetFieldSize()) {
+			m_Curl.assign(m_Grid.GetFieldSize(), 0.0f);
+		}
+
+		m_Pool.ParallelFor(0, Resolution, [&](int RowBegin, int RowEnd) {
+			for (int y = RowBegin; y < RowEnd; y++) {
+				auto CurlSpans = [&](const std::vector<Span>& Spans) {
+					for (const Span& S : Spans) {
+						m_Kernels->CurlRow(GetKernelRow(S.Begin, y, S.End - S.Begin), m_Curl.data() + m_Grid.Index(S.Begin, y));
+					}
+				};
+
+				CurlSpans(m_Activity.GetActiveSpans(y));
+				CurlSpans(m_Activity.GetHaloSpans(y));
+			}
+		});
+	}
+
+	void FluidSolver::Project(float dt)
+	{
+		m_Stats.PressureIterations = 0;
+		m_Stats.PressureResidual = 0.0f;
+
+		switch (Parameters.PressureSolver) {
+		case PressureSolverType::RedBlackGaussSeidel:
+			ProjectRedBlack(dt);
+			break;
+
+		case PressureSolverType::Multigrid:
+			ProjectMultigrid(dt);
+			break;
+
+		case PressureSolverType::PCG:
+			ProjectPCG(dt);
+			break;
+
+		default:
+			ProjectGaussSeidel(dt);
+			break;
+		}
+	}
+
+	int FluidSolver::LoadObstacles(const ObstacleMap& map, const ObstacleMapSettings& settings)
+	{
+		m_Pool.SetThreadCount(Parameters.Threads);
+
+		// The bodies are put back on top of the new map
+		m_Bodies.Lift(m_Grid);
+		const int Changed = map.Apply(m_Grid, settings, m_Pool);
+		PlaceBodies();
+
+		// Tiles at rest can be next to a new wall or get faces zeroed
+		if (m_Grid.HasDirtyObstacles()) {
+			m_Grid.UpdateFaceWeights();
+			m_Activity.WakeAll();
+		}
+
+		return Changed;
+	}
+
+	void FluidSolver::AddBody(const RigidBody& body)
+	{
+		m_Bodies.Add(body);
+		PlaceBodies();
+		m_Grid.UpdateFaceWeights();
+	}
+
+	void FluidSolver::ClearBodies()
+	{
+		m_Bodies.Clear(m_Grid);
+		m_Grid.UpdateFaceWeights();
+	}
+
+	void FluidSolver::PlaceBodies()
+	{
+		m_Bodies.Move(m_Grid, m_Activity, 0.0f, Parameters.Gravity, Parameters.DensityWater, Parameters.GridSpacing);
+	}
+
+	void FluidSolver::MarkPressureRows(std::vector<uint8_t>& rows) const
+	{
+		const bool Relaxation = UsesRelaxation();
+
+		for (int y = 0; y < m_Grid.GetResolution(); y++) {
+			if (!Relaxation ||!m_Activity.GetActiveSpans(y).empty()) {
+				rows[y] = 1;
+			}
+		}
+	}
+
+	void FluidSolver::ProjectGaussSeidel(float dt)
+	{
+		const int Resolution = m_Grid.GetResolution();
+		const float PressureScale = Parameters.DensityWater * Parameters.GridSpacing / dt;
+		const ConvergenceSettings& Convergence = Parameters.Relaxation;
+
+		StartFromHydrostatic(dt, PressureScale);
+
+		// The residual is what each sweep found on its way, no extra pass over the grid
+		while (m_Stats.PressureIterations < std::max(Convergence.MaxIterations, 1)) {
+			float Max = 0.0f;
+			double SumSquares = 0.0;
+
+			Tiling::ForEachTile(Resolution, Resolution, Parameters.TileSize, [&](const Tile& T) {
+				for (int y = T.Y0; y < T.Y1; y++) {
+					m_Activity.ForEachActiveSpan(y, T.X0, T.X1, [&](int Begin, int End) {
+						for (int x = Begin; x < End; x++) {
+							const float Divergence = RelaxCell(x, y, PressureScale);
+
+							Max = std::max(Max, std::fabs(Divergence));
+							SumSquares += double(Divergence) * double(Divergence);
+						}
+					});
+				}
+			});
+
+			m_Stats.PressureIterations++;
+			m_Stats.PressureResidual = PressureSystem::ResidualValue(Convergence.Norm, Max, SumSquares, m_Grid.GetActiveCellCount());
+
+			if (PressureSystem::IsConverged(Convergence, m_Stats.PressureResidual)) {
+				break;
+			}
+		}
+	}
+
+	void FluidSolver::StartFromHydrostatic(float dt, float pressureScale)
+	{
+		const int Resolution = m_Grid.GetResolution();
+		const float Lift = Parameters.Gravity * dt;
+		float* V = m_Grid.GetV();
+		float* Pressure = m_Grid.GetPressure();
+		const uint8_t* Faces = m_Grid.GetFaces();
+
+		// Takes back the gravity ApplyForces() added over the same spans and puts it in the pressure instead
+		// The push of a row grows by Lift per row upwards so every open vertical face gets +Lift, the top row is 0
+		Tiling::ParallelForEachTile(m_Pool, Resolution, Resolution, Parameters.TileSize, [&](const Tile& T, int) {
+			for (int y = T.Y0; y < T.Y1; y++) {
+				const float Push = Lift * float(y - (Resolution - 1));
+
+				m_Activity.ForEachActiveSpan(y, T.X0, T.X1, [&](int Begin, int End) {
+					const int Base = m_Grid.Index(Begin, y);
+					m_Kernels->AddOpenFaces(V + Base, Faces + Base, FACE_BOTTOM, End - Begin, Lift);
+					std::fill(Pressure + Base, Pressure + Base + (End - Begin), Push * pressureScale);
+				});
+			}
+		});
+	}
+
+	void FluidSolver::ProjectRedBlack(float dt)
+	{
+		const float PressureScale = Parameters.DensityWater * Parameters.GridSpacing / dt;
+		const ConvergenceSettings& Convergence = Parameters.Relaxation;
+
+		const int MaxIterations = std::max(Convergence.MaxIterations, 1);
+
+		StartFromHydrostatic(dt, PressureScale);
+
+		while (m_Stats.PressureIterations < MaxIterations) {
+			const int Sweeps = std::min(std::max(Parameters.TemporalBlocking, 1), MaxIterations - m_Stats.PressureIterations);
+			const RowResidual Residual = Sweeps > 1 ? RedBlackWavefront(Sweeps, PressureScale) : RedBlackSweep(PressureScale);
+
+			m_Stats.PressureIterations += Sweeps;
+			m_Stats.PressureResidual = PressureSystem::ResidualValue(Convergence.Norm, Residual.Max, Residual.SumSquares, m_Grid.GetActiveCellCount());
+
+			if (PressureSystem::IsConverged(Convergence, m_Stats.PressureResidual)) {
+				break;
+			}
+		}
+	}
+
+	RowResidual FluidSolver::RedBlackSweep(float pressureScale)
+	{
+		for (int Color = 0; Color < 2; Color++) {
+			for (int RowParity = 0; RowParity < 2; RowParity++) {
+				ForEachRowOfParity(RowParity, [&](int y, float* Scratch) {
+					const RowResidual Row = RelaxRow(y, Color, pressureScale, Scratch);
+
+					// Colours run one after the other, the second one adds to what the first left in the row
+					m_RowMax[y] = Color ? std::max(m_RowMax[y], Row.Max) : Row.Max;
+					m_RowSums[y] = (Color ? m_RowSums[y] : 0.0) + double(Row.SumSquares);
+				});
+			}
+		}
+
+		return ReduceRowResiduals();
+	}
+
+	// Colour pass h of row y reads the faces its neighbour rows moved in pass h - 1 and moves faces they read in pass h + 1
+	// So row y may run pass h once rows y - 1 and y + 1 finished pass h - 1, any order that keeps this is bit identical to whole sweeps
+	//
+	// Inside a band pass h runs on the row h steps behind the leading row, so 2 * sweeps consecutive rows are live at once
+	// Between bands the boundary rows are synchronised through m_RowProgress
+	// Two rows next to each other share the faces between them and must never run at the same time, the lower row of a band boundary
+	// waits until the upper one finished the same pass, so the two alternate
+	// Bands alternate their direction (even ones bottom up, odd ones top down) so both sides of a boundary reach it at the same time
+	RowResidual FluidSolver::RedBlackWavefront(int sweeps, float pressureScale)
+	{
+		const int Resolution = m_Grid.GetResolution();
+		const int Passes = 2 * sweeps;
+
+		// Keeps every band at least two rows deep
+		if (Resolution < 2 * m_Pool.GetThreadCount()) {
+			RowResidual Residual;
+
+			for (int i = 0; i < sweeps; i++) {
+				Residual = RedBlackSweep(pressureScale);
+			}
+
+			return Residual;
+		}
+
+		if (m_RowProgressSize != Resolution) {
+			m_RowProgress.reset(new std::atomic<int>[Resolution]);
+			m_RowProgressSize = Resolution;
+		}
+
+		for (int y = 0; y < Resolution; y++) {
+			m_RowProgress[y].store(0, std::memory_order_relaxed);
+		}
+
+		auto WaitForRow = [&](int y, int passes) {
+			while (m_RowProgress[y].load(std::memory_order_acquire) < passes) {
+				std::this_thread::yield();
+			}
+		};
+
+		m_Pool.Run([&](int index, int threads) {
+			int Begin, End;
+			ThreadPool::GetChunk(0, Resolution, index, threads, Begin, End);
+
+			const int Rows = End - Begin;
+			const bool BottomUp = (index & 1) == 0;
+			float* Scratch = m_Scratch[index].data();
+
+			for (int Step = 0; Step < Rows + Passes - 1; Step++) {
+				for (int Pass = 0; Pass < Passes; Pass++) {
+					const int Offset = Step - Pass;
+
+					if (Offset < 0 || Offset >= Rows) {
+						continue;
+					}
+
+					const int y = BottomUp ? Begin + Offset : End - 1 - Offset;
+
+					if (y == Begin && y > 0) {
+						WaitForRow(y - 1, Pass);
+					}
+
+					if (y == End - 1 && y + 1 < Resolution) {
+						WaitForRow(y + 1, Pass + 1);
+					}
+
+					const int Color = Pass & 1;
+					const RowResidual Row = RelaxRow(y, Color, pressureScale, Scratch);
+
+					// Only the last sweep is reported, combined the same way RedBlackSweep() does
+					if (Pass >= Passes - 2) {
+						m_RowMax[y] = Color ? std::max(m_RowMax[y], Row.Max) : Row.Max;
+						m_RowSums[y] = (Color ? m_RowSums[y] : 0.0) + double(Row.SumSquares);
+					}
+
+					m_RowProgress[y].store(Pass + 1, std::memory_order_release);
+				}
+			}
+		});
+
+		return ReduceRowResiduals();
+	}
+
+	RowResidual FluidSolver::RelaxRow(int y, int color, float pressureScale, float* scratch)
+	{
+		RowResidual Residual;
+
+		// Spans start anywhere, the parity handed to the kernel is relative to the start of the span
+		for (const Span& S : m_Activity.GetActiveSpans(y)) {
+			const RowResidual Part = m_Kernels->RedBlackRow(GetKernelRow(S.Begin, y, S.End - S.Begin), (y + color + S.Begin) & 1,
+				Parameters.OverRelaxationCoefficient, pressureScale, scratch);
+
+			Residual.Max = std::max(Residual.Max, Part.Max);
+			Residual.SumSquares += Part.SumSquares;
+		}
+
+		return Residual;
+	}
+
+	RowResidual FluidSolver::ReduceRowResiduals() const
+	{
+		RowResidual Residual;
+		double SumSquares = 0.0;
+
+		for (int y = 0; y < m_Grid.GetResolution(); y++) {
+			Residual.Max = std::max(Residual.Max, m_RowMax[y]);
+			SumSquares += m_RowSums[y];
+		}
+
+		Residual.SumSquares = float(SumSquares);
+		return Residual;
+	}
+
+	void FluidSolver::ProjectMultigrid(float dt)
+	{
+		const float PressureScale = Parameters.DensityWater * Parameters.GridSpacing / dt;
+		m_Multigrid.Project(m_Grid, m_Pool, Parameters.Multigrid, PressureScale);
+
+		m_Stats.PressureIterations = m_Multigrid.GetCycles();
+		m_Stats.PressureResidual = m_Multigrid.GetFinalResidual();
+	}
+
+	void FluidSolver::ProjectPCG(float dt)
+	{
+		const float PressureScale = Parameters.DensityWater * Parameters.GridSpacing / dt;
+		m_PCG.Project(m_Grid, m_Pool, Parameters.PCG, PressureScale);
+
+		m_Stats.PressureIterations = m_PCG.GetIterations();
+		m_Stats.PressureResidual = m_PCG.GetFinalResidual();
+	}
+
+	void FluidSolver::Advect(float dt)
+	{
+		const int Resolution = m_Grid.GetResolution();
+		const int Stride = m_Grid.GetStride();
+		const float Scale = dt / Parameters.GridSpacing;
+		const int ScalarFields = std::min(std::max(Parameters.ScalarFields, 0), int(SCALAR_COUNT));
+
+		const uint8_t* Faces = m_Grid.GetFaces();
+		const float* U = m_Grid.GetU();
+		const float* V = m_Grid.GetV();
+		float* BackU = m_Grid.GetBackU();
+		float* BackV = m_Grid.GetBackV();
+
+		// U[Index(x, y)] sits at (x, y + 0.5) and V[Index(x, y)] at (x + 0.5, y) in cell units
+		// Going back by the displacement from either one lands on the sample coordinates of the same field
+		// Closed faces (walls, obstacles, the domain edge) keep their value
+		// Row and column Resolution only hold the top/right faces of the domain, which are always closed
+		// They are copied along with the last row/column of tiles
+		// Back traces stay within a few cells for sane timesteps, so the rows a tile samples are still in cache
+		Tiling::ParallelForEachTile(m_Pool, Resolution + 1, Resolution + 1, Parameters.TileSize, [&](const Tile& T, int) {
+			auto ClipSpan = [&](const Span& S, int& Begin, int& End) {
+				Begin = std::max(S.Begin, T.X0);
+				End = std::min(S.End == Resolution ? Resolution + 1 : S.End, T.X1);
+				return Begin < End;
+			};
+
+			for (int y = T.Y0; y < T.Y1; y++) {
+				const int Base = m_Grid.Index(0, y);
+				const int SpanRow = std::min(y, Resolution - 1);
+				int Begin, End;
+
+				// Halo tiles only keep their back buffers in sync, see ActivityMap.h
+				for (const Span& S : m_Activity.GetHaloSpans(SpanRow)) {
+					if (ClipSpan(S, Begin, End)) {
+						memcpy(BackU + Base + Begin, U + Base + Begin, (End - Begin) * sizeof(float));
+						memcpy(BackV + Base + Begin, V + Base + Begin, (End - Begin) * sizeof(float));
+
+						for (int f = 0; f < ScalarFields && y < Resolution; f++) {
+							memcpy(m_Grid.GetBackScalar(f) + Base + Begin, m_Grid.GetScalar(f) + Base + Begin, (End - Begin) * sizeof(float));
+						}
+					}
+				}
+
+				for (const Span& S : m_Activity.GetActiveSpans(SpanRow)) {
+					if (!ClipSpan(S, Begin, End)) {
+						continue;
+					}
+
+					for (int x = Begin; x < End; x++) {
+						const int i = Base + x;
+
+						if (y == Resolution) {
+							BackU[i] = U[i];
+							BackV[i] = V[i];
+							continue;
+						}
+
+						if (Faces[i] & FACE_LEFT) {
+							const float u = U[i];
+							const float v = 0.25f * ((V[i - 1] + V[i]) + (V[i - 1 + Stride] + V[i + Stride]));
+							BackU[i] = SampleFaces(U, x - u * Scale, y - v * Scale, Resolution, Resolution - 1);
+						}
+
+						else {
+							BackU[i] = U[i];
+						}
+
+						if (Faces[i] & FACE_BOTTOM) {
+							const float u = 0.25f * ((U[i] + U[i + 1]) + (U[i - Stride] + U[i + 1 - Stride]));
+							const float v = V[i];
+							BackV[i] = SampleFaces(V, x - u * Scale, y - v * Scale, Resolution - 1, Resolution);
+						}
+
+						else {
+							BackV[i] = V[i];
+						}
+					}
+
+					if (ScalarFields > 0 && y < Resolution) {
+						AdvectScalars(y, Begin, std::min(End, Resolution), Scale, ScalarFields);
+					}
+				}
+			}
+		});
+
+		m_Grid.SwapVelocities();
+
+		m_Grid.SwapScalars(ScalarFields);
+	}
+
+	void FluidSolver::AdvectScalars(int y, int begin, int end, float scale, int count)
+	{
+		const int Resolution = m_Grid.GetResolution();
+		const int Stride = m_Grid.GetStride();
+		const int Base = m_Grid.Index(0, y);
+		const float MaxCoord = float(Resolution - 1);
+
+		const uint8_t* Faces = m_Grid.GetFaces();
+		const float* U = m_Grid.GetU();
+		const float* V = m_Grid.GetV();
+
+		const float* Sources[SCALAR_COUNT];
+		float* Targets[SCALAR_COUNT];
+
+		for (int f = 0; f < count; f++) {
+			Sources[f] = m_Grid.GetScalar(f);
+			Targets[f] = m_Grid.GetBackScalar(f);
+		}
+
+		// Cell centres sit at integer coordinates, the velocity there is the mean of the two faces on each axis
+		// Solid and enclosed cells keep their value
+		for (int x = begin; x < end; x++) {
+			const int i = Base + x;
+
+			if (!Faces[i]) {
+				for (int f = 0; f < count; f++) {
+					Targets[f][i] = Sources[f][i];
+				}
+
+				continue;
+			}
+
+			const float u = 0.5f * (U[i] + U[i + 1]);
+			const float v = 0.5f * (V[i] + V[i + Stride]);
+
+			const float px = std::min(std::max(float(x) - u * scale, 0.0f), MaxCoord);
+			const float py = std::min(std::max(float(y) - v * scale, 0.0f), MaxCoord);
+
+			const int x0 = std::max(std::min(int(px), Resolution - 2), 0);
+			const int y0 = std::max(std::min(int(py), Resolution - 2), 0);
+			const float tx = px - float(x0);
+			const float ty = py - float(y0);
+
+			const float W00 = (1.0f - tx) * (1.0f - ty);
+			const float W10 = tx * (1.0f - ty);
+			const float W01 = (1.0f - tx) * ty;
+			const float W11 = tx * ty;
+
+			const int j = m_Grid.Index(x0, y0);
+
+			for (int f = 0; f < count; f++) {
+				const float* S = Sources[f];
+				Targets[f][i] = (W00 * S[j] + W10 * S[j + 1]) + (W01 * S[j + Stride] + W11 * S[j + Stride + 1]);
+			}
+		}
+	}
+
+	float FluidSolver::SampleFaces(const float* field, float x, float y, int maxX, int maxY) const
+	{
+		x = std::min(std::max(x, 0.0f), float(maxX));
+		y = std::min(std::max(y, 0.0f), float(maxY));
+
+		const int x0 = std::min(int(x), maxX - 1);
+		const int y0 = std::min(int(y), maxY - 1);
+		const float tx = x - float(x0);
+		const float ty = y - float(y0);
+
+		const float* Row0 = field + m_Grid.Index(x0, y0);
+		const float* Row1 = Row0 + m_Grid.GetStride();
+
+		const float Bottom = Row0[0] + (Row0[1] - Row0[0]) * tx;
+		const float Top = Row1[0] + (Row1[1] - Row1[0]) * tx;
+
+		return Bottom + (Top - Bottom) * ty;
+	}
+
+	glm::vec2 FluidSolver::SampleVelocity(const glm::vec2& position) const
+	{
+		const int Resolution = m_Grid.GetResolution();
+
+		// U sits half a cell up from the corners its coordinates name, V half a cell to the right
+		return glm::vec2(
+			SampleFaces(m_Grid.GetU(), position.x, position.y - 0.5f, Resolution, Resolution - 1),
+			SampleFaces(m_Grid.GetV(), position.x - 0.5f, position.y, Resolution - 1, Resolution));
+	}
+
+	float FluidSolver::ComputeDivergence(float* out)
+	{
+		const int Resolution = m_Grid.GetResolution();
+
+		m_Pool.SetThreadCount(Parameters.Threads);
+		m_Scratch.resize(m_Pool.GetThreadCount());
+
+		std::vector<float> ThreadMax(m_Pool.GetThreadCount(), 0.0f);
+
+		for (std::vector<float>& Scratch : m_Scratch) {
+			Scratch.resize(std::max(Scratch.size(), size_t(Resolution) + 2));
+		}
+
+		Tiling::ParallelForEachTile(m_Pool, Resolution, Resolution, Parameters.TileSize, [&](const Tile& T, int index) {
+			for (int y = T.Y0; y < T.Y1; y++) {
+				float* Row = out ? out + m_Grid.Index(T.X0, y) : m_Scratch[index].data();
+				ThreadMax[index] = std::max(ThreadMax[index], m_Kernels->DivergenceRow(GetKernelRow(T.X0, y, T.X1 - T.X0), Row));
+			}
+		});
+
+		return *std::max_element(ThreadMax.begin(), ThreadMax.end());
+	}
+
+	float FluidSolver::RelaxCell(int x, int y, float PressureScale)
+	{
+		const int i = m_Grid.Index(x, y);
+		const int Stride = m_Grid.GetStride();
+		const uint8_t Faces = m_Grid.GetFaces()[i];
+
+		// Solid, or fluid with no open face
+		if (!Faces) {
+			return 0.0f;
+		}
+
+		float* U = m_Grid.GetU();
+		float* V = m_Grid.GetV();
+
+		// Handle divergance
+		const float CellDivergance = (U[i + 1] - U[i]) + (V[i + Stride] - V[i]);
+		const float Divergance = Parameters.OverRelaxationCoefficient * CellDivergance;
+
+		// For divergance > 0, too much outflow
+		// For divergance < 0, too much inflow
+		// For divergance = 0, it is a perfectly incompressible surface
+		// WE need to make the divergance zero
+
+		float PushAmount = Divergance * m_Grid.GetInvWeight()[i];
+
+		// Gauss Seidel method, only through the faces shared with another fluid cell
+		if (Faces & FACE_LEFT) U[i] += PushAmount;
+		if (Faces & FACE_RIGHT) U[i + 1] -= PushAmount;
+		if (Faces & FACE_BOTTOM) V[i] += PushAmount;
+		if (Faces & FACE_TOP) V[i + Stride] -= PushAmount;
+
+		// Solve for pressure gradient, on top of the hydrostatic start
+		m_Grid.GetPressure()[i] += PushAmount * PressureScale;
+
+		return CellDivergance;
+	}
+}
@@ -0,0 +1,262 @@
+#pragma once
+
+#include "FluidGrid.h"
+#include "ActivityMap.h"
+#include "ObstacleMap.h"
+#include "RigidBodies.h"
+#include "Multigrid.h"
+#include "PCG.h"
+#include "Tiling.h"
+
+#include "Kernels/Kernels.h"
+
+#include "../Utils/ThreadPool.h"
+
+#include <vector>
+#include <atomic>
+#include <memory>
+
+namespace Simulation
+{
+	/*
+	1) Verlet Acceleration
+	2) Advection
+	3) Projection to maintain incompressability
+
+	Projecting last leaves every step with a divergence free field
+	*/
+
+	enum class PressureSolverType : int {
+		GaussSeidel = 0,
+		RedBlackGaussSeidel,
+		Multigrid,
+		PCG
+	};
+
+	// Checkpoints and recordings store the fields listed in ParameterBlock.cpp, a new field needs an entry there to be saved
+	struct FluidParameters
+	{
+		float GridSpacing = 1.;
+		float DensityWater = 1000.0f;
+		float OverRelaxationCoefficient = 1.0f;
+		float Gravity = 9.81f;
+
+		// Vorticity confinement strength, 0 disables the pass
+		// Puts back the small swirls numerical dissipation smears out, so a coarser grid keeps the detail of a finer one
+		float VorticityConfinement = 0.0f;
+
+		PressureSolverType PressureSolver = PressureSolverType::GaussSeidel;
+
+		// Sweeps of the Gauss Seidel solvers, one by default like the original solver
+		ConvergenceSettings Relaxation;
+
+		MultigridSettings Multigrid;
+		PCGSettings PCG;
+
+		// Semi-lagrangian transport of the velocities by themselves
+		bool Advection = true;
+
+		// Passive scalars (see FluidGrid.h) carried along in the same sweep, the first ScalarFields of them
+		// Each one only adds four loads and a store per cell, the back trace is shared
+		int ScalarFields = SCALAR_COUNT;
+
+		// Worker threads used by the parallel stages, 1 keeps everything on the calling thread
+		int Threads = 1;
+
+		// Edge of the square tiles the grid stages walk (see Tiling.h), 0 walks full rows
+		int TileSize = Tiling::DefaultTileSize;
+
+		// Red-black sweeps fused into one wavefront pass over the grid, 1 runs them one by one
+		// The convergence check only runs between passes
+		int TemporalBlocking = 4;
+
+		// Forces, advection and Gauss Seidel only run on tiles that are moving (see ActivityMap.h)
+		// Only used with the Gauss Seidel solvers, multigrid and PCG correct the whole domain every step
+		// and would leave their corrections in tiles at rest that are never synced or measured again
+		bool TrackActivity = true;
+		int ActivityTileSize = 32;
+		float ActivityThreshold = 1e-4f;
+
+		// Stopping rule of the selected pressure solver
+		inline ConvergenceSettings& GetConvergence()
+		{
+			switch (PressureSolver) {
+			case PressureSolverType::Multigrid:
+				return Multigrid.Convergence;
+
+			case PressureSolverType::PCG:
+				return PCG.Convergence;
+
+			default:
+				return Relaxation;
+			}
+		}
+	};
+
+	// Wall clock time spent in each stage of the last Step()
+	struct FluidStepStats
+	{
+		float ForcesMs = 0.0f;
+		float ProjectionMs = 0.0f;
+		float AdvectionMs = 0.0f;
+		float TotalMs = 0.0f;
+
+		float ActivityMs = 0.0f;
+
+		// Moving, rasterizing and gathering the forces of the rigid bodies
+		float BodiesMs = 0.0f;
+
+		// Tiles the stages ran on out of the total
+		int ActiveTiles = 0;
+		int TotalTiles = 0;
+
+		// Iterations the pressure solver ran and the residual it ended on, in the norm of its convergence settings
+		// Gauss Seidel reports the divergence its last sweep found before relaxing it
+		int PressureIterations = 0;
+		float PressureResidual = 0.0f;
+	};
+
+	class FluidSolver
+	{
+	public :
+
+		FluidSolver(FluidGrid& grid);
+
+		// Moves the bodies and runs every stage once, rebuilds the face weights first if obstacles changed
+		// Does nothing unless dt and GridSpacing are positive
+		void Step(float dt);
+
+		// Account for gravity and vorticity confinement
+		void ApplyForces(float dt);
+
+		// Relaxes the divergence with the selected pressure solver, writes the full pressure into the grid
+		void Project(float dt);
+
+		// Traces every open face back through the velocity field and takes the velocity found there
+		// The scalars are traced from the cell centres in the same sweep
+		// Writes into the grid back buffers and swaps them in
+		void Advect(float dt);
+
+		// Writes the divergence of every cell into out (grid layout, may be null), returns the max absolute value
+		float ComputeDivergence(float* out = nullptr);
+
+		// Bilinear velocity at a point in cell units, (0, 0) is the lower left corner of the domain
+		// Each component is sampled from its own faces like the advection back trace, points outside are clamped to the domain
+		glm::vec2 SampleVelocity(const glm::vec2& position) const;
+
+		// Sets the entry of every cell row the last Step() wrote pressure in, rows needs one entry per cell row
+		// The Gauss Seidel solvers only write the active tiles, the others the whole domain
+		void MarkPressureRows(std::vector<uint8_t>& rows) const;
+
+		// Replaces the interior obstacles with the rasterized map (see ObstacleMap::Apply()), the image is downsampled on the pool
+		// The face weights are updated right away, only around the cells that flipped, returns how many did
+		int LoadObstacles(const ObstacleMap& map, const ObstacleMapSettings& settings);
+
+		// Rigid bodies stepped along with the fluid (see RigidBodies.h), an added body covers its cells right away
+		void AddBody(const RigidBody& body);
+		void ClearBodies();
+		inline const RigidBodySystem& GetBodies() const { return m_Bodies; }
+
+		// Has every tile measured on the next step, call it after writing the velocities from outside the solver
+		inline void WakeAll() { m_Activity.WakeAll(); }
+
+		inline ConvergenceSettings& GetConvergence() { return Parameters.GetConvergence(); }
+
+		// Picks the stencil kernels, unsupported instruction sets fall back to scalar
+		void SetKernelISA(KernelISA isa);
+		inline KernelISA GetKernelISA() const { return m_KernelISA; }
+
+		inline FluidGrid& GetGrid() { return m_Grid; }
+		inline const FluidStepStats& GetStats() const { return m_Stats; }
+
+		FluidParameters Parameters;
+
+	private :
+
+		// Lexicographic order inside each tile, tiles in row major order, single threaded
+		void ProjectGaussSeidel(float dt);
+
+		// Checkerboard order, cells of one colour share no faces so each colour is split across the pool
+		// Walks whole rows rather than tiles, the kernels move the face between two cells from both of their pushes
+		void ProjectRedBlack(float dt);
+		RowResidual RedBlackSweep(float pressureScale);
+
+		// Gives the Gauss Seidel solvers the hydrostatic pressure up front, they only add their corrections to it
+		// Without it the grid would hold the last correction alone and the bodies would feel no buoyancy
+		void StartFromHydrostatic(float dt, float pressureScale);
+
+		// Runs sweeps red-black sweeps in one pass, bit identical to calling RedBlackSweep() that many times
+		// Every row goes through all 2 * sweeps colour passes while the rows it touches are still in cache
+		// Each thread takes a band of rows, see the .cpp for the schedule
+		RowResidual RedBlackWavefront(int sweeps, float pressureScale);
+
+		// Both red-black paths relax a row through this, one kernel call per active span
+		RowResidual RelaxRow(int y, int color, float pressureScale, float* scratch);
+
+		// Row order reduction of m_RowMax / m_RowSums
+		RowResidual ReduceRowResiduals() const;
+
+		// Gauss Seidel or red-black, the solvers that only relax the active tiles
+		inline bool UsesRelaxation() const
+		{
+			return Parameters.PressureSolver == PressureSolverType::GaussSeidel || Parameters.PressureSolver == PressureSolverType::RedBlackGaussSeidel;
+		}
+
+		// Solves the pressure equation to convergence instead of relaxing it once
+		void ProjectMultigrid(float dt);
+		void ProjectPCG(float dt);
+
+		// Runs fn(row, scratch) over every row with y % 2 == rowParity, in parallel
+		// Rows one apart share the vertical faces between them so they never run at the same time
+		template <typename F>
+		void ForEachRowOfParity(int rowParity, const F& fn);
+
+		// count cells of row y starting at x
+		KernelRow GetKernelRow(int x, int y, int count);
+
+		// Bilinear sample of a face field at integer face coordinates, clamped to [0, maxX] x [0, maxY]
+		float SampleFaces(const float* field, float x, float y, int maxX, int maxY) const;
+
+		// Writes the vorticity of every cell of the active and halo tiles into m_Curl
+		// Covers every cell the confinement pass of the active tiles reads, the rest of m_Curl is stale
+		void ComputeCurl();
+
+		// Rasterizes the bodies where they are without stepping them
+		void PlaceBodies();
+
+		// Advects the first count scalars over cells [begin, end) of row y, every field reuses the trace and weights of a cell
+		void AdvectScalars(int y, int begin, int end, float scale, int count);
+
+		// Pushes the divergence of one cell out through its open faces, returns the divergence it found
+		float RelaxCell(int x, int y, float PressureScale);
+
+		FluidGrid& m_Grid;
+		ThreadPool m_Pool;
+		ActivityMap m_Activity;
+		MultigridSolver m_Multigrid;
+		PCGSolver m_PCG;
+		RigidBodySystem m_Bodies;
+
+		KernelISA m_KernelISA;
+		const KernelTable* m_Kernels;
+
+		// One row of scratch per thread
+		std::vector<std::vector<float>> m_Scratch;
+
+		// Cell centred vorticity in grid layout, the border stays 0
+		std::vector<float> m_Curl;
+
+		// Per row residuals of a red-black sweep, reduced in row order so the result doesn't depend on the thread count
+		std::vector<float> m_RowMax;
+		std::vector<double> m_RowSums;
+
+		// Colour passes each row has finished in the current wavefront
+		std::unique_ptr<std::atomic<int>[]> m_RowProgress;
+		int m_RowProgressSize = 0;
+
+		// Scalars advected by the last step, the back buffers of the others are not kept in sync
+		int m_ScalarFields = -1;
+
+		FluidStepStats m_Stats;
+	};
+}
@@ -0,0 +1,174 @@
+#include "Kernels.h"
+
+#include <cstring>
+
+#if FLUID_KERNELS_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace Simulation
+{
+	namespace
+	{
+		struct CpuFeatures
+		{
+			bool SSE42 = false;
+			bool AVX2 = false;
+			bool AVX512 = false;
+		};
+
+#if FLUID_KERNELS_X86
+		void CpuId(int leaf, int subleaf, unsigned int regs[4])
+		{
+#ifdef _MSC_VER
+			int Out[4];
+			__cpuidex(Out, leaf, subleaf);
+
+			for (int i = 0; i < 4; i++) {
+				regs[i] = (unsigned int)Out[i];
+			}
+#else
+			__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+		}
+
+		uint64_t ReadXCR0()
+		{
+#ifdef _MSC_VER
+			return _xgetbv(0);
+#else
+			unsigned int Low = 0, High = 0;
+			__asm__ volatile("xgetbv" : "=a"(Low), "=d"(High) : "c"(0));
+			return (uint64_t(High) << 32) | Low;
+#endif
+		}
+#endif
+
+		CpuFeatures QueryFeatures()
+		{
+			CpuFeatures Features;
+
+#if FLUID_KERNELS_X86
+			unsigned int Regs[4];
+
+			CpuId(0, 0, Regs);
+			const unsigned int MaxLeaf = Regs[0];
+
+			if (MaxLeaf < 1) {
+				return Features;
+			}
+
+			CpuId(1, 0, Regs);
+			const unsigned int Leaf1Ecx = Regs[2];
+
+			Features.SSE42 = (Leaf1Ecx & (1u << 19)) && (Leaf1Ecx & (1u << 20));
+
+			// The OS has to save the wide registers on context switches or the instructions can't be used
+			const bool OSXSave = (Leaf1Ecx & (1u << 27)) != 0;
+			const bool AVX = (Leaf1Ecx & (1u << 28)) != 0;
+
+			if (!OSXSave || !AVX || MaxLeaf < 7) {
+				return Features;
+			}
+
+			const uint64_t XCR0 = ReadXCR0();
+			const bool YmmState = (XCR0 & 0x6) == 0x6;
+			const bool ZmmState = (XCR0 & 0xE6) == 0xE6;
+
+			CpuId(7, 0, Regs);
+			const unsigned int Leaf7Ebx = Regs[1];
+
+			Features.AVX2 = YmmState && (Leaf7Ebx & (1u << 5));
+			Features.AVX512 = ZmmState && (Leaf7Ebx & (1u << 16));
+#endif
+
+			return Features;
+		}
+
+		const CpuFeatures& GetFeatures()
+		{
+			static const CpuFeatures Features = QueryFeatures();
+			return Features;
+		}
+	}
+
+	bool Kernels::IsSupported(KernelISA isa)
+	{
+		switch (isa) {
+		case KernelISA::Scalar:
+			return true;
+
+		case KernelISA::SSE42:
+			return GetFeatures().SSE42;
+
+		case KernelISA::AVX2:
+			return GetFeatures().AVX2;
+
+		case KernelISA::AVX512:
+			return GetFeatures().AVX512;
+
+		default:
+			return false;
+		}
+	}
+
+	KernelISA Kernels::DetectISA()
+	{
+		for (int i = int(KernelISA::Count) - 1; i > 0; i--) {
+			if (IsSupported(KernelISA(i))) {
+				return KernelISA(i);
+			}
+		}
+
+		return KernelISA::Scalar;
+	}
+
+	const KernelTable& Kernels::Get(KernelISA isa)
+	{
+		// Never hand out code the CPU can't run
+		if (!IsSupported(isa)) {
+			isa = KernelISA::Scalar;
+		}
+
+		switch (isa) {
+		case KernelISA::SSE42:
+			return GetSSE42();
+
+		case KernelISA::AVX2:
+			return GetAVX2();
+
+		case KernelISA::AVX512:
+			return GetAVX512();
+
+		default:
+			return GetScalar();
+		}
+	}
+
+	const char* Kernels::GetName(KernelISA isa)
+	{
+		const char* Names[] = { "scalar", "sse42", "avx2", "avx512" };
+
+		if (int(isa) < 0 || isa >= KernelISA::Count) {
+			return "unknown";
+		}
+
+		return Names[int(isa)];
+	}
+
+	bool Kernels::ParseISA(const char* name, KernelISA& isa)
+	{
+		for (int i = 0; i < int(KernelISA::Count); i++) {
+			if (strcmp(name, GetName(KernelISA(i))) == 0) {
+				isa = KernelISA(i);
+				return true;
+			}
+		}
+
+		return false;
+	}
+}
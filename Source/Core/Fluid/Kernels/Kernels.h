@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define FLUID_KERNELS_X86 1
+#else
+#define FLUID_KERNELS_X86 0
+#endif
+
+// GCC/Clang need the ISA enabled per function to emit the intrinsics, MSVC allows them anywhere
+// GCC also fuses a multiply feeding an add into an FMA wherever the target has one (AVX-512 brings it along),
+// which rounds once where the scalar kernels round twice
+#if defined(__clang__)
+#define FLUID_TARGET(isa) __attribute__((target(isa)))
+#elif defined(__GNUC__)
+#define FLUID_TARGET(isa) __attribute__((target(isa), optimize("fp-contract=off")))
+#else
+#define FLUID_TARGET(isa)
+#endif
+
+namespace Simulation
+{
+	enum class KernelISA : int {
+		Scalar = 0,
+		SSE42,
+		AVX2,
+		AVX512,
+		Count
+	};
+
+	// One row of the padded grid, every pointer is at cell (0, y)
+	struct KernelRow
+	{
+		float* U;
+		float* V;
+		float* Pressure;
+		const uint8_t* Solid;
+		const uint8_t* Faces;
+		const float* InvWeight;
+
+		int Stride;
+		int Count;
+	};
+
+	// Divergence a relaxation pass found in the cells it relaxed (cells without open faces left out), before removing it
+	struct RowResidual
+	{
+		float Max = 0.0f;
+		float SumSquares = 0.0f;
+	};
+
+	// The stencil kernels, one table per instruction set
+	// Every implementation produces bit identical results to the scalar one
+	struct KernelTable
+	{
+		const char* Name;
+
+		// row[x] += value wherever faces[x] has the face bit set
+		void (*AddOpenFaces)(float* row, const uint8_t* faces, uint8_t bit, int count, float value);
+
+		// out[x] = divergence of cell x (0 for solid cells), returns the max absolute divergence
+		float (*DivergenceRow)(const KernelRow& row, float* out);
+
+		// Relaxes every cell of the row with (x & 1) == parity, only open faces are moved
+		// Each relaxed cell adds its push times pressureScale to its pressure
+		// The row can be a span of a grid row, the cells on either side of it are left alone but the faces shared with them move
+		// scratch needs room for row.Count + 2 floats
+		// The residual comes out of the same pass, Max is exact across instruction sets, SumSquares may differ in the last bits
+		RowResidual (*RedBlackRow)(const KernelRow& row, int parity, float overRelaxation, float pressureScale, float* scratch);
+
+		// out[x] = vorticity at the centre of cell x in velocity units (0 for cells without an open face)
+		void (*CurlRow)(const KernelRow& row, float* out);
+
+		// Vorticity confinement : adds scale * the force to the open left and bottom faces of every cell of the row
+		// curl is the CurlRow output in grid layout at cell (0, y), it has to be current one cell around the row
+		void (*ConfinementRow)(const KernelRow& row, const float* curl, float scale);
+	};
+
+	namespace Kernels
+	{
+		// Best instruction set the CPU and OS support
+		KernelISA DetectISA();
+
+		bool IsSupported(KernelISA isa);
+
+		const KernelTable& Get(KernelISA isa);
+
+		const char* GetName(KernelISA isa);
+
+		// Returns false for unknown names
+		bool ParseISA(const char* name, KernelISA& isa);
+
+		// Per instruction set tables, defined in their own translation units
+		const KernelTable& GetScalar();
+		const KernelTable& GetSSE42();
+		const KernelTable& GetAVX2();
+		const KernelTable& GetAVX512();
+	}
+}
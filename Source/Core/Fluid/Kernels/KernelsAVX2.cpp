@@ -0,0 +1,228 @@
+#include "Kernels.h"
+#include "KernelsShared.h"
+
+#if FLUID_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+namespace Simulation
+{
+#if FLUID_KERNELS_X86
+	namespace
+	{
+		// 8 cells per iteration
+
+		FLUID_TARGET("avx2") inline __m256 FluidMask8(const uint8_t* solid)
+		{
+			__m256i Wide = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)solid));
+			return _mm256_castsi256_ps(_mm256_cmpeq_epi32(Wide, _mm256_setzero_si256()));
+		}
+
+		// All ones in the lanes whose face mask has the bit set
+		FLUID_TARGET("avx2") inline __m256 FaceMask8(const uint8_t* faces, __m256i bit)
+		{
+			__m256i Wide = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)faces));
+			return _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(Wide, bit), bit));
+		}
+
+		FLUID_TARGET("avx2") inline __m256 Divergence8(const KernelRow& row, int x)
+		{
+			__m256 U0 = _mm256_loadu_ps(row.U + x);
+			__m256 U1 = _mm256_loadu_ps(row.U + x + 1);
+			__m256 V0 = _mm256_loadu_ps(row.V + x);
+			__m256 V1 = _mm256_loadu_ps(row.V + x + row.Stride);
+
+			return _mm256_add_ps(_mm256_sub_ps(U1, U0), _mm256_sub_ps(V1, V0));
+		}
+
+		FLUID_TARGET("avx2") void AddOpenFacesAVX2(float* row, const uint8_t* faces, uint8_t bit, int count, float value)
+		{
+			const __m256 Value = _mm256_set1_ps(value);
+			const __m256i Bit = _mm256_set1_epi32(bit);
+			int x = 0;
+
+			for (; x + 8 <= count; x += 8) {
+				__m256 Add = _mm256_and_ps(Value, FaceMask8(faces + x, Bit));
+				_mm256_storeu_ps(row + x, _mm256_add_ps(_mm256_loadu_ps(row + x), Add));
+			}
+
+			KernelsShared::AddOpenFacesTail(row, faces, bit, x, count, value);
+		}
+
+		FLUID_TARGET("avx2") float DivergenceRowAVX2(const KernelRow& row, float* out)
+		{
+			const __m256 SignMask = _mm256_set1_ps(-0.0f);
+			__m256 Max = _mm256_setzero_ps();
+			int x = 0;
+
+			for (; x + 8 <= row.Count; x += 8) {
+				__m256 Divergence = _mm256_and_ps(Divergence8(row, x), FluidMask8(row.Solid + x));
+				_mm256_storeu_ps(out + x, Divergence);
+				Max = _mm256_max_ps(Max, _mm256_andnot_ps(SignMask, Divergence));
+			}
+
+			float Lanes[8];
+			_mm256_storeu_ps(Lanes, Max);
+			float MaxDivergence = 0.0f;
+
+			for (int i = 0; i < 8; i++) {
+				MaxDivergence = std::fmax(MaxDivergence, Lanes[i]);
+			}
+
+			return KernelsShared::DivergenceTail(row, x, out, MaxDivergence);
+		}
+
+		FLUID_TARGET("avx2") RowResidual RedBlackRowAVX2(const KernelRow& row, int parity, float overRelaxation, float pressureScale, float* scratch)
+		{
+			// Push[-1] and Push[Count] stay 0 so the faces on the domain edge read a neighbour that never moves
+			float* Push = scratch + 1;
+			Push[-1] = 0.0f;
+			Push[row.Count] = 0.0f;
+
+			// Chunks start on even cells so lane parity is cell parity
+			const __m256 ColorMask = parity == 0 ? _mm256_castsi256_ps(_mm256_setr_epi32(-1, 0, -1, 0, -1, 0, -1, 0)) : _mm256_castsi256_ps(_mm256_setr_epi32(0, -1, 0, -1, 0, -1, 0, -1));
+			const __m256 OverRelaxation = _mm256_set1_ps(overRelaxation);
+			const __m256 PressureScale = _mm256_set1_ps(pressureScale);
+			const __m256 SignMask = _mm256_set1_ps(-0.0f);
+			const __m256 Zero = _mm256_setzero_ps();
+
+			__m256 MaxResidual = Zero;
+			__m256 SumSquares = Zero;
+
+			int x = 0;
+
+			for (; x + 8 <= row.Count; x += 8) {
+				__m256 InvWeight = _mm256_loadu_ps(row.InvWeight + x);
+				__m256 Divergence = Divergence8(row, x);
+
+				__m256 Residual = _mm256_and_ps(Divergence, _mm256_and_ps(ColorMask, _mm256_cmp_ps(InvWeight, Zero, _CMP_GT_OQ)));
+				MaxResidual = _mm256_max_ps(MaxResidual, _mm256_andnot_ps(SignMask, Residual));
+				SumSquares = _mm256_add_ps(SumSquares, _mm256_mul_ps(Residual, Residual));
+
+				__m256 Amount = _mm256_and_ps(_mm256_mul_ps(_mm256_mul_ps(Divergence, OverRelaxation), InvWeight), ColorMask);
+				_mm256_storeu_ps(Push + x, Amount);
+
+				__m256 Pressure = _mm256_loadu_ps(row.Pressure + x);
+				_mm256_storeu_ps(row.Pressure + x, _mm256_blendv_ps(Pressure, _mm256_add_ps(Pressure, _mm256_mul_ps(Amount, PressureScale)), ColorMask));
+			}
+
+			RowResidual Result;
+			float Lanes[8];
+
+			_mm256_storeu_ps(Lanes, MaxResidual);
+
+			for (int i = 0; i < 8; i++) {
+				Result.Max = std::fmax(Result.Max, Lanes[i]);
+			}
+
+			_mm256_storeu_ps(Lanes, SumSquares);
+
+			for (int i = 0; i < 8; i++) {
+				Result.SumSquares += Lanes[i];
+			}
+
+			KernelsShared::RedBlackComputeTail(row, x, parity, overRelaxation, pressureScale, Push, Result);
+
+			const __m256i Left = _mm256_set1_epi32(FACE_LEFT);
+			const __m256i Bottom = _mm256_set1_epi32(FACE_BOTTOM);
+			const __m256i Top = _mm256_set1_epi32(FACE_TOP);
+
+			x = 0;
+
+			for (; x + 8 <= row.Count; x += 8) {
+				const uint8_t* Faces = row.Faces + x;
+				__m256 Current = _mm256_loadu_ps(Push + x);
+				__m256 Horizontal = _mm256_and_ps(_mm256_sub_ps(Current, _mm256_loadu_ps(Push + x - 1)), FaceMask8(Faces, Left));
+
+				_mm256_storeu_ps(row.U + x, _mm256_add_ps(_mm256_loadu_ps(row.U + x), Horizontal));
+				_mm256_storeu_ps(row.V + x, _mm256_add_ps(_mm256_loadu_ps(row.V + x), _mm256_and_ps(Current, FaceMask8(Faces, Bottom))));
+				_mm256_storeu_ps(row.V + x + row.Stride, _mm256_sub_ps(_mm256_loadu_ps(row.V + x + row.Stride), _mm256_and_ps(Current, FaceMask8(Faces, Top))));
+			}
+
+			KernelsShared::RedBlackApplyTail(row, x, Push);
+
+			return Result;
+		}
+
+		FLUID_TARGET("avx2") inline __m256 Curl8(const KernelRow& row, int x)
+		{
+			const int S = row.Stride;
+			__m256 Dv = _mm256_sub_ps(_mm256_add_ps(_mm256_loadu_ps(row.V + x + 1), _mm256_loadu_ps(row.V + x + 1 + S)), _mm256_add_ps(_mm256_loadu_ps(row.V + x - 1), _mm256_loadu_ps(row.V + x - 1 + S)));
+			__m256 Du = _mm256_sub_ps(_mm256_add_ps(_mm256_loadu_ps(row.U + x + S), _mm256_loadu_ps(row.U + x + 1 + S)), _mm256_add_ps(_mm256_loadu_ps(row.U + x - S), _mm256_loadu_ps(row.U + x + 1 - S)));
+
+			return _mm256_mul_ps(_mm256_sub_ps(Dv, Du), _mm256_set1_ps(0.25f));
+		}
+
+		// |a| + |b|
+		FLUID_TARGET("avx2") inline __m256 AbsSum8(const float* a, const float* b, __m256 signMask)
+		{
+			return _mm256_add_ps(_mm256_andnot_ps(signMask, _mm256_loadu_ps(a)), _mm256_andnot_ps(signMask, _mm256_loadu_ps(b)));
+		}
+
+		FLUID_TARGET("avx2") inline __m256 ConfinementForce8(__m256 c0, __m256 c1, __m256 across, __m256 signMask)
+		{
+			__m256 Along = _mm256_sub_ps(_mm256_andnot_ps(signMask, c1), _mm256_andnot_ps(signMask, c0));
+			__m256 Length = _mm256_add_ps(_mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(Along, Along), _mm256_mul_ps(across, across))), _mm256_set1_ps(KernelsShared::ConfinementEpsilon));
+
+			return _mm256_mul_ps(_mm256_div_ps(across, Length), _mm256_mul_ps(_mm256_add_ps(c0, c1), _mm256_set1_ps(0.5f)));
+		}
+
+		FLUID_TARGET("avx2") void CurlRowAVX2(const KernelRow& row, float* out)
+		{
+			int x = 0;
+
+			for (; x + 8 <= row.Count; x += 8) {
+				// The zero test of FluidMask8 on the face mask picks the cells without an open face
+				_mm256_storeu_ps(out + x, _mm256_andnot_ps(FluidMask8(row.Faces + x), Curl8(row, x)));
+			}
+
+			KernelsShared::CurlTail(row, x, out);
+		}
+
+		FLUID_TARGET("avx2") void ConfinementRowAVX2(const KernelRow& row, const float* curl, float scale)
+		{
+			const int S = row.Stride;
+			const __m256 SignMask = _mm256_set1_ps(-0.0f);
+			const __m256 Quarter = _mm256_set1_ps(0.25f);
+			const __m256 Scale = _mm256_set1_ps(scale);
+			const __m256i Left = _mm256_set1_epi32(FACE_LEFT);
+			const __m256i Bottom = _mm256_set1_epi32(FACE_BOTTOM);
+			int x = 0;
+
+			for (; x + 8 <= row.Count; x += 8) {
+				const float* C = curl + x;
+				__m256 Center = _mm256_loadu_ps(C);
+
+				__m256 AcrossU = _mm256_mul_ps(_mm256_sub_ps(AbsSum8(C - 1 + S, C + S, SignMask), AbsSum8(C - 1 - S, C - S, SignMask)), Quarter);
+				__m256 ForceU = _mm256_and_ps(ConfinementForce8(_mm256_loadu_ps(C - 1), Center, AcrossU, SignMask), FaceMask8(row.Faces + x, Left));
+				_mm256_storeu_ps(row.U + x, _mm256_add_ps(_mm256_loadu_ps(row.U + x), _mm256_mul_ps(ForceU, Scale)));
+
+				__m256 AcrossV = _mm256_mul_ps(_mm256_sub_ps(AbsSum8(C + 1, C + 1 - S, SignMask), AbsSum8(C - 1, C - 1 - S, SignMask)), Quarter);
+				__m256 ForceV = _mm256_and_ps(ConfinementForce8(_mm256_loadu_ps(C - S), Center, AcrossV, SignMask), FaceMask8(row.Faces + x, Bottom));
+				_mm256_storeu_ps(row.V + x, _mm256_sub_ps(_mm256_loadu_ps(row.V + x), _mm256_mul_ps(ForceV, Scale)));
+			}
+
+			KernelsShared::ConfinementTail(row, x, curl, scale);
+		}
+	}
+
+	const KernelTable& Kernels::GetAVX2()
+	{
+		static const KernelTable Table = {
+			"avx2",
+			AddOpenFacesAVX2,
+			DivergenceRowAVX2,
+			RedBlackRowAVX2,
+			CurlRowAVX2,
+			ConfinementRowAVX2
+		};
+
+		return Table;
+	}
+#else
+	const KernelTable& Kernels::GetAVX2()
+	{
+		return GetScalar();
+	}
+#endif
+}
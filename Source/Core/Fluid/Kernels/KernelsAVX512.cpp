@@ -0,0 +1,208 @@
+#include "Kernels.h"
+#include "KernelsShared.h"
+
+#if FLUID_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+namespace Simulation
+{
+#if FLUID_KERNELS_X86
+	namespace
+	{
+		// 16 cells per iteration, predication goes through mask registers instead of blends
+
+		FLUID_TARGET("avx512f") inline __mmask16 FluidMask16(const uint8_t* solid)
+		{
+			__m512i Wide = _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i*)solid));
+			return _mm512_cmpeq_epi32_mask(Wide, _mm512_setzero_si512());
+		}
+
+		FLUID_TARGET("avx512f") inline __mmask16 FaceMask16(const uint8_t* faces, __m512i bit)
+		{
+			__m512i Wide = _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i*)faces));
+			return _mm512_test_epi32_mask(Wide, bit);
+		}
+
+		FLUID_TARGET("avx512f") inline __m512 Divergence16(const KernelRow& row, int x)
+		{
+			__m512 U0 = _mm512_loadu_ps(row.U + x);
+			__m512 U1 = _mm512_loadu_ps(row.U + x + 1);
+			__m512 V0 = _mm512_loadu_ps(row.V + x);
+			__m512 V1 = _mm512_loadu_ps(row.V + x + row.Stride);
+
+			return _mm512_add_ps(_mm512_sub_ps(U1, U0), _mm512_sub_ps(V1, V0));
+		}
+
+		FLUID_TARGET("avx512f") void AddOpenFacesAVX512(float* row, const uint8_t* faces, uint8_t bit, int count, float value)
+		{
+			const __m512 Value = _mm512_set1_ps(value);
+			const __m512i Bit = _mm512_set1_epi32(bit);
+			int x = 0;
+
+			for (; x + 16 <= count; x += 16) {
+				__mmask16 Open = FaceMask16(faces + x, Bit);
+				_mm512_mask_storeu_ps(row + x, Open, _mm512_add_ps(_mm512_loadu_ps(row + x), Value));
+			}
+
+			KernelsShared::AddOpenFacesTail(row, faces, bit, x, count, value);
+		}
+
+		FLUID_TARGET("avx512f") float DivergenceRowAVX512(const KernelRow& row, float* out)
+		{
+			__m512 Max = _mm512_setzero_ps();
+			int x = 0;
+
+			for (; x + 16 <= row.Count; x += 16) {
+				__m512 Divergence = _mm512_maskz_mov_ps(FluidMask16(row.Solid + x), Divergence16(row, x));
+				_mm512_storeu_ps(out + x, Divergence);
+				Max = _mm512_max_ps(Max, _mm512_abs_ps(Divergence));
+			}
+
+			float MaxDivergence = _mm512_reduce_max_ps(Max);
+
+			return KernelsShared::DivergenceTail(row, x, out, MaxDivergence);
+		}
+
+		FLUID_TARGET("avx512f") RowResidual RedBlackRowAVX512(const KernelRow& row, int parity, float overRelaxation, float pressureScale, float* scratch)
+		{
+			// Push[-1] and Push[Count] stay 0 so the faces on the domain edge read a neighbour that never moves
+			float* Push = scratch + 1;
+			Push[-1] = 0.0f;
+			Push[row.Count] = 0.0f;
+
+			// Chunks start on even cells so lane parity is cell parity
+			const __mmask16 ColorMask = parity == 0 ? __mmask16(0x5555) : __mmask16(0xAAAA);
+			const __m512 OverRelaxation = _mm512_set1_ps(overRelaxation);
+			const __m512 PressureScale = _mm512_set1_ps(pressureScale);
+			const __m512 Zero = _mm512_setzero_ps();
+
+			__m512 MaxResidual = Zero;
+			__m512 SumSquares = Zero;
+
+			int x = 0;
+
+			for (; x + 16 <= row.Count; x += 16) {
+				__m512 InvWeight = _mm512_loadu_ps(row.InvWeight + x);
+				__m512 Divergence = Divergence16(row, x);
+
+				__m512 Residual = _mm512_maskz_mov_ps(ColorMask & _mm512_cmp_ps_mask(InvWeight, Zero, _CMP_GT_OQ), Divergence);
+				MaxResidual = _mm512_max_ps(MaxResidual, _mm512_abs_ps(Residual));
+				SumSquares = _mm512_add_ps(SumSquares, _mm512_mul_ps(Residual, Residual));
+
+				__m512 Amount = _mm512_maskz_mul_ps(ColorMask, _mm512_mul_ps(Divergence, OverRelaxation), InvWeight);
+				_mm512_storeu_ps(Push + x, Amount);
+
+				__m512 Pressure = _mm512_loadu_ps(row.Pressure + x);
+				_mm512_mask_storeu_ps(row.Pressure + x, ColorMask, _mm512_add_ps(Pressure, _mm512_mul_ps(Amount, PressureScale)));
+			}
+
+			RowResidual Result;
+			Result.Max = _mm512_reduce_max_ps(MaxResidual);
+			Result.SumSquares = _mm512_reduce_add_ps(SumSquares);
+
+			KernelsShared::RedBlackComputeTail(row, x, parity, overRelaxation, pressureScale, Push, Result);
+
+			const __m512i Left = _mm512_set1_epi32(FACE_LEFT);
+			const __m512i Bottom = _mm512_set1_epi32(FACE_BOTTOM);
+			const __m512i Top = _mm512_set1_epi32(FACE_TOP);
+
+			x = 0;
+
+			// Closed faces are simply not stored
+			for (; x + 16 <= row.Count; x += 16) {
+				const uint8_t* Faces = row.Faces + x;
+				__m512 Current = _mm512_loadu_ps(Push + x);
+				__m512 Horizontal = _mm512_sub_ps(Current, _mm512_loadu_ps(Push + x - 1));
+
+				_mm512_mask_storeu_ps(row.U + x, FaceMask16(Faces, Left), _mm512_add_ps(_mm512_loadu_ps(row.U + x), Horizontal));
+				_mm512_mask_storeu_ps(row.V + x, FaceMask16(Faces, Bottom), _mm512_add_ps(_mm512_loadu_ps(row.V + x), Current));
+				_mm512_mask_storeu_ps(row.V + x + row.Stride, FaceMask16(Faces, Top), _mm512_sub_ps(_mm512_loadu_ps(row.V + x + row.Stride), Current));
+			}
+
+			KernelsShared::RedBlackApplyTail(row, x, Push);
+
+			return Result;
+		}
+
+		FLUID_TARGET("avx512f") inline __m512 Curl16(const KernelRow& row, int x)
+		{
+			const int S = row.Stride;
+			__m512 Dv = _mm512_sub_ps(_mm512_add_ps(_mm512_loadu_ps(row.V + x + 1), _mm512_loadu_ps(row.V + x + 1 + S)), _mm512_add_ps(_mm512_loadu_ps(row.V + x - 1), _mm512_loadu_ps(row.V + x - 1 + S)));
+			__m512 Du = _mm512_sub_ps(_mm512_add_ps(_mm512_loadu_ps(row.U + x + S), _mm512_loadu_ps(row.U + x + 1 + S)), _mm512_add_ps(_mm512_loadu_ps(row.U + x - S), _mm512_loadu_ps(row.U + x + 1 - S)));
+
+			return _mm512_mul_ps(_mm512_sub_ps(Dv, Du), _mm512_set1_ps(0.25f));
+		}
+
+		// |a| + |b|
+		FLUID_TARGET("avx512f") inline __m512 AbsSum16(const float* a, const float* b)
+		{
+			return _mm512_add_ps(_mm512_abs_ps(_mm512_loadu_ps(a)), _mm512_abs_ps(_mm512_loadu_ps(b)));
+		}
+
+		FLUID_TARGET("avx512f") inline __m512 ConfinementForce16(__m512 c0, __m512 c1, __m512 across)
+		{
+			__m512 Along = _mm512_sub_ps(_mm512_abs_ps(c1), _mm512_abs_ps(c0));
+			__m512 Length = _mm512_add_ps(_mm512_sqrt_ps(_mm512_add_ps(_mm512_mul_ps(Along, Along), _mm512_mul_ps(across, across))), _mm512_set1_ps(KernelsShared::ConfinementEpsilon));
+
+			return _mm512_mul_ps(_mm512_div_ps(across, Length), _mm512_mul_ps(_mm512_add_ps(c0, c1), _mm512_set1_ps(0.5f)));
+		}
+
+		FLUID_TARGET("avx512f") void CurlRowAVX512(const KernelRow& row, float* out)
+		{
+			int x = 0;
+
+			for (; x + 16 <= row.Count; x += 16) {
+				// The zero test of FluidMask16 on the face mask picks the cells without an open face
+				_mm512_storeu_ps(out + x, _mm512_maskz_mov_ps(_mm512_knot(FluidMask16(row.Faces + x)), Curl16(row, x)));
+			}
+
+			KernelsShared::CurlTail(row, x, out);
+		}
+
+		FLUID_TARGET("avx512f") void ConfinementRowAVX512(const KernelRow& row, const float* curl, float scale)
+		{
+			const int S = row.Stride;
+			const __m512 Quarter = _mm512_set1_ps(0.25f);
+			const __m512 Scale = _mm512_set1_ps(scale);
+			const __m512i Left = _mm512_set1_epi32(FACE_LEFT);
+			const __m512i Bottom = _mm512_set1_epi32(FACE_BOTTOM);
+			int x = 0;
+
+			for (; x + 16 <= row.Count; x += 16) {
+				const float* C = curl + x;
+				__m512 Center = _mm512_loadu_ps(C);
+
+				__m512 AcrossU = _mm512_mul_ps(_mm512_sub_ps(AbsSum16(C - 1 + S, C + S), AbsSum16(C - 1 - S, C - S)), Quarter);
+				__m512 ForceU = ConfinementForce16(_mm512_loadu_ps(C - 1), Center, AcrossU);
+				_mm512_mask_storeu_ps(row.U + x, FaceMask16(row.Faces + x, Left), _mm512_add_ps(_mm512_loadu_ps(row.U + x), _mm512_mul_ps(ForceU, Scale)));
+
+				__m512 AcrossV = _mm512_mul_ps(_mm512_sub_ps(AbsSum16(C + 1, C + 1 - S), AbsSum16(C - 1, C - 1 - S)), Quarter);
+				__m512 ForceV = ConfinementForce16(_mm512_loadu_ps(C - S), Center, AcrossV);
+				_mm512_mask_storeu_ps(row.V + x, FaceMask16(row.Faces + x, Bottom), _mm512_sub_ps(_mm512_loadu_ps(row.V + x), _mm512_mul_ps(ForceV, Scale)));
+			}
+
+			KernelsShared::ConfinementTail(row, x, curl, scale);
+		}
+	}
+
+	const KernelTable& Kernels::GetAVX512()
+	{
+		static const KernelTable Table = {
+			"avx512",
+			AddOpenFacesAVX512,
+			DivergenceRowAVX512,
+			RedBlackRowAVX512,
+			CurlRowAVX512,
+			ConfinementRowAVX512
+		};
+
+		return Table;
+	}
+#else
+	const KernelTable& Kernels::GetAVX512()
+	{
+		return GetScalar();
+	}
+#endif
+}
@@ -0,0 +1,232 @@
+#include "Kernels.h"
+#include "KernelsShared.h"
+
+#include <cstring>
+
+#if FLUID_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+namespace Simulation
+{
+#if FLUID_KERNELS_X86
+	namespace
+	{
+		// 4 cells per iteration
+
+		FLUID_TARGET("sse4.2") inline __m128 FluidMask4(const uint8_t* solid)
+		{
+			int32_t Bytes;
+			memcpy(&Bytes, solid, sizeof(Bytes));
+
+			__m128i Wide = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(Bytes));
+			return _mm_castsi128_ps(_mm_cmpeq_epi32(Wide, _mm_setzero_si128()));
+		}
+
+		// All ones in the lanes whose face mask has the bit set
+		FLUID_TARGET("sse4.2") inline __m128 FaceMask4(const uint8_t* faces, __m128i bit)
+		{
+			int32_t Bytes;
+			memcpy(&Bytes, faces, sizeof(Bytes));
+
+			__m128i Wide = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(Bytes));
+			return _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(Wide, bit), bit));
+		}
+
+		FLUID_TARGET("sse4.2") inline __m128 Divergence4(const KernelRow& row, int x)
+		{
+			__m128 U0 = _mm_loadu_ps(row.U + x);
+			__m128 U1 = _mm_loadu_ps(row.U + x + 1);
+			__m128 V0 = _mm_loadu_ps(row.V + x);
+			__m128 V1 = _mm_loadu_ps(row.V + x + row.Stride);
+
+			return _mm_add_ps(_mm_sub_ps(U1, U0), _mm_sub_ps(V1, V0));
+		}
+
+		FLUID_TARGET("sse4.2") void AddOpenFacesSSE42(float* row, const uint8_t* faces, uint8_t bit, int count, float value)
+		{
+			const __m128 Value = _mm_set1_ps(value);
+			const __m128i Bit = _mm_set1_epi32(bit);
+			int x = 0;
+
+			for (; x + 4 <= count; x += 4) {
+				__m128 Add = _mm_and_ps(Value, FaceMask4(faces + x, Bit));
+				_mm_storeu_ps(row + x, _mm_add_ps(_mm_loadu_ps(row + x), Add));
+			}
+
+			KernelsShared::AddOpenFacesTail(row, faces, bit, x, count, value);
+		}
+
+		FLUID_TARGET("sse4.2") float DivergenceRowSSE42(const KernelRow& row, float* out)
+		{
+			const __m128 SignMask = _mm_set1_ps(-0.0f);
+			__m128 Max = _mm_setzero_ps();
+			int x = 0;
+
+			for (; x + 4 <= row.Count; x += 4) {
+				__m128 Divergence = _mm_and_ps(Divergence4(row, x), FluidMask4(row.Solid + x));
+				_mm_storeu_ps(out + x, Divergence);
+				Max = _mm_max_ps(Max, _mm_andnot_ps(SignMask, Divergence));
+			}
+
+			float Lanes[4];
+			_mm_storeu_ps(Lanes, Max);
+			float MaxDivergence = std::fmax(std::fmax(Lanes[0], Lanes[1]), std::fmax(Lanes[2], Lanes[3]));
+
+			return KernelsShared::DivergenceTail(row, x, out, MaxDivergence);
+		}
+
+		FLUID_TARGET("sse4.2") RowResidual RedBlackRowSSE42(const KernelRow& row, int parity, float overRelaxation, float pressureScale, float* scratch)
+		{
+			// Push[-1] and Push[Count] stay 0 so the faces on the domain edge read a neighbour that never moves
+			float* Push = scratch + 1;
+			Push[-1] = 0.0f;
+			Push[row.Count] = 0.0f;
+
+			// Chunks start on even cells so lane parity is cell parity
+			const __m128 ColorMask = parity == 0 ? _mm_castsi128_ps(_mm_setr_epi32(-1, 0, -1, 0)) : _mm_castsi128_ps(_mm_setr_epi32(0, -1, 0, -1));
+			const __m128 OverRelaxation = _mm_set1_ps(overRelaxation);
+			const __m128 PressureScale = _mm_set1_ps(pressureScale);
+			const __m128 SignMask = _mm_set1_ps(-0.0f);
+			const __m128 Zero = _mm_setzero_ps();
+
+			__m128 MaxResidual = Zero;
+			__m128 SumSquares = Zero;
+
+			int x = 0;
+
+			for (; x + 4 <= row.Count; x += 4) {
+				__m128 InvWeight = _mm_loadu_ps(row.InvWeight + x);
+				__m128 Divergence = Divergence4(row, x);
+
+				__m128 Residual = _mm_and_ps(Divergence, _mm_and_ps(ColorMask, _mm_cmpgt_ps(InvWeight, Zero)));
+				MaxResidual = _mm_max_ps(MaxResidual, _mm_andnot_ps(SignMask, Residual));
+				SumSquares = _mm_add_ps(SumSquares, _mm_mul_ps(Residual, Residual));
+
+				__m128 Amount = _mm_and_ps(_mm_mul_ps(_mm_mul_ps(Divergence, OverRelaxation), InvWeight), ColorMask);
+				_mm_storeu_ps(Push + x, Amount);
+
+				__m128 Pressure = _mm_loadu_ps(row.Pressure + x);
+				_mm_storeu_ps(row.Pressure + x, _mm_blendv_ps(Pressure, _mm_add_ps(Pressure, _mm_mul_ps(Amount, PressureScale)), ColorMask));
+			}
+
+			RowResidual Result;
+			float Lanes[4];
+
+			_mm_storeu_ps(Lanes, MaxResidual);
+
+			for (int i = 0; i < 4; i++) {
+				Result.Max = std::fmax(Result.Max, Lanes[i]);
+			}
+
+			_mm_storeu_ps(Lanes, SumSquares);
+
+			for (int i = 0; i < 4; i++) {
+				Result.SumSquares += Lanes[i];
+			}
+
+			KernelsShared::RedBlackComputeTail(row, x, parity, overRelaxation, pressureScale, Push, Result);
+
+			const __m128i Left = _mm_set1_epi32(FACE_LEFT);
+			const __m128i Bottom = _mm_set1_epi32(FACE_BOTTOM);
+			const __m128i Top = _mm_set1_epi32(FACE_TOP);
+
+			x = 0;
+
+			for (; x + 4 <= row.Count; x += 4) {
+				const uint8_t* Faces = row.Faces + x;
+				__m128 Current = _mm_loadu_ps(Push + x);
+				__m128 Horizontal = _mm_and_ps(_mm_sub_ps(Current, _mm_loadu_ps(Push + x - 1)), FaceMask4(Faces, Left));
+
+				_mm_storeu_ps(row.U + x, _mm_add_ps(_mm_loadu_ps(row.U + x), Horizontal));
+				_mm_storeu_ps(row.V + x, _mm_add_ps(_mm_loadu_ps(row.V + x), _mm_and_ps(Current, FaceMask4(Faces, Bottom))));
+				_mm_storeu_ps(row.V + x + row.Stride, _mm_sub_ps(_mm_loadu_ps(row.V + x + row.Stride), _mm_and_ps(Current, FaceMask4(Faces, Top))));
+			}
+
+			KernelsShared::RedBlackApplyTail(row, x, Push);
+
+			return Result;
+		}
+
+		FLUID_TARGET("sse4.2") inline __m128 Curl4(const KernelRow& row, int x)
+		{
+			const int S = row.Stride;
+			__m128 Dv = _mm_sub_ps(_mm_add_ps(_mm_loadu_ps(row.V + x + 1), _mm_loadu_ps(row.V + x + 1 + S)), _mm_add_ps(_mm_loadu_ps(row.V + x - 1), _mm_loadu_ps(row.V + x - 1 + S)));
+			__m128 Du = _mm_sub_ps(_mm_add_ps(_mm_loadu_ps(row.U + x + S), _mm_loadu_ps(row.U + x + 1 + S)), _mm_add_ps(_mm_loadu_ps(row.U + x - S), _mm_loadu_ps(row.U + x + 1 - S)));
+
+			return _mm_mul_ps(_mm_sub_ps(Dv, Du), _mm_set1_ps(0.25f));
+		}
+
+		// |a| + |b|
+		FLUID_TARGET("sse4.2") inline __m128 AbsSum4(const float* a, const float* b, __m128 signMask)
+		{
+			return _mm_add_ps(_mm_andnot_ps(signMask, _mm_loadu_ps(a)), _mm_andnot_ps(signMask, _mm_loadu_ps(b)));
+		}
+
+		FLUID_TARGET("sse4.2") inline __m128 ConfinementForce4(__m128 c0, __m128 c1, __m128 across, __m128 signMask)
+		{
+			__m128 Along = _mm_sub_ps(_mm_andnot_ps(signMask, c1), _mm_andnot_ps(signMask, c0));
+			__m128 Length = _mm_add_ps(_mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(Along, Along), _mm_mul_ps(across, across))), _mm_set1_ps(KernelsShared::ConfinementEpsilon));
+
+			return _mm_mul_ps(_mm_div_ps(across, Length), _mm_mul_ps(_mm_add_ps(c0, c1), _mm_set1_ps(0.5f)));
+		}
+
+		FLUID_TARGET("sse4.2") void CurlRowSSE42(const KernelRow& row, float* out)
+		{
+			int x = 0;
+
+			for (; x + 4 <= row.Count; x += 4) {
+				// The zero test of FluidMask4 on the face mask picks the cells without an open face
+				_mm_storeu_ps(out + x, _mm_andnot_ps(FluidMask4(row.Faces + x), Curl4(row, x)));
+			}
+
+			KernelsShared::CurlTail(row, x, out);
+		}
+
+		FLUID_TARGET("sse4.2") void ConfinementRowSSE42(const KernelRow& row, const float* curl, float scale)
+		{
+			const int S = row.Stride;
+			const __m128 SignMask = _mm_set1_ps(-0.0f);
+			const __m128 Quarter = _mm_set1_ps(0.25f);
+			const __m128 Scale = _mm_set1_ps(scale);
+			const __m128i Left = _mm_set1_epi32(FACE_LEFT);
+			const __m128i Bottom = _mm_set1_epi32(FACE_BOTTOM);
+			int x = 0;
+
+			for (; x + 4 <= row.Count; x += 4) {
+				const float* C = curl + x;
+				__m128 Center = _mm_loadu_ps(C);
+
+				__m128 AcrossU = _mm_mul_ps(_mm_sub_ps(AbsSum4(C - 1 + S, C + S, SignMask), AbsSum4(C - 1 - S, C - S, SignMask)), Quarter);
+				__m128 ForceU = _mm_and_ps(ConfinementForce4(_mm_loadu_ps(C - 1), Center, AcrossU, SignMask), FaceMask4(row.Faces + x, Left));
+				_mm_storeu_ps(row.U + x, _mm_add_ps(_mm_loadu_ps(row.U + x), _mm_mul_ps(ForceU, Scale)));
+
+				__m128 AcrossV = _mm_mul_ps(_mm_sub_ps(AbsSum4(C + 1, C + 1 - S, SignMask), AbsSum4(C - 1, C - 1 - S, SignMask)), Quarter);
+				__m128 ForceV = _mm_and_ps(ConfinementForce4(_mm_loadu_ps(C - S), Center, AcrossV, SignMask), FaceMask4(row.Faces + x, Bottom));
+				_mm_storeu_ps(row.V + x, _mm_sub_ps(_mm_loadu_ps(row.V + x), _mm_mul_ps(ForceV, Scale)));
+			}
+
+			KernelsShared::ConfinementTail(row, x, curl, scale);
+		}
+	}
+
+	const KernelTable& Kernels::GetSSE42()
+	{
+		static const KernelTable Table = {
+			"sse42",
+			AddOpenFacesSSE42,
+			DivergenceRowSSE42,
+			RedBlackRowSSE42,
+			CurlRowSSE42,
+			ConfinementRowSSE42
+		};
+
+		return Table;
+	}
+#else
+	const KernelTable& Kernels::GetSSE42()
+	{
+		return GetScalar();
+	}
+#endif
+}
@@ -0,0 +1,83 @@
+#include "Kernels.h"
+#include "KernelsShared.h"
+
+#include <cmath>
+
+namespace Simulation
+{
+	namespace
+	{
+		void AddOpenFacesScalar(float* row, const uint8_t* faces, uint8_t bit, int count, float value)
+		{
+			KernelsShared::AddOpenFacesTail(row, faces, bit, 0, count, value);
+		}
+
+		float DivergenceRowScalar(const KernelRow& row, float* out)
+		{
+			return KernelsShared::DivergenceTail(row, 0, out, 0.0f);
+		}
+
+		// Reference implementation, the vector versions split this into a compute and an apply pass
+		RowResidual RedBlackRowScalar(const KernelRow& row, int parity, float overRelaxation, float pressureScale, float* scratch)
+		{
+			RowResidual Residual;
+
+			for (int x = parity; x < row.Count; x += 2) {
+
+				const uint8_t Faces = row.Faces[x];
+				const float Divergence = KernelsShared::CellDivergence(row, x);
+
+				if (Faces) {
+					Residual.Max = std::fmax(Residual.Max, std::fabs(Divergence));
+					Residual.SumSquares += Divergence * Divergence;
+				}
+
+				float Push = (Divergence * overRelaxation) * row.InvWeight[x];
+
+				if (Faces & FACE_LEFT) {
+					row.U[x] += Push;
+				}
+
+				if (Faces & FACE_RIGHT) {
+					row.U[x + 1] -= Push;
+				}
+
+				if (Faces & FACE_BOTTOM) {
+					row.V[x] += Push;
+				}
+
+				if (Faces & FACE_TOP) {
+					row.V[x + row.Stride] -= Push;
+				}
+
+				row.Pressure[x] += Push * pressureScale;
+			}
+
+			return Residual;
+		}
+
+		void CurlRowScalar(const KernelRow& row, float* out)
+		{
+			KernelsShared::CurlTail(row, 0, out);
+		}
+
+		void ConfinementRowScalar(const KernelRow& row, const float* curl, float scale)
+		{
+			KernelsShared::ConfinementTail(row, 0, curl, scale);
+		}
+	}
+
+	const KernelTable& Kernels::GetScalar()
+	{
+		static const KernelTable Table = {
+			"scalar",
+			AddOpenFacesScalar,
+			DivergenceRowScalar,
+			RedBlackRowScalar,
+			CurlRowScalar,
+			ConfinementRowScalar
+		};
+
+		return Table;
+	}
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+#include "Kernels.h"
+
+#include "../FluidGrid.h"
+
+#include <cmath>
+
+// Scalar pieces shared by the vector kernels for the row tails
+// The expressions are written in the same order as the vector code so both give the same result
+
+namespace Simulation
+{
+	namespace KernelsShared
+	{
+		inline float CellDivergence(const KernelRow& row, int x)
+		{
+			return (row.U[x + 1] - row.U[x]) + (row.V[x + row.Stride] - row.V[x]);
+		}
+
+		inline float DivergenceTail(const KernelRow& row, int begin, float* out, float maxDivergence)
+		{
+			for (int x = begin; x < row.Count; x++) {
+				float Divergence = row.Solid[x] ? 0.0f : CellDivergence(row, x);
+				out[x] = Divergence;
+				maxDivergence = std::fmax(maxDivergence, std::fabs(Divergence));
+			}
+
+			return maxDivergence;
+		}
+
+		// Vorticity at the centre of cell x from the face velocities averaged to the centres around it
+		inline float CellCurl(const KernelRow& row, int x)
+		{
+			const int S = row.Stride;
+			const float Dv = (row.V[x + 1] + row.V[x + 1 + S]) - (row.V[x - 1] + row.V[x - 1 + S]);
+			const float Du = (row.U[x + S] + row.U[x + 1 + S]) - (row.U[x - S] + row.U[x + 1 - S]);
+
+			return (Dv - Du) * 0.25f;
+		}
+
+		inline void CurlTail(const KernelRow& row, int begin, float* out)
+		{
+			for (int x = begin; x < row.Count; x++) {
+				out[x] = row.Faces[x] ? CellCurl(row, x) : 0.0f;
+			}
+		}
+
+		// Keeps the normal finite where the vorticity magnitude is flat
+		constexpr float ConfinementEpsilon = 1e-6f;
+
+		// Confinement force on the face between two cells of curl c0 and c1, across is the gradient of |curl| along the face
+		// The normal is the gradient over its length, the force is normal x curl so only the across component pushes this face
+		inline float ConfinementForce(float c0, float c1, float across)
+		{
+			const float Along = std::fabs(c1) - std::fabs(c0);
+			const float Length = std::sqrt(Along * Along + across * across) + ConfinementEpsilon;
+
+			return (across / Length) * ((c0 + c1) * 0.5f);
+		}
+
+		// curl is at cell (0, y) of a grid layout field, the rows above and below are read too
+		inline void ConfinementTail(const KernelRow& row, int begin, const float* curl, float scale)
+		{
+			const int S = row.Stride;
+
+			for (int x = begin; x < row.Count; x++) {
+				const uint8_t Faces = row.Faces[x];
+
+				if (Faces & FACE_LEFT) {
+					const float Across = ((std::fabs(curl[x - 1 + S]) + std::fabs(curl[x + S])) - (std::fabs(curl[x - 1 - S]) + std::fabs(curl[x - S]))) * 0.25f;
+					row.U[x] += ConfinementForce(curl[x - 1], curl[x], Across) * scale;
+				}
+
+				if (Faces & FACE_BOTTOM) {
+					const float Across = ((std::fabs(curl[x + 1]) + std::fabs(curl[x + 1 - S])) - (std::fabs(curl[x - 1]) + std::fabs(curl[x - 1 - S]))) * 0.25f;
+					row.V[x] -= ConfinementForce(curl[x - S], curl[x], Across) * scale;
+				}
+			}
+		}
+
+		inline void AddOpenFacesTail(float* row, const uint8_t* faces, uint8_t bit, int begin, int count, float value)
+		{
+			for (int x = begin; x < count; x++) {
+				if (faces[x] & bit) {
+					row[x] += value;
+				}
+			}
+		}
+
+		// Phase 1 : amount pushed out of every cell of the colour, 0 everywhere else
+		// InvWeight is 0 for solid cells so they push nothing
+		inline void RedBlackComputeTail(const KernelRow& row, int begin, int parity, float overRelaxation, float pressureScale, float* push, RowResidual& residual)
+		{
+			for (int x = begin; x < row.Count; x++) {
+				float Push = 0.0f;
+
+				if ((x & 1) == parity) {
+					const float Divergence = CellDivergence(row, x);
+
+					if (row.InvWeight[x] > 0.0f) {
+						residual.Max = std::fmax(residual.Max, std::fabs(Divergence));
+						residual.SumSquares += Divergence * Divergence;
+					}
+
+					Push = (Divergence * overRelaxation) * row.InvWeight[x];
+					row.Pressure[x] += Push * pressureScale;
+				}
+
+				push[x] = Push;
+			}
+		}
+
+		// Phase 2 : every open face takes the push of the cell on each side, only one of the two is active
+		// The cells left of the row and right of it don't push (push[-1] and push[Count] are 0)
+		inline void RedBlackApplyTail(const KernelRow& row, int begin, const float* push)
+		{
+			for (int x = begin; x < row.Count; x++) {
+				const uint8_t Faces = row.Faces[x];
+
+				if (Faces & FACE_LEFT) {
+					row.U[x] += push[x] - push[x - 1];
+				}
+
+				if (Faces & FACE_BOTTOM) {
+					row.V[x] += push[x];
+				}
+
+				if (Faces & FACE_TOP) {
+					row.V[x + row.Stride] -= push[x];
+				}
+			}
+
+			// A full row ends on the border, where the face is closed, a span of a row can end on an open one
+			if (row.Count > 0 && (row.Faces[row.Count - 1] & FACE_RIGHT)) {
+				row.U[row.Count] -= push[row.Count - 1];
+			}
+		}
+	}
+}
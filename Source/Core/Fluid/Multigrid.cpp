@@ -0,0 +1,323 @@
+#include "Multigrid.h"
+#include "PressureSystem.h"
+
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+#include "../Utils/AlignedAlloc.h"
+
+namespace Simulation
+{
+	namespace
+	{
+		// Levels stop halving below this resolution
+		const int CoarsestResolution = 4;
+
+		// The coarsest level is tiny, it is simply smoothed until it has converged
+		const int CoarsestSweeps = 64;
+	}
+
+	MultigridSolver::~MultigridSolver()
+	{
+		FreeLevels();
+	}
+
+	void MultigridSolver::FreeLevels()
+	{
+		for (Level& L : m_Levels) {
+			AlignedFree(L.Phi);
+			AlignedFree(L.Rhs);
+			AlignedFree(L.Residual);
+			AlignedFree(L.InvWeight);
+			AlignedFree(L.Faces);
+		}
+
+		m_Levels.clear();
+	}
+
+	void MultigridSolver::Build(const FluidGrid& grid)
+	{
+		FreeLevels();
+
+		const int FloatsPerLine = int(FieldAlignment / sizeof(float));
+		int Resolution = grid.GetResolution();
+
+		while (true) {
+			Level L;
+			L.Resolution = Resolution;
+			L.Stride = ((Resolution + 2 + FloatsPerLine - 1) / FloatsPerLine) * FloatsPerLine;
+
+			const size_t Size = L.GetFieldSize();
+
+			L.Phi = AlignedAlloc<float>(Size);
+			L.Rhs = AlignedAlloc<float>(Size);
+			L.Residual = AlignedAlloc<float>(Size);
+			L.InvWeight = AlignedAlloc<float>(Size);
+			L.Faces = AlignedAlloc<uint8_t>(Size);
+
+			// The border never changes, zero it once
+			memset(L.Phi, 0, Size * sizeof(float));
+			memset(L.Rhs, 0, Size * sizeof(float));
+			memset(L.Residual, 0, Size * sizeof(float));
+
+			m_Levels.push_back(L);
+
+			if (Resolution <= CoarsestResolution) {
+				break;
+			}
+
+			Resolution = (Resolution + 1) / 2;
+		}
+
+		// The finest level shares the grid layout
+		Level& Finest = m_Levels[0];
+		memcpy(Finest.Faces, grid.GetFaces(), Finest.GetFieldSize() * sizeof(uint8_t));
+		memcpy(Finest.InvWeight, grid.GetInvWeight(), Finest.GetFieldSize() * sizeof(float));
+
+		for (size_t l = 1; l < m_Levels.size(); l++) {
+			const Level& Fine = m_Levels[l - 1];
+			Level& Coarse = m_Levels[l];
+
+			memset(Coarse.Faces, 0, Coarse.GetFieldSize() * sizeof(uint8_t));
+			memset(Coarse.InvWeight, 0, Coarse.GetFieldSize() * sizeof(float));
+
+			for (int y = 0; y < Coarse.Resolution; y++) {
+				for (int x = 0; x < Coarse.Resolution; x++) {
+					CoarsenCell(Fine, Coarse, x, y);
+				}
+			}
+		}
+
+		m_GridResolution = grid.GetResolution();
+		m_ObstacleVersion = grid.GetObstacleVersion();
+
+		m_RowMax.resize(m_GridResolution);
+		m_RowSums.resize(size_t(m_GridResolution) * 2);
+	}
+
+	void MultigridSolver::Update(const FluidGrid& grid)
+	{
+		Level& Finest = m_Levels[0];
+		m_Changed.clear();
+
+		for (int i : grid.GetChangedCells()) {
+			Finest.Faces[i] = grid.GetFaces()[i];
+			Finest.InvWeight[i] = grid.GetInvWeight()[i];
+			m_Changed.push_back(i);
+		}
+
+		// A fine cell only changes whether its parent is fluid, which only changes the faces of the parent and its 4 neighbours
+		// The coarse cells whose faces did change are the ones to carry on with on the next level
+		for (size_t l = 1; l < m_Levels.size() && !m_Changed.empty(); l++) {
+			const Level& Fine = m_Levels[l - 1];
+			Level& Coarse = m_Levels[l];
+
+			m_Parents.clear();
+
+			for (int i : m_Changed) {
+				const int x = (i % Fine.Stride - 1) / 2;
+				const int y = (i / Fine.Stride - 1) / 2;
+
+				for (const glm::ivec2& Offset : { glm::ivec2(0, 0), glm::ivec2(-1, 0), glm::ivec2(1, 0), glm::ivec2(0, -1), glm::ivec2(0, 1) }) {
+					const int nx = x + Offset.x;
+					const int ny = y + Offset.y;
+
+					if (nx >= 0 && ny >= 0 && nx < Coarse.Resolution && ny < Coarse.Resolution) {
+						m_Parents.push_back(Coarse.Index(nx, ny));
+					}
+				}
+			}
+
+			std::sort(m_Parents.begin(), m_Parents.end());
+			m_Parents.erase(std::unique(m_Parents.begin(), m_Parents.end()), m_Parents.end());
+
+			m_Changed.clear();
+
+			for (int i : m_Parents) {
+				if (CoarsenCell(Fine, Coarse, i % Coarse.Stride - 1, i / Coarse.Stride - 1)) {
+					m_Changed.push_back(i);
+				}
+			}
+		}
+
+		m_ObstacleVersion = grid.GetObstacleVersion();
+	}
+
+	bool MultigridSolver::CoarsenCell(const Level& fine, Level& coarse, int x, int y)
+	{
+		// Children past the edge of an odd sized level land on the border, which has no open faces
+		auto IsFluid = [&](int cx, int cy) {
+			if (cx < 0 || cy < 0 || cx >= coarse.Resolution || cy >= coarse.Resolution) {
+				return false;
+			}
+
+			const int Child = fine.Index(2 * cx, 2 * cy);
+			return (fine.Faces[Child] | fine.Faces[Child + 1] | fine.Faces[Child + fine.Stride] | fine.Faces[Child + fine.Stride + 1]) != 0;
+		};
+
+		uint8_t Faces = 0;
+
+		if (IsFluid(x, y)) {
+			if (IsFluid(x - 1, y)) Faces |= FACE_LEFT;
+			if (IsFluid(x + 1, y)) Faces |= FACE_RIGHT;
+			if (IsFluid(x, y - 1)) Faces |= FACE_BOTTOM;
+			if (IsFluid(x, y + 1)) Faces |= FACE_TOP;
+		}
+
+		const int i = coarse.Index(x, y);
+		const bool Changed = coarse.Faces[i] != Faces;
+
+		coarse.Faces[i] = Faces;
+		coarse.InvWeight[i] = Faces ? 1.0f / PressureSystem::OpenFaceCount(Faces) : 0.0f;
+		return Changed;
+	}
+
+	void MultigridSolver::Project(FluidGrid& grid, ThreadPool& pool, const MultigridSettings& settings, float pressureScale)
+	{
+		if (m_Levels.empty() || grid.GetResolution() != m_GridResolution) {
+			Build(grid);
+		}
+
+		// Moving bodies change a few cells every step, those only touch the coarse cells above them
+		else if (grid.GetObstacleVersion() == m_ObstacleVersion + 1 && !grid.IsLastUpdateFull()) {
+			Update(grid);
+		}
+
+		else if (grid.GetObstacleVersion() != m_ObstacleVersion) {
+			Build(grid);
+		}
+
+		m_Pool = &pool;
+		m_Settings = settings;
+
+		Level& Finest = m_Levels[0];
+		PressureSystem::BuildRhs(grid, pool, Finest.Rhs, m_RowSums);
+
+		memset(Finest.Phi, 0, Finest.GetFieldSize() * sizeof(float));
+
+		m_ActiveCells = grid.GetActiveCellCount();
+		m_InitialResidual = ComputeResidual(Finest);
+		m_FinalResidual = m_InitialResidual;
+		m_Cycles = 0;
+
+		while (m_Cycles < m_Settings.Convergence.MaxIterations && !PressureSystem::IsConverged(m_Settings.Convergence, m_FinalResidual)) {
+			Cycle(0);
+			m_Cycles++;
+			m_FinalResidual = ComputeResidual(Finest);
+		}
+
+		PressureSystem::ApplyPush(grid, pool, Finest.Phi, pressureScale);
+	}
+
+	void MultigridSolver::Cycle(int level)
+	{
+		Level& L = m_Levels[level];
+
+		if (level + 1 == int(m_Levels.size())) {
+			Smooth(L, CoarsestSweeps);
+			return;
+		}
+
+		Level& Coarse = m_Levels[level + 1];
+
+		Smooth(L, m_Settings.PreSmoothing);
+		ComputeResidual(L);
+		Restrict(L, Coarse);
+
+		memset(Coarse.Phi, 0, Coarse.GetFieldSize() * sizeof(float));
+
+		const int Visits = m_Settings.Cycle == MultigridCycleType::W ? 2 : 1;
+
+		for (int i = 0; i < Visits; i++) {
+			Cycle(level + 1);
+		}
+
+		Prolong(Coarse, L);
+		Smooth(L, m_Settings.PostSmoothing);
+	}
+
+	void MultigridSolver::Smooth(Level& level, int sweeps)
+	{
+		for (int Sweep = 0; Sweep < sweeps; Sweep++) {
+			// A cell only reads the other colour so every row of one colour can run at once
+			for (int Color = 0; Color < 2; Color++) {
+				m_Pool->ParallelFor(0, level.Resolution, [&](int RowBegin, int RowEnd) {
+					for (int y = RowBegin; y < RowEnd; y++) {
+						for (int x = (y + Color) & 1; x < level.Resolution; x += 2) {
+							const int i = level.Index(x, y);
+							const uint8_t Faces = level.Faces[i];
+
+							level.Phi[i] = (level.Rhs[i] + PressureSystem::NeighbourSum(level.Phi, i, level.Stride, Faces)) * level.InvWeight[i];
+						}
+					}
+				});
+			}
+		}
+	}
+
+	float MultigridSolver::ComputeResidual(Level& level)
+	{
+		m_Pool->ParallelFor(0, level.Resolution, [&](int RowBegin, int RowEnd) {
+			for (int y = RowBegin; y < RowEnd; y++) {
+				float Max = 0.0f;
+				double SumSquares = 0.0;
+
+				for (int x = 0; x < level.Resolution; x++) {
+					const int i = level.Index(x, y);
+					const uint8_t Faces = level.Faces[i];
+					float Residual = 0.0f;
+
+					if (Faces) {
+						Residual = level.Rhs[i] - PressureSystem::Apply(level.Phi, i, level.Stride, Faces);
+					}
+
+					level.Residual[i] = Residual;
+					Max = std::fmax(Max, std::fabs(Residual));
+					SumSquares += double(Residual) * double(Residual);
+				}
+
+				m_RowMax[y] = Max;
+				m_RowSums[y] = SumSquares;
+			}
+		});
+
+		double SumSquares = 0.0;
+
+		for (int y = 0; y < level.Resolution; y++) {
+			SumSquares += m_RowSums[y];
+		}
+
+		const float Max = *std::max_element(m_RowMax.begin(), m_RowMax.begin() + level.Resolution);
+		return PressureSystem::ResidualValue(m_Settings.Convergence.Norm, Max, SumSquares, m_ActiveCells);
+	}
+
+	void MultigridSolver::Restrict(const Level& fine, Level& coarse)
+	{
+		m_Pool->ParallelFor(0, coarse.Resolution, [&](int RowBegin, int RowEnd) {
+			for (int y = RowBegin; y < RowEnd; y++) {
+				for (int x = 0; x < coarse.Resolution; x++) {
+					const int Child = fine.Index(2 * x, 2 * y);
+
+					coarse.Rhs[coarse.Index(x, y)] = (fine.Residual[Child] + fine.Residual[Child + 1]) +
+						(fine.Residual[Child + fine.Stride] + fine.Residual[Child + fine.Stride + 1]);
+				}
+			}
+		});
+	}
+
+	void MultigridSolver::Prolong(const Level& coarse, Level& fine)
+	{
+		m_Pool->ParallelFor(0, fine.Resolution, [&](int RowBegin, int RowEnd) {
+			for (int y = RowBegin; y < RowEnd; y++) {
+				for (int x = 0; x < fine.Resolution; x++) {
+					const int i = fine.Index(x, y);
+
+					if (fine.Faces[i]) {
+						fine.Phi[i] += coarse.Phi[coarse.Index(x / 2, y / 2)];
+					}
+				}
+			}
+		});
+	}
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include "FluidGrid.h"
+#include "PressureSystem.h"
+
+#include "../Utils/ThreadPool.h"
+
+namespace Simulation
+{
+	enum class MultigridCycleType : int {
+		V = 0,
+		W
+	};
+
+	struct MultigridSettings
+	{
+		MultigridCycleType Cycle = MultigridCycleType::V;
+
+		// An iteration is one cycle, the residual is checked on the finest level after each
+		ConvergenceSettings Convergence = { 2, 0.0f, ResidualNorm::Linf };
+
+		// Red-black sweeps before/after visiting the coarser level
+		int PreSmoothing = 2;
+		int PostSmoothing = 2;
+	};
+
+	// Geometric multigrid pressure projection, solves the system described in PressureSystem.h
+	//
+	// Each level halves the resolution, a coarse cell is fluid when any of its 4 children is
+	// Residuals are summed on the way down (the coarse stencil spans twice the distance) and corrections copied on the way up
+	// Every level is smoothed with red-black Gauss Seidel split across the pool
+	class MultigridSolver
+	{
+	public :
+
+		MultigridSolver() = default;
+		~MultigridSolver();
+
+		MultigridSolver(const MultigridSolver&) = delete;
+		MultigridSolver operator=(MultigridSolver const&) = delete;
+
+		// Makes the velocities divergence free and writes phi * pressureScale to the pressure field
+		// The hierarchy is rebuilt when the resolution changes or the obstacles changed more than once since the last call,
+		// a single local change (see FluidGrid::GetChangedCells()) only updates the coarse cells above it
+		void Project(FluidGrid& grid, ThreadPool& pool, const MultigridSettings& settings, float pressureScale);
+
+		// Residual on the finest level (in the selected norm) before/after the last Project() and the cycles it took
+		inline float GetInitialResidual() const { return m_InitialResidual; }
+		inline float GetFinalResidual() const { return m_FinalResidual; }
+		inline int GetCycles() const { return m_Cycles; }
+
+		inline int GetLevelCount() const { return int(m_Levels.size()); }
+
+	private :
+
+		// Same padded layout as FluidGrid, the border cells have no open faces
+		struct Level
+		{
+			int Resolution = 0;
+			int Stride = 0;
+
+			float* Phi = nullptr;
+			float* Rhs = nullptr;
+			float* Residual = nullptr;
+			float* InvWeight = nullptr;
+			uint8_t* Faces = nullptr;
+
+			inline int Index(int x, int y) const { return ((y + 1) * Stride) + (x + 1); }
+			inline size_t GetFieldSize() const { return size_t(Stride) * size_t(Resolution + 2); }
+		};
+
+		void Build(const FluidGrid& grid);
+		void FreeLevels();
+
+		// Brings the hierarchy to the next obstacle version from the cells the grid changed, same result as Build()
+		void Update(const FluidGrid& grid);
+
+		// Faces and weight of coarse cell (x, y) from its children, a coarse cell is fluid when any of them has open faces
+		// Returns whether its faces changed
+		bool CoarsenCell(const Level& fine, Level& coarse, int x, int y);
+
+		void Cycle(int level);
+		void Smooth(Level& level, int sweeps);
+
+		// Writes the residual of every cell, returns its norm
+		float ComputeResidual(Level& level);
+
+		void Restrict(const Level& fine, Level& coarse);
+		void Prolong(const Level& coarse, Level& fine);
+
+		std::vector<Level> m_Levels;
+		ThreadPool* m_Pool = nullptr;
+		MultigridSettings m_Settings;
+
+		int m_GridResolution = 0;
+		uint64_t m_ObstacleVersion = 0;
+
+		// Update() scratch, cells changed on the last level and the coarse cells to redo on the next
+		std::vector<int> m_Changed;
+		std::vector<int> m_Parents;
+
+		// Per row partial results, reduced in row order so the result doesn't depend on the thread count
+		std::vector<double> m_RowSums;
+		std::vector<float> m_RowMax;
+
+		int m_ActiveCells = 0;
+		int m_Cycles = 0;
+		float m_InitialResidual = 0.0f;
+		float m_FinalResidual = 0.0f;
+	};
+}
@@ -0,0 +1,125 @@
+#include "ObstacleMap.h"
+
+#include "../GLClasses/stb_image.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace Simulation
+{
+	bool ObstacleMap::Load(const std::string& path)
+	{
+		// The texture loaders leave the flip flag set either way, the map wants file order
+		stbi_set_flip_vertically_on_load(false);
+
+		// One channel, colour images are converted to luminance by stb_image
+		int Width = 0, Height = 0, Channels = 0;
+		stbi_uc* Pixels = stbi_load(path.c_str(), &Width, &Height, &Channels, 1);
+
+		if (!Pixels) {
+			return false;
+		}
+
+		m_Pixels.assign(Pixels, Pixels + size_t(Width) * size_t(Height));
+		stbi_image_free(Pixels);
+
+		m_Path = path;
+		m_Width = Width;
+		m_Height = Height;
+		return true;
+	}
+
+	void ObstacleMap::Assign(const std::string& path, int width, int height, std::vector<uint8_t> pixels)
+	{
+		m_Path = path;
+		m_Width = width;
+		m_Height = height;
+		m_Pixels = std::move(pixels);
+	}
+
+	void ObstacleMap::Rasterize(int resolution, const ObstacleMapSettings& settings, ThreadPool& pool, std::vector<uint8_t>& solid) const
+	{
+		solid.assign(size_t(resolution) * size_t(resolution), 0);
+
+		if (IsEmpty() || resolution <= 0) {
+			return;
+		}
+
+		// Pixel columns [ColumnBegin[x], ColumnEnd[x]) fall into cell column x, at least one per cell
+		std::vector<int> ColumnBegin(resolution);
+		std::vector<int> ColumnEnd(resolution);
+
+		for (int x = 0; x < resolution; x++) {
+			ColumnBegin[x] = int(int64_t(x) * m_Width / resolution);
+			ColumnEnd[x] = std::max(int(int64_t(x + 1) * m_Width / resolution), ColumnBegin[x] + 1);
+		}
+
+		pool.ParallelFor(0, resolution, [&](int RowBegin, int RowEnd) {
+			std::vector<uint64_t> Sums(resolution);
+
+			for (int y = RowBegin; y < RowEnd; y++) {
+				// Grid rows count from the bottom, image rows from the top
+				const int Band = resolution - 1 - y;
+				const int PixelY0 = int(int64_t(Band) * m_Height / resolution);
+				const int PixelY1 = std::max(int(int64_t(Band + 1) * m_Height / resolution), PixelY0 + 1);
+
+				std::fill(Sums.begin(), Sums.end(), uint64_t(0));
+
+				// Walks the pixel rows of the band in memory order
+				for (int py = PixelY0; py < PixelY1; py++) {
+					const uint8_t* Row = m_Pixels.data() + size_t(py) * size_t(m_Width);
+
+					for (int x = 0; x < resolution; x++) {
+						uint32_t Sum = 0;
+
+						for (int px = ColumnBegin[x]; px < ColumnEnd[x]; px++) {
+							Sum += Row[px];
+						}
+
+						Sums[x] += Sum;
+					}
+				}
+
+				uint8_t* Out = solid.data() + size_t(y) * size_t(resolution);
+
+				for (int x = 0; x < resolution; x++) {
+					const double Pixels = double(PixelY1 - PixelY0) * double(ColumnEnd[x] - ColumnBegin[x]);
+					const float Mean = float(double(Sums[x]) / (255.0 * Pixels));
+
+					Out[x] = (Mean >= settings.Threshold) != settings.Invert ? 1 : 0;
+				}
+			}
+		});
+	}
+
+	int ObstacleMap::Apply(FluidGrid& grid, const ObstacleMapSettings& settings, ThreadPool& pool) const
+	{
+		const int Resolution = grid.GetResolution();
+
+		std::vector<uint8_t> Solid;
+		Rasterize(Resolution, settings, pool, Solid);
+
+		int Changed = 0;
+
+		for (int y = 0; y < Resolution; y++) {
+			for (int x = 0; x < Resolution; x++) {
+				const bool IsSolid = Solid[size_t(y) * size_t(Resolution) + size_t(x)] != 0;
+
+				if (grid.IsSolid(x, y) == IsSolid) {
+					continue;
+				}
+
+				grid.SetSolid(x, y, IsSolid);
+				Changed++;
+
+				if (IsSolid) {
+					for (int z = 0; z < 4; z++) {
+						grid.GetVelocityRef(x, y, Directions(z)) = 0.0f;
+					}
+				}
+			}
+		}
+
+		return Changed;
+	}
+}
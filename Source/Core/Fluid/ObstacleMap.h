@@ -0,0 +1,59 @@
+#pragma once
+
+#include "FluidGrid.h"
+
+#include "../Utils/ThreadPool.h"
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace Simulation
+{
+	// How an obstacle image turns into solid cells
+	struct ObstacleMapSettings
+	{
+		// Cells whose mean brightness in [0, 1] is at or above the threshold are solid
+		float Threshold = 0.5f;
+
+		// Dark cells are solid instead
+		bool Invert = false;
+	};
+
+	// Grayscale obstacle mask from any image stb_image reads (PNG, PGM, ...), colour is converted to luminance
+	// The pixels are kept in file order, top row first, the bottom row of the image lands on y = 0 of the grid
+	// Independent of the grid resolution, the same map can be applied to any grid
+	class ObstacleMap
+	{
+	public :
+
+		// Returns false and leaves the map untouched when the file can't be read
+		bool Load(const std::string& path);
+
+		// Takes width * height pixels already in file order, recordings keep the image as it was when applied
+		void Assign(const std::string& path, int width, int height, std::vector<uint8_t> pixels);
+
+		inline bool IsEmpty() const { return m_Pixels.empty(); }
+		inline int GetWidth() const { return m_Width; }
+		inline int GetHeight() const { return m_Height; }
+		inline const std::string& GetPath() const { return m_Path; }
+		inline const std::vector<uint8_t>& GetPixels() const { return m_Pixels; }
+
+		// Solid flag of every cell of a resolution x resolution grid, row major from the bottom row
+		// Each cell averages the block of pixels it covers, an image smaller than the grid repeats its pixels
+		// Rows are split across the pool, the result doesn't depend on the thread count
+		void Rasterize(int resolution, const ObstacleMapSettings& settings, ThreadPool& pool, std::vector<uint8_t>& solid) const;
+
+		// Replaces the interior obstacles of the grid, returns how many cells flipped
+		// Only the flipped cells go through SetSolid() so UpdateFaceWeights() rebuilds just the cells around them
+		// Cells turning solid get their faces zeroed like Scenarios::ObstacleDisk()
+		int Apply(FluidGrid& grid, const ObstacleMapSettings& settings, ThreadPool& pool) const;
+
+	private :
+
+		std::string m_Path;
+		int m_Width = 0;
+		int m_Height = 0;
+		std::vector<uint8_t> m_Pixels;
+	};
+}
@@ -0,0 +1,381 @@
+#include "PCG.h"
+#include "PressureSystem.h"
+
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+#include "../Utils/AlignedAlloc.h"
+
+namespace Simulation
+{
+	namespace
+	{
+		// Bridson's MIC(0) constants, Tau blends towards modified IC, Sigma guards against tiny pivots
+		const float MICTau = 0.97f;
+		const float MICSigma = 0.25f;
+	}
+
+	PCGSolver::~PCGSolver()
+	{
+		Free();
+	}
+
+	void PCGSolver::Free()
+	{
+		AlignedFree(m_Phi);
+		AlignedFree(m_Residual);
+		AlignedFree(m_Z);
+		AlignedFree(m_Search);
+		AlignedFree(m_Q);
+		AlignedFree(m_Precon);
+
+		m_Phi = m_Residual = m_Z = m_Search = m_Q = m_Precon = nullptr;
+	}
+
+	void PCGSolver::Allocate(const FluidGrid& grid)
+	{
+		Free();
+
+		m_Resolution = grid.GetResolution();
+		m_FieldSize = grid.GetFieldSize();
+
+		float** Fields[] = { &m_Phi, &m_Residual, &m_Z, &m_Search, &m_Q, &m_Precon };
+
+		// Border cells are never written, they have to read as 0
+		for (float** Field : Fields) {
+			*Field = AlignedAlloc<float>(m_FieldSize);
+			memset(*Field, 0, m_FieldSize * sizeof(float));
+		}
+
+		m_RowSums.resize(m_Resolution);
+		m_RowMax.resize(m_Resolution);
+		m_HasMIC = false;
+	}
+
+	void PCGSolver::Project(FluidGrid& grid, ThreadPool& pool, const PCGSettings& settings, float pressureScale)
+	{
+		if (grid.GetResolution() != m_Resolution || grid.GetFieldSize() != m_FieldSize || !m_Phi) {
+			Allocate(grid);
+		}
+
+		if (settings.Preconditioner == PreconditionerType::MIC0) {
+			// Moving bodies change a few cells every step, the factor is only redone from those on
+			if (m_HasMIC && grid.GetObstacleVersion() == m_ObstacleVersion + 1 && !grid.IsLastUpdateFull()) {
+				UpdateMIC(grid);
+			}
+
+			else if (!m_HasMIC || grid.GetObstacleVersion() != m_ObstacleVersion) {
+				BuildMIC(grid);
+			}
+		}
+
+		// phi starts at 0 so the residual is the right hand side
+		PressureSystem::BuildRhs(grid, pool, m_Residual, m_RowSums);
+		memset(m_Phi, 0, m_FieldSize * sizeof(float));
+
+		const ConvergenceSettings& Convergence = settings.Convergence;
+
+		m_Norm = Convergence.Norm;
+		m_ActiveCells = grid.GetActiveCellCount();
+		m_Iterations = 0;
+		m_InitialResidual = MeasureResidual(grid, pool);
+		m_FinalResidual = m_InitialResidual;
+
+		if (!PressureSystem::IsConverged(Convergence, m_InitialResidual)) {
+			auto Precondition = [&]() {
+				return settings.Preconditioner == PreconditionerType::MIC0 ? ApplyMIC(grid) : ApplyJacobi(grid, pool);
+			};
+
+			double Sigma = Precondition();
+			memcpy(m_Search, m_Z, m_FieldSize * sizeof(float));
+
+			while (m_Iterations < Convergence.MaxIterations) {
+				const double Curvature = ApplyOperator(grid, pool);
+				m_Iterations++;
+
+				if (Curvature <= 0.0) {
+					break;
+				}
+
+				m_FinalResidual = UpdateSolution(grid, pool, float(Sigma / Curvature));
+
+				if (PressureSystem::IsConverged(Convergence, m_FinalResidual)) {
+					break;
+				}
+
+				const double NewSigma = Precondition();
+				UpdateSearch(grid, pool, float(NewSigma / Sigma));
+				Sigma = NewSigma;
+			}
+		}
+
+		PressureSystem::ApplyPush(grid, pool, m_Phi, pressureScale);
+	}
+
+	float PCGSolver::MICEntry(const FluidGrid& grid, int i) const
+	{
+		const int Stride = grid.GetStride();
+		const uint8_t* Faces = grid.GetFaces();
+		const uint8_t CellFaces = Faces[i];
+
+		if (!CellFaces) {
+			return 0.0f;
+		}
+
+		// A coefficient between two fluid neighbours is -1, products of two of them are 1
+		const float Diagonal = PressureSystem::OpenFaceCount(CellFaces);
+		float e = Diagonal;
+
+		if (CellFaces & FACE_LEFT) {
+			const float p = m_Precon[i - 1];
+			e -= p * p;
+			e -= MICTau * ((Faces[i - 1] & FACE_TOP) ? p * p : 0.0f);
+		}
+
+		if (CellFaces & FACE_BOTTOM) {
+			const float p = m_Precon[i - Stride];
+			e -= p * p;
+			e -= MICTau * ((Faces[i - Stride] & FACE_RIGHT) ? p * p : 0.0f);
+		}
+
+		if (e < MICSigma * Diagonal) {
+			e = Diagonal;
+		}
+
+		return 1.0f / std::sqrt(e);
+	}
+
+	void PCGSolver::BuildMIC(const FluidGrid& grid, int firstRow)
+	{
+		for (int y = firstRow; y < m_Resolution; y++) {
+			for (int x = 0; x < m_Resolution; x++) {
+				const int i = grid.Index(x, y);
+				m_Precon[i] = MICEntry(grid, i);
+			}
+		}
+
+		m_HasMIC = true;
+		m_ObstacleVersion = grid.GetObstacleVersion();
+	}
+
+	void PCGSolver::UpdateMIC(const FluidGrid& grid)
+	{
+		const int Stride = grid.GetStride();
+
+		if (m_Queued.size() != m_FieldSize) {
+			m_Queued.assign(m_FieldSize, 0);
+		}
+
+		// Entry i reads the faces of i, i - 1 and i - Stride and the entries of the last two, lowest index first is the order of BuildMIC()
+		auto Push = [&](int i) {
+			const int x = i % Stride - 1;
+			const int y = i / Stride - 1;
+
+			if (x < m_Resolution && y < m_Resolution && !m_Queued[i]) {
+				m_Queued[i] = 1;
+				m_Pending.push(i);
+			}
+		};
+
+		for (int i : grid.GetChangedCells()) {
+			Push(i);
+			Push(i + 1);
+			Push(i + Stride);
+		}
+
+		// The change fades out along the sweep, once an entry comes out the same the cells after it have nothing new to read
+		// Past a quarter of the grid a plain sweep from the current row is cheaper than the queue
+		int Updated = 0;
+
+		while (!m_Pending.empty()) {
+			const int i = m_Pending.top();
+			m_Pending.pop();
+			m_Queued[i] = 0;
+
+			if (++Updated > m_Resolution * m_Resolution / 4) {
+				while (!m_Pending.empty()) {
+					m_Queued[m_Pending.top()] = 0;
+					m_Pending.pop();
+				}
+
+				BuildMIC(grid, i / Stride - 1);
+				return;
+			}
+
+			const float Entry = MICEntry(grid, i);
+
+			if (Entry != m_Precon[i]) {
+				m_Precon[i] = Entry;
+				Push(i + 1);
+				Push(i + Stride);
+			}
+		}
+
+		m_ObstacleVersion = grid.GetObstacleVersion();
+	}
+
+	double PCGSolver::ApplyMIC(const FluidGrid& grid)
+	{
+		const int Stride = grid.GetStride();
+		const uint8_t* Faces = grid.GetFaces();
+
+		// L q = r, then L^T z = q in place
+		for (int y = 0; y < m_Resolution; y++) {
+			for (int x = 0; x < m_Resolution; x++) {
+				const int i = grid.Index(x, y);
+				const uint8_t CellFaces = Faces[i];
+
+				float t = m_Residual[i];
+
+				if (CellFaces & FACE_LEFT) t += m_Precon[i - 1] * m_Z[i - 1];
+				if (CellFaces & FACE_BOTTOM) t += m_Precon[i - Stride] * m_Z[i - Stride];
+
+				m_Z[i] = t * m_Precon[i];
+			}
+		}
+
+		double Dot = 0.0;
+
+		for (int y = m_Resolution - 1; y >= 0; y--) {
+			for (int x = m_Resolution - 1; x >= 0; x--) {
+				const int i = grid.Index(x, y);
+				const uint8_t CellFaces = Faces[i];
+
+				float t = m_Z[i];
+
+				if (CellFaces & FACE_RIGHT) t += m_Precon[i] * m_Z[i + 1];
+				if (CellFaces & FACE_TOP) t += m_Precon[i] * m_Z[i + Stride];
+
+				m_Z[i] = t * m_Precon[i];
+				Dot += double(m_Z[i]) * double(m_Residual[i]);
+			}
+		}
+
+		return Dot;
+	}
+
+	double PCGSolver::ApplyJacobi(const FluidGrid& grid, ThreadPool& pool)
+	{
+		const float* InvWeight = grid.GetInvWeight();
+
+		pool.ParallelFor(0, m_Resolution, [&](int RowBegin, int RowEnd) {
+			for (int y = RowBegin; y < RowEnd; y++) {
+				double Dot = 0.0;
+
+				for (int x = 0; x < m_Resolution; x++) {
+					const int i = grid.Index(x, y);
+
+					m_Z[i] = m_Residual[i] * InvWeight[i];
+					Dot += double(m_Z[i]) * double(m_Residual[i]);
+				}
+
+				m_RowSums[y] = Dot;
+			}
+		});
+
+		return SumRows(m_Resolution);
+	}
+
+	double PCGSolver::ApplyOperator(const FluidGrid& grid, ThreadPool& pool)
+	{
+		const int Stride = grid.GetStride();
+		const uint8_t* Faces = grid.GetFaces();
+
+		pool.ParallelFor(0, m_Resolution, [&](int RowBegin, int RowEnd) {
+			for (int y = RowBegin; y < RowEnd; y++) {
+				double Dot = 0.0;
+
+				for (int x = 0; x < m_Resolution; x++) {
+					const int i = grid.Index(x, y);
+					const uint8_t CellFaces = Faces[i];
+
+					m_Q[i] = CellFaces ? PressureSystem::Apply(m_Search, i, Stride, CellFaces) : 0.0f;
+					Dot += double(m_Search[i]) * double(m_Q[i]);
+				}
+
+				m_RowSums[y] = Dot;
+			}
+		});
+
+		return SumRows(m_Resolution);
+	}
+
+	float PCGSolver::UpdateSolution(const FluidGrid& grid, ThreadPool& pool, float alpha)
+	{
+		pool.ParallelFor(0, m_Resolution, [&](int RowBegin, int RowEnd) {
+			for (int y = RowBegin; y < RowEnd; y++) {
+				float Max = 0.0f;
+				double SumSquares = 0.0;
+				const int Base = grid.Index(0, y);
+
+				for (int i = Base; i < Base + m_Resolution; i++) {
+					m_Phi[i] += alpha * m_Search[i];
+					m_Residual[i] -= alpha * m_Q[i];
+					Max = std::fmax(Max, std::fabs(m_Residual[i]));
+					SumSquares += double(m_Residual[i]) * double(m_Residual[i]);
+				}
+
+				m_RowMax[y] = Max;
+				m_RowSums[y] = SumSquares;
+			}
+		});
+
+		return ReduceResidual();
+	}
+
+	void PCGSolver::UpdateSearch(const FluidGrid& grid, ThreadPool& pool, float beta)
+	{
+		pool.ParallelFor(0, m_Resolution, [&](int RowBegin, int RowEnd) {
+			for (int y = RowBegin; y < RowEnd; y++) {
+				const int Base = grid.Index(0, y);
+
+				for (int i = Base; i < Base + m_Resolution; i++) {
+					m_Search[i] = m_Z[i] + beta * m_Search[i];
+				}
+			}
+		});
+	}
+
+	float PCGSolver::MeasureResidual(const FluidGrid& grid, ThreadPool& pool)
+	{
+		pool.ParallelFor(0, m_Resolution, [&](int RowBegin, int RowEnd) {
+			for (int y = RowBegin; y < RowEnd; y++) {
+				float Max = 0.0f;
+				double SumSquares = 0.0;
+				const int Base = grid.Index(0, y);
+
+				for (int i = Base; i < Base + m_Resolution; i++) {
+					Max = std::fmax(Max, std::fabs(m_Residual[i]));
+					SumSquares += double(m_Residual[i]) * double(m_Residual[i]);
+				}
+
+				m_RowMax[y] = Max;
+				m_RowSums[y] = SumSquares;
+			}
+		});
+
+		return ReduceResidual();
+	}
+
+	float PCGSolver::ReduceResidual() const
+	{
+		return PressureSystem::ResidualValue(m_Norm, MaxRows(m_Resolution), SumRows(m_Resolution), m_ActiveCells);
+	}
+
+	double PCGSolver::SumRows(int rows) const
+	{
+		double Sum = 0.0;
+
+		for (int y = 0; y < rows; y++) {
+			Sum += m_RowSums[y];
+		}
+
+		return Sum;
+	}
+
+	float PCGSolver::MaxRows(int rows) const
+	{
+		return *std::max_element(m_RowMax.begin(), m_RowMax.begin() + rows);
+	}
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <queue>
+#include <functional>
+
+#include "FluidGrid.h"
+#include "PressureSystem.h"
+
+#include "../Utils/ThreadPool.h"
+
+namespace Simulation
+{
+	enum class PreconditionerType : int {
+		// Modified incomplete Cholesky, strongest but its triangular solves run on one thread
+		MIC0 = 0,
+
+		// Diagonal, fully parallel
+		Jacobi
+	};
+
+	struct PCGSettings
+	{
+		PreconditionerType Preconditioner = PreconditionerType::MIC0;
+
+		ConvergenceSettings Convergence = { 200, 1e-4f, ResidualNorm::Linf };
+	};
+
+	// Matrix free preconditioned conjugate gradient, solves the system described in PressureSystem.h
+	// The operator is applied straight from the face mask so any solid layout works
+	// SpMV, dot products and AXPYs are split across the pool, dot products are reduced per row in row order
+	class PCGSolver
+	{
+	public :
+
+		PCGSolver() = default;
+		~PCGSolver();
+
+		PCGSolver(const PCGSolver&) = delete;
+		PCGSolver operator=(PCGSolver const&) = delete;
+
+		// Makes the velocities divergence free and writes phi * pressureScale to the pressure field
+		void Project(FluidGrid& grid, ThreadPool& pool, const PCGSettings& settings, float pressureScale);
+
+		// Results of the last Project(), residuals in the selected norm
+		inline int GetIterations() const { return m_Iterations; }
+		inline float GetInitialResidual() const { return m_InitialResidual; }
+		inline float GetFinalResidual() const { return m_FinalResidual; }
+
+	private :
+
+		void Allocate(const FluidGrid& grid);
+		void Free();
+
+		// Incomplete Cholesky factor, only depends on the face mask
+		// Rows below firstRow are taken as already built
+		void BuildMIC(const FluidGrid& grid, int firstRow = 0);
+
+		// Brings the factor to the next obstacle version from the cells the grid changed, same result as BuildMIC()
+		// Each entry depends on every entry before it in the sweep, so this recomputes in sweep order from the changed cells
+		// and only carries on past an entry that came out different
+		void UpdateMIC(const FluidGrid& grid);
+
+		// Factor entry of cell i from the entries left of and below it
+		float MICEntry(const FluidGrid& grid, int i) const;
+
+		// z = M^-1 r, returns dot(z, r)
+		double ApplyMIC(const FluidGrid& grid);
+		double ApplyJacobi(const FluidGrid& grid, ThreadPool& pool);
+
+		// q = A s, returns dot(s, q)
+		double ApplyOperator(const FluidGrid& grid, ThreadPool& pool);
+
+		// phi += alpha s, r -= alpha q, returns the norm of the residual
+		float UpdateSolution(const FluidGrid& grid, ThreadPool& pool, float alpha);
+
+		// s = z + beta s
+		void UpdateSearch(const FluidGrid& grid, ThreadPool& pool, float beta);
+
+		float MeasureResidual(const FluidGrid& grid, ThreadPool& pool);
+
+		double SumRows(int rows) const;
+		float MaxRows(int rows) const;
+
+		// Norm of the residual from the per row max/sum of squares
+		float ReduceResidual() const;
+
+		int m_Resolution = 0;
+		size_t m_FieldSize = 0;
+		uint64_t m_ObstacleVersion = 0;
+		bool m_HasMIC = false;
+
+		float* m_Phi = nullptr;
+		float* m_Residual = nullptr;
+		float* m_Z = nullptr;
+		float* m_Search = nullptr;
+		float* m_Q = nullptr;
+		float* m_Precon = nullptr;
+
+		// UpdateMIC() work list, lowest index first, and whether a cell is in it
+		std::priority_queue<int, std::vector<int>, std::greater<int>> m_Pending;
+		std::vector<uint8_t> m_Queued;
+
+		// Per row partial results
+		std::vector<double> m_RowSums;
+		std::vector<float> m_RowMax;
+
+		ResidualNorm m_Norm = ResidualNorm::Linf;
+		int m_ActiveCells = 0;
+
+		int m_Iterations = 0;
+		float m_InitialResidual = 0.0f;
+		float m_FinalResidual = 0.0f;
+	};
+}
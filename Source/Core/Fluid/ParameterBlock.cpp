@@ -0,0 +1,162 @@
+#include "ParameterBlock.h"
+
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+
+namespace Simulation
+{
+	namespace
+	{
+		enum class FieldType : uint8_t {
+			Float = 0,
+			Int,
+			Bool
+		};
+
+		struct FieldEntry
+		{
+			const char* Name;
+			FieldType Type;
+			size_t Offset;
+		};
+
+		template <typename T>
+		constexpr FieldType GetFieldType()
+		{
+			if constexpr (std::is_same<T, float>::value) {
+				return FieldType::Float;
+			}
+
+			else if constexpr (std::is_same<T, bool>::value) {
+				return FieldType::Bool;
+			}
+
+			else {
+				static_assert(std::is_same<T, int>::value || (std::is_enum<T>::value && sizeof(T) == sizeof(int32_t)), "Parameters are floats, ints, int enums or bools");
+				return FieldType::Int;
+			}
+		}
+
+		static_assert(std::is_standard_layout<FluidParameters>::value, "The fields are found with offsetof");
+
+		// The type comes from the member itself, changing it changes the layout hash
+#define PARAMETER_FIELD(member) { #member, GetFieldType<std::remove_reference<decltype(std::declval<FluidParameters&>().member)>::type>(), offsetof(FluidParameters, member) }
+
+		// Append new fields, every change here makes older files unreadable
+		const FieldEntry Fields[] = {
+			PARAMETER_FIELD(GridSpacing),
+			PARAMETER_FIELD(DensityWater),
+			PARAMETER_FIELD(OverRelaxationCoefficient),
+			PARAMETER_FIELD(Gravity),
+			PARAMETER_FIELD(VorticityConfinement),
+			PARAMETER_FIELD(PressureSolver),
+			PARAMETER_FIELD(Relaxation.MaxIterations),
+			PARAMETER_FIELD(Relaxation.Tolerance),
+			PARAMETER_FIELD(Relaxation.Norm),
+			PARAMETER_FIELD(Multigrid.Cycle),
+			PARAMETER_FIELD(Multigrid.Convergence.MaxIterations),
+			PARAMETER_FIELD(Multigrid.Convergence.Tolerance),
+			PARAMETER_FIELD(Multigrid.Convergence.Norm),
+			PARAMETER_FIELD(Multigrid.PreSmoothing),
+			PARAMETER_FIELD(Multigrid.PostSmoothing),
+			PARAMETER_FIELD(PCG.Preconditioner),
+			PARAMETER_FIELD(PCG.Convergence.MaxIterations),
+			PARAMETER_FIELD(PCG.Convergence.Tolerance),
+			PARAMETER_FIELD(PCG.Convergence.Norm),
+			PARAMETER_FIELD(Advection),
+			PARAMETER_FIELD(ScalarFields),
+			PARAMETER_FIELD(Threads),
+			PARAMETER_FIELD(TileSize),
+			PARAMETER_FIELD(TemporalBlocking),
+			PARAMETER_FIELD(TrackActivity),
+			PARAMETER_FIELD(ActivityTileSize),
+			PARAMETER_FIELD(ActivityThreshold)
+		};
+
+#undef PARAMETER_FIELD
+
+		constexpr uint32_t FieldCount = uint32_t(sizeof(Fields) / sizeof(Fields[0]));
+
+		uint32_t HashBytes(uint32_t hash, const void* data, size_t bytes)
+		{
+			const uint8_t* Bytes = static_cast<const uint8_t*>(data);
+
+			for (size_t i = 0; i < bytes; i++) {
+				hash = (hash ^ Bytes[i]) * 16777619u;
+			}
+
+			return hash;
+		}
+	}
+
+	uint32_t ParameterBlock::GetFieldCount()
+	{
+		return FieldCount;
+	}
+
+	size_t ParameterBlock::GetBytes()
+	{
+		return size_t(FieldCount) * sizeof(uint32_t);
+	}
+
+	uint32_t ParameterBlock::GetLayout()
+	{
+		uint32_t Hash = 2166136261u;
+
+		// The terminating zero keeps "ab" + "c" apart from "a" + "bc"
+		for (const FieldEntry& Field : Fields) {
+			Hash = HashBytes(Hash, Field.Name, strlen(Field.Name) + 1);
+			Hash = HashBytes(Hash, &Field.Type, sizeof(Field.Type));
+		}
+
+		return Hash;
+	}
+
+	std::vector<uint8_t> ParameterBlock::Write(const FluidParameters& parameters)
+	{
+		std::vector<uint8_t> Bytes(GetBytes());
+		const uint8_t* Base = reinterpret_cast<const uint8_t*>(&parameters);
+
+		for (uint32_t i = 0; i < FieldCount; i++) {
+			uint32_t Word = 0;
+
+			if (Fields[i].Type == FieldType::Bool) {
+				bool Value;
+				memcpy(&Value, Base + Fields[i].Offset, sizeof(Value));
+				Word = Value ? 1 : 0;
+			}
+
+			else {
+				memcpy(&Word, Base + Fields[i].Offset, sizeof(Word));
+			}
+
+			memcpy(Bytes.data() + i * sizeof(Word), &Word, sizeof(Word));
+		}
+
+		return Bytes;
+	}
+
+	FluidParameters ParameterBlock::Read(const uint8_t* data)
+	{
+		FluidParameters Parameters;
+		uint8_t* Base = reinterpret_cast<uint8_t*>(&Parameters);
+
+		for (uint32_t i = 0; i < FieldCount; i++) {
+			uint32_t Word;
+			memcpy(&Word, data + i * sizeof(Word), sizeof(Word));
+
+			if (Fields[i].Type == FieldType::Bool) {
+				const bool Value = Word != 0;
+				memcpy(Base + Fields[i].Offset, &Value, sizeof(Value));
+			}
+
+			else {
+				memcpy(Base + Fields[i].Offset, &Word, sizeof(Word));
+			}
+		}
+
+		return Parameters;
+	}
+}
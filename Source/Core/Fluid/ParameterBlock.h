@@ -0,0 +1,30 @@
+#pragma once
+
+#include "FluidSolver.h"
+
+#include <vector>
+#include <cstdint>
+
+// FluidParameters as checkpoints and recordings store them
+//
+// One 32 bit word per field in the order of the table in ParameterBlock.cpp, floats as their bits, enums as int, bools as 0 or 1
+// The bytes only depend on the values, never on padding or on how the compiler laid out the struct
+// The layout hash covers the name and type of every entry, data written with another table is refused instead of misread
+
+namespace Simulation
+{
+	namespace ParameterBlock
+	{
+		uint32_t GetFieldCount();
+		size_t GetBytes();
+
+		// FNV-1a over the field names and types, in table order
+		uint32_t GetLayout();
+
+		// GetBytes() bytes
+		std::vector<uint8_t> Write(const FluidParameters& parameters);
+
+		// data holds GetBytes() bytes written by a build with the same layout, the caller checks that
+		FluidParameters Read(const uint8_t* data);
+	}
+}
@@ -0,0 +1,93 @@
+#include "PressureSystem.h"
+
+namespace Simulation
+{
+	void PressureSystem::BuildRhs(const FluidGrid& grid, ThreadPool& pool, float* rhs, std::vector<double>& rowSums)
+	{
+		const int Resolution = grid.GetResolution();
+		const int Stride = grid.GetStride();
+		const uint8_t* Faces = grid.GetFaces();
+		const float* U = grid.GetU();
+		const float* V = grid.GetV();
+
+		rowSums.resize(size_t(Resolution) * 2);
+
+		pool.ParallelFor(0, Resolution, [&](int RowBegin, int RowEnd) {
+			for (int y = RowBegin; y < RowEnd; y++) {
+				double Sum = 0.0;
+				int Count = 0;
+
+				for (int x = 0; x < Resolution; x++) {
+					const int i = grid.Index(x, y);
+					float Divergence = 0.0f;
+
+					if (Faces[i]) {
+						Divergence = (U[i + 1] - U[i]) + (V[i + Stride] - V[i]);
+						Sum += Divergence;
+						Count++;
+					}
+
+					rhs[i] = Divergence;
+				}
+
+				rowSums[2 * y] = Sum;
+				rowSums[2 * y + 1] = double(Count);
+			}
+		});
+
+		double Sum = 0.0;
+		double Count = 0.0;
+
+		for (int y = 0; y < Resolution; y++) {
+			Sum += rowSums[2 * y];
+			Count += rowSums[2 * y + 1];
+		}
+
+		if (Count == 0.0) {
+			return;
+		}
+
+		const float Mean = float(Sum / Count);
+
+		pool.ParallelFor(0, Resolution, [&](int RowBegin, int RowEnd) {
+			for (int y = RowBegin; y < RowEnd; y++) {
+				for (int x = 0; x < Resolution; x++) {
+					const int i = grid.Index(x, y);
+
+					if (Faces[i]) {
+						rhs[i] -= Mean;
+					}
+				}
+			}
+		});
+	}
+
+	void PressureSystem::ApplyPush(FluidGrid& grid, ThreadPool& pool, const float* phi, float pressureScale)
+	{
+		const int Resolution = grid.GetResolution();
+		const int Stride = grid.GetStride();
+		const uint8_t* Faces = grid.GetFaces();
+		float* U = grid.GetU();
+		float* V = grid.GetV();
+		float* Pressure = grid.GetPressure();
+
+		// Each cell owns its left and bottom face so rows never write to each other
+		pool.ParallelFor(0, Resolution, [&](int RowBegin, int RowEnd) {
+			for (int y = RowBegin; y < RowEnd; y++) {
+				for (int x = 0; x < Resolution; x++) {
+					const int i = grid.Index(x, y);
+					const uint8_t CellFaces = Faces[i];
+
+					if (!CellFaces) {
+						continue;
+					}
+
+					if (CellFaces & FACE_LEFT) U[i] += phi[i] - phi[i - 1];
+					if (CellFaces & FACE_BOTTOM) V[i] += phi[i] - phi[i - Stride];
+
+					Pressure[i] = phi[i] * pressureScale;
+				}
+			}
+		});
+	}
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdint>
+#include <cmath>
+#include <vector>
+
+#include "FluidGrid.h"
+
+#include "../Utils/ThreadPool.h"
+
+// The pressure equation shared by the global solvers (multigrid, PCG)
+//
+// A phi = div, phi being the total amount every cell pushes out through its open faces
+// (A phi)[i] = n * phi[i] - sum of phi over the n fluid neighbours
+// Every field is on the padded FluidGrid layout, cells without open faces are left out of the system
+
+namespace Simulation
+{
+	enum class ResidualNorm : int {
+		// Max absolute divergence left in any cell
+		Linf = 0,
+
+		// Root mean square over the cells in the system, doesn't grow with the resolution
+		L2
+	};
+
+	// Stopping rule of an iterative pressure solver
+	// An iteration is one sweep for Gauss Seidel, one cycle for multigrid and one step for PCG
+	struct ConvergenceSettings
+	{
+		int MaxIterations = 1;
+
+		// Stops early once the residual is at or below this, 0 always runs MaxIterations
+		float Tolerance = 0.0f;
+		ResidualNorm Norm = ResidualNorm::Linf;
+	};
+
+	namespace PressureSystem
+	{
+		inline float ResidualValue(ResidualNorm norm, float maxResidual, double sumSquares, int cells)
+		{
+			if (norm == ResidualNorm::L2) {
+				return cells > 0 ? float(std::sqrt(sumSquares / double(cells))) : 0.0f;
+			}
+
+			return maxResidual;
+		}
+
+		inline bool IsConverged(const ConvergenceSettings& settings, float residual)
+		{
+			return settings.Tolerance > 0.0f && residual <= settings.Tolerance;
+		}
+
+		inline float OpenFaceCount(uint8_t faces)
+		{
+			static const float Counts[16] = {
+				0.0f, 1.0f, 1.0f, 2.0f, 1.0f, 2.0f, 2.0f, 3.0f,
+				1.0f, 2.0f, 2.0f, 3.0f, 2.0f, 3.0f, 3.0f, 4.0f
+			};
+
+			return Counts[faces & 0xF];
+		}
+
+		// Sum of phi over the open neighbours of cell i
+		inline float NeighbourSum(const float* phi, int i, int stride, uint8_t faces)
+		{
+			float Sum = 0.0f;
+
+			if (faces & FACE_LEFT) Sum += phi[i - 1];
+			if (faces & FACE_RIGHT) Sum += phi[i + 1];
+			if (faces & FACE_BOTTOM) Sum += phi[i - stride];
+			if (faces & FACE_TOP) Sum += phi[i + stride];
+
+			return Sum;
+		}
+
+		inline float Apply(const float* phi, int i, int stride, uint8_t faces)
+		{
+			return OpenFaceCount(faces) * phi[i] - NeighbourSum(phi, i, stride, faces);
+		}
+
+		// rhs = divergence of every cell in the system, 0 elsewhere
+		// The mean is removed, flux through closed faces (walls set by a scenario) would otherwise leave the system without a solution
+		// rowSums is per row scratch, reduced in row order so the result doesn't depend on the thread count
+		void BuildRhs(const FluidGrid& grid, ThreadPool& pool, float* rhs, std::vector<double>& rowSums);
+
+		// Moves every open face by the difference of the pushes on both sides and writes phi * pressureScale to the pressure
+		void ApplyPush(FluidGrid& grid, ThreadPool& pool, const float* phi, float pressureScale);
+	}
+}
@@ -0,0 +1,348 @@
+#include "RigidBodies.h"
+
+#include <cmath>
+#include <algorithm>
+
+namespace Simulation
+{
+	RigidBody RigidBodies::MakeCircle(glm::vec2 position, float radius, float density)
+	{
+		RigidBody Body;
+		Body.Shape = BodyShape::Circle;
+		Body.Area = 3.14159265f * radius * radius;
+		Body.State.Position = position;
+		Body.State.MassRadius = glm::vec2(density * Body.Area, radius);
+		return Body;
+	}
+
+	RigidBody RigidBodies::MakePolygon(glm::vec2 position, const std::vector<glm::vec2>& vertices, float density)
+	{
+		RigidBody Body;
+		Body.Shape = BodyShape::Polygon;
+		Body.Vertices = vertices;
+
+		float Area = 0.0f;
+		float Radius = 0.0f;
+
+		// Shoelace formula, positive for counter clockwise vertices
+		for (size_t i = 0; i < vertices.size(); i++) {
+			const glm::vec2 A = vertices[i];
+			const glm::vec2 B = vertices[(i + 1) % vertices.size()];
+
+			Area += A.x * B.y - B.x * A.y;
+			Radius = std::max(Radius, glm::length(A));
+		}
+
+		Body.Area = std::fabs(Area) * 0.5f;
+		Body.State.Position = position;
+		Body.State.MassRadius = glm::vec2(density * Body.Area, Radius);
+		return Body;
+	}
+
+	bool RigidBodies::Contains(const RigidBody& body, glm::vec2 point)
+	{
+		const glm::vec2 P = point - body.State.Position;
+
+		if (body.Shape == BodyShape::Circle) {
+			return glm::dot(P, P) < body.State.MassRadius.y * body.State.MassRadius.y;
+		}
+
+		if (body.Vertices.size() < 3) {
+			return false;
+		}
+
+		// Left of every edge
+		for (size_t i = 0; i < body.Vertices.size(); i++) {
+			const glm::vec2 A = body.Vertices[i];
+			const glm::vec2 Edge = body.Vertices[(i + 1) % body.Vertices.size()] - A;
+			const glm::vec2 ToPoint = P - A;
+
+			if (Edge.x * ToPoint.y - Edge.y * ToPoint.x < 0.0f) {
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	void RigidBodySystem::Add(const RigidBody& body)
+	{
+		m_Bodies.push_back(body);
+		m_Footprints.emplace_back();
+	}
+
+	void RigidBodySystem::Clear(FluidGrid& grid)
+	{
+		Lift(grid);
+
+		m_Bodies.clear();
+		m_Footprints.clear();
+	}
+
+	void RigidBodySystem::Lift(FluidGrid& grid)
+	{
+		if (m_Coverage.size() != grid.GetFieldSize()) {
+			return;
+		}
+
+		for (Footprint& Cells : m_Footprints) {
+			Release(grid, Cells);
+		}
+	}
+
+	void RigidBodySystem::Move(FluidGrid& grid, ActivityMap& activity, float dt, float gravity, float fluidDensity, float gridSpacing)
+	{
+		// Rasterizing divides by the spacing, the bodies wait for a valid one (see FluidSolver::Step())
+		if (!IsValidSpacing(gridSpacing)) {
+			return;
+		}
+
+		const size_t Size = grid.GetFieldSize();
+
+		// A new grid has none of the cells the footprints remember
+		if (m_Coverage.size() != Size) {
+			m_Coverage.assign(Size, 0);
+			m_UnderlyingSolid.assign(Size, 0);
+			m_CoveredCells = 0;
+
+			for (Footprint& Cells : m_Footprints) {
+				Cells = Footprint();
+			}
+		}
+
+		const float Extent = float(grid.GetResolution()) * gridSpacing;
+		Footprint Scratch;
+
+		for (size_t i = 0; i < m_Bodies.size(); i++) {
+			RigidBody& Body = m_Bodies[i];
+
+			if (dt > 0.0f) {
+				Integrate(Body, dt, gravity, fluidDensity, Extent);
+			}
+
+			const Footprint& Cells = m_Footprints[i];
+			const int X0 = Cells.Valid ? Cells.X0 : grid.GetResolution();
+			const int Y0 = Cells.Valid ? Cells.Y0 : grid.GetResolution();
+			const int X1 = Cells.Valid ? Cells.X1 : 0;
+			const int Y1 = Cells.Valid ? Cells.Y1 : 0;
+
+			const bool Moved = !Cells.Valid || Cells.Position != Body.State.Position;
+
+			if (Moved) {
+				Rasterize(grid, i, gridSpacing, Scratch);
+			}
+
+			// A body at rest in the same cells has already written its faces
+			if (!Moved && Body.State.Velocity == glm::vec2(0.0f)) {
+				continue;
+			}
+
+			ImposeVelocity(grid, Cells, Body.State.Velocity);
+
+			// Old and new cells, plus the right/top faces of the last row and column
+			activity.WakeCells(std::min(X0, Cells.X0), std::min(Y0, Cells.Y0), std::max(X1, Cells.X1) + 1, std::max(Y1, Cells.Y1) + 1);
+		}
+	}
+
+	void RigidBodySystem::GatherForces(const FluidGrid& grid, float gridSpacing)
+	{
+		if (m_Coverage.size() != grid.GetFieldSize() || !IsValidSpacing(gridSpacing)) {
+			return;
+		}
+
+		const int Stride = grid.GetStride();
+		const uint8_t* Faces = grid.GetFaces();
+		const float* Pressure = grid.GetPressure();
+
+		for (size_t i = 0; i < m_Bodies.size(); i++) {
+			const Footprint& Cells = m_Footprints[i];
+			glm::vec2 Force = glm::vec2(0.0f);
+
+			// The grid holds the push of each cell, the negative of the physical pressure (see PressureSystem.h)
+			// Fluid on the left of a body cell pushes it right with that pressure over one face, and so on
+			for (int y = Cells.Y0; y < Cells.Y1; y++) {
+				for (int x = Cells.X0; x < Cells.X1; x++) {
+					if (!Cells.IsCovered(x, y)) {
+						continue;
+					}
+
+					const int c = grid.Index(x, y);
+
+					if (Faces[c - 1]) Force.x -= Pressure[c - 1];
+					if (Faces[c + 1]) Force.x += Pressure[c + 1];
+					if (Faces[c - Stride]) Force.y -= Pressure[c - Stride];
+					if (Faces[c + Stride]) Force.y += Pressure[c + Stride];
+				}
+			}
+
+			m_Bodies[i].State.Force = Force * gridSpacing;
+		}
+	}
+
+	void RigidBodySystem::Integrate(RigidBody& body, float dt, float gravity, float fluidDensity, float extent)
+	{
+		Object& State = body.State;
+		const glm::vec2 Start = State.Position;
+
+		State.Dv = glm::vec2(0.0f);
+
+		// The fluid the body drags along adds to its inertia, without it the lagged force overshoots on light bodies
+		if (!body.Kinematic) {
+			const float Mass = State.MassRadius.x;
+			const float Inertia = Mass + fluidDensity * body.Area;
+
+			if (Inertia > 0.0f) {
+				State.Dv = (State.Force + glm::vec2(0.0f, -gravity * Mass)) * (dt / Inertia);
+			}
+		}
+
+		State.Velocity += State.Dv;
+		State.Position += State.Velocity * dt;
+
+		// Stops against the border, the body can touch it but not cross it
+		const float Radius = std::min(State.MassRadius.y, extent * 0.5f);
+
+		for (int k = 0; k < 2; k++) {
+			if (State.Position[k] < Radius) {
+				State.Position[k] = Radius;
+				State.Velocity[k] = std::max(State.Velocity[k], 0.0f);
+			}
+
+			else if (State.Position[k] > extent - Radius) {
+				State.Position[k] = extent - Radius;
+				State.Velocity[k] = std::min(State.Velocity[k], 0.0f);
+			}
+		}
+
+		State.Dx = State.Position - Start;
+	}
+
+	void RigidBodySystem::Rasterize(FluidGrid& grid, size_t index, float gridSpacing, Footprint& scratch)
+	{
+		const RigidBody& Body = m_Bodies[index];
+		Footprint& Cells = m_Footprints[index];
+
+		const int Resolution = grid.GetResolution();
+		const glm::vec2 Position = Body.State.Position;
+		const float Radius = Body.State.MassRadius.y;
+
+		// Cells whose centre can be inside the bounding circle
+		const glm::vec2 Min = (Position - Radius) / gridSpacing - 0.5f;
+		const glm::vec2 Max = (Position + Radius) / gridSpacing - 0.5f;
+
+		scratch.X0 = std::min(std::max(int(std::ceil(Min.x)), 0), Resolution);
+		scratch.Y0 = std::min(std::max(int(std::ceil(Min.y)), 0), Resolution);
+		scratch.X1 = std::max(std::min(int(std::floor(Max.x)) + 1, Resolution), scratch.X0);
+		scratch.Y1 = std::max(std::min(int(std::floor(Max.y)) + 1, Resolution), scratch.Y0);
+		scratch.Covered.assign(size_t(scratch.X1 - scratch.X0) * size_t(scratch.Y1 - scratch.Y0), 0);
+
+		for (int y = scratch.Y0; y < scratch.Y1; y++) {
+			uint8_t* Row = scratch.Covered.data() + size_t(y - scratch.Y0) * size_t(scratch.X1 - scratch.X0);
+
+			for (int x = scratch.X0; x < scratch.X1; x++) {
+				const glm::vec2 Centre = (glm::vec2(x, y) + 0.5f) * gridSpacing;
+				Row[x - scratch.X0] = RigidBodies::Contains(Body, Centre) ? 1 : 0;
+			}
+		}
+
+		// Cells left behind first, then the ones entered, only the swept difference touches the grid
+		for (int y = Cells.Y0; y < Cells.Y1 && Cells.Valid; y++) {
+			for (int x = Cells.X0; x < Cells.X1; x++) {
+				if (Cells.IsCovered(x, y) && !scratch.IsCovered(x, y)) {
+					Uncover(grid, x, y);
+				}
+			}
+		}
+
+		for (int y = scratch.Y0; y < scratch.Y1; y++) {
+			for (int x = scratch.X0; x < scratch.X1; x++) {
+				if (scratch.IsCovered(x, y) && !(Cells.Valid && Cells.IsCovered(x, y))) {
+					Cover(grid, x, y);
+				}
+			}
+		}
+
+		std::swap(Cells.Covered, scratch.Covered);
+		Cells.X0 = scratch.X0;
+		Cells.Y0 = scratch.Y0;
+		Cells.X1 = scratch.X1;
+		Cells.Y1 = scratch.Y1;
+		Cells.Position = Position;
+		Cells.Valid = true;
+	}
+
+	void RigidBodySystem::Release(FluidGrid& grid, Footprint& footprint)
+	{
+		for (int y = footprint.Y0; y < footprint.Y1 && footprint.Valid; y++) {
+			for (int x = footprint.X0; x < footprint.X1; x++) {
+				if (footprint.IsCovered(x, y)) {
+					Uncover(grid, x, y);
+				}
+			}
+		}
+
+		footprint = Footprint();
+	}
+
+	void RigidBodySystem::Cover(FluidGrid& grid, int x, int y)
+	{
+		const int i = grid.Index(x, y);
+
+		if (m_Coverage[i]++ == 0) {
+			m_UnderlyingSolid[i] = grid.IsSolid(x, y) ? 1 : 0;
+
+			if (!m_UnderlyingSolid[i]) {
+				grid.SetSolid(x, y, true);
+			}
+		}
+
+		m_CoveredCells++;
+	}
+
+	void RigidBodySystem::Uncover(FluidGrid& grid, int x, int y)
+	{
+		const int i = grid.Index(x, y);
+
+		m_CoveredCells--;
+
+		if (--m_Coverage[i] != 0 || m_UnderlyingSolid[i]) {
+			return;
+		}
+
+		grid.SetSolid(x, y, false);
+
+		// Faces towards solids nobody moves have to stop moving, the body velocity left on them would act as a source
+		const int Stride = grid.GetStride();
+		const int Neighbours[4] = { i - 1, i + 1, i - Stride, i + Stride };
+		const Directions Sides[4] = { LEFT, RIGHT, DOWN, UP };
+
+		for (int k = 0; k < 4; k++) {
+			if (grid.GetSolid()[Neighbours[k]] && !m_Coverage[Neighbours[k]]) {
+				grid.GetVelocityRef(x, y, Sides[k]) = 0.0f;
+			}
+		}
+	}
+
+	void RigidBodySystem::ImposeVelocity(FluidGrid& grid, const Footprint& footprint, glm::vec2 velocity) const
+	{
+		const int Stride = grid.GetStride();
+		float* U = grid.GetU();
+		float* V = grid.GetV();
+
+		// Cells the body shares with a static obstacle keep that obstacle's faces
+		for (int y = footprint.Y0; y < footprint.Y1; y++) {
+			for (int x = footprint.X0; x < footprint.X1; x++) {
+				const int i = grid.Index(x, y);
+
+				if (!footprint.IsCovered(x, y) || m_UnderlyingSolid[i]) {
+					continue;
+				}
+
+				U[i] = velocity.x;
+				U[i + 1] = velocity.x;
+				V[i] = velocity.y;
+				V[i + Stride] = velocity.y;
+			}
+		}
+	}
+}
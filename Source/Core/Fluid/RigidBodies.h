@@ -0,0 +1,128 @@
+#pragma once
+
+#include "FluidGrid.h"
+#include "ActivityMap.h"
+
+#include "../Object.h"
+
+#include <vector>
+#include <cstdint>
+
+namespace Simulation
+{
+	enum class BodyShape : int {
+		Circle = 0,
+		Polygon
+	};
+
+	// Rigid obstacle moving through the grid, translation only
+	// State is in world units, a cell is GridSpacing wide and cell (0, 0) starts at the origin
+	// State.MassRadius -> (mass, bounding radius), State.Force -> force the fluid put on the body in the last step
+	// State.Dx / State.Dv -> displacement and velocity change of the last step
+	struct RigidBody
+	{
+		Object State {};
+		BodyShape Shape = BodyShape::Circle;
+
+		// Convex, counter clockwise and relative to State.Position, polygons only
+		std::vector<glm::vec2> Vertices;
+
+		float Area = 0.0f;
+
+		// Keeps its velocity whatever the fluid does
+		bool Kinematic = false;
+	};
+
+	namespace RigidBodies
+	{
+		// Mass is density * area
+		RigidBody MakeCircle(glm::vec2 position, float radius, float density);
+		RigidBody MakePolygon(glm::vec2 position, const std::vector<glm::vec2>& vertices, float density);
+
+		// Point in world units
+		bool Contains(const RigidBody& body, glm::vec2 point);
+	}
+
+	// Moving obstacles coupled both ways with the fluid
+	//
+	// Every step the bodies are integrated with the force of the last projection plus gravity,
+	// rasterized into the solid mask, and their velocity is written on the faces of the cells they cover
+	// Those faces are closed so the projection takes them as the boundary condition of the fluid next to the body
+	// After the projection the pressure around each body is summed back into its force
+	//
+	// Each body keeps the set of cells it covers, a move only walks the bounding boxes of its old and new position
+	// so the cost follows the area the bodies sweep rather than the grid, and only the cells that flipped reach UpdateFaceWeights()
+	// Multigrid then only updates the coarse cells above those, PCG's MIC(0) factor has to follow each change along its sweep
+	// until it fades out, which behind a body can be a few thousand cells (about half a full rebuild at 512^2 with 200 bodies)
+	// Cells are reference counted, overlapping bodies are fine and an uncovered cell goes back to what it was (fluid or static obstacle)
+	// Bodies only collide with the domain border, not with each other or the static obstacles
+	class RigidBodySystem
+	{
+	public :
+
+		void Add(const RigidBody& body);
+
+		// Removes every body and gives their cells back
+		void Clear(FluidGrid& grid);
+
+		// Gives the cells of every body back but keeps the bodies, the next Move() rasterizes them from scratch
+		// Has to run before the static obstacles are edited, the body cells would be taken for static ones otherwise
+		void Lift(FluidGrid& grid);
+
+		// Integrates the bodies over dt (0 only rasterizes), moves their cells and writes their velocities on their faces
+		// The mass of the displaced fluid is added to the inertia, it keeps light bodies stable with the force lagging one step behind
+		// Wakes the tiles under every body that moved or isn't at rest, flipped cells still need UpdateFaceWeights()
+		// Does nothing unless IsValidSpacing(gridSpacing), the same for GatherForces()
+		void Move(FluidGrid& grid, ActivityMap& activity, float dt, float gravity, float fluidDensity, float gridSpacing);
+
+		// Sums the pressure of the fluid cells around each body into its State.Force
+		// Every solver leaves the full pressure in the grid, the Gauss Seidel ones start from the hydrostatic pressure and add to it
+		void GatherForces(const FluidGrid& grid, float gridSpacing);
+
+		inline bool IsEmpty() const { return m_Bodies.empty(); }
+		inline int GetCount() const { return int(m_Bodies.size()); }
+		inline const std::vector<RigidBody>& GetBodies() const { return m_Bodies; }
+
+		// Is the cell at grid index i solid only because a body covers it
+		inline bool IsBodyCell(size_t i) const { return i < m_Coverage.size() && m_Coverage[i] && !m_UnderlyingSolid[i]; }
+
+		// Cells currently covered by a body, overlaps counted once per body
+		inline int GetCoveredCells() const { return m_CoveredCells; }
+
+	private :
+
+		// Cells [X0, X1) x [Y0, Y1) around a body, Covered has one entry per cell of the rectangle
+		struct Footprint
+		{
+			int X0 = 0;
+			int Y0 = 0;
+			int X1 = 0;
+			int Y1 = 0;
+			std::vector<uint8_t> Covered;
+
+			// Where the body was rasterized, a body that hasn't moved since keeps its cells
+			glm::vec2 Position = glm::vec2(0.0f);
+			bool Valid = false;
+
+			inline bool IsCovered(int x, int y) const {
+				return x >= X0 && x < X1 && y >= Y0 && y < Y1 && Covered[size_t(y - Y0) * size_t(X1 - X0) + size_t(x - X0)];
+			}
+		};
+
+		void Integrate(RigidBody& body, float dt, float gravity, float fluidDensity, float extent);
+		void Rasterize(FluidGrid& grid, size_t index, float gridSpacing, Footprint& scratch);
+		void Release(FluidGrid& grid, Footprint& footprint);
+		void Cover(FluidGrid& grid, int x, int y);
+		void Uncover(FluidGrid& grid, int x, int y);
+		void ImposeVelocity(FluidGrid& grid, const Footprint& footprint, glm::vec2 velocity) const;
+
+		std::vector<RigidBody> m_Bodies;
+		std::vector<Footprint> m_Footprints;
+
+		// Per cell in grid layout : bodies covering it, and whether it was solid before the first one did
+		std::vector<uint16_t> m_Coverage;
+		std::vector<uint8_t> m_UnderlyingSolid;
+
+		int m_CoveredCells = 0;
+	};
+}
@@ -0,0 +1,67 @@
+#include "Scenarios.h"
+#include "Tiling.h"
+
+namespace Simulation
+{
+	void Scenarios::CircularBurst(FluidGrid& grid, glm::vec2 center, float radius)
+	{
+		const int Resolution = grid.GetResolution();
+
+		Tiling::ForEachCell(Resolution, Resolution, Tiling::DefaultTileSize, [&](int x, int y) {
+
+			glm::vec2 V = glm::vec2(x, y);
+			V /= float(Resolution);
+			V = V * 2.f - 1.f;
+
+			float d = glm::distance(V, center);
+
+			for (int z = 0; z < 4; z++) {
+				auto& v = grid.GetVelocityRef(x, y, Directions(z));
+				v = 0.0f;
+			}
+
+			for (int z = 0; z < 4; z++) {
+				auto& v = grid.GetVelocityRef(x, y, Directions(z));
+
+				if (d < radius)
+					v = 10.0f;
+			}
+		});
+	}
+
+	void Scenarios::ScalarDisk(FluidGrid& grid, ScalarField field, glm::vec2 center, float radius, float value)
+	{
+		const int Resolution = grid.GetResolution();
+		float* Scalar = grid.GetScalar(field);
+
+		Tiling::ForEachCell(Resolution, Resolution, Tiling::DefaultTileSize, [&](int x, int y) {
+			glm::vec2 P = glm::vec2(x, y) / float(Resolution) * 2.0f - 1.0f;
+
+			if (glm::distance(P, center) < radius) {
+				Scalar[grid.Index(x, y)] = value;
+			}
+		});
+	}
+
+	void Scenarios::ObstacleDisk(FluidGrid& grid, glm::vec2 center, float radius)
+	{
+		const int Resolution = grid.GetResolution();
+
+		for (int y = 0; y < Resolution; y++) {
+			for (int x = 0; x < Resolution; x++) {
+
+				glm::vec2 P = (glm::vec2(x, y) + 0.5f) / float(Resolution);
+
+				if (glm::distance(P, center) >= radius) {
+					continue;
+				}
+
+				grid.SetSolid(x, y, true);
+
+				for (int z = 0; z < 4; z++) {
+					grid.GetVelocityRef(x, y, Directions(z)) = 0.0f;
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "FluidGrid.h"
+
+namespace Simulation
+{
+	namespace Scenarios
+	{
+		// Disk of fluid moving outwards/upwards, center and radius are in [-1, 1] domain units, the default fills the middle
+		void CircularBurst(FluidGrid& grid, glm::vec2 center = glm::vec2(0.0f), float radius = 0.7f);
+
+		// Sets a scalar field to value inside a disk, same units as CircularBurst()
+		void ScalarDisk(FluidGrid& grid, ScalarField field, glm::vec2 center, float radius, float value);
+
+		// Marks a solid disk, center and radius are in [0, 1] domain units
+		// The faces of the new solid cells are zeroed
+		void ObstacleDisk(FluidGrid& grid, glm::vec2 center, float radius);
+	}
+}
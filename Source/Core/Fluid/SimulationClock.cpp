@@ -0,0 +1,398 @@
+#include "SimulationClock.h"
+
+#include <chrono>
+#include <algorithm>
+#include <filesystem>
+
+namespace Simulation
+{
+	SimulationClock::SimulationClock(FluidSolver& solver) : m_Solver(solver)
+	{
+	}
+
+	SimulationClock::~SimulationClock()
+	{
+		StopThread();
+		StopRecording();
+	}
+
+	int SimulationClock::Advance(float frameTime)
+	{
+		if (IsThreaded()) {
+			return 0;
+		}
+
+		ApplyCommands();
+		const int Steps = RunDueSteps(frameTime);
+		PublishSnapshot();
+
+		return Steps;
+	}
+
+	bool SimulationClock::Submit(const SimulationCommand& command)
+	{
+		if (!m_Commands.TryPush(command)) {
+			return false;
+		}
+
+		// Steps and unpausing should not wait for the thread's next timed wake up
+		{
+			std::lock_guard<std::mutex> Guard(m_WakeMutex);
+			m_Wake = true;
+		}
+
+		m_WakeCondition.notify_all();
+		return true;
+	}
+
+	bool SimulationClock::AcquireSnapshot()
+	{
+		return m_Snapshots.Acquire();
+	}
+
+	void SimulationClock::SetThreaded(bool threaded)
+	{
+		if (threaded == IsThreaded()) {
+			return;
+		}
+
+		if (!threaded) {
+			StopThread();
+			return;
+		}
+
+		m_Stop = false;
+		m_Thread = std::thread(&SimulationClock::ThreadLoop, this);
+	}
+
+	void SimulationClock::ApplyCommands()
+	{
+		SimulationCommand Command;
+
+		while (m_Commands.TryPop(Command)) {
+			ApplyCommand(Command);
+
+			if (m_IsRecording && CommandRecording::IsRecorded(Command.Kind)) {
+				const double Time = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_RecordingStart).count();
+				m_Recording.Add(m_RecordedSteps, Time, Command);
+			}
+		}
+	}
+
+	void SimulationClock::ApplyCommand(const SimulationCommand& command)
+	{
+		switch (command.Kind) {
+		case SimulationCommand::Type::SetParameters:
+			m_Solver.Parameters = command.Parameters;
+			break;
+
+		case SimulationCommand::Type::SetClockSettings:
+			m_Settings = command.Clock;
+			break;
+
+		case SimulationCommand::Type::SetPaused:
+			m_Paused = command.Paused;
+			break;
+
+		case SimulationCommand::Type::Step:
+			m_PendingSteps++;
+			break;
+
+		case SimulationCommand::Type::Reset:
+			m_Solver.GetGrid().Reset();
+			m_Solver.WakeAll();
+			m_FieldsChanged = true;
+			m_AllRowsDirty = true;
+			break;
+
+		case SimulationCommand::Type::LoadFields:
+			LoadFields(command);
+			break;
+
+		case SimulationCommand::Type::LoadObstacles:
+			// The new face mask has to reach the snapshot even while paused
+			if (command.Obstacles) {
+				m_Solver.LoadObstacles(*command.Obstacles, command.ObstacleSettings);
+				m_FieldsChanged = true;
+			}
+			break;
+
+		case SimulationCommand::Type::AddBody:
+			m_Solver.AddBody(command.Body);
+			m_FieldsChanged = true;
+			break;
+
+		case SimulationCommand::Type::ClearBodies:
+			m_Solver.ClearBodies();
+			m_FieldsChanged = true;
+			break;
+
+		case SimulationCommand::Type::SaveCheckpoint:
+			SaveCheckpoint(command.Path);
+			break;
+
+		case SimulationCommand::Type::StartStream:
+			m_FieldStream.Open(command.Path, m_Solver.GetGrid(), command.StreamSettings);
+			m_StreamEvery = std::max(command.StreamEvery, 1);
+			break;
+
+		case SimulationCommand::Type::StopStream:
+			m_FieldStream.Close();
+			break;
+
+		case SimulationCommand::Type::StartRecording:
+			StartRecording(command.Path);
+			break;
+
+		case SimulationCommand::Type::StopRecording:
+			StopRecording();
+			break;
+		}
+	}
+
+	int SimulationClock::RunDueSteps(float elapsed)
+	{
+		const float DeltaTime = m_Settings.GetFixedDeltaTime();
+		int Steps = 0;
+
+		// Single steps requested while paused
+		for (; m_PendingSteps > 0; m_PendingSteps--) {
+			StepSolver(DeltaTime);
+			Steps++;
+		}
+
+		if (m_Paused) {
+			m_Accumulator = 0.0f;
+		}
+
+		else {
+			m_Accumulator += std::max(elapsed, 0.0f);
+
+			const int MaxSteps = std::max(m_Settings.Substeps * m_Settings.MaxCatchUpFrames, 1);
+
+			while (m_Accumulator >= DeltaTime && Steps < MaxSteps) {
+				StepSolver(DeltaTime);
+				m_Accumulator -= DeltaTime;
+				Steps++;
+			}
+
+			if (m_Accumulator >= DeltaTime) {
+				m_DroppedTime += double(m_Accumulator);
+				m_Accumulator = 0.0f;
+			}
+		}
+
+		m_LastStepCount = Steps;
+		m_FieldsChanged |= Steps > 0;
+
+		return Steps;
+	}
+
+	void SimulationClock::LoadFields(const SimulationCommand& command)
+	{
+		FluidGrid& Grid = m_Solver.GetGrid();
+		const size_t Size = Grid.GetFieldSize();
+
+		if (command.Checkpoint) {
+			if (RestoreCheckpoint(*command.Checkpoint, m_Solver)) {
+				m_StepIndex = command.Checkpoint->GetStepIndex();
+				m_FieldsChanged = true;
+				m_AllRowsDirty = true;
+			}
+
+			return;
+		}
+
+		if (command.U.size() != Size || command.V.size() != Size || command.Pressure.size() != Size) {
+			return;
+		}
+
+		// Both velocity buffers, advection only rewrites the back buffers of active tiles
+		std::copy(command.U.begin(), command.U.end(), Grid.GetU());
+		std::copy(command.V.begin(), command.V.end(), Grid.GetV());
+		std::copy(command.U.begin(), command.U.end(), Grid.GetBackU());
+		std::copy(command.V.begin(), command.V.end(), Grid.GetBackV());
+		std::copy(command.Pressure.begin(), command.Pressure.end(), Grid.GetPressure());
+
+		m_Solver.WakeAll();
+		m_FieldsChanged = true;
+		m_AllRowsDirty = true;
+	}
+
+	void SimulationClock::SaveCheckpoint(const std::string& path)
+	{
+		// Only the copy happens between the steps, the file is written while stepping goes on
+		std::shared_ptr<CheckpointState> State = m_CheckpointWriter.AcquireState();
+		State->Capture(m_Solver, m_StepIndex);
+		m_CheckpointWriter.Save(path, std::move(State));
+	}
+
+	void SimulationClock::StartRecording(const std::string& path)
+	{
+		StopRecording();
+
+		// Written right away rather than through the writer, a save requested next would replace it while it waits
+		const std::string StartCheckpoint = path + ".eulckpt";
+		CheckpointState State;
+		State.Capture(m_Solver, m_StepIndex);
+
+		if (!WriteCheckpoint(StartCheckpoint, State)) {
+			return;
+		}
+
+		m_Recording.Begin(std::filesystem::path(StartCheckpoint).filename().string());
+
+		// The checkpoint has the parameters but not the clock, which sets the step size
+		SimulationCommand Settings;
+		Settings.Kind = SimulationCommand::Type::SetClockSettings;
+		Settings.Clock = m_Settings;
+		m_Recording.Add(0, 0.0, Settings);
+
+		m_RecordingPath = path;
+		m_RecordedSteps = 0;
+		m_RecordingStart = std::chrono::steady_clock::now();
+		m_IsRecording = true;
+	}
+
+	void SimulationClock::StopRecording()
+	{
+		if (!m_IsRecording) {
+			return;
+		}
+
+		m_Recording.SetStepCount(m_RecordedSteps);
+		m_Recording.Save(m_RecordingPath);
+		m_IsRecording = false;
+	}
+
+	void SimulationClock::StepSolver(float dt)
+	{
+		m_Solver.Step(dt);
+		m_StepIndex++;
+		m_RecordedSteps += m_IsRecording ? 1 : 0;
+
+		// Waits here when the stream's writer is behind, the stream counts that as a stall
+		if (m_FieldStream.IsOpen() && m_StepIndex % uint64_t(m_StreamEvery) == 0) {
+			m_FieldStream.Push(m_Solver.GetGrid(), m_StepIndex);
+		}
+
+		m_DirtyRows.resize(m_Solver.GetGrid().GetResolution(), 1);
+		m_Solver.MarkPressureRows(m_DirtyRows);
+	}
+
+	void SimulationClock::PublishSnapshot()
+	{
+		if (!m_FieldsChanged) {
+			return;
+		}
+
+		const FluidGrid& Grid = m_Solver.GetGrid();
+		const int Resolution = Grid.GetResolution();
+		const int Stride = Grid.GetStride();
+		const size_t Size = Grid.GetFieldSize();
+
+		m_Version++;
+		m_DirtyRows.resize(Resolution, 1);
+		m_RowVersions.resize(size_t(Resolution) + 2, 0);
+
+		// The padding rows only change along with everything else
+		for (int y = -1; y <= Resolution; y++) {
+			const bool Inside = y >= 0 && y < Resolution;
+
+			if (m_AllRowsDirty || (Inside && m_DirtyRows[y])) {
+				m_RowVersions[y + 1] = m_Version;
+			}
+		}
+
+		std::fill(m_DirtyRows.begin(), m_DirtyRows.end(), uint8_t(0));
+		m_AllRowsDirty = false;
+
+		FieldSnapshot& Snapshot = m_Snapshots.GetWriteBuffer();
+
+		// The slot still holds the rows of the publish it was last filled at, only newer rows are copied
+		if (Snapshot.Pressure.size() != Size) {
+			Snapshot.Pressure.assign(Grid.GetPressure(), Grid.GetPressure() + Size);
+		}
+
+		else {
+			for (int Row = 0; Row < Resolution + 2; Row++) {
+				if (m_RowVersions[Row] > Snapshot.Version) {
+					const size_t Offset = size_t(Row) * size_t(Stride);
+					std::copy(Grid.GetPressure() + Offset, Grid.GetPressure() + Offset + Stride, Snapshot.Pressure.data() + Offset);
+				}
+			}
+		}
+
+		Snapshot.U.assign(Grid.GetU(), Grid.GetU() + Size);
+		Snapshot.V.assign(Grid.GetV(), Grid.GetV() + Size);
+
+		for (int f = 0; f < SCALAR_COUNT; f++) {
+			Snapshot.Scalars[f].assign(Grid.GetScalar(f), Grid.GetScalar(f) + Size);
+		}
+
+		if (Snapshot.ObstacleVersion != Grid.GetObstacleVersion() || Snapshot.Faces.size() != Size) {
+			Snapshot.Faces.assign(Grid.GetFaces(), Grid.GetFaces() + Size);
+			Snapshot.InvWeight.assign(Grid.GetInvWeight(), Grid.GetInvWeight() + Size);
+			Snapshot.ObstacleVersion = Grid.GetObstacleVersion();
+		}
+
+		Snapshot.Bodies = m_Solver.GetBodies().GetBodies();
+
+		Snapshot.Version = m_Version;
+		Snapshot.PressureRowVersions = m_RowVersions;
+		Snapshot.Stats = m_Solver.GetStats();
+		Snapshot.StepIndex = m_StepIndex;
+		Snapshot.LastStepCount = m_LastStepCount;
+		Snapshot.DroppedTime = m_DroppedTime;
+		Snapshot.FixedDeltaTime = m_Settings.GetFixedDeltaTime();
+
+		m_Snapshots.Publish();
+		m_FieldsChanged = false;
+	}
+
+	void SimulationClock::ThreadLoop()
+	{
+		using Clock = std::chrono::steady_clock;
+
+		Clock::time_point Last = Clock::now();
+
+		while (!m_Stop) {
+			ApplyCommands();
+
+			Clock::time_point Now = Clock::now();
+			const float Elapsed = std::chrono::duration<float>(Now - Last).count();
+			Last = Now;
+
+			RunDueSteps(Elapsed);
+			PublishSnapshot();
+
+			// Sleep until the next step is due or a command comes in
+			const float DeltaTime = m_Settings.GetFixedDeltaTime();
+			const float Wait = m_Paused ? DeltaTime : std::max(DeltaTime - m_Accumulator, 0.0f);
+
+			std::unique_lock<std::mutex> Guard(m_WakeMutex);
+
+			m_WakeCondition.wait_for(Guard, std::chrono::duration<float>(Wait), [this]() {
+				return m_Stop || m_Wake;
+			});
+
+			m_Wake = false;
+		}
+	}
+
+	void SimulationClock::StopThread()
+	{
+		if (!m_Thread.joinable()) {
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> Guard(m_WakeMutex);
+			m_Stop = true;
+		}
+
+		m_WakeCondition.notify_all();
+		m_Thread.join();
+		m_Accumulator = 0.0f;
+	}
+}
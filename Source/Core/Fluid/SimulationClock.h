@@ -0,0 +1,147 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <chrono>
+
+#include "FluidSolver.h"
+#include "SimulationCommand.h"
+#include "Checkpoint.h"
+#include "FieldStream.h"
+#include "CommandRecording.h"
+
+#include "../Utils/TripleBuffer.h"
+#include "../Utils/SPSCQueue.h"
+
+namespace Simulation
+{
+	// Copy of what the renderer and the UI read, published after every batch of steps
+	struct FieldSnapshot
+	{
+		std::vector<float> Pressure;
+		std::vector<float> U;
+		std::vector<float> V;
+		std::vector<float> Scalars[SCALAR_COUNT];
+
+		// Publish count this snapshot was taken at, and the one each padded pressure row last changed at
+		// A consumer holding rows from publish N only has to copy the rows with a newer version
+		uint64_t Version = 0;
+		std::vector<uint64_t> PressureRowVersions;
+
+		// Obstacle derived fields of the grid, only copied into a slot when the obstacles changed since it was last filled
+		std::vector<uint8_t> Faces;
+		std::vector<float> InvWeight;
+		uint64_t ObstacleVersion = 0;
+
+		// Position, velocity and last fluid force of every rigid body
+		std::vector<RigidBody> Bodies;
+
+		FluidStepStats Stats;
+		uint64_t StepIndex = 0;
+		int LastStepCount = 0;
+		double DroppedTime = 0.0;
+		float FixedDeltaTime = 0.0f;
+	};
+
+	// Drives the solver with a fixed timestep regardless of how often it is called
+	// Wall time goes into an accumulator and whole steps are taken out of it
+	//
+	// The solver and the grid belong to the simulation side, which is the calling thread of Advance() or,
+	// in threaded mode, the clock's own thread running in real time
+	// The other side never touches them : edits go through Submit() and results come back through AcquireSnapshot()
+	// Both are lock free, a slow step never blocks a frame and a slow frame never blocks a step
+	// Submit() and AcquireSnapshot() must be called from one thread
+	class SimulationClock
+	{
+	public :
+
+		SimulationClock(FluidSolver& solver);
+		~SimulationClock();
+
+		SimulationClock(const SimulationClock&) = delete;
+		SimulationClock operator=(SimulationClock const&) = delete;
+
+		// Called once per rendered frame with the wall time since the last one
+		// Applies the queued commands and runs the steps that are due (nothing in threaded mode), returns how many ran
+		int Advance(float frameTime);
+
+		// Returns false when the queue is full, the command should be sent again later
+		bool Submit(const SimulationCommand& command);
+
+		// Takes the newest published snapshot, returns false when nothing new was published since the last call
+		bool AcquireSnapshot();
+		inline const FieldSnapshot& GetSnapshot() const { return m_Snapshots.GetReadBuffer(); }
+
+		// Saves requested through SaveCheckpoint are captured between two steps and written by this, safe to query from any thread
+		inline const CheckpointWriter& GetCheckpointWriter() const { return m_CheckpointWriter; }
+
+		// Stream opened by StartStream, only its GetStats() may be called from the other side
+		inline const FieldStreamWriter& GetFieldStream() const { return m_FieldStream; }
+
+		void SetThreaded(bool threaded);
+		inline bool IsThreaded() const { return m_Thread.joinable(); }
+
+		// Applies one command right away on the calling thread, for drivers that step the solver themselves (replays)
+		// Only valid while the clock isn't threaded, the calling thread is then the simulation side
+		void ApplyCommand(const SimulationCommand& command);
+		inline const ClockSettings& GetSettings() const { return m_Settings; }
+
+	private :
+
+		// Simulation side
+		void ApplyCommands();
+		void LoadFields(const SimulationCommand& command);
+		void SaveCheckpoint(const std::string& path);
+		void StartRecording(const std::string& path);
+		void StopRecording();
+		int RunDueSteps(float elapsed);
+		void StepSolver(float dt);
+		void PublishSnapshot();
+
+		void ThreadLoop();
+		void StopThread();
+
+		FluidSolver& m_Solver;
+		ClockSettings m_Settings;
+
+		SPSCQueue<SimulationCommand, 64> m_Commands;
+		TripleBuffer<FieldSnapshot> m_Snapshots;
+		CheckpointWriter m_CheckpointWriter;
+		FieldStreamWriter m_FieldStream;
+		int m_StreamEvery = 10;
+
+		// Commands applied since StartRecording, keyed by the steps taken since, saved on StopRecording
+		CommandRecording m_Recording;
+		std::string m_RecordingPath;
+		bool m_IsRecording = false;
+		uint64_t m_RecordedSteps = 0;
+		std::chrono::steady_clock::time_point m_RecordingStart;
+
+		// Only guards the sleep of the thread, no data is shared through it
+		std::mutex m_WakeMutex;
+		std::condition_variable m_WakeCondition;
+		std::thread m_Thread;
+		std::atomic<bool> m_Stop { false };
+		std::atomic<bool> m_Wake { false };
+
+		float m_Accumulator = 0.0f;
+		bool m_Paused = true;
+		bool m_FieldsChanged = true;
+
+		// Pressure rows written since the last publish, per cell row
+		std::vector<uint8_t> m_DirtyRows;
+		std::vector<uint64_t> m_RowVersions;
+		uint64_t m_Version = 0;
+		bool m_AllRowsDirty = true;
+		int m_PendingSteps = 0;
+		int m_LastStepCount = 0;
+		uint64_t m_StepIndex = 0;
+		double m_DroppedTime = 0.0;
+	};
+}
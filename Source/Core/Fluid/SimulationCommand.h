@@ -0,0 +1,73 @@
+#pragma once
+
+#include "FluidSolver.h"
+#include "Checkpoint.h"
+#include "FieldStream.h"
+
+#include <string>
+#include <vector>
+#include <memory>
+
+namespace Simulation
+{
+	struct ClockSettings
+	{
+		// Fixed sub-steps per frame of simulated time, every step advances 1 / (FrameRate * Substeps) seconds
+		int Substeps = 3;
+		float FrameRate = 60.0f;
+
+		// Catch up is capped at this many frames worth of steps, the rest of the backlog is dropped
+		// Keeps a slow step from snowballing into ever longer frames
+		int MaxCatchUpFrames = 4;
+
+		inline float GetFixedDeltaTime() const { return 1.0f / (FrameRate * float(Substeps)); }
+	};
+
+	// Edits from the UI, applied by the simulation side between steps
+	struct SimulationCommand
+	{
+		enum class Type : int {
+			SetParameters = 0,
+			SetClockSettings,
+			SetPaused,
+			Step,
+			Reset,
+			LoadFields,
+			LoadObstacles,
+			AddBody,
+			ClearBodies,
+			SaveCheckpoint,
+			StartStream,
+			StopStream,
+			StartRecording,
+			StopRecording
+		};
+
+		Type Kind = Type::Step;
+
+		FluidParameters Parameters;
+		ClockSettings Clock;
+		bool Paused = false;
+
+		// Velocities and pressure in grid layout for LoadFields
+		std::vector<float> U;
+		std::vector<float> V;
+		std::vector<float> Pressure;
+
+		// Set instead of the fields above, LoadFields then restores the whole state out of the mapped file
+		std::shared_ptr<const MappedCheckpoint> Checkpoint;
+
+		// Destination of SaveCheckpoint, StartStream and StartRecording
+		std::string Path;
+
+		// StartStream writes a frame every StreamEvery steps
+		FieldStreamSettings StreamSettings;
+		int StreamEvery = 10;
+
+		// Decoded on the submitting side, shared so a settings change doesn't copy the image again
+		std::shared_ptr<const ObstacleMap> Obstacles;
+		ObstacleMapSettings ObstacleSettings;
+
+		RigidBody Body;
+	};
+}
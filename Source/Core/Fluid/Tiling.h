@@ -0,0 +1,106 @@
+#pragma once
+
+#include <algorithm>
+
+#include "../Utils/ThreadPool.h"
+
+// Blocked traversal of the padded grid
+//
+// The domain is cut into TileSize x TileSize tiles, tiles are visited in row major order and the cells of a tile row by row
+// The inner loop always runs along x, which is contiguous in every field, and one tile of every field a stage touches stays in L1/L2
+// So stencils that read the rows above/below (Gauss Seidel, advection) reuse them from cache instead of streaming whole rows
+// A tile size of 0 degenerates into plain full rows
+
+namespace Simulation
+{
+	// Cells [X0, X1) x [Y0, Y1)
+	struct Tile
+	{
+		int X0;
+		int Y0;
+		int X1;
+		int Y1;
+	};
+
+	namespace Tiling
+	{
+		// Full rows, with the inner loop along x the hardware prefetcher already keeps the 3 row stencils fed up to 4096^2
+		// Square tiles (32 - 256) only pay off once a few rows of every field no longer fit the L2
+		const int DefaultTileSize = 0;
+
+		inline int GetTileCount(int extent, int tileSize)
+		{
+			return (extent + tileSize - 1) / tileSize;
+		}
+
+		// Tile edges for a tile size, 0 gives single full rows
+		inline void GetTileExtent(int width, int tileSize, int& tileWidth, int& tileHeight)
+		{
+			tileWidth = tileSize > 0 ? std::min(tileSize, width) : width;
+			tileHeight = tileSize > 0 ? tileSize : 1;
+		}
+
+		inline Tile GetTile(int width, int height, int tileWidth, int tileHeight, int tileX, int tileY)
+		{
+			Tile T;
+			T.X0 = tileX * tileWidth;
+			T.Y0 = tileY * tileHeight;
+			T.X1 = std::min(T.X0 + tileWidth, width);
+			T.Y1 = std::min(T.Y0 + tileHeight, height);
+			return T;
+		}
+
+		// fn(tile) over every tile of a width x height domain, in order
+		template <typename F>
+		void ForEachTile(int width, int height, int tileSize, const F& fn)
+		{
+			int TileWidth, TileHeight;
+			GetTileExtent(width, tileSize, TileWidth, TileHeight);
+
+			const int TilesX = GetTileCount(width, TileWidth);
+			const int TilesY = GetTileCount(height, TileHeight);
+
+			for (int ty = 0; ty < TilesY; ty++) {
+				for (int tx = 0; tx < TilesX; tx++) {
+					fn(GetTile(width, height, TileWidth, TileHeight, tx, ty));
+				}
+			}
+		}
+
+		// fn(x, y) over every cell, tile by tile, for stages where the visiting order matters (lexicographic Gauss Seidel)
+		template <typename F>
+		void ForEachCell(int width, int height, int tileSize, const F& fn)
+		{
+			ForEachTile(width, height, tileSize, [&](const Tile& T) {
+				for (int y = T.Y0; y < T.Y1; y++) {
+					for (int x = T.X0; x < T.X1; x++) {
+						fn(x, y);
+					}
+				}
+			});
+		}
+
+		// fn(tile, threadIndex) with each thread taking a contiguous band of tile rows
+		// Tiles of different threads run at the same time, only use it for stages without dependencies between cells
+		template <typename F>
+		void ParallelForEachTile(ThreadPool& pool, int width, int height, int tileSize, const F& fn)
+		{
+			int TileWidth, TileHeight;
+			GetTileExtent(width, tileSize, TileWidth, TileHeight);
+
+			const int TilesX = GetTileCount(width, TileWidth);
+			const int TilesY = GetTileCount(height, TileHeight);
+
+			pool.Run([&](int index, int threads) {
+				int Begin, End;
+				ThreadPool::GetChunk(0, TilesY, index, threads, Begin, End);
+
+				for (int ty = Begin; ty < End; ty++) {
+					for (int tx = 0; tx < TilesX; tx++) {
+						fn(GetTile(width, height, TileWidth, TileHeight, tx, ty), index);
+					}
+				}
+			});
+		}
+	}
+}
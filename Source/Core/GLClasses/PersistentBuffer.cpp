@@ -0,0 +1,104 @@
+#include "PersistentBuffer.h"
+
+#include <iostream>
+
+namespace GLClasses
+{
+	PersistentBuffer::PersistentBuffer(GLenum type, GLsizeiptr segmentSize, int segments) : m_Type(type)
+	{
+		GLint Alignment = 1;
+
+		if (type == GL_SHADER_STORAGE_BUFFER) {
+			glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &Alignment);
+		}
+
+		else if (type == GL_UNIFORM_BUFFER) {
+			glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &Alignment);
+		}
+
+		Alignment = Alignment > 0 ? Alignment : 1;
+
+		m_SegmentSize = segmentSize;
+		m_SegmentStride = ((segmentSize + Alignment - 1) / Alignment) * Alignment;
+		m_SegmentCount = segments > 1 ? segments : 1;
+		m_Current = m_SegmentCount - 1;
+		m_Fences.assign(m_SegmentCount, (GLsync)0);
+
+		const GLbitfield Flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT;
+
+		glGenBuffers(1, &m_ID);
+		glBindBuffer(m_Type, m_ID);
+		glBufferStorage(m_Type, m_SegmentStride * m_SegmentCount, nullptr, Flags);
+		m_Mapped = (uint8_t*)glMapBufferRange(m_Type, 0, m_SegmentStride * m_SegmentCount, Flags | GL_MAP_FLUSH_EXPLICIT_BIT);
+		glBindBuffer(m_Type, 0);
+
+		if (!m_Mapped) {
+			std::cout << "\nPersistentBuffer : could not map " << m_SegmentStride * m_SegmentCount << " bytes\n";
+		}
+	}
+
+	PersistentBuffer::~PersistentBuffer()
+	{
+		for (GLsync& Fence : m_Fences) {
+			if (Fence) {
+				glDeleteSync(Fence);
+			}
+		}
+
+		if (m_Mapped) {
+			glBindBuffer(m_Type, m_ID);
+			glUnmapBuffer(m_Type);
+			glBindBuffer(m_Type, 0);
+		}
+
+		glDeleteBuffers(1, &m_ID);
+	}
+
+	void* PersistentBuffer::BeginSegment()
+	{
+		m_Current = (m_Current + 1) % m_SegmentCount;
+
+		GLsync& Fence = m_Fences[m_Current];
+
+		if (Fence) {
+			// Only blocks when the GPU is more than the whole ring behind
+			GLenum Result = glClientWaitSync(Fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+
+			while (Result == GL_TIMEOUT_EXPIRED) {
+				Result = glClientWaitSync(Fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+			}
+
+			glDeleteSync(Fence);
+			Fence = 0;
+		}
+
+		return m_Mapped ? m_Mapped + m_SegmentStride * m_Current : nullptr;
+	}
+
+	void PersistentBuffer::FlushRange(GLintptr offset, GLsizeiptr size) const
+	{
+		if (!m_Mapped || size <= 0) {
+			return;
+		}
+
+		glBindBuffer(m_Type, m_ID);
+		glFlushMappedBufferRange(m_Type, m_SegmentStride * m_Current + offset, size);
+		glBindBuffer(m_Type, 0);
+	}
+
+	void PersistentBuffer::BindBase(GLuint index) const
+	{
+		glBindBufferRange(m_Type, index, m_ID, m_SegmentStride * m_Current, m_SegmentSize);
+	}
+
+	void PersistentBuffer::FenceSegment()
+	{
+		GLsync& Fence = m_Fences[m_Current];
+
+		if (Fence) {
+			glDeleteSync(Fence);
+		}
+
+		Fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace GLClasses
+{
+	// Buffer storage mapped once for its whole lifetime and split into a ring of segments written in turn
+	// Each segment is guarded by a fence, the CPU never writes a segment the GPU may still be reading
+	// The mapping is not coherent, written ranges only reach the GPU once they are flushed
+	class PersistentBuffer
+	{
+	public :
+
+		PersistentBuffer(GLenum type, GLsizeiptr segmentSize, int segments = 3);
+		~PersistentBuffer();
+
+		PersistentBuffer(const PersistentBuffer&) = delete;
+		PersistentBuffer operator=(PersistentBuffer const&) = delete;
+
+		// Moves on to the next segment, waits until the GPU is done with it and returns its mapped memory
+		void* BeginSegment();
+
+		// Makes [offset, offset + size) of the current segment visible to the GPU
+		void FlushRange(GLintptr offset, GLsizeiptr size) const;
+
+		// Binds the current segment to an indexed binding point
+		void BindBase(GLuint index) const;
+
+		// Call once the last command reading the current segment was issued
+		void FenceSegment();
+
+		inline int GetSegment() const { return m_Current; }
+		inline int GetSegmentCount() const { return m_SegmentCount; }
+		inline GLsizeiptr GetSegmentSize() const { return m_SegmentSize; }
+
+	private :
+
+		GLuint m_ID = 0;
+		GLenum m_Type;
+
+		// Segment size rounded up to the offset alignment of the binding point
+		GLsizeiptr m_SegmentSize = 0;
+		GLsizeiptr m_SegmentStride = 0;
+		int m_SegmentCount = 0;
+		int m_Current = 0;
+
+		uint8_t* m_Mapped = nullptr;
+		std::vector<GLsync> m_Fences;
+	};
+}
@@ -0,0 +1,277 @@
+#include "GpuFluidSolver.h"
+
+#include "ShaderManager.h"
+
+#include <cstring>
+#include <algorithm>
+
+namespace Simulation
+{
+	// Binding points shared with the FLUID_* compute shaders
+	enum GpuFieldBindings : GLuint {
+		BINDING_U = 0,
+		BINDING_V,
+		BINDING_BACK_U,
+		BINDING_BACK_V,
+		BINDING_PRESSURE,
+		BINDING_FACES,
+		BINDING_INV_WEIGHT,
+		BINDING_DIVERGENCE,
+		BINDING_STATS,
+		BINDING_CURL
+	};
+
+	static const GLuint GroupSize = 8;
+
+	static GLuint CreateFieldBuffer(size_t bytes)
+	{
+		GLuint Buffer = 0;
+		glGenBuffers(1, &Buffer);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, Buffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, bytes, nullptr, GL_DYNAMIC_COPY);
+
+		const float Zero = 0.0f;
+		glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32F, GL_RED, GL_FLOAT, &Zero);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+		return Buffer;
+	}
+
+	GpuFluidSolver::GpuFluidSolver(int resolution, int stride) : m_Resolution(resolution), m_Stride(stride)
+	{
+		const size_t FieldBytes = GetFieldSize() * sizeof(float);
+
+		m_U = CreateFieldBuffer(FieldBytes);
+		m_V = CreateFieldBuffer(FieldBytes);
+		m_BackU = CreateFieldBuffer(FieldBytes);
+		m_BackV = CreateFieldBuffer(FieldBytes);
+		m_Pressure = CreateFieldBuffer(FieldBytes);
+		m_Faces = CreateFieldBuffer(GetFieldSize() * sizeof(uint32_t));
+		m_InvWeight = CreateFieldBuffer(FieldBytes);
+		m_Divergence = CreateFieldBuffer(FieldBytes);
+		m_Curl = CreateFieldBuffer(FieldBytes);
+		m_StatsBuffer = CreateFieldBuffer(2 * sizeof(uint32_t));
+
+		const GLbitfield Flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+		glGenBuffers(1, &m_Readback);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, m_Readback);
+		glBufferStorage(GL_COPY_WRITE_BUFFER, 2 * sizeof(uint32_t), nullptr, Flags);
+		m_ReadbackMapped = (const uint32_t*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, 2 * sizeof(uint32_t), Flags);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+
+	GpuFluidSolver::~GpuFluidSolver()
+	{
+		if (m_ReadbackFence) {
+			glDeleteSync(m_ReadbackFence);
+		}
+
+		glBindBuffer(GL_COPY_WRITE_BUFFER, m_Readback);
+		glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+		const GLuint Buffers[] = { m_U, m_V, m_BackU, m_BackV, m_Pressure, m_Faces, m_InvWeight, m_Divergence, m_Curl, m_StatsBuffer, m_Readback };
+		glDeleteBuffers(GLsizei(sizeof(Buffers) / sizeof(Buffers[0])), Buffers);
+	}
+
+	void GpuFluidSolver::Reset()
+	{
+		const float Zero = 0.0f;
+
+		for (GLuint Buffer : { m_U, m_V, m_BackU, m_BackV, m_Pressure }) {
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, Buffer);
+			glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32F, GL_RED, GL_FLOAT, &Zero);
+		}
+
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	}
+
+	void GpuFluidSolver::LoadFields(const float* u, const float* v, const float* pressure)
+	{
+		const size_t FieldBytes = GetFieldSize() * sizeof(float);
+
+		glNamedBufferSubData(m_U, 0, FieldBytes, u);
+		glNamedBufferSubData(m_V, 0, FieldBytes, v);
+		glNamedBufferSubData(m_Pressure, 0, FieldBytes, pressure);
+	}
+
+	void GpuFluidSolver::LoadObstacles(const uint8_t* faces, const float* invWeight, uint64_t version)
+	{
+		// The shaders read the face mask as uints
+		std::vector<uint32_t> Faces(faces, faces + GetFieldSize());
+
+		glNamedBufferSubData(m_Faces, 0, Faces.size() * sizeof(uint32_t), Faces.data());
+		glNamedBufferSubData(m_InvWeight, 0, GetFieldSize() * sizeof(float), invWeight);
+
+		m_ObstacleVersion = version;
+	}
+
+	void GpuFluidSolver::ReadFields(float* u, float* v, float* pressure) const
+	{
+		const size_t FieldBytes = GetFieldSize() * sizeof(float);
+
+		glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+		glGetNamedBufferSubData(m_U, 0, FieldBytes, u);
+		glGetNamedBufferSubData(m_V, 0, FieldBytes, v);
+		glGetNamedBufferSubData(m_Pressure, 0, FieldBytes, pressure);
+	}
+
+	void GpuFluidSolver::BindFields() const
+	{
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING_U, m_U);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING_V, m_V);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING_BACK_U, m_BackU);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING_BACK_V, m_BackV);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING_PRESSURE, m_Pressure);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING_FACES, m_Faces);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING_INV_WEIGHT, m_InvWeight);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING_DIVERGENCE, m_Divergence);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING_STATS, m_StatsBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING_CURL, m_Curl);
+	}
+
+	void GpuFluidSolver::Dispatch(GLuint groupsX, GLuint groupsY) const
+	{
+		glDispatchCompute(groupsX, groupsY, 1);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+	}
+
+	void GpuFluidSolver::Step(float dt)
+	{
+		// Same rule as FluidSolver::Step(), the advection shader divides by the spacing
+		if (dt <= 0.0f || !IsValidSpacing(Parameters.GridSpacing)) {
+			return;
+		}
+
+		PollStats();
+
+		const GLuint CellGroups = (GLuint(m_Resolution) + GroupSize - 1) / GroupSize;
+		const GLuint FaceGroups = (GLuint(m_Resolution) + GroupSize) / GroupSize;
+		const GLuint HalfRowGroups = ((GLuint(m_Resolution) + 1) / 2 + GroupSize - 1) / GroupSize;
+
+		const uint32_t ZeroStats[2] = { 0, 0 };
+		glNamedBufferSubData(m_StatsBuffer, 0, sizeof(ZeroStats), ZeroStats);
+
+		BindFields();
+
+		// Vorticity confinement takes the curl before gravity moves anything, like the fused CPU pass
+		// The whole curl field has to be written before any face reads it
+		const bool Confinement = Parameters.VorticityConfinement > 0.0f;
+		GLClasses::ComputeShader& Vorticity = ShaderManager::GetComputeShader("FLUID_VORTICITY");
+
+		if (Confinement) {
+			Vorticity.Use();
+			Vorticity.SetInteger("u_Resolution", m_Resolution);
+			Vorticity.SetInteger("u_Stride", m_Stride);
+			Vorticity.SetInteger("u_Pass", 0);
+			Dispatch(CellGroups, CellGroups);
+		}
+
+		// Forces, the acceleration is rounded the same way as on the CPU
+		GLClasses::ComputeShader& Forces = ShaderManager::GetComputeShader("FLUID_FORCES");
+		Forces.Use();
+		Forces.SetInteger("u_Resolution", m_Resolution);
+		Forces.SetInteger("u_Stride", m_Stride);
+		Forces.SetFloat("u_Acceleration", float(Parameters.Gravity * dt * -1.));
+		Dispatch(CellGroups, CellGroups);
+
+		if (Confinement) {
+			Vorticity.Use();
+			Vorticity.SetInteger("u_Pass", 1);
+			Vorticity.SetFloat("u_Scale", Parameters.VorticityConfinement * dt);
+			Dispatch(CellGroups, CellGroups);
+		}
+
+		// Advection, then the back buffers become the front ones
+		if (Parameters.Advection) {
+			GLClasses::ComputeShader& Advect = ShaderManager::GetComputeShader("FLUID_ADVECT");
+			Advect.Use();
+			Advect.SetInteger("u_Resolution", m_Resolution);
+			Advect.SetInteger("u_Stride", m_Stride);
+			Advect.SetFloat("u_Scale", dt / Parameters.GridSpacing);
+			Dispatch(FaceGroups, FaceGroups);
+
+			std::swap(m_U, m_BackU);
+			std::swap(m_V, m_BackV);
+			BindFields();
+		}
+
+		// Projection from the hydrostatic pressure, then one dispatch per colour
+		const int Sweeps = std::max(Parameters.Relaxation.MaxIterations, 1);
+		const float PressureScale = Parameters.DensityWater * Parameters.GridSpacing / dt;
+
+		GLClasses::ComputeShader& Hydrostatic = ShaderManager::GetComputeShader("FLUID_HYDROSTATIC");
+		Hydrostatic.Use();
+		Hydrostatic.SetInteger("u_Resolution", m_Resolution);
+		Hydrostatic.SetInteger("u_Stride", m_Stride);
+		Hydrostatic.SetFloat("u_Lift", Parameters.Gravity * dt);
+		Hydrostatic.SetFloat("u_PressureScale", PressureScale);
+		Dispatch(CellGroups, CellGroups);
+
+		GLClasses::ComputeShader& RedBlack = ShaderManager::GetComputeShader("FLUID_RED_BLACK");
+		RedBlack.Use();
+		RedBlack.SetInteger("u_Resolution", m_Resolution);
+		RedBlack.SetInteger("u_Stride", m_Stride);
+		RedBlack.SetFloat("u_OverRelaxation", Parameters.OverRelaxationCoefficient);
+		RedBlack.SetFloat("u_PressureScale", PressureScale);
+
+		for (int Sweep = 0; Sweep < Sweeps; Sweep++) {
+			for (int Color = 0; Color < 2; Color++) {
+				RedBlack.SetInteger("u_Color", Color);
+				RedBlack.SetInteger("u_MeasureResidual", Sweep == Sweeps - 1);
+				Dispatch(HalfRowGroups, CellGroups);
+			}
+		}
+
+		// Hands the residual to the CPU without waiting for it
+		if (!m_ReadbackFence) {
+			glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+			glCopyNamedBufferSubData(m_StatsBuffer, m_Readback, 0, 0, 2 * sizeof(uint32_t));
+			m_ReadbackFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		}
+
+		m_Stats.PressureIterations = Sweeps;
+		m_Stats.ActiveTiles = 0;
+		m_Stats.TotalTiles = 0;
+	}
+
+	void GpuFluidSolver::PollStats()
+	{
+		if (!m_ReadbackFence || glClientWaitSync(m_ReadbackFence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+			return;
+		}
+
+		glDeleteSync(m_ReadbackFence);
+		m_ReadbackFence = 0;
+
+		float Residual;
+		memcpy(&Residual, &m_ReadbackMapped[0], sizeof(float));
+		m_Stats.PressureResidual = Residual;
+	}
+
+	float GpuFluidSolver::ComputeDivergence()
+	{
+		const GLuint CellGroups = (GLuint(m_Resolution) + GroupSize - 1) / GroupSize;
+
+		const uint32_t ZeroStats[2] = { 0, 0 };
+		glNamedBufferSubData(m_StatsBuffer, 0, sizeof(ZeroStats), ZeroStats);
+
+		BindFields();
+
+		GLClasses::ComputeShader& Divergence = ShaderManager::GetComputeShader("FLUID_DIVERGENCE");
+		Divergence.Use();
+		Divergence.SetInteger("u_Resolution", m_Resolution);
+		Divergence.SetInteger("u_Stride", m_Stride);
+		Dispatch(CellGroups, CellGroups);
+
+		glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+		uint32_t Stats[2];
+		glGetNamedBufferSubData(m_StatsBuffer, 0, sizeof(Stats), Stats);
+
+		float Max;
+		memcpy(&Max, &Stats[1], sizeof(float));
+		return Max;
+	}
+}
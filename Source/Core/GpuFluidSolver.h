@@ -0,0 +1,81 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "Fluid/FluidSolver.h"
+
+namespace Simulation
+{
+	// Compute shader counterpart of FluidSolver : forces (vorticity confinement included), advection and red-black projection
+	// The fields live in SSBOs in the same padded layout as FluidGrid and never leave the GPU while it steps
+	// State moves between the two backends through LoadFields() / ReadFields(), which only happen on a switch
+	//
+	// Projection is always red-black Gauss Seidel and runs Relaxation.MaxIterations sweeps, a tolerance would need a readback every sweep
+	// Every cell is stepped, there is no activity tracking
+	// Needs the GL context and the "FLUID_*" compute shaders of ShaderManager
+	class GpuFluidSolver
+	{
+	public :
+
+		GpuFluidSolver(int resolution, int stride);
+		~GpuFluidSolver();
+
+		GpuFluidSolver(const GpuFluidSolver&) = delete;
+		GpuFluidSolver operator=(GpuFluidSolver const&) = delete;
+
+		void Step(float dt);
+
+		// Zeroes velocities and pressure
+		void Reset();
+
+		// Field arrays in grid layout, GetFieldSize() elements each
+		void LoadFields(const float* u, const float* v, const float* pressure);
+		void LoadObstacles(const uint8_t* faces, const float* invWeight, uint64_t version);
+
+		// Blocks until the GPU caught up
+		void ReadFields(float* u, float* v, float* pressure) const;
+		float ComputeDivergence();
+
+		inline uint64_t GetObstacleVersion() const { return m_ObstacleVersion; }
+		inline GLuint GetPressureBuffer() const { return m_Pressure; }
+		inline size_t GetFieldSize() const { return size_t(m_Stride) * size_t(m_Resolution + 2); }
+
+		// The residual lags a few steps behind, it is only read back once the GPU finished the step that measured it
+		inline const FluidStepStats& GetStats() const { return m_Stats; }
+
+		FluidParameters Parameters;
+
+	private :
+
+		void BindFields() const;
+		void Dispatch(GLuint groupsX, GLuint groupsY) const;
+		void PollStats();
+
+		int m_Resolution = 0;
+		int m_Stride = 0;
+
+		GLuint m_U = 0;
+		GLuint m_V = 0;
+		GLuint m_BackU = 0;
+		GLuint m_BackV = 0;
+		GLuint m_Pressure = 0;
+		GLuint m_Faces = 0;
+		GLuint m_InvWeight = 0;
+		GLuint m_Divergence = 0;
+		GLuint m_Curl = 0;
+
+		// Max residual of the last sweep and max divergence, as float bits
+		GLuint m_StatsBuffer = 0;
+
+		// Persistently mapped copy of the stats the CPU reads once its fence signalled
+		GLuint m_Readback = 0;
+		const uint32_t* m_ReadbackMapped = nullptr;
+		GLsync m_ReadbackFence = 0;
+
+		uint64_t m_ObstacleVersion = 0;
+		FluidStepStats m_Stats;
+	};
+}
@@ -4,126 +4,105 @@
 
 #include "Object.h"
 
+#include "Fluid/FluidGrid.h"
+#include "Fluid/FluidSolver.h"
+#include "Fluid/Scenarios.h"
+#include "Fluid/SimulationClock.h"
+#include "Fluid/ObstacleMap.h"
+#include "Fluid/Checkpoint.h"
+
+#include "GpuFluidSolver.h"
+
 #include "FpsCamera.h"
 #include "Player.h"
 
+#include <filesystem>
+#include <memory>
+
+// Bodies one click of "Drop Bodies" adds
 #define MAX_SPHERES 16
 
 namespace Simulation {
 
-	/*
-	1) Verlet Acceleration
-	2) Projection to maintain incompressability 
-	3) Advection
-	*/
-
-	enum Directions : uint8_t {
-		UP=0, 
-		DOWN,
-		LEFT,
-		RIGHT
-	};
-	
-	// Optimal to use memory complexity 2(n+2)^2 instead of 4n^2 for n >= 5
-	struct Cell {
-
-		// 0 -> Right Velocity
-		// 1 -> Bottom Velocity
-		glm::vec2 Velocities;
-	};
-
 	// Boiler
 	typedef glm::vec3 Force;
 	// Boiler
 
 	// Simulation
 
-	float GridSpacing = 1.;
-	float DensityWater = 1000.0f;
-	float OverRelaxationCoefficient = 1.0f;
-
 	const int SimulationMapResolution = 256;
-	const int PaddedResolution = SimulationMapResolution + 2;
-	Cell* SimulationMap;
-	float* PressureGrid;
-	float Gravity = 9.81f; 
+	FluidGrid* Grid;
+	FluidSolver* Solver;
+	SimulationClock* Clock;
+	GpuFluidSolver* GpuSolver;
 
 
 	float DebugVar = 0.0f;
 
 	// Sim
-	int Substeps = 3;
 	bool DoSim = false;
 	bool PhysicsStep = false;
+	bool ThreadedSim = false;
+
+	// UI side copies of what the simulation side owns, sent over when edited
+	FluidParameters UIParameters;
+	ClockSettings UIClock;
+	bool ParametersDirty = false;
+	bool ClockDirty = false;
+	bool ResetRequested = false;
+	bool SentPaused = true;
+
+	// 0 -> FluidSolver driven by the clock, 1 -> GpuFluidSolver stepped on this thread
+	int SolverBackend = 0;
+	bool GpuActive = false;
+	float GpuAccumulator = 0.0f;
+
+	// 0 -> Pressure, 1 + f -> Scalar f, the field uploaded last is kept to catch changes while paused
+	int DisplayField = 0;
+	int UploadedField = -1;
+
+	// Obstacle image, decoded on this thread and rasterized by the simulation side at its resolution
+	// A watched file is reloaded whenever its modification time changes
+	char ObstaclePath[260] = "Res/Heightmap.png";
+	std::shared_ptr<ObstacleMap> Obstacles;
+	ObstacleMapSettings UIObstacleSettings;
+	bool ObstaclesDirty = false;
+	bool ObstacleLoadFailed = false;
+	bool WatchObstacles = false;
+	std::filesystem::file_time_type ObstacleWriteTime;
+	float ObstaclePollTimer = 0.0f;
+
+	// Rigid bodies, sizes in cells, every other one dropped is a square
+	float BodyRadius = 6.0f;
+	float BodyDensity = 1500.0f;
+	int BodiesToDrop = 0;
+	int BodiesDropped = 0;
+	bool ClearBodiesRequested = false;
+
+	// Checkpoints, saved by the simulation side's writer thread and mapped here before being handed over
+	char CheckpointPath[260] = "Simulation.eulckpt";
+	bool SaveCheckpointRequested = false;
+	std::shared_ptr<MappedCheckpoint> PendingCheckpoint;
+	std::string CheckpointError;
+
+	// Set when the last checkpoint loaded its fields but not its parameters
+	std::string CheckpointWarning;
+
+	// Field stream, frames pushed by the simulation side every StreamEvery steps and written by the stream's thread
+	char StreamPath[260] = "Simulation.eulstrm";
+	int StreamEvery = 10;
+	FieldStreamSettings UIStreamSettings;
+	bool Streaming = false;
+	bool StreamToggleRequested = false;
+
+	// Command recording, replayed headless with eulerian-sim --replay, the start state is saved next to it
+	char RecordingPath[260] = "Simulation.eulrec";
+	bool Recording = false;
+	bool RecordToggleRequested = false;
 
 	// RNG 
 	Random RandomGen;
 
-	// Conversion Functions 
-	int To1DIdxMap(int x, int y) {
-		++x;
-		++y;
-		return (y * PaddedResolution) + x;
-	}
-
-	int To1DIdx(int x, int y) {
-		return (y * SimulationMapResolution) + x;
-	}
-
-
-	bool IsObstacle(int x, int y, Directions dir) {
-
-		const glm::ivec2 Offsets[4] = {
-			glm::ivec2(0,1), glm::ivec2(0,-1), glm::ivec2(-1,0), glm::ivec2(1,0)
-		};
-
-		if (x < 0 || x >= SimulationMapResolution || y < 0 || y >= SimulationMapResolution) {
-			return true;
-		}
-
-		return false;
-	}
-
-	// Gets velocity at a particular direction
-	// Assume velocity is at the border of a square 
-	float GetVelocity(int x, int y, Directions dir) {
-		const glm::ivec3 References[4] = {
-			  glm::ivec3(0,1,1),
-			  glm::ivec3(0,0,1),
-			  glm::ivec3(-1,0,0),
-			  glm::ivec3(0,0,0)
-		};
-
-		if (int(dir) < 0 || int(dir) > 3) {
-			throw "WTFFF";
-		}
-
-		const auto& r = References[int(dir)];
-		return SimulationMap[To1DIdxMap(x + r.x, y + r.y)].Velocities[r.z];
-	}
-
-	float& GetVelocityRef(int x, int y, Directions dir) {
-		const glm::ivec3 References[4] = {
-			  glm::ivec3(0,1,1),
-			  glm::ivec3(0,0,1),
-			  glm::ivec3(-1,0,0),
-			  glm::ivec3(0,0,0)
-		};
-		if (int(dir) < 0 || int(dir) > 3) {
-			throw "WTFFF";
-		}
-
-		glm::ivec3 r = References[int(dir)];
-		return SimulationMap[To1DIdxMap(x + r.x, y + r.y)].Velocities[r.z];
-	}
-
-	float GetDirectionSign(Directions dir) {
-		if (dir == Directions::DOWN || dir == Directions::LEFT) {
-			return -1.;
-		}
-		return 1.;
-	}
-
 	float Frametime = 0.0f;
 	float DeltaTime = 0.0f;
 	float CurrentTime;
@@ -164,6 +143,191 @@ namespace Simulation {
 		}
 	}
 
+	// Writes the rows of the displayed field into the next ring segment's mapped memory, consecutive rows are flushed as one range
+	// Pressure only copies the rows that changed since that segment was last written, scalars are copied whole
+	void UploadDisplayField(const FieldSnapshot& snapshot, int field, int stride, GLClasses::PersistentBuffer& ring, std::vector<uint64_t>& segmentVersions)
+	{
+		float* Mapped = (float*)ring.BeginSegment();
+		uint64_t& SegmentVersion = segmentVersions[ring.GetSegment()];
+
+		if (!Mapped) {
+			return;
+		}
+
+		const bool Pressure = field == 0;
+		const std::vector<float>& Source = Pressure ? snapshot.Pressure : snapshot.Scalars[field - 1];
+		const int Rows = int(snapshot.PressureRowVersions.size());
+		const GLsizeiptr RowBytes = sizeof(float) * stride;
+		int RunBegin = -1;
+
+		for (int Row = 0; Row <= Rows; Row++) {
+			const bool Dirty = Row < Rows && (!Pressure || snapshot.PressureRowVersions[Row] > SegmentVersion);
+
+			if (Dirty) {
+				memcpy(Mapped + size_t(Row) * stride, Source.data() + size_t(Row) * stride, RowBytes);
+				RunBegin = RunBegin < 0 ? Row : RunBegin;
+			}
+
+			else if (RunBegin >= 0) {
+				ring.FlushRange(RunBegin * RowBytes, (Row - RunBegin) * RowBytes);
+				RunBegin = -1;
+			}
+		}
+
+		// A segment holding a scalar has no pressure rows to build on
+		SegmentVersion = Pressure ? snapshot.Version : 0;
+	}
+
+	// Decodes ObstaclePath, the current map is kept when the file can't be read
+	bool LoadObstacleImage()
+	{
+		std::shared_ptr<ObstacleMap> Map = std::make_shared<ObstacleMap>();
+
+		if (!Map->Load(ObstaclePath)) {
+			return false;
+		}
+
+		std::error_code Error;
+		ObstacleWriteTime = std::filesystem::last_write_time(ObstaclePath, Error);
+
+		Obstacles = Map;
+		ObstaclesDirty = true;
+		return true;
+	}
+
+	// Checks the watched file twice a second, editors write in several steps so a failed decode is retried on the next change
+	void PollObstacleFile(float frameTime)
+	{
+		ObstaclePollTimer += frameTime;
+
+		if (!WatchObstacles || !Obstacles || Obstacles->IsEmpty() || ObstaclePollTimer < 0.5f) {
+			return;
+		}
+
+		ObstaclePollTimer = 0.0f;
+
+		std::error_code Error;
+		const std::filesystem::file_time_type WriteTime = std::filesystem::last_write_time(Obstacles->GetPath(), Error);
+
+		if (!Error && WriteTime != ObstacleWriteTime) {
+			ObstacleWriteTime = WriteTime;
+			ObstacleLoadFailed = !LoadObstacleImage();
+		}
+	}
+
+	// Next body of a drop, spread along the top of the domain
+	RigidBody MakeDropBody(int index)
+	{
+		const float Spacing = UIParameters.GridSpacing;
+		const float Extent = float(SimulationMapResolution) * Spacing;
+		const float Radius = BodyRadius * Spacing;
+
+		glm::vec2 Position;
+		Position.x = (float(index % MAX_SPHERES) + 0.5f + (RandomGen.Float() - 0.5f) * 0.5f) * Extent / float(MAX_SPHERES);
+		Position.y = Extent - Radius * 2.0f;
+
+		if (index % 2 == 0) {
+			return RigidBodies::MakeCircle(Position, Radius, BodyDensity);
+		}
+
+		const std::vector<glm::vec2> Square = { { -Radius, -Radius }, { Radius, -Radius }, { Radius, Radius }, { -Radius, Radius } };
+		return RigidBodies::MakePolygon(Position, Square, BodyDensity);
+	}
+
+	// Maps the checkpoint and takes its parameters over, the simulation side restores the fields once it gets the command
+	void OpenCheckpoint()
+	{
+		std::shared_ptr<MappedCheckpoint> Mapped = std::make_shared<MappedCheckpoint>();
+
+		if (!Mapped->Open(CheckpointPath)) {
+			CheckpointError = Mapped->GetError();
+			CheckpointWarning.clear();
+			return;
+		}
+
+		if (Mapped->GetResolution() != SimulationMapResolution) {
+			CheckpointError = "resolution " + std::to_string(Mapped->GetResolution()) + ", the app runs " + std::to_string(SimulationMapResolution);
+			CheckpointWarning.clear();
+			return;
+		}
+
+		// Another build's layout can't be read, the fields still load and the current parameters stay
+		if (!Mapped->GetParameters(UIParameters)) {
+			CheckpointWarning = "parameters not restored : layout mismatch";
+		}
+
+		else {
+			CheckpointWarning.clear();
+		}
+
+		PendingCheckpoint = Mapped;
+		CheckpointError.clear();
+	}
+
+	// Hands the fields over to the other backend, returns false when it has to be retried next frame
+	bool SwitchBackend(bool gpu)
+	{
+		if (gpu) {
+			const FieldSnapshot& Snapshot = Clock->GetSnapshot();
+
+			if (Snapshot.Pressure.empty()) {
+				return false;
+			}
+
+			GpuSolver->LoadFields(Snapshot.U.data(), Snapshot.V.data(), Snapshot.Pressure.data());
+			GpuSolver->LoadObstacles(Snapshot.Faces.data(), Snapshot.InvWeight.data(), Snapshot.ObstacleVersion);
+			GpuAccumulator = 0.0f;
+			return true;
+		}
+
+		SimulationCommand Command;
+		Command.Kind = SimulationCommand::Type::LoadFields;
+		Command.U.resize(GpuSolver->GetFieldSize());
+		Command.V.resize(GpuSolver->GetFieldSize());
+		Command.Pressure.resize(GpuSolver->GetFieldSize());
+		GpuSolver->ReadFields(Command.U.data(), Command.V.data(), Command.Pressure.data());
+
+		return Clock->Submit(Command);
+	}
+
+	// Same fixed step rule as SimulationClock, for the backend that has to step on the GL thread
+	void StepGpu(float frameTime)
+	{
+		GpuSolver->Parameters = UIParameters;
+
+		const float FixedDeltaTime = UIClock.GetFixedDeltaTime();
+
+		if (ResetRequested) {
+			GpuSolver->Reset();
+			ResetRequested = false;
+		}
+
+		if (PhysicsStep) {
+			GpuSolver->Step(FixedDeltaTime);
+			PhysicsStep = false;
+		}
+
+		if (!DoSim) {
+			GpuAccumulator = 0.0f;
+			return;
+		}
+
+		const int MaxSteps = std::max(UIClock.Substeps * UIClock.MaxCatchUpFrames, 1);
+		int Steps = 0;
+
+		GpuAccumulator += std::max(frameTime, 0.0f);
+
+		while (GpuAccumulator >= FixedDeltaTime && Steps < MaxSteps) {
+			GpuSolver->Step(FixedDeltaTime);
+			GpuAccumulator -= FixedDeltaTime;
+			Steps++;
+		}
+
+		if (GpuAccumulator >= FixedDeltaTime) {
+			GpuAccumulator = 0.0f;
+		}
+	}
+
 	class RayTracerApp : public Simulation::Application
 	{
 	public:
@@ -203,25 +367,204 @@ namespace Simulation {
 				ImGui::Text("Camera Front : %f,  %f,  %f", Camera.GetFront().x, Camera.GetFront().y, Camera.GetFront().z);
 				ImGui::Text("Time : %f s", glfwGetTime());
 
+				// The widgets edit copies, the simulation side gets them through the clock's command queue
+				const FieldSnapshot& Snapshot = Clock->GetSnapshot();
+				bool ParametersEdited = false;
+				bool ClockEdited = false;
+
 				ImGui::NewLine();
 				ImGui::Checkbox("Do Sim", &DoSim);
 
-				PhysicsStep = ImGui::Button("Step Simulation");
+				PhysicsStep |= ImGui::Button("Step Simulation");
+
+				ImGui::Checkbox("Sim Thread", &ThreadedSim);
 
-				ImGui::SliderInt("Substeps", &Substeps, 1, 100);
+				const char* Backends[] = { "CPU", "GPU Compute" };
+				ImGui::Combo("Backend", &SolverBackend, Backends, IM_ARRAYSIZE(Backends));
 
-				if (ImGui::Button("Reset")) {
-					memset(SimulationMap, 0, PaddedResolution * PaddedResolution * sizeof(Cell));
-					memset(PressureGrid, 0, SimulationMapResolution * SimulationMapResolution * sizeof(float));
+				if (GpuActive) {
+					ImGui::Text("GPU : red-black projection, Max Iterations sweeps, no activity tracking, no bodies, pressure display only");
 				}
 
+				const char* DisplayFields[] = { "Pressure", "Dye", "Temperature" };
+				ImGui::Combo("Display", &DisplayField, DisplayFields, IM_ARRAYSIZE(DisplayFields));
 
+				const FluidStepStats& Stats = GpuActive ? GpuSolver->GetStats() : Snapshot.Stats;
+				ClockEdited |= ImGui::SliderInt("Substeps", &UIClock.Substeps, 1, 100);
+				ClockEdited |= ImGui::SliderFloat("Sim Frame Rate", &UIClock.FrameRate, 10.0f, 240.0f);
+				ImGui::Text("Steps Last Frame : %d (dt %.5f s)", Snapshot.LastStepCount, Snapshot.FixedDeltaTime);
+				ImGui::Text("Dropped Sim Time : %.3f s", Snapshot.DroppedTime);
+
+				const char* PressureSolvers[] = { "Gauss Seidel", "Red Black Gauss Seidel", "Multigrid", "PCG" };
+				ParametersEdited |= ImGui::Combo("Pressure Solver", (int*)&UIParameters.PressureSolver, PressureSolvers, IM_ARRAYSIZE(PressureSolvers));
+
+				if (UIParameters.PressureSolver == PressureSolverType::Multigrid) {
+					const char* Cycles[] = { "V Cycle", "W Cycle" };
+					ParametersEdited |= ImGui::Combo("Multigrid Cycle", (int*)&UIParameters.Multigrid.Cycle, Cycles, IM_ARRAYSIZE(Cycles));
+				}
+
+				if (UIParameters.PressureSolver == PressureSolverType::RedBlackGaussSeidel) {
+					ParametersEdited |= ImGui::SliderInt("Sweeps Per Pass", &UIParameters.TemporalBlocking, 1, 16);
+				}
+
+				if (UIParameters.PressureSolver == PressureSolverType::PCG) {
+					const char* Preconditioners[] = { "MIC(0)", "Jacobi" };
+					ParametersEdited |= ImGui::Combo("Preconditioner", (int*)&UIParameters.PCG.Preconditioner, Preconditioners, IM_ARRAYSIZE(Preconditioners));
+				}
+
+				ConvergenceSettings& Convergence = UIParameters.GetConvergence();
+				const char* Norms[] = { "Max", "RMS" };
+				ParametersEdited |= ImGui::SliderInt("Max Iterations", &Convergence.MaxIterations, 1, 1000);
+				ParametersEdited |= ImGui::InputFloat("Tolerance (0 = off)", &Convergence.Tolerance, 0.0f, 0.0f, "%g");
+				ParametersEdited |= ImGui::Combo("Residual Norm", (int*)&Convergence.Norm, Norms, IM_ARRAYSIZE(Norms));
+				ImGui::Text("Iterations : %d, Residual : %g", Stats.PressureIterations, Stats.PressureResidual);
+
+				ParametersEdited |= ImGui::Checkbox("Advection", &UIParameters.Advection);
+				ParametersEdited |= ImGui::SliderInt("Scalar Fields", &UIParameters.ScalarFields, 0, SCALAR_COUNT);
+				ParametersEdited |= ImGui::SliderInt("Threads", &UIParameters.Threads, 1, ThreadPool::GetHardwareThreads());
+				ParametersEdited |= ImGui::SliderInt("Tile Size (0 = rows)", &UIParameters.TileSize, 0, 256);
+
+				ParametersEdited |= ImGui::Checkbox("Skip Resting Tiles", &UIParameters.TrackActivity);
+				ParametersEdited |= ImGui::SliderInt("Activity Tile Size", &UIParameters.ActivityTileSize, 8, 128);
+				ParametersEdited |= ImGui::InputFloat("Activity Threshold", &UIParameters.ActivityThreshold, 0.0f, 0.0f, "%g");
+				ImGui::Text("Active Tiles : %d / %d", Stats.ActiveTiles, Stats.TotalTiles);
+
+				ResetRequested |= ImGui::Button("Reset");
 
 				ImGui::NewLine();
 
-				ImGui::SliderFloat("Grid Spacing", &GridSpacing, 0.0f, 10.0f);
-				ImGui::SliderFloat("Density Water", &DensityWater, 10.0f, 10000.0f);
-				ImGui::SliderFloat("Over Relaxation Coeff", &OverRelaxationCoefficient, 0.0f, 2.0f);
+				ImGui::InputText("Obstacle Image", ObstaclePath, sizeof(ObstaclePath));
+
+				if (ImGui::Button("Load Obstacles")) {
+					ObstacleLoadFailed = !LoadObstacleImage();
+				}
+
+				ImGui::SameLine();
+
+				// An empty map clears every interior obstacle
+				if (ImGui::Button("Clear Obstacles")) {
+					Obstacles = std::make_shared<ObstacleMap>();
+					ObstaclesDirty = true;
+				}
+
+				if (Obstacles && !Obstacles->IsEmpty()) {
+					ObstaclesDirty |= ImGui::SliderFloat("Obstacle Threshold", &UIObstacleSettings.Threshold, 0.0f, 1.0f);
+					ObstaclesDirty |= ImGui::Checkbox("Invert Obstacles", &UIObstacleSettings.Invert);
+					ImGui::Checkbox("Watch Obstacle File", &WatchObstacles);
+					ImGui::Text("Obstacles : %s (%d x %d)", Obstacles->GetPath().c_str(), Obstacles->GetWidth(), Obstacles->GetHeight());
+				}
+
+				if (ObstacleLoadFailed) {
+					ImGui::Text("Couldn't read %s", ObstaclePath);
+				}
+
+				ImGui::NewLine();
+
+				ImGui::SliderFloat("Body Radius (cells)", &BodyRadius, 1.0f, 32.0f);
+				ImGui::SliderFloat("Body Density", &BodyDensity, 100.0f, 5000.0f);
+
+				if (ImGui::Button("Drop Bodies")) {
+					BodiesToDrop += MAX_SPHERES;
+				}
+
+				ImGui::SameLine();
+				ClearBodiesRequested |= ImGui::Button("Clear Bodies");
+
+				ImGui::Text("Bodies : %d (%.4f ms/step)", int(Snapshot.Bodies.size()), Stats.BodiesMs);
+
+				ImGui::NewLine();
+
+				ImGui::InputText("Checkpoint", CheckpointPath, sizeof(CheckpointPath));
+
+				if (GpuActive) {
+					ImGui::Text("Switch to the CPU backend to save or load checkpoints");
+				}
+
+				else {
+					SaveCheckpointRequested |= ImGui::Button("Save Checkpoint");
+					ImGui::SameLine();
+
+					if (ImGui::Button("Load Checkpoint")) {
+						OpenCheckpoint();
+					}
+				}
+
+				const CheckpointWriter& Writer = Clock->GetCheckpointWriter();
+				const CheckpointSaveResult Saved = Writer.GetLastResult();
+
+				if (Writer.IsBusy()) {
+					ImGui::Text("Saving checkpoint...");
+				}
+
+				else if (Saved.Saves > 0 && Saved.Succeeded) {
+					ImGui::Text("Saved step %llu to %s (%.1f MB, %.0f ms)", (unsigned long long)Saved.StepIndex, Saved.Path.c_str(), double(Saved.Bytes) / (1024.0 * 1024.0), Saved.WriteMs);
+				}
+
+				else if (Saved.Saves > 0) {
+					ImGui::Text("Couldn't write %s", Saved.Path.c_str());
+				}
+
+				if (!CheckpointError.empty()) {
+					ImGui::Text("Couldn't load %s : %s", CheckpointPath, CheckpointError.c_str());
+				}
+
+				else if (!CheckpointWarning.empty()) {
+					ImGui::Text("Loaded %s, %s", CheckpointPath, CheckpointWarning.c_str());
+				}
+
+				ImGui::NewLine();
+
+				ImGui::InputText("Field Stream", StreamPath, sizeof(StreamPath));
+				ImGui::SliderInt("Stream Every (steps)", &StreamEvery, 1, 100);
+				ImGui::Checkbox("Compress Stream", &UIStreamSettings.Compress);
+
+				if (GpuActive) {
+					ImGui::Text("Switch to the CPU backend to stream fields");
+				}
+
+				else {
+					StreamToggleRequested |= ImGui::Button(Streaming ? "Stop Stream" : "Start Stream");
+				}
+
+				const FieldStreamStats Streamed = Clock->GetFieldStream().GetStats();
+
+				if (Streamed.Failed) {
+					ImGui::Text("Couldn't write %s", StreamPath);
+				}
+
+				else if (Streaming || Streamed.Frames > 0) {
+					ImGui::Text("Frames : %d (%.1f MB, %.2fx), stalls : %d (%.0f ms), dropped : %d", Streamed.Frames, double(Streamed.StoredBytes) / (1024.0 * 1024.0),
+						double(Streamed.RawBytes) / double(std::max(Streamed.StoredBytes, uint64_t(1))), Streamed.Stalls, Streamed.StallMs, Streamed.Dropped);
+				}
+
+				ImGui::NewLine();
+
+				ImGui::InputText("Recording", RecordingPath, sizeof(RecordingPath));
+
+				// Steps the GPU takes aren't recorded, only the fields it hands back
+				if (GpuActive) {
+					ImGui::Text("Switch to the CPU backend to record");
+				}
+
+				else {
+					RecordToggleRequested |= ImGui::Button(Recording ? "Stop Recording" : "Start Recording");
+				}
+
+				if (Recording) {
+					ImGui::Text("Recording edits, replay with eulerian-sim --replay %s", RecordingPath);
+				}
+
+
+
+				ImGui::NewLine();
+
+				ParametersEdited |= ImGui::SliderFloat("Grid Spacing", &UIParameters.GridSpacing, 0.01f, 10.0f);
+				ParametersEdited |= ImGui::SliderFloat("Density Water", &UIParameters.DensityWater, 10.0f, 10000.0f);
+				ParametersEdited |= ImGui::SliderFloat("Over Relaxation Coeff", &UIParameters.OverRelaxationCoefficient, 0.0f, 2.0f);
+				ParametersEdited |= ImGui::SliderFloat("Vorticity Confinement", &UIParameters.VorticityConfinement, 0.0f, 10.0f);
+
+				ParametersDirty |= ParametersEdited;
+				ClockDirty |= ClockEdited;
 
 				ImGui::NewLine();
 				ImGui::NewLine();
@@ -287,72 +630,6 @@ namespace Simulation {
 
 	};
 
-	// Account for gravity 
-	void SimulateVelocities(float dt) {
-
-		bool ObstacleCache[4];
-
-		memset(ObstacleCache, 0, 4 * sizeof(bool));
-
-		for (int x = 0; x < SimulationMapResolution; x++) {
-			for (int y = 0; y < SimulationMapResolution; y++) {
-				float Weight = 0.;
-
-				for (uint8_t z = 0; z < 4; z++) {
-					float& v = GetVelocityRef(x, y, Directions(z));
-					ObstacleCache[z] = IsObstacle(x, y, Directions(z));
-
-					if (!ObstacleCache[z]) {
-						v += Gravity * dt * -1.;
-					}
-					
-					Weight += float(!ObstacleCache[z]);
-				}
-
-				if (Weight < 0.01f) {
-					continue;
-				}
-
-				// Handle divergance 
-				float Divergance = 0.0f;
-
-				Divergance = OverRelaxationCoefficient * (GetVelocity(x, y, Directions::RIGHT) - GetVelocity(x, y, Directions::LEFT));
-				Divergance += OverRelaxationCoefficient* (GetVelocity(x, y, Directions::UP) - GetVelocity(x, y, Directions::DOWN));
-
-				// For divergance > 0, too much outflow
-				// For divergance < 0, too much inflow
-				// For divergance = 0, it is a perfectly incompressible surface 
-				// WE need to make the divergance zero
-
-				float PushAmount = Divergance / Weight;
-				float Avg = 0.0f;
-
-				// Gauss Seidel method 
-				for (uint8_t z = 0; z < 4; z++) {
-
-					if (!ObstacleCache[int(z)]) {
-
-						float& v = GetVelocityRef(x, y, Directions(z));
-						v += PushAmount * float(!ObstacleCache[z]) * GetDirectionSign(Directions(z)) * -1.;
-						Avg += v;
-					}
-				}
-
-				// Solve for pressure gradient 
-
-				// Todo : WHY divergance/weight?
-				// Essence? WHY.?
-				
-				Avg /= 4.;
-				PressureGrid[To1DIdx(x, y)] = (Divergance / Weight)* (DensityWater * GridSpacing / DeltaTime);
-				
-			}
-		}
-
-	}
-
-
-
 	void Pipeline::StartPipeline()
 	{
 		// Application
@@ -366,11 +643,6 @@ namespace Simulation {
 
 		RandomGen.Float();
 
-		//GLClasses::Texture Heightmap;
-		//Heightmap.CreateTexture("Res/Heightmap.png", false, false, false, GL_TEXTURE_2D,
-		//	GL_LINEAR, GL_LINEAR,
-		//	GL_REPEAT, GL_REPEAT, false);
-
 		// Setup screensized quad for rendering
 		{
 			float QuadVertices_NDC[] =
@@ -398,44 +670,22 @@ namespace Simulation {
 		GLClasses::Framebuffer GBuffer = GLClasses::Framebuffer(16, 16, { {GL_RGBA, GL_RGBA, GL_UNSIGNED_BYTE, false, false},  {GL_RGBA16F, GL_RGBA, GL_FLOAT, false, false} }, true, true);
 
 		// CPU data
-		SimulationMap = new Cell[PaddedResolution * PaddedResolution];
-		memset(SimulationMap, 0, PaddedResolution * PaddedResolution * sizeof(Cell));
+		Grid = new FluidGrid(SimulationMapResolution);
+		Solver = new FluidSolver(*Grid);
+		Clock = new SimulationClock(*Solver);
 
-		PressureGrid = new float[SimulationMapResolution * SimulationMapResolution];
-		memset(PressureGrid, 0, SimulationMapResolution * SimulationMapResolution * sizeof(float));
+		GpuSolver = new GpuFluidSolver(Grid->GetResolution(), Grid->GetStride());
 
+		UIParameters = Solver->Parameters;
 
-		for (int x = 0; x < SimulationMapResolution; x++) {
-			for (int y = 0; y < SimulationMapResolution; y++) {
-				
-				glm::vec2 V = glm::vec2(x, y);
-				V /= float(SimulationMapResolution);
-				V = V * 2.f - 1.f;
-
-				float d = glm::distance(V, glm::vec2(0.0));
-				
-				for (int z = 0; z < 4; z++) {
-					auto& v = GetVelocityRef(x, y, Directions(z));
-					v = 0.0f;//RandomGen.Float();
-
-				}
-
-				for (int z = 0; z < 4; z++) {
-					auto& v = GetVelocityRef(x, y, Directions(z));
-
-					if (d < 0.7f)
-						v = 10.0f;//RandomGen.Float();
-
-				}
-			}
-		}
+		Scenarios::CircularBurst(*Grid);
+		Scenarios::ScalarDisk(*Grid, SCALAR_DYE, glm::vec2(0.0f), 0.7f, 1.0f);
+		Scenarios::ScalarDisk(*Grid, SCALAR_TEMPERATURE, glm::vec2(0.0f), 0.35f, 1.0f);
 
 		// GPU Data
-		GLuint PressureGradientSSBO = 0;
-		glGenBuffers(1, &PressureGradientSSBO);
-		glBindBuffer(GL_SHADER_STORAGE_BUFFER, PressureGradientSSBO);
-		glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(float) * SimulationMapResolution * SimulationMapResolution, (void*)0, GL_DYNAMIC_DRAW);
-		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		// The displayed field goes through a persistently mapped ring, the frame writing one segment never waits on the GPU reading another
+		GLClasses::PersistentBuffer DisplayRing(GL_SHADER_STORAGE_BUFFER, sizeof(float) * Grid->GetFieldSize(), 3);
+		std::vector<uint64_t> DisplaySegmentVersions(DisplayRing.GetSegmentCount(), 0);
 
 		glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
 		glClear(GL_COLOR_BUFFER_BIT);
@@ -454,14 +704,131 @@ namespace Simulation {
 			MainPlayer.OnUpdate(app.GetWindow(), DeltaTime, 0.5f, app.GetCurrentFrame());
 
 			// SIMULATE
-			if (DoSim || PhysicsStep)
-			{
-				SimulateVelocities(DeltaTime);
-				PhysicsStep = false;
+			// Fixed sub-steps out of the frame time, the frame rate no longer changes the dt the solver sees
+			Clock->SetThreaded(ThreadedSim);
+
+			// Switching backends hands the fields over once, nothing moves between CPU and GPU while either one steps
+			if ((SolverBackend == 1) != GpuActive && SwitchBackend(SolverBackend == 1)) {
+				GpuActive = SolverBackend == 1;
+			}
+
+			if (GpuActive) {
+				StepGpu(DeltaTime);
+			}
+
+			// Whatever does not fit in the queue this frame is sent on the next one
+			SimulationCommand Command;
+
+			if (ParametersDirty) {
+				Command.Kind = SimulationCommand::Type::SetParameters;
+				Command.Parameters = UIParameters;
+				ParametersDirty = !Clock->Submit(Command);
+			}
+
+			if (ClockDirty) {
+				Command.Kind = SimulationCommand::Type::SetClockSettings;
+				Command.Clock = UIClock;
+				ClockDirty = !Clock->Submit(Command);
+			}
+
+			// The CPU side sits idle while the GPU steps
+			const bool Paused = !DoSim || GpuActive;
+
+			if (SentPaused != Paused) {
+				Command.Kind = SimulationCommand::Type::SetPaused;
+				Command.Paused = Paused;
+
+				if (Clock->Submit(Command)) {
+					SentPaused = Paused;
+				}
+			}
+
+			if (PhysicsStep) {
+				Command.Kind = SimulationCommand::Type::Step;
+				PhysicsStep = !Clock->Submit(Command);
+			}
+
+			if (ResetRequested) {
+				Command.Kind = SimulationCommand::Type::Reset;
+				ResetRequested = !Clock->Submit(Command);
 			}
 
-			glBindBuffer(GL_SHADER_STORAGE_BUFFER, PressureGradientSSBO);
-			glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(float) * SimulationMapResolution * SimulationMapResolution, PressureGrid, GL_DYNAMIC_DRAW);
+			PollObstacleFile(DeltaTime);
+
+			if (ObstaclesDirty) {
+				Command.Kind = SimulationCommand::Type::LoadObstacles;
+				Command.Obstacles = Obstacles;
+				Command.ObstacleSettings = UIObstacleSettings;
+				ObstaclesDirty = !Clock->Submit(Command);
+			}
+
+			if (SaveCheckpointRequested) {
+				Command.Kind = SimulationCommand::Type::SaveCheckpoint;
+				Command.Path = CheckpointPath;
+				SaveCheckpointRequested = !Clock->Submit(Command);
+			}
+
+			if (StreamToggleRequested) {
+				Command.Kind = Streaming ? SimulationCommand::Type::StopStream : SimulationCommand::Type::StartStream;
+				Command.Path = StreamPath;
+				Command.StreamSettings = UIStreamSettings;
+				Command.StreamEvery = StreamEvery;
+
+				if (Clock->Submit(Command)) {
+					Streaming = !Streaming;
+					StreamToggleRequested = false;
+				}
+			}
+
+			if (RecordToggleRequested) {
+				Command.Kind = Recording ? SimulationCommand::Type::StopRecording : SimulationCommand::Type::StartRecording;
+				Command.Path = RecordingPath;
+
+				if (Clock->Submit(Command)) {
+					Recording = !Recording;
+					RecordToggleRequested = false;
+				}
+			}
+
+			// The parameters were taken from the file, the restore sets them on the simulation side as well
+			if (PendingCheckpoint) {
+				Command.Kind = SimulationCommand::Type::LoadFields;
+				Command.Checkpoint = PendingCheckpoint;
+
+				if (Clock->Submit(Command)) {
+					PendingCheckpoint.reset();
+				}
+
+				Command.Checkpoint.reset();
+			}
+
+			if (ClearBodiesRequested) {
+				Command.Kind = SimulationCommand::Type::ClearBodies;
+				ClearBodiesRequested = !Clock->Submit(Command);
+			}
+
+			for (; BodiesToDrop > 0; BodiesToDrop--, BodiesDropped++) {
+				Command.Kind = SimulationCommand::Type::AddBody;
+				Command.Body = MakeDropBody(BodiesDropped);
+
+				if (!Clock->Submit(Command)) {
+					break;
+				}
+			}
+
+			Clock->Advance(DeltaTime);
+
+			// Only uploads when the simulation side published something new
+			if (Clock->AcquireSnapshot() || DisplayField != UploadedField) {
+				const FieldSnapshot& Snapshot = Clock->GetSnapshot();
+
+				if (GpuActive && Snapshot.ObstacleVersion != GpuSolver->GetObstacleVersion()) {
+					GpuSolver->LoadObstacles(Snapshot.Faces.data(), Snapshot.InvWeight.data(), Snapshot.ObstacleVersion);
+				}
+
+				UploadDisplayField(Snapshot, DisplayField, Grid->GetStride(), DisplayRing, DisplaySegmentVersions);
+				UploadedField = DisplayField;
+			}
 
 			glDisable(GL_DEPTH_TEST);
 			glDisable(GL_CULL_FACE);
@@ -475,17 +842,27 @@ namespace Simulation {
 			RenderShader.Use();
 
 			RenderShader.SetInteger("u_Resolution", (SimulationMapResolution));
+			RenderShader.SetInteger("u_Stride", Grid->GetStride());
+			RenderShader.SetInteger("u_DisplayMode", GpuActive ? 0 : DisplayField);
 			RenderShader.SetFloat("u_zNear", Camera.GetNearPlane());
 			RenderShader.SetFloat("u_zFar", Camera.GetFarPlane());
 			RenderShader.SetMatrix4("u_InverseProjection", glm::inverse(Camera.GetProjectionMatrix()));
 			RenderShader.SetMatrix4("u_InverseView", glm::inverse(Camera.GetViewMatrix()));
 
-			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, PressureGradientSSBO);
+			if (GpuActive) {
+				glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, GpuSolver->GetPressureBuffer());
+			}
+
+			else {
+				DisplayRing.BindBase(0);
+			}
 
 			ScreenQuadVAO.Bind();
 			glDrawArrays(GL_TRIANGLES, 0, 6);
 			ScreenQuadVAO.Unbind();
 
+			DisplayRing.FenceSegment();
+
 			// Blit
 
 			glBindFramebuffer(GL_FRAMEBUFFER, 0);
@@ -504,7 +881,6 @@ namespace Simulation {
 			glDrawArrays(GL_TRIANGLES, 0, 6);
 			ScreenQuadVAO.Unbind();
 
-			glFinish();
 			app.FinishFrame();
 
 			CurrentTime = glfwGetTime();
@@ -7,6 +7,7 @@
 #include "Application/Application.h"
 #include "GLClasses/VertexArray.h"
 #include "GLClasses/VertexBuffer.h"
+#include "GLClasses/PersistentBuffer.h"
 #include "GLClasses/IndexBuffer.h"
 #include "GLClasses/Framebuffer.h"
 #include "GLClasses/Shader.h"
@@ -8,6 +8,13 @@ void Simulation::ShaderManager::CreateShaders()
 {
 	AddShader("BLIT", "Core/Shaders/FBOVert.glsl", "Core/Shaders/Blit.glsl");
 	AddShader("RD", "Core/Shaders/FBOVert.glsl", "Core/Shaders/Render.frag");
+
+	AddComputeShader("FLUID_FORCES", "Core/Shaders/FluidForces.comp");
+	AddComputeShader("FLUID_VORTICITY", "Core/Shaders/FluidVorticity.comp");
+	AddComputeShader("FLUID_ADVECT", "Core/Shaders/FluidAdvect.comp");
+	AddComputeShader("FLUID_HYDROSTATIC", "Core/Shaders/FluidHydrostatic.comp");
+	AddComputeShader("FLUID_RED_BLACK", "Core/Shaders/FluidRedBlack.comp");
+	AddComputeShader("FLUID_DIVERGENCE", "Core/Shaders/FluidDivergence.comp");
 }
 
 void Simulation::ShaderManager::AddShader(const std::string& name, const std::string& vert, const std::string& frag, const std::string& geo)
@@ -7,13 +7,20 @@ in vec2 v_TexCoords;
 
 uniform int u_Resolution;
 
+// 0 -> Pressure, 1 -> Dye, 2 -> Temperature
+uniform int u_DisplayMode;
 
+// Row pitch of the padded field, cell (0, 0) sits at (1, 1)
+uniform int u_Stride;
+
+
+// Whichever field is displayed, in the padded grid layout
 layout (std430, binding = 0) buffer SSBO_HM {
-	float PressureGradient[];
+	float DisplayField[];
 };
 
 int To1DIdx(int x, int y) {
-	return (y * u_Resolution) + x;
+	return ((y + 1) * u_Stride) + (x + 1);
 }
 
 float CatmullRom(in vec2 uv);
@@ -21,13 +28,13 @@ float Bicubic(vec2 coord);
 
 float Sample(vec2 UV) {
 	ivec2 Texel = ivec2((UV) * vec2(float(u_Resolution)));
-	return PressureGradient[To1DIdx(Texel.x, Texel.y)];
+	return DisplayField[To1DIdx(Texel.x, Texel.y)];
 }
 
 float Sample(ivec2 px) {
     
     px = clamp(px, ivec2(0), ivec2(u_Resolution - 1));
-	return PressureGradient[To1DIdx(px.x, px.y)];
+	return DisplayField[To1DIdx(px.x, px.y)];
 }
 
 float Bilinear(vec2 SampleUV)
@@ -62,6 +69,17 @@ void main() {
 
     float V = Bilinear(v_TexCoords);
 
+    if (u_DisplayMode == 1) {
+        o_Color = vec4(vec3(0.2f, 0.6f, 1.0f) * clamp(V, 0.0f, 1.0f), 1.);
+        return;
+    }
+
+    if (u_DisplayMode == 2) {
+        V = clamp(V, 0.0f, 1.0f);
+        o_Color = vec4(mix(vec3(0.05f, 0.1f, 0.4f), vec3(1.0f, 0.35f, 0.05f), V) * (0.25f + 0.75f * V), 1.);
+        return;
+    }
+
    // V = abs(V);
     V /= 10000.0f;
 
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdlib>
+#include <cstddef>
+
+#ifdef _MSC_VER
+#include <malloc.h>
+#endif
+
+namespace Simulation
+{
+	// Cache line / AVX-512 register width
+	constexpr size_t FieldAlignment = 64;
+
+	template <typename T>
+	T* AlignedAlloc(size_t count, size_t alignment = FieldAlignment)
+	{
+		size_t Bytes = ((count * sizeof(T) + alignment - 1) / alignment) * alignment;
+
+#ifdef _MSC_VER
+		return static_cast<T*>(_aligned_malloc(Bytes, alignment));
+#else
+		void* Ptr = nullptr;
+
+		if (posix_memalign(&Ptr, alignment, Bytes) != 0) {
+			return nullptr;
+		}
+
+		return static_cast<T*>(Ptr);
+#endif
+	}
+
+	inline void AlignedFree(void* ptr)
+	{
+#ifdef _MSC_VER
+		_aligned_free(ptr);
+#else
+		free(ptr);
+#endif
+	}
+}
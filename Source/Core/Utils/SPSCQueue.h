@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+namespace Simulation
+{
+	// Bounded lock free queue between exactly one producer thread and one consumer thread
+	// Capacity has to be a power of two
+	template <typename T, size_t Capacity>
+	class SPSCQueue
+	{
+		static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "SPSCQueue capacity must be a power of two");
+
+	public :
+
+		SPSCQueue() = default;
+
+		SPSCQueue(const SPSCQueue&) = delete;
+		SPSCQueue operator=(SPSCQueue const&) = delete;
+
+		// Producer side, returns false when the queue is full
+		bool TryPush(const T& item)
+		{
+			const size_t Tail = m_Tail.load(std::memory_order_relaxed);
+
+			if (Tail - m_Head.load(std::memory_order_acquire) == Capacity) {
+				return false;
+			}
+
+			m_Items[Tail & (Capacity - 1)] = item;
+			m_Tail.store(Tail + 1, std::memory_order_release);
+			return true;
+		}
+
+		// Consumer side, returns false when the queue is empty
+		bool TryPop(T& item)
+		{
+			const size_t Head = m_Head.load(std::memory_order_relaxed);
+
+			if (Head == m_Tail.load(std::memory_order_acquire)) {
+				return false;
+			}
+
+			item = std::move(m_Items[Head & (Capacity - 1)]);
+			m_Head.store(Head + 1, std::memory_order_release);
+			return true;
+		}
+
+	private :
+
+		T m_Items[Capacity];
+
+		// Free running counters, each written by one side only
+		alignas(64) std::atomic<size_t> m_Head { 0 };
+		alignas(64) std::atomic<size_t> m_Tail { 0 };
+	};
+}
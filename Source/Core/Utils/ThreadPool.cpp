@@ -0,0 +1,143 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+namespace Simulation
+{
+	ThreadPool::ThreadPool(int threads)
+	{
+		SetThreadCount(threads);
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		StopWorkers();
+	}
+
+	int ThreadPool::GetHardwareThreads()
+	{
+		return std::max(1, int(std::thread::hardware_concurrency()));
+	}
+
+	void ThreadPool::SetThreadCount(int threads)
+	{
+		threads = std::max(threads, 1);
+
+		if (threads == m_ThreadCount && int(m_Workers.size()) == threads - 1) {
+			return;
+		}
+
+		StopWorkers();
+
+		m_Stop = false;
+		m_ThreadCount = threads;
+
+		for (int i = 1; i < threads; i++) {
+			m_Workers.emplace_back(&ThreadPool::WorkerLoop, this, i, m_Generation);
+		}
+	}
+
+	void ThreadPool::StopWorkers()
+	{
+		{
+			std::lock_guard<std::mutex> Lock(m_Mutex);
+			m_Stop = true;
+		}
+
+		m_WakeCondition.notify_all();
+
+		for (auto& Worker : m_Workers) {
+			Worker.join();
+		}
+
+		m_Workers.clear();
+	}
+
+	void ThreadPool::WorkerLoop(int index, uint64_t generation)
+	{
+		// Generation is handed over at spawn time, reading it here could skip a job dispatched before the thread got scheduled
+		uint64_t SeenGeneration = generation;
+
+		while (true) {
+			const std::function<void(int, int)>* Job = nullptr;
+			int Count = 0;
+
+			{
+				std::unique_lock<std::mutex> Lock(m_Mutex);
+				m_WakeCondition.wait(Lock, [&]() { return m_Stop || m_Generation != SeenGeneration; });
+
+				if (m_Stop) {
+					return;
+				}
+
+				SeenGeneration = m_Generation;
+				Job = m_Job;
+				Count = m_ThreadCount;
+			}
+
+			(*Job)(index, Count);
+
+			{
+				std::lock_guard<std::mutex> Lock(m_Mutex);
+
+				if (--m_Pending == 0) {
+					m_DoneCondition.notify_one();
+				}
+			}
+		}
+	}
+
+	void ThreadPool::Run(const std::function<void(int, int)>& fn)
+	{
+		if (m_ThreadCount == 1) {
+			fn(0, 1);
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> Lock(m_Mutex);
+			m_Job = &fn;
+			m_Pending = m_ThreadCount - 1;
+			m_Generation++;
+		}
+
+		m_WakeCondition.notify_all();
+
+		fn(0, m_ThreadCount);
+
+		std::unique_lock<std::mutex> Lock(m_Mutex);
+		m_DoneCondition.wait(Lock, [&]() { return m_Pending == 0; });
+		m_Job = nullptr;
+	}
+
+	void ThreadPool::GetChunk(int begin, int end, int index, int threads, int& chunkBegin, int& chunkEnd)
+	{
+		const int64_t Count = int64_t(end) - int64_t(begin);
+
+		chunkBegin = begin + int((Count * index) / threads);
+		chunkEnd = begin + int((Count * (index + 1)) / threads);
+	}
+
+	void ThreadPool::ParallelFor(int begin, int end, const std::function<void(int, int)>& fn)
+	{
+		const int Count = end - begin;
+
+		if (Count <= 0) {
+			return;
+		}
+
+		if (m_ThreadCount == 1 || Count == 1) {
+			fn(begin, end);
+			return;
+		}
+
+		Run([&](int index, int threads) {
+			int ChunkBegin, ChunkEnd;
+			GetChunk(begin, end, index, threads, ChunkBegin, ChunkEnd);
+
+			if (ChunkBegin < ChunkEnd) {
+				fn(ChunkBegin, ChunkEnd);
+			}
+		});
+	}
+}
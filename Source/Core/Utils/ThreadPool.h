@@ -0,0 +1,59 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <cstdint>
+
+namespace Simulation
+{
+	// Persistent set of worker threads, the calling thread always takes part as thread 0
+	// Workers stay parked on a condition variable between dispatches so there is no thread creation per sweep
+	class ThreadPool
+	{
+	public :
+
+		ThreadPool(int threads = 1);
+		~ThreadPool();
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool operator=(ThreadPool const&) = delete;
+
+		// Joins the current workers and starts (threads - 1) new ones
+		void SetThreadCount(int threads);
+		inline int GetThreadCount() const { return m_ThreadCount; }
+
+		// Runs fn(threadIndex, threadCount) once on every thread, all of them are live at the same time
+		// Returns once every thread has finished
+		void Run(const std::function<void(int, int)>& fn);
+
+		// Splits [begin, end) into one contiguous chunk per thread and runs fn(chunkBegin, chunkEnd)
+		// The split only depends on the range and the thread count so results are reproducible
+		void ParallelFor(int begin, int end, const std::function<void(int, int)>& fn);
+
+		// The chunk of [begin, end) that ParallelFor hands to thread index
+		static void GetChunk(int begin, int end, int index, int threads, int& chunkBegin, int& chunkEnd);
+
+		static int GetHardwareThreads();
+
+	private :
+
+		void WorkerLoop(int index, uint64_t generation);
+		void StopWorkers();
+
+		std::vector<std::thread> m_Workers;
+		int m_ThreadCount = 1;
+
+		std::mutex m_Mutex;
+		std::condition_variable m_WakeCondition;
+		std::condition_variable m_DoneCondition;
+
+		const std::function<void(int, int)>* m_Job = nullptr;
+		uint64_t m_Generation = 0;
+		int m_Pending = 0;
+		bool m_Stop = false;
+	};
+}
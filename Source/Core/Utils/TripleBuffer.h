@@ -0,0 +1,53 @@
+#pragma once
+
+#include <atomic>
+
+namespace Simulation
+{
+	// Lock free handoff of the latest value from one writer thread to one reader thread
+	// The writer fills the back slot and publishes it, the reader takes the newest published slot
+	// Neither side ever waits, values published faster than they are read are skipped
+	template <typename T>
+	class TripleBuffer
+	{
+	public :
+
+		TripleBuffer() = default;
+
+		TripleBuffer(const TripleBuffer&) = delete;
+		TripleBuffer operator=(TripleBuffer const&) = delete;
+
+		// Writer side
+		inline T& GetWriteBuffer() { return m_Slots[m_Back]; }
+
+		inline void Publish()
+		{
+			m_Back = m_Middle.exchange(m_Back | FreshBit, std::memory_order_acq_rel) & IndexMask;
+		}
+
+		// Reader side, returns true when a newer value than the current read buffer was taken
+		inline bool Acquire()
+		{
+			if (!(m_Middle.load(std::memory_order_relaxed) & FreshBit)) {
+				return false;
+			}
+
+			m_Front = m_Middle.exchange(m_Front, std::memory_order_acq_rel) & IndexMask;
+			return true;
+		}
+
+		inline const T& GetReadBuffer() const { return m_Slots[m_Front]; }
+
+	private :
+
+		static const int IndexMask = 3;
+		static const int FreshBit = 4;
+
+		T m_Slots[3];
+
+		// The middle slot index, plus FreshBit when the writer published it after the reader's last Acquire()
+		alignas(64) std::atomic<int> m_Middle { 1 };
+		alignas(64) int m_Back = 0;
+		alignas(64) int m_Front = 2;
+	};
+}
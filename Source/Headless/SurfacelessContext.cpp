@@ -0,0 +1,54 @@
+#include "SurfacelessContext.h"
+
+#include <glad/glad.h>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+namespace Simulation
+{
+	bool CreateSurfacelessContext(std::string& renderer, std::string& error)
+	{
+		auto GetPlatformDisplay = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+
+		if (!GetPlatformDisplay) {
+			error = "eglGetPlatformDisplayEXT is missing";
+			return false;
+		}
+
+		EGLDisplay Display = GetPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+
+		if (Display == EGL_NO_DISPLAY || !eglInitialize(Display, nullptr, nullptr)) {
+			error = "no surfaceless EGL display";
+			return false;
+		}
+
+		if (!eglBindAPI(EGL_OPENGL_API)) {
+			error = "EGL can't bind desktop GL";
+			return false;
+		}
+
+		// The compute shaders need 4.3, the solver uses the direct state access of 4.5
+		const EGLint Attributes[] = {
+			EGL_CONTEXT_MAJOR_VERSION, 4,
+			EGL_CONTEXT_MINOR_VERSION, 5,
+			EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+			EGL_NONE
+		};
+
+		EGLContext Context = eglCreateContext(Display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, Attributes);
+
+		if (Context == EGL_NO_CONTEXT || !eglMakeCurrent(Display, EGL_NO_SURFACE, EGL_NO_SURFACE, Context)) {
+			error = "no GL 4.5 context without a surface";
+			return false;
+		}
+
+		if (!gladLoadGLLoader(reinterpret_cast<GLADloadproc>(eglGetProcAddress))) {
+			error = "glad couldn't load GL";
+			return false;
+		}
+
+		renderer = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+		return true;
+	}
+}
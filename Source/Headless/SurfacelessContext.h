@@ -0,0 +1,11 @@
+#pragma once
+
+#include <string>
+
+namespace Simulation
+{
+	// Makes a GL 4.5 context current without a window or display server (EGL_MESA_platform_surfaceless, llvmpipe is enough)
+	// and loads the GL functions through glad, returns false with the reason in error otherwise
+	// The context stays current on the calling thread until the process exits
+	bool CreateSurfacelessContext(std::string& renderer, std::string& error);
+}
@@ -0,0 +1,1000 @@
+#include <iostream>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <chrono>
+#include <vector>
+#include <cmath>
+#include <memory>
+#include <filesystem>
+
+#include "../Core/Fluid/FluidGrid.h"
+#include "../Core/Fluid/FluidSolver.h"
+#include "../Core/Fluid/Scenarios.h"
+#include "../Core/Fluid/ObstacleMap.h"
+#include "../Core/Fluid/Checkpoint.h"
+#include "../Core/Fluid/FieldStream.h"
+#include "../Core/Fluid/CommandRecording.h"
+#include "../Core/Fluid/SimulationClock.h"
+
+// Defined by the CMake build when EGL is found, see --backend gpu
+#ifdef FLUID_GPU_BACKEND
+#include "../Core/GpuFluidSolver.h"
+#include "../Core/ShaderManager.h"
+#include "SurfacelessContext.h"
+#endif
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+// Runs the solver without a window and reports throughput
+// eulerian-sim --res 1024 --steps 5000 --threads 16 --solver rbgs
+
+namespace
+{
+	struct Options
+	{
+		int Resolution = 256;
+		int Steps = 1000;
+		float DeltaTime = 1.0f / 60.0f;
+		int Threads = 1;
+		int TileSize = Simulation::Tiling::DefaultTileSize;
+		int TemporalBlocking = 4;
+		std::string Solver = "gs";
+		std::string Kernels = "auto";
+		std::string Scenario = "burst";
+		std::string Cycle = "v";
+		std::string Preconditioner = "mic";
+		std::string Backend = "cpu";
+
+		// Convergence of the selected solver, negative keeps its default
+		int MaxIterations = -1;
+		float Tolerance = -1.0f;
+		std::string Norm = "linf";
+		bool BenchKernels = false;
+		bool BenchTiles = false;
+		bool Advection = true;
+		int ScalarFields = Simulation::SCALAR_COUNT;
+		bool TrackActivity = true;
+		float ActivityThreshold = 1e-4f;
+		float Gravity = 9.81f;
+		float Vorticity = 0.0f;
+
+		// Image decoded once while parsing, every run rasterizes it at its own resolution
+		std::string ObstaclePath;
+		Simulation::ObstacleMapSettings ObstacleSettings;
+		Simulation::ObstacleMap Obstacles;
+
+		// Rigid bodies dropped from a lattice over the upper half, radius in cells
+		int Bodies = 0;
+		float BodyRadius = 4.0f;
+		float BodyDensity = 1500.0f;
+
+		// Saved at the end of the run, and every SaveEvery steps on the writer thread while stepping goes on
+		std::string SavePath;
+		int SaveEvery = 0;
+
+		// Mapped while parsing, sets the resolution and replaces the scenario
+		std::string RestorePath;
+		std::shared_ptr<Simulation::MappedCheckpoint> Restore;
+
+		// Recording loaded while parsing, its start checkpoint becomes the restore and its length the step count
+		std::string ReplayPath;
+		std::shared_ptr<Simulation::CommandRecording> Replay;
+
+		// Fields written every StreamEvery steps by the stream's writer thread
+		std::string StreamPath;
+		int StreamEvery = 10;
+		Simulation::FieldStreamSettings StreamSettings;
+	};
+
+	struct RunResult
+	{
+		// Set when the run couldn't start (stream not writable), the rest is left empty
+		bool Failed = false;
+
+		double Seconds = 0.0;
+		double ForcesMs = 0.0;
+		double AdvectionMs = 0.0;
+		double ProjectionMs = 0.0;
+		double ActivityMs = 0.0;
+		double ActiveFraction = 0.0;
+		float MaxDivergence = 0.0f;
+		double PressureIterations = 0.0;
+		float PressureResidual = 0.0f;
+		double DyeTotal = 0.0;
+		double ObstacleMs = 0.0;
+		int SolidCells = 0;
+		double BodiesMs = 0.0;
+		float BodyHeight = 0.0f;
+		double RestoreMs = 0.0;
+		double CaptureMs = 0.0;
+		int Saves = 0;
+		Simulation::CheckpointSaveResult Saved;
+		Simulation::FieldStreamStats Streamed;
+		double StreamCloseMs = 0.0;
+		std::vector<float> U;
+		std::vector<float> V;
+		std::vector<float> Pressure;
+	};
+
+	void PrintUsage()
+	{
+		std::cout << "usage : eulerian-sim [options]\n"
+			<< "  --res N        grid resolution (default 256)\n"
+			<< "  --steps N      number of simulation steps (default 1000)\n"
+			<< "  --dt F         timestep in seconds (default 1/60)\n"
+			<< "  --threads N    worker threads for the parallel stages (default 1)\n"
+			<< "  --tile N       tile edge of the grid traversal in cells, 0 walks full rows (default 0)\n"
+			<< "  --block N      red-black sweeps fused into one wavefront pass, 1 disables (default 4)\n"
+			<< "  --solver NAME  pressure solver : gs, rbgs, mg, pcg (default gs)\n"
+			<< "  --cycle NAME   multigrid cycle : v, w (default v)\n"
+			<< "  --precond NAME pcg preconditioner : mic, jacobi (default mic)\n"
+			<< "  --max-iters N  pressure iterations per step, sweeps/cycles/steps (default gs/rbgs 1, mg 2, pcg 200)\n"
+			<< "  --tolerance F  stop once the residual is at or below F, 0 disables (default pcg 1e-4, others 0)\n"
+			<< "  --norm NAME    residual norm : linf, l2 (rms over fluid cells) (default linf)\n"
+			<< "  --kernels NAME stencil kernels : auto, scalar, sse42, avx2, avx512 (default auto)\n"
+			<< "  --scenario NAME  initial state : burst, obstacle (burst around a solid disk), puff (small burst in one corner) (default burst)\n"
+			<< "  --no-advection skip the advection stage\n"
+			<< "  --scalars N    passive scalars advected along (dye, temperature), 0 disables (default 2)\n"
+			<< "  --no-activity  run every stage over the whole domain instead of the moving tiles (mg and pcg always do)\n"
+			<< "  --activity F   speed/divergence below which a tile counts as at rest (default 1e-4)\n"
+			<< "  --gravity F    gravity in m/s^2 (default 9.81)\n"
+			<< "  --vorticity F  vorticity confinement strength, 0 disables (default 0)\n"
+			<< "  --obstacles PATH  obstacle mask image (png, pgm, ...), bright pixels are solid, replaces the scenario's obstacles\n"
+			<< "  --obstacle-threshold F  mean brightness in [0, 1] from which a cell is solid (default 0.5)\n"
+			<< "  --invert-obstacles  dark pixels are solid instead\n"
+			<< "  --bodies N     rigid bodies (circles and squares) dropped from the upper half, two way coupled (default 0)\n"
+			<< "  --body-radius F  body radius in cells (default 4)\n"
+			<< "  --body-density F  body density in kg/m^3 (default 1500)\n"
+			<< "  --save PATH    write a checkpoint of the final state\n"
+			<< "  --save-every N also checkpoint to the --save path every N steps, written in the background (default 0)\n"
+			<< "  --restore PATH start from a checkpoint instead of the scenario, its resolution replaces --res\n"
+			<< "  --replay PATH  rerun a recording made in the app at full speed, from its start checkpoint and with its parameters, dt and step count\n"
+			<< "  --stream PATH  write the velocities, pressure and scalars to a field stream every --stream-every steps\n"
+			<< "  --stream-every N  steps between two streamed frames (default 10)\n"
+			<< "  --stream-compress  byte shuffle + LZ compress the streamed fields on the writer thread\n"
+			<< "  --stream-queue N  frames the stream can hold before the step waits for the disk (default 4)\n"
+			<< "  --stream-drop  drop frames when the stream queue is full instead of waiting\n"
+			<< "  --bench-kernels  run the scenario once per supported kernel set and report the projection speedup over scalar\n"
+			<< "                 always on rbgs with activity off, the only projection that runs the SIMD kernels\n"
+			<< "  --bench-tiles  run the scenario once per tile size and report the per stage ms/step\n"
+			<< "  --backend NAME cpu, or gpu : run the burst, obstacle and puff scenarios on the compute shaders in a surfaceless EGL\n"
+			<< "                 context and on rbgs with block 1 and activity off, report max |du| and max |dp| and exit with 2 unless\n"
+			<< "                 both are 0 (77 without a context, run from Source/ for the shaders) (default cpu)\n"
+			<< "  --help         show this message\n";
+	}
+
+	bool ParseOptions(int argc, char** argv, Options& options)
+	{
+		for (int i = 1; i < argc; i++) {
+			std::string Arg = argv[i];
+
+			if (Arg == "--help" || Arg == "-h") {
+				PrintUsage();
+				exit(0);
+			}
+
+			if (Arg == "--bench-kernels") {
+				options.BenchKernels = true;
+				continue;
+			}
+
+			if (Arg == "--bench-tiles") {
+				options.BenchTiles = true;
+				continue;
+			}
+
+			if (Arg == "--no-advection") {
+				options.Advection = false;
+				continue;
+			}
+
+			if (Arg == "--no-activity") {
+				options.TrackActivity = false;
+				continue;
+			}
+
+			if (Arg == "--stream-compress") {
+				options.StreamSettings.Compress = true;
+				continue;
+			}
+
+			if (Arg == "--stream-drop") {
+				options.StreamSettings.DropWhenFull = true;
+				continue;
+			}
+
+			if (Arg == "--invert-obstacles") {
+				options.ObstacleSettings.Invert = true;
+				continue;
+			}
+
+			if (i + 1 >= argc) {
+				std::cerr << "Missing value for " << Arg << "\n";
+				return false;
+			}
+
+			const char* Value = argv[++i];
+
+			if (Arg == "--res") {
+				options.Resolution = atoi(Value);
+			}
+
+			else if (Arg == "--steps") {
+				options.Steps = atoi(Value);
+			}
+
+			else if (Arg == "--dt") {
+				options.DeltaTime = float(atof(Value));
+			}
+
+			else if (Arg == "--threads") {
+				options.Threads = atoi(Value);
+			}
+
+			else if (Arg == "--tile") {
+				options.TileSize = atoi(Value);
+			}
+
+			else if (Arg == "--block") {
+				options.TemporalBlocking = atoi(Value);
+			}
+
+			else if (Arg == "--solver") {
+				options.Solver = Value;
+			}
+
+			else if (Arg == "--cycle") {
+				options.Cycle = Value;
+			}
+
+			else if (Arg == "--precond") {
+				options.Preconditioner = Value;
+			}
+
+			else if (Arg == "--tolerance") {
+				options.Tolerance = float(atof(Value));
+			}
+
+			else if (Arg == "--max-iters") {
+				options.MaxIterations = atoi(Value);
+			}
+
+			else if (Arg == "--norm") {
+				options.Norm = Value;
+			}
+
+			else if (Arg == "--activity") {
+				options.ActivityThreshold = float(atof(Value));
+			}
+
+			else if (Arg == "--gravity") {
+				options.Gravity = float(atof(Value));
+			}
+
+			else if (Arg == "--vorticity") {
+				options.Vorticity = float(atof(Value));
+			}
+
+			else if (Arg == "--obstacles") {
+				options.ObstaclePath = Value;
+			}
+
+			else if (Arg == "--obstacle-threshold") {
+				options.ObstacleSettings.Threshold = float(atof(Value));
+			}
+
+			else if (Arg == "--bodies") {
+				options.Bodies = atoi(Value);
+			}
+
+			else if (Arg == "--body-radius") {
+				options.BodyRadius = float(atof(Value));
+			}
+
+			else if (Arg == "--body-density") {
+				options.BodyDensity = float(atof(Value));
+			}
+
+			else if (Arg == "--save") {
+				options.SavePath = Value;
+			}
+
+			else if (Arg == "--save-every") {
+				options.SaveEvery = atoi(Value);
+			}
+
+			else if (Arg == "--restore") {
+				options.RestorePath = Value;
+			}
+
+			else if (Arg == "--replay") {
+				options.ReplayPath = Value;
+			}
+
+			else if (Arg == "--stream") {
+				options.StreamPath = Value;
+			}
+
+			else if (Arg == "--stream-every") {
+				options.StreamEvery = atoi(Value);
+			}
+
+			else if (Arg == "--stream-queue") {
+				options.StreamSettings.QueueDepth = atoi(Value);
+			}
+
+			else if (Arg == "--kernels") {
+				options.Kernels = Value;
+			}
+
+			else if (Arg == "--scalars") {
+				options.ScalarFields = atoi(Value);
+			}
+
+			else if (Arg == "--scenario") {
+				options.Scenario = Value;
+			}
+
+			else if (Arg == "--backend") {
+				options.Backend = Value;
+			}
+
+			else {
+				std::cerr << "Unknown option : " << Arg << "\n";
+				return false;
+			}
+		}
+
+		if (!options.ReplayPath.empty()) {
+			if (!options.RestorePath.empty()) {
+				std::cerr << "--replay starts from its own checkpoint, it can't be combined with --restore\n";
+				return false;
+			}
+
+			options.Replay = std::make_shared<Simulation::CommandRecording>();
+
+			if (!options.Replay->Load(options.ReplayPath)) {
+				std::cerr << "Can't replay " << options.ReplayPath << " : " << options.Replay->GetError() << "\n";
+				return false;
+			}
+
+			if (options.Replay->GetStepCount() == 0) {
+				std::cerr << "Nothing to replay, " << options.ReplayPath << " recorded no step\n";
+				return false;
+			}
+
+			// The start checkpoint is written next to the recording
+			options.RestorePath = (std::filesystem::path(options.ReplayPath).parent_path() / options.Replay->GetStartCheckpoint()).string();
+			options.Steps = int(options.Replay->GetStepCount());
+		}
+
+		if (!options.RestorePath.empty()) {
+			options.Restore = std::make_shared<Simulation::MappedCheckpoint>();
+
+			if (!options.Restore->Open(options.RestorePath)) {
+				std::cerr << "Can't restore " << options.RestorePath << " : " << options.Restore->GetError() << "\n";
+				return false;
+			}
+
+			options.Resolution = options.Restore->GetResolution();
+		}
+
+		if (options.SaveEvery < 0 || (options.SaveEvery > 0 && options.SavePath.empty())) {
+			std::cerr << "--save-every needs --save\n";
+			return false;
+		}
+
+		if (options.StreamEvery < 1 || options.StreamSettings.QueueDepth < 1) {
+			std::cerr << "Invalid stream-every/stream-queue\n";
+			return false;
+		}
+
+		if (options.Resolution < 4 || options.Steps < 1 || options.DeltaTime <= 0.0f || options.Threads < 1 || options.TileSize < 0 || options.TemporalBlocking < 1) {
+			std::cerr << "Invalid resolution/steps/dt/threads/tile/block\n";
+			return false;
+		}
+
+		if (options.Solver != "gs" && options.Solver != "rbgs" && options.Solver != "mg" && options.Solver != "pcg") {
+			std::cerr << "Unknown solver : " << options.Solver << "\n";
+			return false;
+		}
+
+		if (options.Cycle != "v" && options.Cycle != "w") {
+			std::cerr << "Unknown multigrid cycle : " << options.Cycle << "\n";
+			return false;
+		}
+
+		if (options.Preconditioner != "mic" && options.Preconditioner != "jacobi") {
+			std::cerr << "Unknown pcg preconditioner : " << options.Preconditioner << "\n";
+			return false;
+		}
+
+		if (options.MaxIterations == 0 || (options.Norm != "linf" && options.Norm != "l2")) {
+			std::cerr << "Invalid max-iters/norm\n";
+			return false;
+		}
+
+		if (options.Scenario != "burst" && options.Scenario != "obstacle" && options.Scenario != "puff") {
+			std::cerr << "Unknown scenario : " << options.Scenario << "\n";
+			return false;
+		}
+
+		if (options.Bodies < 0 || options.BodyRadius <= 0.0f || options.BodyDensity <= 0.0f) {
+			std::cerr << "Invalid bodies/body-radius/body-density\n";
+			return false;
+		}
+
+		if (!options.ObstaclePath.empty() && !options.Obstacles.Load(options.ObstaclePath)) {
+			std::cerr << "Can't read obstacle image : " << options.ObstaclePath << "\n";
+			return false;
+		}
+
+		if (options.Backend != "cpu" && options.Backend != "gpu") {
+			std::cerr << "Unknown backend : " << options.Backend << "\n";
+			return false;
+		}
+
+		if (options.Backend == "gpu" && (options.Restore || options.Bodies > 0 || !options.Obstacles.IsEmpty() || !options.SavePath.empty() || !options.StreamPath.empty())) {
+			std::cerr << "--backend gpu only runs the built-in scenarios, without bodies, obstacle maps, checkpoints or streams\n";
+			return false;
+		}
+
+		Simulation::KernelISA ISA;
+
+		if (options.Kernels != "auto" && !Simulation::Kernels::ParseISA(options.Kernels.c_str(), ISA)) {
+			std::cerr << "Unknown kernel set : " << options.Kernels << "\n";
+			return false;
+		}
+
+		return true;
+	}
+
+	Simulation::PressureSolverType ParseSolver(const std::string& name)
+	{
+		using Simulation::PressureSolverType;
+
+		if (name == "rbgs") {
+			return PressureSolverType::RedBlackGaussSeidel;
+		}
+
+		if (name == "mg") {
+			return PressureSolverType::Multigrid;
+		}
+
+		if (name == "pcg") {
+			return PressureSolverType::PCG;
+		}
+
+		return PressureSolverType::GaussSeidel;
+	}
+
+	void ApplyOptions(const Options& options, Simulation::FluidParameters& parameters)
+	{
+		using namespace Simulation;
+
+		parameters.Threads = options.Threads;
+		parameters.TileSize = options.TileSize;
+		parameters.TemporalBlocking = options.TemporalBlocking;
+		parameters.Advection = options.Advection;
+		parameters.ScalarFields = options.ScalarFields;
+		parameters.TrackActivity = options.TrackActivity;
+		parameters.ActivityThreshold = options.ActivityThreshold;
+		parameters.Gravity = options.Gravity;
+		parameters.VorticityConfinement = options.Vorticity;
+		parameters.PressureSolver = ParseSolver(options.Solver);
+		parameters.Multigrid.Cycle = options.Cycle == "w" ? MultigridCycleType::W : MultigridCycleType::V;
+		parameters.PCG.Preconditioner = options.Preconditioner == "jacobi" ? PreconditionerType::Jacobi : PreconditionerType::MIC0;
+
+		ConvergenceSettings& Convergence = parameters.GetConvergence();
+		Convergence.Norm = options.Norm == "l2" ? ResidualNorm::L2 : ResidualNorm::Linf;
+
+		if (options.MaxIterations > 0) {
+			Convergence.MaxIterations = options.MaxIterations;
+		}
+
+		if (options.Tolerance >= 0.0f) {
+			Convergence.Tolerance = options.Tolerance;
+		}
+	}
+
+	// Dye fills the burst, temperature its core
+	void InitScenario(const Options& options, Simulation::FluidGrid& grid)
+	{
+		using namespace Simulation;
+
+		const glm::vec2 Center = options.Scenario == "puff" ? glm::vec2(-0.6f, -0.6f) : glm::vec2(0.0f);
+		const float Radius = options.Scenario == "puff" ? 0.1f : 0.7f;
+
+		Scenarios::CircularBurst(grid, Center, Radius);
+		Scenarios::ScalarDisk(grid, SCALAR_DYE, Center, Radius, 1.0f);
+		Scenarios::ScalarDisk(grid, SCALAR_TEMPERATURE, Center, Radius * 0.5f, 1.0f);
+
+		if (options.Scenario == "obstacle") {
+			Scenarios::ObstacleDisk(grid, glm::vec2(0.5f, 0.35f), 0.12f);
+		}
+	}
+
+	RunResult RunScenario(const Options& options, Simulation::KernelISA isa)
+	{
+		using namespace Simulation;
+
+		FluidGrid Grid(options.Resolution);
+		FluidSolver Solver(Grid);
+
+		ApplyOptions(options, Solver.Parameters);
+		Solver.SetKernelISA(isa);
+
+		RunResult Result;
+		uint64_t StepIndex = 0;
+
+		// Parameters come from the command line and the checkpoint only brings the state, unless replaying
+		if (options.Restore) {
+			auto RestoreStart = std::chrono::steady_clock::now();
+			RestoreCheckpoint(*options.Restore, Solver, options.Replay != nullptr);
+			Result.RestoreMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - RestoreStart).count();
+			StepIndex = options.Restore->GetStepIndex();
+		}
+
+		else {
+			InitScenario(options, Grid);
+		}
+
+		if (!options.Obstacles.IsEmpty()) {
+			auto ObstacleStart = std::chrono::steady_clock::now();
+			Solver.LoadObstacles(options.Obstacles, options.ObstacleSettings);
+			Result.ObstacleMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - ObstacleStart).count();
+		}
+
+		for (int y = 0; y < options.Resolution; y++) {
+			for (int x = 0; x < options.Resolution; x++) {
+				Result.SolidCells += Grid.IsSolid(x, y);
+			}
+		}
+
+		// Square lattice over the upper half, every other body is a square
+		const int BodyColumns = std::max(int(std::ceil(std::sqrt(double(options.Bodies)))), 1);
+		const float Spacing = Solver.Parameters.GridSpacing;
+		const float Extent = float(options.Resolution) * Spacing;
+		const float BodyRadius = options.BodyRadius * Spacing;
+
+		for (int i = 0; i < options.Bodies; i++) {
+			const glm::vec2 Position = glm::vec2(
+				(float(i % BodyColumns) + 0.5f) / float(BodyColumns),
+				0.5f + 0.5f * (float(i / BodyColumns) + 0.5f) / float(BodyColumns)) * Extent;
+
+			if (i % 2 == 0) {
+				Solver.AddBody(RigidBodies::MakeCircle(Position, BodyRadius, options.BodyDensity));
+			}
+
+			else {
+				const std::vector<glm::vec2> Square = { { -BodyRadius, -BodyRadius }, { BodyRadius, -BodyRadius }, { BodyRadius, BodyRadius }, { -BodyRadius, BodyRadius } };
+				Solver.AddBody(RigidBodies::MakePolygon(Position, Square, options.BodyDensity));
+			}
+		}
+
+		CheckpointWriter Writer;
+
+		// Only the capture is on the stepping thread
+		auto Save = [&]() {
+			auto CaptureStart = std::chrono::steady_clock::now();
+			std::shared_ptr<CheckpointState> State = Writer.AcquireState();
+			State->Capture(Solver, StepIndex);
+			Result.CaptureMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - CaptureStart).count();
+			Result.Saves++;
+
+			Writer.Save(options.SavePath, std::move(State));
+		};
+
+		FieldStreamWriter Stream;
+
+		if (!options.StreamPath.empty() && !Stream.Open(options.StreamPath, Grid, options.StreamSettings)) {
+			std::cerr << "Can't open the field stream " << options.StreamPath << "\n";
+			Result.Failed = true;
+			return Result;
+		}
+
+		// Applies the recorded commands the way the app's clock did, the step size follows its recorded settings
+		std::unique_ptr<SimulationClock> Replayer;
+		size_t NextCommand = 0;
+
+		auto ApplyRecorded = [&](uint64_t steps) {
+			const std::vector<RecordedCommand>& Commands = options.Replay->GetCommands();
+
+			for (; NextCommand < Commands.size() && Commands[NextCommand].Step <= steps; NextCommand++) {
+				Replayer->ApplyCommand(Commands[NextCommand].Command);
+			}
+		};
+
+		if (options.Replay) {
+			Replayer = std::make_unique<SimulationClock>(Solver);
+		}
+
+		auto Start = std::chrono::steady_clock::now();
+
+		for (int i = 0; i < options.Steps; i++) {
+			float DeltaTime = options.DeltaTime;
+
+			if (Replayer) {
+				ApplyRecorded(uint64_t(i));
+				DeltaTime = Replayer->GetSettings().GetFixedDeltaTime();
+			}
+
+			Solver.Step(DeltaTime);
+			StepIndex++;
+
+			if (options.SaveEvery > 0 && (i + 1) % options.SaveEvery == 0 && i + 1 < options.Steps) {
+				Save();
+			}
+
+			if (Stream.IsOpen() && StepIndex % uint64_t(options.StreamEvery) == 0) {
+				Stream.Push(Grid, StepIndex);
+			}
+
+			const FluidStepStats& Stats = Solver.GetStats();
+			Result.ActivityMs += Stats.ActivityMs;
+			Result.BodiesMs += Stats.BodiesMs;
+			Result.ActiveFraction += double(Stats.ActiveTiles) / double(Stats.TotalTiles);
+			Result.ForcesMs += Stats.ForcesMs;
+			Result.AdvectionMs += Stats.AdvectionMs;
+			Result.ProjectionMs += Stats.ProjectionMs;
+			Result.PressureIterations += Stats.PressureIterations;
+			Result.PressureResidual = Stats.PressureResidual;
+		}
+
+		auto End = std::chrono::steady_clock::now();
+		Result.Seconds = std::chrono::duration<double>(End - Start).count();
+
+		// Edits made after the last recorded step still belong to the final state
+		if (Replayer) {
+			ApplyRecorded(uint64_t(options.Steps));
+		}
+
+		// Frames still queued are written out here, outside the timed loop
+		if (Stream.IsOpen()) {
+			Stream.Close();
+			Result.StreamCloseMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - End).count();
+			Result.Streamed = Stream.GetStats();
+		}
+
+		if (!options.SavePath.empty()) {
+			Save();
+			Writer.Wait();
+			Result.Saved = Writer.GetLastResult();
+		}
+
+		Result.MaxDivergence = Solver.ComputeDivergence();
+		Result.U.assign(Grid.GetU(), Grid.GetU() + Grid.GetFieldSize());
+		Result.V.assign(Grid.GetV(), Grid.GetV() + Grid.GetFieldSize());
+		Result.Pressure.assign(Grid.GetPressure(), Grid.GetPressure() + Grid.GetFieldSize());
+
+		for (const RigidBody& Body : Solver.GetBodies().GetBodies()) {
+			Result.BodyHeight += Body.State.Position.y / Spacing / float(options.Bodies);
+		}
+
+		for (int y = 0; y < options.Resolution; y++) {
+			for (int x = 0; x < options.Resolution; x++) {
+				Result.DyeTotal += Grid.GetScalar(SCALAR_DYE)[Grid.Index(x, y)];
+			}
+		}
+
+		return Result;
+	}
+
+	// Largest absolute difference between two fields of the same size
+	float MaxDifference(const std::vector<float>& a, const std::vector<float>& b)
+	{
+		float Max = 0.0f;
+
+		for (size_t i = 0; i < a.size(); i++) {
+			Max = std::fmax(Max, std::fabs(a[i] - b[i]));
+		}
+
+		return Max;
+	}
+
+	// Runs the same scenario with every kernel set the CPU supports and compares against scalar
+	// Always on rbgs over the whole domain, the other solvers project without the SIMD stencil kernels
+	int BenchKernels(const Options& options)
+	{
+		using namespace Simulation;
+
+		Options KernelOptions = options;
+		KernelOptions.Solver = "rbgs";
+		KernelOptions.TrackActivity = false;
+
+		printf("Projection : rbgs, activity off (--solver and --no-activity are ignored)\n");
+
+		RunResult Reference;
+
+		printf("%-8s %12s %12s %10s %14s\n", "kernels", "ms/step", "proj ms", "speedup", "max |dp|");
+
+		for (int i = 0; i < int(KernelISA::Count); i++) {
+			KernelISA ISA = KernelISA(i);
+
+			if (!Kernels::IsSupported(ISA)) {
+				printf("%-8s %12s\n", Kernels::GetName(ISA), "unsupported");
+				continue;
+			}
+
+			RunResult Result = RunScenario(KernelOptions, ISA);
+
+			if (Result.Failed) {
+				return 1;
+			}
+
+			if (ISA == KernelISA::Scalar) {
+				Reference = Result;
+			}
+
+			printf("%-8s %12.4f %12.4f %9.2fx %14g\n", Kernels::GetName(ISA),
+				Result.Seconds * 1000.0 / KernelOptions.Steps, Result.ProjectionMs / KernelOptions.Steps,
+				Reference.ProjectionMs / Result.ProjectionMs, MaxDifference(Result.Pressure, Reference.Pressure));
+		}
+
+		return 0;
+	}
+
+	// Runs the same scenario with a range of tile sizes, "rows" is the untiled row by row traversal
+	int BenchTiles(const Options& options)
+	{
+		const int TileSizes[] = { 0, 16, 32, 64, 128, 256 };
+
+		printf("%-8s %12s %12s %12s %12s\n", "tile", "ms/step", "forces ms", "advect ms", "proj ms");
+
+		for (int TileSize : TileSizes) {
+			if (TileSize >= options.Resolution) {
+				continue;
+			}
+
+			Options TileOptions = options;
+			TileOptions.TileSize = TileSize;
+
+			RunResult Result = RunScenario(TileOptions, Simulation::Kernels::DetectISA());
+
+			if (Result.Failed) {
+				return 1;
+			}
+
+			const double Steps = double(options.Steps);
+
+			printf("%-8s %12.4f %12.4f %12.4f %12.4f\n", TileSize ? std::to_string(TileSize).c_str() : "rows",
+				Result.Seconds * 1000.0 / Steps, Result.ForcesMs / Steps, Result.AdvectionMs / Steps, Result.ProjectionMs / Steps);
+		}
+
+		return 0;
+	}
+
+	// Runs the built-in scenarios on the compute shaders and on the CPU settings they mirror, both have to match bit for bit
+	int CompareBackends(const Options& options, Simulation::KernelISA isa)
+	{
+#ifdef FLUID_GPU_BACKEND
+		using namespace Simulation;
+
+		std::string Renderer;
+		std::string Error;
+
+		// 77 is what ctest reports as skipped
+		if (!CreateSurfacelessContext(Renderer, Error)) {
+			std::cerr << "No GPU backend : " << Error << "\n";
+			return 77;
+		}
+
+		// The app loads them relative to Source/ too
+		if (!std::filesystem::exists("Core/Shaders/FluidRedBlack.comp")) {
+			std::cerr << "No Core/Shaders here, run --backend gpu from the Source directory\n";
+			return 1;
+		}
+
+		ShaderManager::CreateShaders();
+
+		printf("Renderer : %s\n", Renderer.c_str());
+		printf("%-10s %12s %12s %14s %14s\n", "scenario", "cpu ms/step", "gpu ms/step", "max |du|", "max |dp|");
+
+		Options Reference = options;
+		Reference.Solver = "rbgs";
+		Reference.TemporalBlocking = 1;
+		Reference.TrackActivity = false;
+
+		bool Matches = true;
+
+		for (const char* Scenario : { "burst", "obstacle", "puff" }) {
+			Reference.Scenario = Scenario;
+			const RunResult Cpu = RunScenario(Reference, isa);
+
+			if (Cpu.Failed) {
+				return 1;
+			}
+
+			FluidGrid Grid(options.Resolution);
+			InitScenario(Reference, Grid);
+			Grid.UpdateFaceWeights();
+
+			GpuFluidSolver Gpu(options.Resolution, Grid.GetStride());
+			ApplyOptions(Reference, Gpu.Parameters);
+			Gpu.LoadFields(Grid.GetU(), Grid.GetV(), Grid.GetPressure());
+			Gpu.LoadObstacles(Grid.GetFaces(), Grid.GetInvWeight(), Grid.GetObstacleVersion());
+
+			// Reading the fields back waits for the last step
+			const size_t FieldSize = Grid.GetFieldSize();
+			std::vector<float> U(FieldSize), V(FieldSize), Pressure(FieldSize);
+
+			auto Start = std::chrono::steady_clock::now();
+
+			for (int i = 0; i < options.Steps; i++) {
+				Gpu.Step(options.DeltaTime);
+			}
+
+			Gpu.ReadFields(U.data(), V.data(), Pressure.data());
+			const double GpuSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+
+			const float VelocityDifference = std::fmax(MaxDifference(U, Cpu.U), MaxDifference(V, Cpu.V));
+			const float PressureDifference = MaxDifference(Pressure, Cpu.Pressure);
+			Matches = Matches && VelocityDifference == 0.0f && PressureDifference == 0.0f;
+
+			printf("%-10s %12.4f %12.4f %14g %14g\n", Scenario, Cpu.Seconds * 1000.0 / options.Steps, GpuSeconds * 1000.0 / options.Steps,
+				VelocityDifference, PressureDifference);
+		}
+
+		return Matches ? 0 : 2;
+#else
+		std::cerr << "--backend gpu needs a build with EGL (FLUID_GPU_BACKEND, see CMakeLists.txt)\n";
+		return 1;
+#endif
+	}
+
+	// Peak resident set size in megabytes
+	double GetPeakRSS()
+	{
+#ifdef _WIN32
+		PROCESS_MEMORY_COUNTERS Counters;
+		GetProcessMemoryInfo(GetCurrentProcess(), &Counters, sizeof(Counters));
+		return double(Counters.PeakWorkingSetSize) / (1024.0 * 1024.0);
+#else
+		rusage Usage;
+		getrusage(RUSAGE_SELF, &Usage);
+#ifdef __APPLE__
+		return double(Usage.ru_maxrss) / (1024.0 * 1024.0);
+#else
+		return double(Usage.ru_maxrss) / 1024.0;
+#endif
+#endif
+	}
+}
+
+int main(int argc, char** argv)
+{
+	using namespace Simulation;
+
+	Options Opts;
+
+	if (!ParseOptions(argc, argv, Opts)) {
+		PrintUsage();
+		return 1;
+	}
+
+	if (Opts.BenchKernels) {
+		return BenchKernels(Opts);
+	}
+
+	if (Opts.BenchTiles) {
+		return BenchTiles(Opts);
+	}
+
+	KernelISA ISA = Kernels::DetectISA();
+
+	if (Opts.Kernels != "auto") {
+		Kernels::ParseISA(Opts.Kernels.c_str(), ISA);
+	}
+
+	if (Opts.Backend == "gpu") {
+		return CompareBackends(Opts, ISA);
+	}
+
+	RunResult Result = RunScenario(Opts, ISA);
+
+	if (Result.Failed) {
+		return 1;
+	}
+
+	double Seconds = Result.Seconds;
+
+	double Cells = double(Opts.Resolution) * double(Opts.Resolution);
+	double Steps = double(Opts.Steps);
+
+	printf("Resolution      : %d x %d\n", Opts.Resolution, Opts.Resolution);
+	printf("Steps           : %d\n", Opts.Steps);
+	printf("Scenario        : %s\n", Opts.Scenario.c_str());
+
+	if (!Opts.Obstacles.IsEmpty()) {
+		printf("Obstacles       : %s (%d x %d, %d solid cells, %.2f ms)\n", Opts.ObstaclePath.c_str(),
+			Opts.Obstacles.GetWidth(), Opts.Obstacles.GetHeight(), Result.SolidCells, Result.ObstacleMs);
+	}
+
+	if (Opts.Replay) {
+		printf("Replayed        : %s (%d commands over %llu steps)\n", Opts.ReplayPath.c_str(), int(Opts.Replay->GetCommands().size()),
+			(unsigned long long)Opts.Replay->GetStepCount());
+	}
+
+	if (Opts.Restore) {
+		printf("Restored        : %s (step %llu, %.1f MB, %.2f ms)\n", Opts.RestorePath.c_str(), (unsigned long long)Opts.Restore->GetStepIndex(),
+			double(Opts.Restore->GetFileSize()) / (1024.0 * 1024.0), Result.RestoreMs);
+	}
+
+	if (Opts.Replay) {
+		printf("Solver          : as recorded\n");
+	}
+
+	else if (Opts.Solver == "mg") {
+		printf("Solver          : mg (%s-cycle)\n", Opts.Cycle == "w" ? "W" : "V");
+	}
+
+	else if (Opts.Solver == "pcg") {
+		printf("Solver          : pcg (%s)\n", Opts.Preconditioner.c_str());
+	}
+
+	else {
+		printf("Solver          : %s\n", Opts.Solver.c_str());
+	}
+	printf("Threads         : %d\n", Opts.Threads);
+	printf("Tile size       : %d\n", Opts.TileSize);
+	if (Opts.Solver == "rbgs") {
+		printf("Sweeps/pass     : %d\n", Opts.TemporalBlocking);
+	}
+
+	printf("Kernels         : %s\n", Kernels::GetName(Kernels::IsSupported(ISA) ? ISA : KernelISA::Scalar));
+	printf("Wall time       : %.3f s\n", Seconds);
+	printf("Throughput      : %.3f Mcells/s\n", (Cells * Steps) / Seconds / 1e6);
+	printf("ms/step         : %.4f\n", Seconds * 1000.0 / Steps);
+	if (Opts.Bodies > 0) {
+		printf("  bodies        : %.4f\n", Result.BodiesMs / Steps);
+	}
+
+	printf("  activity      : %.4f\n", Result.ActivityMs / Steps);
+	printf("  forces        : %.4f\n", Result.ForcesMs / Steps);
+	printf("  advection     : %.4f\n", Result.AdvectionMs / Steps);
+	printf("  projection    : %.4f\n", Result.ProjectionMs / Steps);
+	printf("Iterations/step : %.1f\n", Result.PressureIterations / Steps);
+	printf("Final residual  : %g (%s)\n", Result.PressureResidual, Opts.Norm.c_str());
+
+	printf("Active tiles    : %.1f %%\n", Result.ActiveFraction * 100.0 / Steps);
+	printf("Max divergence  : %g\n", Result.MaxDivergence);
+
+	if (Opts.Bodies > 0) {
+		printf("Bodies          : %d (radius %g cells, density %g, mean height %.1f cells)\n", Opts.Bodies, Opts.BodyRadius, Opts.BodyDensity, Result.BodyHeight);
+	}
+
+	printf("Scalars         : %d (dye total %.1f)\n", std::max(std::min(Opts.ScalarFields, int(SCALAR_COUNT)), 0), Result.DyeTotal);
+	if (!Opts.SavePath.empty()) {
+		if (Result.Saved.Succeeded) {
+			printf("Checkpoint      : %s (step %llu, %.1f MB, %d saves, capture %.2f ms/save, last write %.2f ms)\n", Opts.SavePath.c_str(),
+				(unsigned long long)Result.Saved.StepIndex, double(Result.Saved.Bytes) / (1024.0 * 1024.0), Result.Saves, Result.CaptureMs / Result.Saves, Result.Saved.WriteMs);
+		}
+
+		else {
+			printf("Checkpoint      : couldn't write %s\n", Opts.SavePath.c_str());
+		}
+	}
+
+	if (!Opts.StreamPath.empty()) {
+		const FieldStreamStats& Streamed = Result.Streamed;
+		const int Frames = std::max(Streamed.Frames, 1);
+
+		printf("Stream          : %s (%d frames, %.1f MB -> %.1f MB, %.2fx, %d dropped%s)\n", Opts.StreamPath.c_str(), Streamed.Frames,
+			double(Streamed.RawBytes) / (1024.0 * 1024.0), double(Streamed.StoredBytes) / (1024.0 * 1024.0),
+			double(Streamed.RawBytes) / double(std::max(Streamed.StoredBytes, uint64_t(1))), Streamed.Dropped, Streamed.Failed ? ", write failed" : "");
+		printf("  per frame     : copy %.2f ms, compress %.2f ms, write %.2f ms\n", Streamed.CopyMs / Frames, Streamed.CompressMs / Frames, Streamed.WriteMs / Frames);
+		printf("  stalls        : %d (%.2f ms in the step loop, %.2f ms draining at the end)\n", Streamed.Stalls, Streamed.StallMs, Result.StreamCloseMs);
+	}
+
+	printf("Peak RSS        : %.1f MB\n", GetPeakRSS());
+
+	return 0;
+}
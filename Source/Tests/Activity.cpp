@@ -0,0 +1,84 @@
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
+
+#include "../Core/Fluid/FluidGrid.h"
+#include "../Core/Fluid/FluidSolver.h"
+#include "../Core/Fluid/Scenarios.h"
+
+// Runs a small burst in one corner with and without activity tracking, with every pressure solver at its default settings
+// Skipping the tiles at rest may only change the velocities by about the activity threshold, exits with 1 otherwise
+
+namespace
+{
+	struct SolverCase
+	{
+		const char* Name;
+		Simulation::PressureSolverType Type;
+	};
+
+	const SolverCase Solvers[] = {
+		{ "gs", Simulation::PressureSolverType::GaussSeidel },
+		{ "rbgs", Simulation::PressureSolverType::RedBlackGaussSeidel },
+		{ "mg", Simulation::PressureSolverType::Multigrid },
+		{ "pcg", Simulation::PressureSolverType::PCG }
+	};
+
+	const int Resolution = 128;
+
+	void RunPuff(Simulation::FluidGrid& grid, Simulation::PressureSolverType solver, bool trackActivity, float gravity, int steps)
+	{
+		Simulation::Scenarios::CircularBurst(grid, glm::vec2(-0.6f, -0.6f), 0.1f);
+
+		Simulation::FluidSolver Solver(grid);
+		Solver.Parameters.PressureSolver = solver;
+		Solver.Parameters.TrackActivity = trackActivity;
+		Solver.Parameters.Gravity = gravity;
+
+		for (int Step = 0; Step < steps; Step++) {
+			Solver.Step(1.0f / 60.0f);
+		}
+	}
+
+	// Max |du| and |dv| over every face of the domain
+	float MaxVelocityDifference(const Simulation::FluidGrid& a, const Simulation::FluidGrid& b)
+	{
+		float Max = 0.0f;
+
+		for (int y = 0; y <= Resolution; y++) {
+			for (int x = 0; x <= Resolution; x++) {
+				const int i = a.Index(x, y);
+				Max = std::max(Max, std::max(std::fabs(a.GetU()[i] - b.GetU()[i]), std::fabs(a.GetV()[i] - b.GetV()[i])));
+			}
+		}
+
+		return Max;
+	}
+}
+
+int main()
+{
+	const int Steps = 20;
+	bool Passed = true;
+
+	for (const SolverCase& Case : Solvers) {
+		for (float Gravity : { 9.81f, 0.0f }) {
+			Simulation::FluidGrid Tracked(Resolution);
+			Simulation::FluidGrid Full(Resolution);
+
+			RunPuff(Tracked, Case.Type, true, Gravity, Steps);
+			RunPuff(Full, Case.Type, false, Gravity, Steps);
+
+			// With gravity the tiles at rest stay about the default threshold from where relaxing them would put them
+			// Without it there is nothing for them to pick up
+			const float Tolerance = Gravity > 0.0f ? 1e-3f : 1e-6f;
+			const float Difference = MaxVelocityDifference(Tracked, Full);
+			const bool Ok = Difference <= Tolerance;
+
+			std::printf("%-5s : gravity %.2f, max velocity difference with and without activity %g %s\n", Case.Name, Gravity, Difference, Ok ? "ok" : "FAILED");
+			Passed = Passed && Ok;
+		}
+	}
+
+	return Passed ? 0 : 1;
+}
@@ -0,0 +1,61 @@
+#include <cstdio>
+
+#include "../Core/Fluid/FluidGrid.h"
+#include "../Core/Fluid/FluidSolver.h"
+
+// Drops one body lighter and one heavier than water into fluid at rest, with every pressure solver at its default settings
+// The light one has to rise and the heavy one sink, exits with 1 otherwise
+
+namespace
+{
+	struct SolverCase
+	{
+		const char* Name;
+		Simulation::PressureSolverType Type;
+	};
+
+	const float StartHeight = 96.0f;
+
+	const SolverCase Solvers[] = {
+		{ "gs", Simulation::PressureSolverType::GaussSeidel },
+		{ "rbgs", Simulation::PressureSolverType::RedBlackGaussSeidel },
+		{ "mg", Simulation::PressureSolverType::Multigrid },
+		{ "pcg", Simulation::PressureSolverType::PCG }
+	};
+
+	// Height in cells the body ends at after steps steps
+	float DropBody(Simulation::PressureSolverType solver, float density, int steps)
+	{
+		const int Resolution = 128;
+
+		Simulation::FluidGrid Grid(Resolution);
+		Simulation::FluidSolver Solver(Grid);
+		Solver.Parameters.PressureSolver = solver;
+
+		const float Spacing = Solver.Parameters.GridSpacing;
+		Solver.AddBody(Simulation::RigidBodies::MakeCircle(glm::vec2(Resolution / 2, StartHeight) * Spacing, 4.0f * Spacing, density));
+
+		for (int Step = 0; Step < steps; Step++) {
+			Solver.Step(1.0f / 60.0f);
+		}
+
+		return Solver.GetBodies().GetBodies()[0].State.Position.y / Spacing;
+	}
+}
+
+int main()
+{
+	const int Steps = 100;
+	bool Passed = true;
+
+	for (const SolverCase& Case : Solvers) {
+		const float Light = DropBody(Case.Type, 300.0f, Steps);
+		const float Heavy = DropBody(Case.Type, 1500.0f, Steps);
+		const bool Ok = Light > StartHeight + 1.0f && Heavy < StartHeight - 1.0f;
+
+		std::printf("%-5s : density 300 at %.1f, density 1500 at %.1f cells (from %.1f) %s\n", Case.Name, Light, Heavy, StartHeight, Ok ? "ok" : "FAILED");
+		Passed = Passed && Ok;
+	}
+
+	return Passed ? 0 : 1;
+}
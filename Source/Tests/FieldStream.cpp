@@ -0,0 +1,218 @@
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <string>
+
+#include "../Core/Fluid/FluidGrid.h"
+#include "../Core/Fluid/FluidSolver.h"
+#include "../Core/Fluid/Scenarios.h"
+#include "../Core/Fluid/FieldStream.h"
+
+// Streams the same frames raw and compressed, every field read back has to match the grid bit for bit
+// A copy of the compressed stream cut inside its last frame, and copies with a corrupt chunk table or footer, have to read as far as they are intact
+// Writes its files to the working directory, exits with 1 on any mismatch
+
+namespace
+{
+	const int Resolution = 64;
+	const int Frames = 6;
+
+	struct Check
+	{
+		bool Passed = true;
+
+		void Expect(bool condition, const char* what)
+		{
+			std::printf("%-60s %s\n", what, condition ? "ok" : "FAILED");
+			Passed = Passed && condition;
+		}
+	};
+
+	std::vector<uint8_t> ReadFile(const std::string& path)
+	{
+		std::vector<uint8_t> Bytes;
+		FILE* File = std::fopen(path.c_str(), "rb");
+
+		if (!File) {
+			return Bytes;
+		}
+
+		uint8_t Buffer[1 << 16];
+
+		for (size_t Read; (Read = std::fread(Buffer, 1, sizeof(Buffer), File)) > 0;) {
+			Bytes.insert(Bytes.end(), Buffer, Buffer + Read);
+		}
+
+		std::fclose(File);
+		return Bytes;
+	}
+
+	void WriteFile(const std::string& path, const std::vector<uint8_t>& bytes)
+	{
+		FILE* File = std::fopen(path.c_str(), "wb");
+		std::fwrite(bytes.data(), 1, bytes.size(), File);
+		std::fclose(File);
+	}
+
+	std::vector<uint32_t> FieldIds()
+	{
+		std::vector<uint32_t> Ids = { Simulation::CHECKPOINT_U, Simulation::CHECKPOINT_V, Simulation::CHECKPOINT_PRESSURE };
+
+		for (int f = 0; f < Simulation::SCALAR_COUNT; f++) {
+			Ids.push_back(Simulation::CHECKPOINT_SCALAR + f);
+		}
+
+		return Ids;
+	}
+
+	// Start of every frame in a stream file, walked like FieldStreamReader does for an unclosed stream
+	std::vector<uint64_t> FrameOffsets(const std::vector<uint8_t>& bytes, int frames)
+	{
+		std::vector<uint64_t> Offsets;
+		uint64_t Offset = sizeof(Simulation::FieldStreamHeader);
+
+		for (int Frame = 0; Frame < frames; Frame++) {
+			Simulation::FieldStreamFrameHeader Header;
+			std::memcpy(&Header, bytes.data() + Offset, sizeof(Header));
+			Offsets.push_back(Offset);
+			Offset += sizeof(Header) + Header.FieldCount * sizeof(Simulation::FieldStreamChunk);
+
+			for (uint32_t c = 0; c < Header.FieldCount; c++) {
+				Simulation::FieldStreamChunk Chunk;
+				std::memcpy(&Chunk, bytes.data() + Offsets.back() + sizeof(Header) + c * sizeof(Chunk), sizeof(Chunk));
+				Offset += Chunk.StoredBytes;
+			}
+		}
+
+		Offsets.push_back(Offset);
+		return Offsets;
+	}
+
+	// Every field of frames [first, end) of the stream equals the expected fields
+	bool MatchesFrames(Simulation::FieldStreamReader& reader, const std::vector<std::vector<std::vector<float>>>& expected, int first, int end)
+	{
+		const std::vector<uint32_t> Ids = FieldIds();
+		std::vector<float> Field;
+
+		for (int Frame = first; Frame < end; Frame++) {
+			for (size_t i = 0; i < Ids.size(); i++) {
+				const std::vector<float>& Expected = expected[Frame][i];
+
+				if (!reader.ReadField(Frame, Ids[i], Field) || Field.size() != Expected.size()
+					|| std::memcmp(Field.data(), Expected.data(), Field.size() * sizeof(float)) != 0) {
+					return false;
+				}
+			}
+		}
+
+		return true;
+	}
+}
+
+int main()
+{
+	using namespace Simulation;
+
+	const std::string RawPath = "fieldstream-raw.eulstrm";
+	const std::string CompressedPath = "fieldstream-compressed.eulstrm";
+	const std::string TruncatedPath = "fieldstream-truncated.eulstrm";
+	const std::string CorruptPath = "fieldstream-corrupt.eulstrm";
+
+	FluidGrid Grid(Resolution);
+	FluidSolver Solver(Grid);
+	Scenarios::CircularBurst(Grid);
+	Scenarios::ScalarDisk(Grid, SCALAR_DYE, glm::vec2(0.0f), 0.7f, 1.0f);
+
+	FieldStreamSettings Settings;
+	FieldStreamWriter Raw;
+	FieldStreamWriter Compressed;
+	Check Test;
+
+	Settings.Compress = false;
+	Test.Expect(Raw.Open(RawPath, Grid, Settings), "raw stream opens");
+
+	Settings.Compress = true;
+	Test.Expect(Compressed.Open(CompressedPath, Grid, Settings), "compressed stream opens");
+
+	// What every frame has to read back as, in FieldIds() order
+	std::vector<std::vector<std::vector<float>>> Expected;
+
+	for (int Frame = 0; Frame < Frames; Frame++) {
+		Solver.Step(1.0f / 60.0f);
+
+		Raw.Push(Grid, Frame);
+		Compressed.Push(Grid, Frame);
+
+		Expected.emplace_back();
+
+		for (uint32_t Id : FieldIds()) {
+			const float* Data = Id == CHECKPOINT_U ? Grid.GetU() : Id == CHECKPOINT_V ? Grid.GetV() : Id == CHECKPOINT_PRESSURE ? Grid.GetPressure()
+				: Grid.GetScalar(int(Id - CHECKPOINT_SCALAR));
+			Expected.back().emplace_back(Data, Data + Grid.GetFieldSize());
+		}
+	}
+
+	Test.Expect(Raw.Close() && Compressed.Close(), "both streams close");
+
+	const FieldStreamStats Stats = Compressed.GetStats();
+	Test.Expect(Stats.Frames == Frames && Stats.StoredBytes < Stats.RawBytes, "compressed stream is smaller");
+
+	FieldStreamReader Reader;
+	Test.Expect(Reader.Open(RawPath) && Reader.GetFrameCount() == Frames && MatchesFrames(Reader, Expected, 0, Frames), "raw stream reads back every field");
+	Test.Expect(Reader.Open(CompressedPath) && Reader.GetFrameCount() == Frames && MatchesFrames(Reader, Expected, 0, Frames), "compressed stream reads back every field");
+
+	// Unclosed stream cut in the middle of its last frame, the index is rebuilt from the frames before it
+	const std::vector<uint8_t> Bytes = ReadFile(CompressedPath);
+	const std::vector<uint64_t> Offsets = FrameOffsets(Bytes, Frames);
+	const uint64_t Cut = (Offsets[Frames - 1] + Offsets[Frames]) / 2;
+	const std::vector<uint8_t> Truncated(Bytes.begin(), Bytes.begin() + ptrdiff_t(Cut));
+
+	WriteFile(TruncatedPath, Truncated);
+	Test.Expect(Reader.Open(TruncatedPath) && Reader.GetFrameCount() == Frames - 1 && MatchesFrames(Reader, Expected, 0, Frames - 1),
+		"truncated stream reads back every complete frame");
+
+	// A field count whose chunk table can't fit in the file ends the walk at that frame
+	std::vector<uint8_t> Corrupt = Truncated;
+	FieldStreamFrameHeader Header;
+	std::memcpy(&Header, Corrupt.data() + Offsets[2], sizeof(Header));
+	Header.FieldCount = 0xFFFFFFFFu;
+	std::memcpy(Corrupt.data() + Offsets[2], &Header, sizeof(Header));
+
+	WriteFile(CorruptPath, Corrupt);
+	Test.Expect(Reader.Open(CorruptPath) && Reader.GetFrameCount() == 2 && MatchesFrames(Reader, Expected, 0, 2), "huge field count ends the walk");
+
+	// A chunk stored past the end of its frame is rejected instead of read, the other frames are unaffected
+	Corrupt = Bytes;
+	FieldStreamChunk Chunk;
+	const size_t ChunkOffset = size_t(Offsets[0]) + sizeof(FieldStreamFrameHeader);
+	std::memcpy(&Chunk, Corrupt.data() + ChunkOffset, sizeof(Chunk));
+	Chunk.StoredBytes = ~uint64_t(0) / 2;
+	std::memcpy(Corrupt.data() + ChunkOffset, &Chunk, sizeof(Chunk));
+
+	WriteFile(CorruptPath, Corrupt);
+	std::vector<float> Field;
+	Test.Expect(Reader.Open(CorruptPath) && Reader.GetFrameCount() == Frames && !Reader.ReadField(0, Chunk.Id, Field)
+		&& MatchesFrames(Reader, Expected, 1, Frames), "huge stored size is rejected");
+
+	// A frame count whose index wraps around to end at the footer is not trusted, the frames are walked instead
+	Corrupt = Bytes;
+	FieldStreamFooter Footer;
+	std::memcpy(&Footer, Corrupt.data() + Corrupt.size() - sizeof(Footer), sizeof(Footer));
+	Footer.IndexOffset = Corrupt.size() - 32;
+	Footer.FrameCount = ((uint64_t(1) << 61) + 1) / 3;
+	std::memcpy(Corrupt.data() + Corrupt.size() - sizeof(Footer), &Footer, sizeof(Footer));
+
+	WriteFile(CorruptPath, Corrupt);
+	Test.Expect(Reader.Open(CorruptPath) && Reader.GetFrameCount() == Frames && MatchesFrames(Reader, Expected, 0, Frames), "wrapping frame count is rejected");
+
+	Reader.Close();
+
+	FieldStreamWriter Missing;
+	Test.Expect(!Missing.Open("no-such-directory/stream.eulstrm", Grid, Settings) && !Missing.IsOpen(), "open fails without a directory");
+
+	for (const std::string& Path : { RawPath, CompressedPath, TruncatedPath, CorruptPath }) {
+		std::remove(Path.c_str());
+	}
+
+	return Test.Passed ? 0 : 1;
+}
@@ -0,0 +1,142 @@
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <string>
+
+#include "../Core/Fluid/FluidGrid.h"
+#include "../Core/Fluid/FluidSolver.h"
+#include "../Core/Fluid/ParameterBlock.h"
+#include "../Core/Fluid/Checkpoint.h"
+#include "../Core/Fluid/CommandRecording.h"
+
+// Parameters written to a checkpoint and a recording come back unchanged
+// The same files with another layout hash have to be refused, and a refused restore leaves the solver's parameters alone
+// Writes its files to the working directory, exits with 1 on any failure
+
+namespace
+{
+	struct Check
+	{
+		bool Passed = true;
+
+		void Expect(bool condition, const char* what)
+		{
+			std::printf("%-60s %s\n", what, condition ? "ok" : "FAILED");
+			Passed = Passed && condition;
+		}
+	};
+
+	std::vector<uint8_t> ReadFile(const std::string& path)
+	{
+		std::vector<uint8_t> Bytes;
+		FILE* File = std::fopen(path.c_str(), "rb");
+
+		if (!File) {
+			return Bytes;
+		}
+
+		uint8_t Buffer[1 << 16];
+
+		for (size_t Read; (Read = std::fread(Buffer, 1, sizeof(Buffer), File)) > 0;) {
+			Bytes.insert(Bytes.end(), Buffer, Buffer + Read);
+		}
+
+		std::fclose(File);
+		return Bytes;
+	}
+
+	void WriteFile(const std::string& path, const std::vector<uint8_t>& bytes)
+	{
+		FILE* File = std::fopen(path.c_str(), "wb");
+		std::fwrite(bytes.data(), 1, bytes.size(), File);
+		std::fclose(File);
+	}
+
+	// Same values, compared through the blocks since FluidParameters has no operator==
+	bool SameParameters(const Simulation::FluidParameters& a, const Simulation::FluidParameters& b)
+	{
+		return Simulation::ParameterBlock::Write(a) == Simulation::ParameterBlock::Write(b);
+	}
+}
+
+int main()
+{
+	using namespace Simulation;
+
+	const std::string CheckpointPath = "parameters.eulckpt";
+	const std::string OtherCheckpointPath = "parameters-other.eulckpt";
+	const std::string RecordingPath = "parameters.eulrec";
+	const std::string OtherRecordingPath = "parameters-other.eulrec";
+
+	FluidGrid Grid(32);
+	FluidSolver Solver(Grid);
+	Check Test;
+
+	// Away from the defaults in every kind of field
+	FluidParameters Edited;
+	Edited.Gravity = 3.5f;
+	Edited.Advection = false;
+	Edited.PressureSolver = PressureSolverType::PCG;
+	Edited.PCG.Preconditioner = PreconditionerType::Jacobi;
+	Edited.VorticityConfinement = 1.5f;
+	Edited.ScalarFields = 1;
+
+	const FluidParameters Defaults = Solver.Parameters;
+	Test.Expect(!SameParameters(Edited, Defaults), "edited parameters differ from the defaults");
+	Test.Expect(SameParameters(ParameterBlock::Read(ParameterBlock::Write(Edited).data()), Edited), "block round trip");
+
+	Solver.Parameters = Edited;
+	CheckpointState State;
+	State.Capture(Solver, 0);
+	Test.Expect(WriteCheckpoint(CheckpointPath, State) != 0, "checkpoint written");
+
+	FluidParameters Read;
+	MappedCheckpoint Checkpoint;
+	Test.Expect(Checkpoint.Open(CheckpointPath) && Checkpoint.GetParameters(Read) && SameParameters(Read, Edited), "checkpoint parameters read back");
+
+	// Flip the layout hash, the first word of the parameter block
+	std::vector<uint8_t> Bytes = ReadFile(CheckpointPath);
+	const CheckpointFieldEntry* Entry = Checkpoint.FindField(CHECKPOINT_PARAMETERS);
+	uint32_t Layout = 0;
+	std::memcpy(&Layout, Bytes.data() + Entry->Offset, sizeof(Layout));
+	Layout ^= 1u;
+	std::memcpy(Bytes.data() + Entry->Offset, &Layout, sizeof(Layout));
+	Checkpoint.Close();
+	WriteFile(OtherCheckpointPath, Bytes);
+
+	MappedCheckpoint Other;
+	Test.Expect(Other.Open(OtherCheckpointPath) && !Other.GetParameters(Read), "checkpoint with another layout refused");
+
+	FluidGrid RestoredGrid(32);
+	FluidSolver Restored(RestoredGrid);
+	Test.Expect(RestoreCheckpoint(Other, Restored, true) && SameParameters(Restored.Parameters, Defaults), "refused parameters aren't restored");
+	Other.Close();
+
+	// Recordings check the layout once in their header
+	CommandRecording Recording;
+	Recording.Begin("parameters-start.eulckpt");
+
+	SimulationCommand Command;
+	Command.Kind = SimulationCommand::Type::SetParameters;
+	Command.Parameters = Edited;
+	Recording.Add(0, 0.0, Command);
+
+	CommandRecording Loaded;
+	Test.Expect(Recording.Save(RecordingPath) && Loaded.Load(RecordingPath) && Loaded.GetCommands().size() == 1
+		&& SameParameters(Loaded.GetCommands()[0].Command.Parameters, Edited), "recorded parameters read back");
+
+	Bytes = ReadFile(RecordingPath);
+	CommandRecordingHeader Header;
+	std::memcpy(&Header, Bytes.data(), sizeof(Header));
+	Header.ParametersLayout ^= 1u;
+	std::memcpy(Bytes.data(), &Header, sizeof(Header));
+	WriteFile(OtherRecordingPath, Bytes);
+
+	Test.Expect(!Loaded.Load(OtherRecordingPath) && Loaded.GetCommands().empty(), "recording with another layout refused");
+
+	for (const std::string& Path : { CheckpointPath, OtherCheckpointPath, RecordingPath, OtherRecordingPath }) {
+		std::remove(Path.c_str());
+	}
+
+	return Test.Passed ? 0 : 1;
+}
@@ -0,0 +1,30 @@
+# Saves at step N, restores that checkpoint and runs on to 2N, with every pressure solver
+# The final checkpoint has to equal the one of an uninterrupted --save-every N run byte for byte
+# cmake -DSIM=<eulerian-sim> -P Restore.cmake, writes its checkpoints to the working directory
+
+set(Steps 25)
+math(EXPR TwiceSteps "${Steps} * 2")
+
+function(run_sim)
+	execute_process(COMMAND ${SIM} ${ARGN} OUTPUT_QUIET RESULT_VARIABLE Result)
+
+	if(NOT Result EQUAL 0)
+		message(FATAL_ERROR "eulerian-sim ${ARGN} failed : ${Result}")
+	endif()
+endfunction()
+
+foreach(Solver gs rbgs mg pcg)
+	run_sim(--res 64 --steps ${Steps} --solver ${Solver} --bodies 3 --save restore-half.eulckpt)
+	run_sim(--steps ${Steps} --solver ${Solver} --restore restore-half.eulckpt --save restore-resumed.eulckpt)
+	run_sim(--res 64 --steps ${TwiceSteps} --solver ${Solver} --bodies 3 --save restore-full.eulckpt --save-every ${Steps})
+
+	execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files restore-resumed.eulckpt restore-full.eulckpt RESULT_VARIABLE Different)
+
+	if(Different)
+		message(FATAL_ERROR "${Solver} : the restored run doesn't match the uninterrupted one")
+	endif()
+
+	message(STATUS "${Solver} : restored run matches")
+endforeach()
+
+file(REMOVE restore-half.eulckpt restore-resumed.eulckpt restore-full.eulckpt)